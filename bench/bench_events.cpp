@@ -0,0 +1,154 @@
+/*
+ * Fan-out of events to the subscriptions: TopicIndex::match and the content
+ * filters (EventFilter) of 1000 subscriptions at 10000 events per second.
+ *
+ * The subscriptions are like the ones of many VMS: a tenth takes all events,
+ * most take one topic of one video source (TopicExpression and MessageContent),
+ * the others take the subtrees of the topics. The events go round 32 video
+ * sources and 6 topics.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "event_broker.h"
+#include "event_filter.h"
+#include "smacros.h"
+
+
+
+
+
+static const size_t SUBSCRIPTIONS = 1000;
+static const size_t EVENTS        = 100000;
+static const size_t RATE          = 10000; // events per sec
+static const int    SOURCES       = 32;
+
+
+
+static const char *topics[] =
+{
+    "tns1:VideoSource/MotionAlarm",
+    "tns1:VideoSource/ImageTooBlurry/AnalyticsService",
+    "tns1:VideoSource/GlobalSceneChange/AnalyticsService",
+    "tns1:RuleEngine/CellMotionDetector/Motion",
+    "tns1:RuleEngine/TamperDetector/Tamper",
+    "tns1:Device/Trigger/DigitalInput"
+};
+
+
+
+static int64_t now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return (int64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+
+
+static EventFilterPtr make_filter(size_t i)
+{
+    char topic_expr[256];
+    char content_expr[256];
+
+    std::shared_ptr<EventFilter> filter = std::make_shared<EventFilter>();
+
+    switch( i % 10 )
+    {
+        case 0:
+            return EventFilterPtr(); // all events
+
+        case 7:
+        case 8:
+            snprintf(topic_expr, sizeof(topic_expr), "tns1:VideoSource//.");
+            break;
+
+        case 9:
+            snprintf(topic_expr, sizeof(topic_expr), "tns1:Device//.|tns1:RuleEngine/CellMotionDetector/Motion");
+            break;
+
+        default:
+            snprintf(topic_expr, sizeof(topic_expr), "%s", topics[i % COUNT_ELEMENTS(topics)]);
+            snprintf(content_expr, sizeof(content_expr),
+                     "boolean(//tt:Source/tt:SimpleItem[@Name=\"VideoSourceConfigurationToken\" and @Value=\"vsc%d\"])",
+                     (int)(i % SOURCES));
+
+            if( !filter->set_content(content_expr) )
+            {
+                fprintf(stderr, "content filter: %s\n", filter->get_cstr_err());
+                exit(EXIT_FAILURE);
+            }
+            break;
+    }
+
+
+    if( !filter->set_topics(topic_expr) )
+    {
+        fprintf(stderr, "topic filter: %s\n", filter->get_cstr_err());
+        exit(EXIT_FAILURE);
+    }
+
+    return filter;
+}
+
+
+
+int main(void)
+{
+    std::shared_ptr<EventSubscriptionList> list = std::make_shared<EventSubscriptionList>();
+
+    for( size_t i = 0; i < SUBSCRIPTIONS; ++i )
+        list->push_back(std::make_shared<EventSubscription>(i + 1, 1, 0, std::string(), make_filter(i)));
+
+
+    int64_t   start = now_ns();
+    TopicIndex index(list);
+    int64_t   build_ns = now_ns() - start;
+
+
+    std::vector<EventMessage> events(COUNT_ELEMENTS(topics) * SOURCES);
+
+    for( size_t i = 0; i < events.size(); ++i )
+    {
+        char source[16];
+        snprintf(source, sizeof(source), "vsc%d", (int)(i % SOURCES));
+        events[i].set(topics[i % COUNT_ELEMENTS(topics)], "VideoSourceConfigurationToken", source, "State", "true");
+    }
+
+
+    std::vector<EventSubscription *> matched(SUBSCRIPTIONS);
+    uint64_t candidates = 0;
+    uint64_t delivered  = 0;
+
+    start = now_ns();
+
+    for( size_t n = 0; n < EVENTS; ++n )
+    {
+        const EventMessage &msg = events[n % events.size()];
+        size_t count = index.match(msg.topic, &matched[0]);
+
+        candidates += count;
+
+        for( size_t i = 0; i < count; ++i )
+        {
+            const EventFilter *filter = matched[i]->get_filter();
+
+            if( !filter || filter->match_content(msg) )
+                delivered++;
+        }
+    }
+
+    int64_t run_ns = now_ns() - start;
+
+
+    double per_event_ns = (double)run_ns / EVENTS;
+
+    printf("events: %zu subscriptions, index built in %.1f us\n", SUBSCRIPTIONS, build_ns / 1000.0);
+    printf("events: %zu events, %.0f ns per event, %.1f matched by topic, %.1f delivered\n", EVENTS, per_event_ns,
+           (double)candidates / EVENTS, (double)delivered / EVENTS);
+    printf("events: %zu events/s take %.2f%% of a core\n", RATE, per_event_ns * RATE / 1e7);
+
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,167 @@
+/*
+ * GetProfiles of NVR and encoder deployments: 10, 100 and 1000 profiles (four
+ * per video source). The objects of the profiles are built once for the set
+ * (ServiceContext::get_profiles_cache), then every GetProfiles only collects
+ * the pointers and serializes them; the time and the heap of both are shown.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <malloc.h>
+
+#include "soapMediaBindingService.h"
+#include "ServiceContext.h"
+#include "smacros.h"
+
+#include "DeviceBinding.nsmap"
+
+
+
+
+
+static const int PROFILES_PER_SOURCE = 4;
+static const int REQUESTS            = 20;
+
+static const int sizes[] = { 10, 100, 1000 };
+
+static size_t sent; // bytes of the response
+
+
+
+static int64_t now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return (int64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+
+
+static size_t heap_used(void)
+{
+#if defined(__GLIBC__) && ((__GLIBC__ > 2) || (__GLIBC_MINOR__ >= 33))
+    return mallinfo2().uordblks;
+#else
+    return (size_t)mallinfo().uordblks;
+#endif
+}
+
+
+
+static int count_send(struct soap *soap, const char *buf, size_t len)
+{
+    UNUSED(soap);
+    UNUSED(buf);
+
+    sent += len;
+    return SOAP_OK;
+}
+
+
+
+static void add_profiles(ServiceContext &ctx, int count)
+{
+    VideoSource   source;
+    StreamProfile profile;
+    char          val[64];
+
+    for( int i = 0; i < count; ++i )
+    {
+        int ch = i / PROFILES_PER_SOURCE;
+
+        if( i % PROFILES_PER_SOURCE == 0 )
+        {
+            snprintf(val, sizeof(val), "ch%03d:1920x1080@25", ch);
+            if( !source.set_spec(val) || !ctx.add_video_source(source) )
+            {
+                fprintf(stderr, "video source: %s %s\n", source.get_cstr_err(), ctx.get_cstr_err());
+                exit(EXIT_FAILURE);
+            }
+        }
+
+
+        bool first = (i % PROFILES_PER_SOURCE == 0); // the main stream of the source
+
+        snprintf(val, sizeof(val), "ch%03d_%d", ch, i % PROFILES_PER_SOURCE);
+        profile.set_name(val);
+        profile.set_width(first ? "1920" : "640");
+        profile.set_height(first ? "1080" : "360");
+        snprintf(val, sizeof(val), "rtsp://%%s/ch%03d/%d", ch, i % PROFILES_PER_SOURCE);
+        profile.set_url(val);
+        snprintf(val, sizeof(val), "ch%03d", ch);
+        profile.set_source(val);
+
+        if( !profile.set_type("H264") || !ctx.add_profile(profile) )
+        {
+            fprintf(stderr, "profile: %s %s\n", profile.get_cstr_err(), ctx.get_cstr_err());
+            exit(EXIT_FAILURE);
+        }
+
+        profile.clear();
+    }
+}
+
+
+
+int main(void)
+{
+    for( size_t n = 0; n < COUNT_ELEMENTS(sizes); ++n )
+    {
+        ServiceContext *ctx = new ServiceContext;
+        add_profiles(*ctx, sizes[n]);
+
+
+        size_t  heap  = heap_used();
+        int64_t start = now_ns();
+
+        ctx->get_profiles_cache();
+
+        int64_t build_ns   = now_ns() - start;
+        size_t  cache_heap = heap_used() - heap;
+
+
+        struct soap *soap = soap_new();
+        soap->user  = ctx;
+        soap->fsend = count_send;
+
+        int64_t response_ns = 0;
+        size_t  max_heap    = 0;
+
+        for( int r = 0; r < REQUESTS; ++r )
+        {
+            MediaBindingService service(soap);
+            _trt__GetProfilesResponse response;
+
+            sent  = 0;
+            heap  = heap_used();
+            start = now_ns();
+
+            if( service.GetProfiles(NULL, response) || soap_write__trt__GetProfilesResponse(soap, &response) )
+            {
+                soap_print_fault(soap, stderr);
+                return EXIT_FAILURE;
+            }
+
+            response_ns += now_ns() - start;
+
+            size_t used = heap_used() - heap;
+            if( used > max_heap )
+                max_heap = used;
+
+            soap_destroy(soap);
+            soap_end(soap);
+        }
+
+
+        printf("GetProfiles: %4d profiles  build %8.1f us, %7zu KB  response %8.1f us, %7zu KB sent, %5zu KB heap\n",
+               sizes[n], build_ns / 1000.0, cache_heap / 1024, response_ns / 1000.0 / REQUESTS, sent / 1024,
+               max_heap / 1024);
+
+
+        soap_free(soap);
+        delete ctx;
+    }
+
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,94 @@
+/*
+ * Thumbnails of the snapshots: downscale of a 1920x1080 NV12 frame to the
+ * sizes of the tile walls with each kernel this CPU can run, and the baseline
+ * JPEG of the result.
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "yuv_scale.h"
+#include "jpeg_encoder.h"
+#include "smacros.h"
+
+
+
+
+
+static const int SRC_WIDTH  = 1920;
+static const int SRC_HEIGHT = 1080;
+static const int FRAMES     = 200;
+
+
+
+static const char *kernels[] = { "scalar", "sse2", "avx2", "neon" };
+
+static const struct { int width; int height; } sizes[] =
+{
+    { 320, 180 },
+    { 640, 360 },
+    { 1280, 720 }
+};
+
+
+
+static int64_t now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return (int64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+
+
+int main(void)
+{
+    // a gradient with noise, not a flat frame (JPEG of a flat frame is too cheap)
+    std::vector<uint8_t> frame(SRC_WIDTH * SRC_HEIGHT * 3 / 2);
+
+    for( size_t i = 0; i < frame.size(); ++i )
+        frame[i] = (uint8_t)((i % SRC_WIDTH) / 8 + (i / SRC_WIDTH) / 8 + (rand() & 15));
+
+
+    YuvImage img;
+
+    for( size_t k = 0; k < COUNT_ELEMENTS(kernels); ++k )
+    {
+        if( !yuv_scale_set_kernel(kernels[k]) )
+            continue;
+
+        for( size_t s = 0; s < COUNT_ELEMENTS(sizes); ++s )
+        {
+            int64_t start = now_ns();
+
+            for( int n = 0; n < FRAMES; ++n )
+                yuv_scale(&frame[0], YUV_NV12, SRC_WIDTH, SRC_HEIGHT, img, sizes[s].width, sizes[s].height);
+
+            printf("yuv_scale: %-6s %dx%d -> %4dx%-4d %8.1f us\n", kernels[k], SRC_WIDTH, SRC_HEIGHT,
+                   sizes[s].width, sizes[s].height, (now_ns() - start) / 1000.0 / FRAMES);
+        }
+    }
+
+
+    JpegEncoder encoder;
+
+    for( size_t s = 0; s < COUNT_ELEMENTS(sizes); ++s )
+    {
+        yuv_scale(&frame[0], YUV_NV12, SRC_WIDTH, SRC_HEIGHT, img, sizes[s].width, sizes[s].height);
+
+        std::string jpeg;
+        int64_t start = now_ns();
+
+        for( int n = 0; n < FRAMES; ++n )
+        {
+            jpeg.clear();
+            encoder.encode(img, jpeg);
+        }
+
+        printf("jpeg: %4dx%-4d q%d %8.1f us, %zu bytes\n", sizes[s].width, sizes[s].height, encoder.get_quality(),
+               (now_ns() - start) / 1000.0 / FRAMES, jpeg.size());
+    }
+
+    return EXIT_SUCCESS;
+}
@@ -1,12 +1,20 @@
 #include <arpa/inet.h>
+#include <stdio.h>
+#include <string.h>
+#include <ctype.h>
 
 #include <sstream>
+#include <algorithm>
 
 #include "ServiceContext.h"
 #include "stools.h"
+#include "smacros.h"
 
 
 
+static const char ptz_cfg_token[] = "PTZCfgToken";
+
+
 
 
 ServiceContext::ServiceContext():
@@ -20,21 +28,20 @@ ServiceContext::ServiceContext():
     model            ( "Model"          ),
     firmware_version ( "FirmwareVersion"),
     serial_number    ( "SerialNumber"   ),
-    hardware_id      ( "HardwareId"     )
+    hardware_id      ( "HardwareId"     ),
+
+    profiles ( std::make_shared<ProfileMap>() )
 {
 }
 
 
 
-std::string ServiceContext::getServerIpFromClientIp(uint32_t client_ip) const
+void ServiceContext::getServerIpFromClientIp(uint32_t client_ip, char *server_ip) const
 {
-    char server_ip[INET_ADDRSTRLEN];
-
-
     if (eth_ifs.size() == 1)
     {
         eth_ifs[0].get_ip(server_ip);
-        return server_ip;
+        return;
     }
 
     for(size_t i = 0; i < eth_ifs.size(); ++i)
@@ -46,12 +53,23 @@ std::string ServiceContext::getServerIpFromClientIp(uint32_t client_ip) const
         if( (if_ip & if_mask) == (client_ip & if_mask) )
         {
             eth_ifs[i].get_ip(server_ip);
-            return server_ip;
+            return;
         }
     }
 
 
-    return "127.0.0.1";  //localhost
+    strcpy(server_ip, "127.0.0.1");  //localhost
+}
+
+
+
+std::string ServiceContext::getServerIpFromClientIp(uint32_t client_ip) const
+{
+    char server_ip[INET_ADDRSTRLEN];
+
+    getServerIpFromClientIp(client_ip, server_ip);
+
+    return server_ip;
 }
 
 
@@ -60,6 +78,14 @@ std::string ServiceContext::getXAddr(soap *soap) const
 {
     std::ostringstream os;
 
+#ifdef WITH_OPENSSL
+    if( soap->ssl )
+    {
+        os << "https://" << getServerIpFromClientIp(htonl(soap->ip)) << ":" << tls_listener.get_port();
+        return os.str();
+    }
+#endif
+
     os << "http://" << getServerIpFromClientIp(htonl(soap->ip)) << ":" << port;
 
     return os.str();
@@ -67,6 +93,28 @@ std::string ServiceContext::getXAddr(soap *soap) const
 
 
 
+bool ServiceContext::is_tls_enabled() const
+{
+#ifdef WITH_OPENSSL
+    return tls_listener.enabled();
+#else
+    return false;
+#endif
+}
+
+
+
+int ServiceContext::get_tls_port() const
+{
+#ifdef WITH_OPENSSL
+    return tls_listener.enabled() ? tls_listener.get_port() : 0;
+#else
+    return 0;
+#endif
+}
+
+
+
 bool ServiceContext::add_profile(const StreamProfile &profile)
 {
     if( !profile.is_valid() )
@@ -76,49 +124,609 @@ bool ServiceContext::add_profile(const StreamProfile &profile)
     }
 
 
-    if( profiles.find(profile.get_name()) != profiles.end() )
+    if( get_profiles()->count(profile.get_name()) )
+    {
+        str_err = "profile: " + profile.get_name() +  " already exist";
+        return false;
+    }
+
+
+    StreamProfile new_profile(profile);
+
+    if( profile.get_source().empty() )
+    {
+        // profile without the table of sources has own source (old behavior)
+        VideoSource source;
+        source.set(profile.get_name(), profile.get_width(), profile.get_height());
+
+        if( !add_video_source(source) )
+            return false;
+
+        new_profile.set_source(profile.get_name().c_str());
+    }
+    else if( !get_video_source(profile.get_source()) )
+    {
+        str_err = "profile: " + profile.get_name() + " video source: " + profile.get_source() + " not found";
+        return false;
+    }
+
+
+    new_profile.reset_bounds(*get_video_source(new_profile.get_source()));
+
+
+    if( !profile.get_snapshm().empty() &&
+        !snapshot_proxy.add_shm_source(profile.get_name(), profile.get_snapshm()) )
+    {
+        str_err = "profile: " + profile.get_name() + " " + snapshot_proxy.get_str_err();
+        return false;
+    }
+
+
+    if( !profile.get_snapraw().empty() &&
+        !snapshot_proxy.add_raw_source(profile.get_name(), profile.get_snapraw(),
+                                       profile.get_width(), profile.get_height()) )
+    {
+        str_err = "profile: " + profile.get_name() + " " + snapshot_proxy.get_str_err();
+        return false;
+    }
+
+
+    return update_profiles([&new_profile](ProfileMap &map)
+    {
+        map[new_profile.get_name()] = std::make_shared<StreamProfile>(new_profile);
+        return true;
+    }, false);
+}
+
+
+
+bool ServiceContext::add_video_source(const VideoSource &source)
+{
+    if( video_sources.count(source.get_token()) )
+    {
+        str_err = "video source: " + source.get_token() + " already exist";
+        return false;
+    }
+
+
+    video_sources[source.get_token()] = source;
+    return true;
+}
+
+
+
+const VideoSource *ServiceContext::get_video_source(const std::string &token) const
+{
+    auto it = video_sources.find(token);
+
+    return (it != video_sources.end()) ? &it->second : NULL;
+}
+
+
+
+bool ServiceContext::update_profiles(const std::function<bool(ProfileMap &)> &fn, bool persist)
+{
+    std::lock_guard<std::mutex> lock(profiles_mtx);
+
+
+    // readers keep the old set while they hold it, the new one is published at once
+    std::shared_ptr<ProfileMap> next = std::make_shared<ProfileMap>(*get_profiles());
+
+    if( !fn(*next) )
+        return false;
+
+    std::atomic_store(&profiles, ProfileMapPtr(next));
+
+
+    if( !persist || !profile_store.enabled() )
+        return true;
+
+
+    std::vector<ProfileRecord> records;
+
+    for( auto it = next->cbegin(); it != next->cend(); ++it )
+    {
+        const StreamProfile &profile = *it->second;
+
+        if( profile.is_fixed() )
+            continue;
+
+
+        ProfileRecord rec;
+
+        rec.token     = profile.get_name();
+        rec.title     = profile.get_title();
+        rec.cfg_token = profile.get_cfg_token();
+        rec.video_src = profile.has_config(StreamProfile::VIDEO_SOURCE);
+        rec.video_enc = profile.has_config(StreamProfile::VIDEO_ENCODER);
+        rec.ptz       = profile.has_config(StreamProfile::PTZ);
+
+        records.push_back(rec);
+    }
+
+
+    profile_store.save(std::move(records)); // written by the thread of the store
+    return true;
+}
+
+
+
+bool ServiceContext::check_profile_token(const std::string &token)
+{
+    if( token.empty() || (token.size() > 64) )
+    {
+        str_err = "token of profile must be 1-64 chars";
+        return false;
+    }
+
+
+    for( size_t i = 0; i < token.size(); ++i )
+    {
+        if( !isalnum((unsigned char)token[i]) && !strchr("_-.", token[i]) )
+        {
+            str_err = "token of profile: " + token + " has wrong chars (allowed: A-Z a-z 0-9 _ - .)";
+            return false;
+        }
+    }
+
+
+    return true;
+}
+
+
+
+static bool is_dynamic_profile(const ProfileMap::value_type &item)
+{
+    return !item.second->is_fixed();
+}
+
+
+
+static StreamProfile *copy_profile(ProfileMap::iterator it)
+{
+    // the old one can be used by readers, the change is done in the copy
+    std::shared_ptr<StreamProfile> profile = std::make_shared<StreamProfile>(*it->second);
+    it->second = profile;
+
+    return profile.get();
+}
+
+
+
+static StreamProfile *find_dynamic_profile(ProfileMap &map, const std::string &token, std::string &str_err)
+{
+    auto it = map.find(token);
+
+    if( it == map.end() )
+    {
+        str_err = "profile: " + token + " not found";
+        return NULL;
+    }
+
+
+    if( it->second->is_fixed() )
+    {
+        str_err = "profile: " + token + " is fixed";
+        return NULL;
+    }
+
+
+    return copy_profile(it);
+}
+
+
+
+// configurations are owned by the fixed profiles, token of configuration is the name of owner
+static StreamProfile *find_cfg_owner(ProfileMap &map, const std::string &cfg_token, std::string &str_err)
+{
+    auto it = map.find(cfg_token);
+
+    if( (it == map.end()) || !it->second->is_fixed() )
+    {
+        str_err = "configuration: " + cfg_token + " not found";
+        return NULL;
+    }
+
+
+    return copy_profile(it);
+}
+
+
+
+// dynamic profiles have a copy of the configuration, it is taken again after a change
+static void update_cfg_users(ProfileMap &map, const StreamProfile &owner)
+{
+    for( auto it = map.begin(); it != map.end(); ++it )
+    {
+        if( it->second->is_fixed() || (it->second->get_cfg_token() != owner.get_name()) )
+            continue;
+
+
+        StreamProfile *profile = copy_profile(it);
+
+        if( profile->has_config(StreamProfile::VIDEO_SOURCE) )
+            profile->add_video_config(StreamProfile::VIDEO_SOURCE, owner);
+
+        if( profile->has_config(StreamProfile::VIDEO_ENCODER) )
+            profile->add_video_config(StreamProfile::VIDEO_ENCODER, owner);
+    }
+}
+
+
+
+bool ServiceContext::create_profile(std::string &token, const std::string &title)
+{
+    if( !token.empty() && !check_profile_token(token) )
+        return false;
+
+
+    if( title.size() > 64 )
+    {
+        str_err = "name of profile is too long (max 64 chars)";
+        return false;
+    }
+
+    for( size_t i = 0; i < title.size(); ++i )
+    {
+        if( iscntrl((unsigned char)title[i]) )
+        {
+            str_err = "name of profile has control chars";
+            return false;
+        }
+    }
+
+
+    return update_profiles([&](ProfileMap &map)
+    {
+        if( count_if(map.cbegin(), map.cend(), is_dynamic_profile) >= (long)MAX_DYNAMIC_PROFILES )
+        {
+            str_err = "max number of profiles is reached";
+            return false;
+        }
+
+
+        for( size_t n = 1; token.empty(); ++n )
+        {
+            std::string new_token = "profile_" + std::to_string(n);
+            if( !map.count(new_token) )
+                token = new_token;
+        }
+
+
+        if( map.count(token) )
+        {
+            str_err = "profile: " + token + " already exist";
+            return false;
+        }
+
+
+        StreamProfile profile;
+        profile.set_name(token.c_str());
+        profile.set_dynamic(title);
+
+        map[token] = std::make_shared<StreamProfile>(profile);
+        return true;
+    }, true);
+}
+
+
+
+bool ServiceContext::delete_profile(const std::string &token)
+{
+    return update_profiles([&](ProfileMap &map)
+    {
+        if( !find_dynamic_profile(map, token, str_err) )
+            return false;
+
+        map.erase(token);
+        return true;
+    }, true);
+}
+
+
+
+bool ServiceContext::add_profile_config(const std::string &token, StreamProfile::Config cfg,
+                                        const std::string &cfg_token)
+{
+    return update_profiles([&](ProfileMap &map)
+    {
+        StreamProfile *profile = find_dynamic_profile(map, token, str_err);
+        if( !profile )
+            return false;
+
+
+        if( cfg == StreamProfile::PTZ )
+        {
+            if( !ptz_node.enable || (!cfg_token.empty() && (cfg_token != ptz_cfg_token)) )
+            {
+                str_err = "PTZ configuration: " + cfg_token + " not found";
+                return false;
+            }
+
+            profile->add_ptz_config();
+            return true;
+        }
+
+
+        auto owner = map.find(cfg_token);
+        if( (owner == map.end()) || !owner->second->is_fixed() )
+        {
+            str_err = "configuration: " + cfg_token + " not found";
+            return false;
+        }
+
+
+        profile->add_video_config(cfg, *owner->second);
+        return true;
+    }, true);
+}
+
+
+
+bool ServiceContext::remove_profile_config(const std::string &token, StreamProfile::Config cfg)
+{
+    return update_profiles([&](ProfileMap &map)
+    {
+        StreamProfile *profile = find_dynamic_profile(map, token, str_err);
+        if( !profile )
+            return false;
+
+        profile->remove_config(cfg);
+        return true;
+    }, true);
+}
+
+
+
+bool ServiceContext::load_users()
+{
+#ifdef WITH_OPENSSL
+    if( !user_store.load() )
+    {
+        str_err = user_store.get_str_err();
+        return false;
+    }
+
+
+    // the first Administrator comes from the options (opt user, opt password)
+    if( !user_store.get_users()->empty() || user.empty() )
+        return true;
+
+    if( (user.size() > UserStore::MAX_NAME_LEN) || (password.size() > UserStore::MAX_PASSWORD_LEN) )
+    {
+        str_err = "user name or password is too long";
+        return false;
+    }
+
+    if( !user_store.update([this](UserMap &map)
+    {
+        User &admin = map[user];
+
+        admin.name  = user;
+        admin.level = USER_LEVEL_ADMINISTRATOR;
+        UserStore::set_password(admin, password);
+
+        return true;
+    }) )
+    {
+        str_err = user_store.get_str_err();
+        return false;
+    }
+#endif
+
+    return true;
+}
+
+
+
+bool ServiceContext::load_profiles()
+{
+    std::vector<ProfileRecord> records;
+
+    if( !profile_store.enabled() )
+        return true;
+
+    if( !profile_store.load(records) )
+    {
+        str_err = profile_store.get_str_err();
+        return false;
+    }
+
+
+    return update_profiles([&](ProfileMap &map)
+    {
+        for( size_t i = 0; i < records.size(); ++i )
+        {
+            const ProfileRecord &rec = records[i];
+
+            if( !check_profile_token(rec.token) || map.count(rec.token) )
+            {
+                DEBUG_MSG("Skip saved profile: %s\n", rec.token.c_str());
+                continue;
+            }
+
+
+            StreamProfile profile;
+            profile.set_name(rec.token.c_str());
+            profile.set_dynamic(rec.title);
+
+            auto owner = map.find(rec.cfg_token);
+            if( (owner != map.end()) && owner->second->is_fixed() )
+            {
+                if( rec.video_src )
+                    profile.add_video_config(StreamProfile::VIDEO_SOURCE, *owner->second);
+
+                if( rec.video_enc )
+                    profile.add_video_config(StreamProfile::VIDEO_ENCODER, *owner->second);
+            }
+
+            if( rec.ptz && ptz_node.enable )
+                profile.add_ptz_config();
+
+
+            map[rec.token] = std::make_shared<StreamProfile>(profile);
+        }
+
+        return true;
+    }, false);
+}
+
+
+
+bool ServiceContext::set_video_enc_cfg(const tt__VideoEncoderConfiguration &cfg)
+{
+    return update_profiles([&](ProfileMap &map)
+    {
+        StreamProfile *owner = find_cfg_owner(map, cfg.token, str_err);
+        if( !owner )
+            return false;
+
+
+        if( !owner->set_video_enc_cfg(cfg) )
+        {
+            str_err = "configuration: " + cfg.token + " " + owner->get_str_err();
+            return false;
+        }
+
+
+        update_cfg_users(map, *owner);
+        publish_encoder_ctl(*owner);
+        return true;
+    }, false);
+}
+
+
+
+bool ServiceContext::set_video_src_cfg(const tt__VideoSourceConfiguration &cfg)
+{
+    return update_profiles([&](ProfileMap &map)
+    {
+        StreamProfile *owner = find_cfg_owner(map, cfg.token, str_err);
+        if( !owner )
+            return false;
+
+
+        const VideoSource *src = get_video_source(owner->get_source());
+
+        if( !src || !owner->set_video_src_cfg(cfg, *src) )
+        {
+            str_err = "configuration: " + cfg.token + " " + owner->get_str_err();
+            return false;
+        }
+
+
+        update_cfg_users(map, *owner);
+        publish_encoder_ctl(*owner);
+        return true;
+    }, false);
+}
+
+
+
+bool ServiceContext::open_encoder_control()
+{
+    if( !encoder_control.enabled() )
+        return true;
+
+
+    std::vector<EncCtlConfig> configs;
+    ProfileMapPtr             current = get_profiles();
+
+    for( auto it = current->cbegin(); it != current->cend(); ++it )
+    {
+        if( !it->second->is_fixed() )
+            continue;
+
+        configs.push_back(EncCtlConfig());
+        it->second->get_encoder_ctl(configs.back());
+    }
+
+
+    if( !encoder_control.open(configs) )
+    {
+        str_err = encoder_control.get_str_err();
+        return false;
+    }
+
+
+    return true;
+}
+
+
+
+// called under the lock of profiles, so the slot has one writer
+void ServiceContext::publish_encoder_ctl(const StreamProfile &profile)
+{
+    if( !encoder_control.enabled() )
+        return;
+
+
+    EncCtlConfig cfg;
+    profile.get_encoder_ctl(cfg);
+
+    if( !encoder_control.publish(cfg) )
+        DEBUG_MSG("Encoder control: %s\n", encoder_control.get_cstr_err());
+}
+
+
+
+int ServiceContext::render_uri(const UriTemplate &tpl, const StreamProfile &profile,
+                               uint32_t client_ip, char *buf, size_t size) const
+{
+    char server_ip[INET_ADDRSTRLEN];
+    char client_ip_str[INET_ADDRSTRLEN];
+
+
+    UriTemplateArgs args;
+
+    if( tpl.has_field(UriTemplate::SERVER_IP) )
     {
-        str_err = "profile: " + profile.get_name() +  " already exist";
-        return false;
+        getServerIpFromClientIp(client_ip, server_ip);
+        args.server_ip = server_ip;
     }
 
+    if( tpl.has_field(UriTemplate::CLIENT_IP) &&
+        inet_ntop(AF_INET, &client_ip, client_ip_str, sizeof(client_ip_str)) )
+        args.client_ip = client_ip_str;
 
-    profiles[profile.get_name()] = profile;
-    return true;
-}
-
-
-
-std::string ServiceContext::get_stream_uri(const std::string &profile_url, uint32_t client_ip) const
-{
-    std::string uri(profile_url);
-    std::string template_str("%s");
+    args.port    = port;
+    args.profile = profile.get_cfg_token().c_str();
 
 
-    auto it = uri.find(template_str, 0);
+    return tpl.render(buf, size, args);
+}
 
-    if( it != std::string::npos )
-        uri.replace(it, template_str.size(), getServerIpFromClientIp(client_ip));
 
 
-    return uri;
+int ServiceContext::get_stream_uri(const StreamProfile &profile, uint32_t client_ip,
+                                   char *buf, size_t size) const
+{
+    return render_uri(profile.get_url_tpl(), profile, client_ip, buf, size);
 }
 
 
 
-std::string ServiceContext::get_snapshot_uri(const std::string &profile_url, uint32_t client_ip) const
+int ServiceContext::get_snapshot_uri(const StreamProfile &profile, uint32_t client_ip,
+                                     char *buf, size_t size) const
 {
-    std::string uri(profile_url);
-    std::string template_str("%s");
+    if( !snapshot_proxy.enable || !profile.has_snapshot() )
+        return get_snapshot_src_uri(profile, client_ip, buf, size);
+
+
+    char server_ip[INET_ADDRSTRLEN];
+    getServerIpFromClientIp(client_ip, server_ip);
 
+    int len = snprintf(buf, size, "http://%s:%d/snapshot/%s", server_ip, port, profile.get_cfg_token().c_str());
 
-    auto it = uri.find(template_str, 0);
+    return ((len < 0) || ((size_t)len >= size)) ? -1 : len;
+}
 
-    if( it != std::string::npos )
-        uri.replace(it, template_str.size(), getServerIpFromClientIp(client_ip));
 
 
-    return uri;
+int ServiceContext::get_snapshot_src_uri(const StreamProfile &profile, uint32_t client_ip,
+                                         char *buf, size_t size) const
+{
+    return render_uri(profile.get_snapurl_tpl(), profile, client_ip, buf, size);
 }
 
 
@@ -144,21 +752,36 @@ tds__DeviceServiceCapabilities *ServiceContext::getDeviceServiceCapabilities(soa
 
     capabilities->Security->TLS1_x002e0          = soap_new_ptr(soap, false);
     capabilities->Security->TLS1_x002e1          = soap_new_ptr(soap, false);
-    capabilities->Security->TLS1_x002e2          = soap_new_ptr(soap, false);
+    capabilities->Security->TLS1_x002e2          = soap_new_ptr(soap, is_tls_enabled()); // TLS 1.2 or newer
     capabilities->Security->OnboardKeyGeneration = soap_new_ptr(soap, false);
     capabilities->Security->AccessPolicyConfig   = soap_new_ptr(soap, false);
+#ifdef WITH_OPENSSL
+    capabilities->Security->DefaultAccessPolicy  = soap_new_ptr(soap, true);
+#else
     capabilities->Security->DefaultAccessPolicy  = soap_new_ptr(soap, false);
+#endif
     capabilities->Security->Dot1X                = soap_new_ptr(soap, false);
     capabilities->Security->RemoteUserHandling   = soap_new_ptr(soap, false);
     capabilities->Security->X_x002e509Token      = soap_new_ptr(soap, false);
     capabilities->Security->SAMLToken            = soap_new_ptr(soap, false);
     capabilities->Security->KerberosToken        = soap_new_ptr(soap, false);
+#ifdef WITH_OPENSSL
+    capabilities->Security->UsernameToken        = soap_new_ptr(soap, true);
+    capabilities->Security->HttpDigest           = soap_new_ptr(soap, true);
+#else
     capabilities->Security->UsernameToken        = soap_new_ptr(soap, false);
     capabilities->Security->HttpDigest           = soap_new_ptr(soap, false);
+#endif
     capabilities->Security->RELToken             = soap_new_ptr(soap, false);
+#ifdef WITH_OPENSSL
+    capabilities->Security->MaxUsers             = soap_new_ptr(soap, (int)UserStore::MAX_USERS);
+    capabilities->Security->MaxUserNameLength    = soap_new_ptr(soap, (int)UserStore::MAX_NAME_LEN);
+    capabilities->Security->MaxPasswordLength    = soap_new_ptr(soap, (int)UserStore::MAX_PASSWORD_LEN);
+#else
     capabilities->Security->MaxUsers             = soap_new_ptr(soap, 0);
     capabilities->Security->MaxUserNameLength    = soap_new_ptr(soap, 0);
     capabilities->Security->MaxPasswordLength    = soap_new_ptr(soap, 0);
+#endif
 
 
     capabilities->System = soap_new_tds__SystemCapabilities(soap);
@@ -185,15 +808,20 @@ trt__Capabilities *ServiceContext::getMediaServiceCapabilities(soap *soap)
 {
     trt__Capabilities *capabilities = soap_new_trt__Capabilities(soap);
 
+    int fixed_profiles = 0;
+
     auto profiles = this->get_profiles();
-    for( auto it = profiles.cbegin(); it != profiles.cend(); ++it ) {
-        if (( !it->second.get_snapurl().empty() ) && ( capabilities->SnapshotUri == NULL )) {
+    for( auto it = profiles->cbegin(); it != profiles->cend(); ++it ) {
+        if (( it->second->has_snapshot() ) && ( capabilities->SnapshotUri == NULL )) {
             capabilities->SnapshotUri = soap_new_ptr(soap, true);
         }
+        if ( it->second->is_fixed() ) {
+            fixed_profiles++;
+        }
     }
 
     capabilities->ProfileCapabilities = soap_new_trt__ProfileCapabilities(soap);
-    capabilities->ProfileCapabilities->MaximumNumberOfProfiles = soap_new_ptr(soap, 1);
+    capabilities->ProfileCapabilities->MaximumNumberOfProfiles = soap_new_ptr(soap, fixed_profiles + (int)MAX_DYNAMIC_PROFILES);
 
     capabilities->StreamingCapabilities = soap_new_trt__StreamingCapabilities(soap);
     capabilities->StreamingCapabilities->RTPMulticast = soap_new_ptr(soap, false);
@@ -210,7 +838,7 @@ tt__PTZConfiguration *ServiceContext::GetPTZConfiguration (struct soap *soap)
     tt__PTZConfiguration* ptz_cfg = soap_new_tt__PTZConfiguration (soap);
 
     ptz_cfg->Name = "PTZCfg";
-    ptz_cfg->token = "PTZCfgToken";
+    ptz_cfg->token = ptz_cfg_token;
     ptz_cfg->NodeToken = "PTZNodeToken";
 
     ptz_cfg->MoveRamp = soap_new_ptr (soap, (int)0);
@@ -283,72 +911,496 @@ tt__PTZConfigurationOptions* ServiceContext::GetPTZConfigurationOptions (struct
     /// Optional element 'tt:AbsolutePanTiltPositionSpace' of XML schema type 'tt:Space2DDescription'
     pOptions->Spaces->AbsolutePanTiltPositionSpace.push_back (pSpace2DDescription);
 
-    pSpace1DDescription = soap_new_tt__Space1DDescription (soap);
-    pSpace1DDescription->URI = "http://www.onvif.org/ver10/tptz/PanTiltSpaces/TranslationGenericSpace";
-    pSpace1DDescription->XRange = soap_new_set_tt__FloatRange (soap, 0.0, 1.0);
-    /// Optional element 'tt:AbsoluteZoomPositionSpace' of XML schema type 'tt:Space1DDescription'
-    pOptions->Spaces->AbsoluteZoomPositionSpace.push_back (pSpace1DDescription);
+    pSpace1DDescription = soap_new_tt__Space1DDescription (soap);
+    pSpace1DDescription->URI = "http://www.onvif.org/ver10/tptz/PanTiltSpaces/TranslationGenericSpace";
+    pSpace1DDescription->XRange = soap_new_set_tt__FloatRange (soap, 0.0, 1.0);
+    /// Optional element 'tt:AbsoluteZoomPositionSpace' of XML schema type 'tt:Space1DDescription'
+    pOptions->Spaces->AbsoluteZoomPositionSpace.push_back (pSpace1DDescription);
+
+    pSpace2DDescription = soap_new_tt__Space2DDescription (soap);
+    pSpace2DDescription->URI = "http://www.onvif.org/ver10/tptz/ZoomSpaces/TranslationGenericSpace";
+    pSpace2DDescription->XRange = soap_new_set_tt__FloatRange (soap, -1.0, 1.0);
+    pSpace2DDescription->YRange = soap_new_set_tt__FloatRange (soap, -1.0, 1.0);
+    /// Optional element 'tt:RelativePanTiltTranslationSpace' of XML schema type 'tt:Space2DDescription'
+    pOptions->Spaces->RelativePanTiltTranslationSpace.push_back (pSpace2DDescription);
+
+
+    pSpace1DDescription = soap_new_tt__Space1DDescription (soap);
+    pSpace1DDescription->URI = "http://www.onvif.org/ver10/tptz/PanTiltSpaces/PositionGenericSpace";
+    pSpace1DDescription->XRange = soap_new_set_tt__FloatRange (soap, -1.0, 1.0);
+    /// Optional element 'tt:RelativeZoomTranslationSpace' of XML schema type 'tt:Space1DDescription'
+    pOptions->Spaces->RelativeZoomTranslationSpace.push_back (pSpace1DDescription);
+
+    pSpace2DDescription = soap_new_tt__Space2DDescription (soap);
+    pSpace2DDescription->URI = "http://www.onvif.org/ver10/tptz/PanTiltSpaces/VelocityGenericSpace";
+    pSpace2DDescription->XRange = soap_new_set_tt__FloatRange (soap, -1.0, 1.0);
+    pSpace2DDescription->YRange = soap_new_set_tt__FloatRange (soap, -1.0, 1.0);
+    /// Optional element 'tt:ContinuousPanTiltVelocitySpace' of XML schema type 'tt:Space2DDescription'
+    pOptions->Spaces->ContinuousPanTiltVelocitySpace.push_back (pSpace2DDescription);
+
+    pSpace1DDescription = soap_new_tt__Space1DDescription (soap);
+    pSpace1DDescription->URI = "http://www.onvif.org/ver10/tptz/ZoomSpaces/VelocityGenericSpace";
+    pSpace1DDescription->XRange = soap_new_set_tt__FloatRange (soap, 0.0, 1.0);
+    /// Optional element 'tt:ContinuousZoomVelocitySpace' of XML schema type 'tt:Space1DDescription'
+    pOptions->Spaces->ContinuousZoomVelocitySpace.push_back (pSpace1DDescription);
+
+    pSpace1DDescription = soap_new_tt__Space1DDescription (soap);
+    pSpace1DDescription->URI = "http://www.onvif.org/ver10/tptz/PanTiltSpaces/GenericSpeedSpace";
+    pSpace1DDescription->XRange = soap_new_set_tt__FloatRange (soap, -1.0, 1.0);
+    /// Optional element 'tt:PanTiltSpeedSpace' of XML schema type 'tt:Space1DDescription'
+    pOptions->Spaces->PanTiltSpeedSpace.push_back (pSpace1DDescription);
+
+    pSpace1DDescription = soap_new_tt__Space1DDescription (soap);
+    pSpace1DDescription->URI = "http://www.onvif.org/ver10/tptz/ZoomSpaces/ZoomGenericSpeedSpace";
+    pSpace1DDescription->XRange = soap_new_set_tt__FloatRange (soap, -1.0, 1.0);
+    /// Optional element 'tt:ZoomSpeedSpace' of XML schema type 'tt:Space1DDescription'
+    pOptions->Spaces->ZoomSpeedSpace.push_back (pSpace1DDescription);
+
+
+    /// Required element 'tt:PTZTimeout' of XML schema type 'tt:DurationRange'
+    pOptions->PTZTimeout = soap_new_set_tt__DurationRange (soap, 1000, 100000);
+
+    /// Optional element 'tt:PTControlDirection' of XML schema type 'tt:PTControlDirectionOptions'
+    pOptions->PTControlDirection = soap_new_tt__PTControlDirectionOptions (soap);
+    pOptions->PTControlDirection->EFlip = soap_new_tt__EFlipOptions (soap);
+    pOptions->PTControlDirection->EFlip->Mode.push_back (tt__EFlipMode__OFF);
+    pOptions->PTControlDirection->EFlip->Mode.push_back (tt__EFlipMode__ON);
+    pOptions->PTControlDirection->Reverse = soap_new_tt__ReverseOptions (soap);
+    pOptions->PTControlDirection->Reverse->Mode.push_back (tt__ReverseMode__OFF);
+    pOptions->PTControlDirection->Reverse->Mode.push_back (tt__ReverseMode__ON);
+    pOptions->PTControlDirection->Reverse->Mode.push_back (tt__ReverseMode__AUTO);
+    return pOptions;
+}
+
+tr2__Capabilities2 *ServiceContext::getMedia2ServiceCapabilities(soap *soap)
+{
+    tr2__Capabilities2 *capabilities = soap_new_tr2__Capabilities2(soap);
+
+    int fixed_profiles = 0;
+
+    auto profiles = this->get_profiles();
+    for( auto it = profiles->cbegin(); it != profiles->cend(); ++it ) {
+        if (( it->second->has_snapshot() ) && ( capabilities->SnapshotUri == NULL )) {
+            capabilities->SnapshotUri = soap_new_ptr(soap, true);
+        }
+        if ( it->second->is_fixed() ) {
+            fixed_profiles++;
+        }
+    }
+
+    capabilities->ProfileCapabilities = soap_new_tr2__ProfileCapabilities(soap);
+    capabilities->ProfileCapabilities->MaximumNumberOfProfiles = soap_new_ptr(soap, fixed_profiles + (int)MAX_DYNAMIC_PROFILES);
+    capabilities->ProfileCapabilities->ConfigurationsSupported = soap_new_std__string(soap);
+    *capabilities->ProfileCapabilities->ConfigurationsSupported = ptz_node.enable ? "VideoSource VideoEncoder PTZ" : "VideoSource VideoEncoder";
+
+    capabilities->StreamingCapabilities = soap_new_tr2__StreamingCapabilities(soap);
+    capabilities->StreamingCapabilities->RTSPStreaming = soap_new_ptr(soap, true);
+    capabilities->StreamingCapabilities->RTPMulticast = soap_new_ptr(soap, false);
+    capabilities->StreamingCapabilities->RTP_USCORERTSP_USCORETCP = soap_new_ptr(soap, true);
+
+
+    return capabilities;
+}
+
+
+
+tptz__Capabilities *ServiceContext::getPTZServiceCapabilities(soap *soap)
+{
+    tptz__Capabilities *capabilities = soap_new_tptz__Capabilities(soap);
+
+    return capabilities;
+}
+
+
+
+tev__Capabilities *ServiceContext::getEventServiceCapabilities(soap *soap)
+{
+    tev__Capabilities *capabilities = soap_new_tev__Capabilities(soap);
+
+    capabilities->WSPullPointSupport                            = soap_new_ptr(soap, true);
+    capabilities->WSSubscriptionPolicySupport                   = soap_new_ptr(soap, false);
+    capabilities->WSPausableSubscriptionManagerInterfaceSupport = soap_new_ptr(soap, false);
+    capabilities->MaxNotificationProducers                      = soap_new_ptr(soap, (int)EventBroker::MAX_SUBSCRIPTIONS);
+    capabilities->MaxPullPoints                                 = soap_new_ptr(soap, (int)EventBroker::MAX_SUBSCRIPTIONS);
+
+    return capabilities;
+}
+
+
+
+static tt__IntRange *new_int_range(struct soap *soap, const EncoderCaps::Range &range)
+{
+    return soap_new_req_tt__IntRange(soap, range.min, range.max);
+}
+
+
+
+template<typename T>
+static T *fill_codec_options(T *opts, struct soap *soap, const EncoderCaps &caps)
+{
+    for( size_t i = 0; i < caps.resolutions.size(); ++i )
+    {
+        const EncoderCaps::Resolution &res = caps.resolutions[i];
+        opts->ResolutionsAvailable.push_back(soap_new_req_tt__VideoResolution(soap, res.width, res.height));
+    }
+
+    opts->FrameRateRange        = new_int_range(soap, caps.fps);
+    opts->EncodingIntervalRange = new_int_range(soap, caps.interval);
+
+    return opts;
+}
+
+
+
+// options of the codec (other codecs are kept), quality range covers all codecs
+static void add_video_enc_options(struct soap *soap, tt__VideoEncoderConfigurationOptions *opts,
+                                  int encoding, const EncoderCaps &caps)
+{
+    if( opts->QualityRange )
+    {
+        opts->QualityRange->Min = std::min(opts->QualityRange->Min, caps.quality.min);
+        opts->QualityRange->Max = std::max(opts->QualityRange->Max, caps.quality.max);
+    }
+    else
+    {
+        opts->QualityRange = new_int_range(soap, caps.quality);
+    }
+
+    if( !opts->Extension )
+        opts->Extension = soap_new_tt__VideoEncoderOptionsExtension(soap);
+
+
+    // options of ONVIF 1.0 and the same with bitrate in the extension
+    switch( encoding )
+    {
+        case tt__VideoEncoding__JPEG:
+            opts->JPEG            = fill_codec_options(soap_new_tt__JpegOptions(soap), soap, caps);
+            opts->Extension->JPEG = fill_codec_options(soap_new_tt__JpegOptions2(soap), soap, caps);
+            opts->Extension->JPEG->BitrateRange = new_int_range(soap, caps.bitrate);
+            break;
+
+        case tt__VideoEncoding__MPEG4:
+            opts->MPEG4            = fill_codec_options(soap_new_tt__Mpeg4Options(soap), soap, caps);
+            opts->Extension->MPEG4 = fill_codec_options(soap_new_tt__Mpeg4Options2(soap), soap, caps);
+            opts->Extension->MPEG4->BitrateRange = new_int_range(soap, caps.bitrate);
+
+            opts->MPEG4->GovLengthRange            = new_int_range(soap, caps.gov);
+            opts->Extension->MPEG4->GovLengthRange = opts->MPEG4->GovLengthRange;
+            opts->MPEG4->Mpeg4ProfilesSupported.push_back(tt__Mpeg4Profile__SP);
+            opts->Extension->MPEG4->Mpeg4ProfilesSupported = opts->MPEG4->Mpeg4ProfilesSupported;
+            break;
+
+        case tt__VideoEncoding__H264:
+            opts->H264            = fill_codec_options(soap_new_tt__H264Options(soap), soap, caps);
+            opts->Extension->H264 = fill_codec_options(soap_new_tt__H264Options2(soap), soap, caps);
+            opts->Extension->H264->BitrateRange = new_int_range(soap, caps.bitrate);
+
+            opts->H264->GovLengthRange            = new_int_range(soap, caps.gov);
+            opts->Extension->H264->GovLengthRange = opts->H264->GovLengthRange;
+            opts->H264->H264ProfilesSupported.push_back(tt__H264Profile__Main);
+            opts->Extension->H264->H264ProfilesSupported = opts->H264->H264ProfilesSupported;
+            break;
+    }
+}
+
+
+
+// options of Media2, one object for each encoding
+static tt__VideoEncoder2ConfigurationOptions *new_video_enc2_options(struct soap *soap, int encoding,
+                                                                     const EncoderCaps &caps)
+{
+    tt__VideoEncoder2ConfigurationOptions *opts = soap_new_tt__VideoEncoder2ConfigurationOptions(soap);
+
+    opts->Encoding     = StreamProfile::get_media2_encoding(encoding);
+    opts->QualityRange = soap_new_req_tt__FloatRange(soap, caps.quality.min, caps.quality.max);
+    opts->BitrateRange = new_int_range(soap, caps.bitrate);
+
+    for( size_t i = 0; i < caps.resolutions.size(); ++i )
+    {
+        const EncoderCaps::Resolution &res = caps.resolutions[i];
+        opts->ResolutionsAvailable.push_back(soap_new_req_tt__VideoResolution2(soap, res.width, res.height));
+    }
+
+
+    // attributes are lists of values: frame rates, GOV length "min max"
+    std::string rates;
+
+    for( int fps = caps.fps.max; fps >= caps.fps.min && fps > 0; fps /= 2 )
+        rates += (rates.empty() ? "" : " ") + std::to_string(fps);
+
+    if( !rates.empty() )
+    {
+        opts->FrameRatesSupported  = soap_new_std__string(soap);
+        *opts->FrameRatesSupported = rates;
+    }
+
+    if( caps.gov.is_set() )
+    {
+        opts->GovLengthRange  = soap_new_std__string(soap);
+        *opts->GovLengthRange = std::to_string(caps.gov.min) + " " + std::to_string(caps.gov.max);
+    }
+
+    if( encoding == tt__VideoEncoding__H264 )
+    {
+        opts->ProfilesSupported  = soap_new_std__string(soap);
+        *opts->ProfilesSupported = "Main";
+    }
+
+
+    return opts;
+}
+
+
+
+static tt__VideoSourceConfigurationOptions *new_video_src_options(struct soap *soap, const VideoSource &src)
+{
+    tt__VideoSourceConfigurationOptions *opts = soap_new_tt__VideoSourceConfigurationOptions(soap);
+
+    opts->BoundsRange              = soap_new_tt__IntRectangleRange(soap);
+    opts->BoundsRange->XRange      = soap_new_req_tt__IntRange(soap, 0, src.get_width());
+    opts->BoundsRange->YRange      = soap_new_req_tt__IntRange(soap, 0, src.get_height());
+    opts->BoundsRange->WidthRange  = soap_new_req_tt__IntRange(soap, 0, src.get_width());
+    opts->BoundsRange->HeightRange = soap_new_req_tt__IntRange(soap, 0, src.get_height());
+
+    opts->VideoSourceTokensAvailable.push_back(src.get_token());
+
+    return opts;
+}
+
+
+
+const ServiceContext::ProfilesCache &ServiceContext::get_profiles_cache()
+{
+    ProfilesCache &cache   = profiles_cache;
+    ProfileMapPtr  current = get_profiles();
+
+    if( cache.soap && (cache.src == current) )
+        return cache;
+
+
+    if( !cache.soap )
+    {
+        cache.soap = soap_new();
+        cache.soap->user = this;
+    }
+    else
+    {
+        soap_destroy(cache.soap);
+        soap_end(cache.soap);
+    }
+
+
+    cache.src = current;
+    cache.profiles.clear();
+    cache.video_srcs.clear();
+    cache.video_src_cfgs.clear();
+    cache.video_enc_cfgs.clear();
+    cache.video_src_opts.clear();
+    cache.video_enc_opts.clear();
+    cache.video_enc2_cfgs.clear();
+    cache.video_enc2_opts.clear();
+
+
+    for( auto it = video_sources.cbegin(); it != video_sources.cend(); ++it )
+        cache.video_srcs[it->first] = it->second.get_video_src(cache.soap);
+
+
+    // options without a configuration: caps of all profiles merged per encoding
+    std::map<int, EncoderCaps> all_caps;
+
+
+    // configurations are owned by the fixed profiles, one object for all profiles
+    for( auto it = current->cbegin(); it != current->cend(); ++it )
+    {
+        const StreamProfile &profile = *it->second;
+        const std::string   &cfg     = profile.get_cfg_token();
+
+        if( !profile.is_fixed() )
+            continue;
+
+        cache.video_src_cfgs[cfg] = profile.get_video_src_cnf(cache.soap);
+        cache.video_enc_cfgs[cfg] = profile.get_video_enc_cfg(cache.soap);
+
+
+        int         encoding = profile.get_type();
+        EncoderCaps caps     = profile.get_caps().resolve(encoding, profile.get_width(), profile.get_height());
+
+        tt__VideoEncoderConfigurationOptions *enc_opts = soap_new_tt__VideoEncoderConfigurationOptions(cache.soap);
+        add_video_enc_options(cache.soap, enc_opts, encoding, caps);
+        cache.video_enc_opts[cfg] = enc_opts;
+
+        cache.video_enc2_cfgs[cfg] = profile.get_video_enc2_cfg(cache.soap);
+        cache.video_enc2_opts[cfg].push_back(new_video_enc2_options(cache.soap, encoding, caps));
+
+        if( all_caps.count(encoding) )
+            all_caps[encoding].merge(caps);
+        else
+            all_caps[encoding] = caps;
+
+
+        const VideoSource *src = get_video_source(profile.get_source());
+        if( !src )
+            continue;
+
+        cache.video_src_opts[cfg] = new_video_src_options(cache.soap, *src);
+
+        if( !cache.video_src_opts.count("") )
+            cache.video_src_opts[""] = cache.video_src_opts[cfg]; // first one, as it was before
+    }
+
+
+    tt__VideoEncoderConfigurationOptions *all_enc_opts = soap_new_tt__VideoEncoderConfigurationOptions(cache.soap);
+    cache.video_enc_opts[""] = all_enc_opts;
+
+    for( auto it = all_caps.cbegin(); it != all_caps.cend(); ++it )
+    {
+        add_video_enc_options(cache.soap, all_enc_opts, it->first, it->second);
+        cache.video_enc2_opts[""].push_back(new_video_enc2_options(cache.soap, it->first, it->second));
+    }
+
+
+    tt__PTZConfiguration *ptz_cfg = ptz_node.enable ? GetPTZConfiguration(cache.soap) : NULL;
+    cache.ptz_cfg = ptz_cfg;
+
+    for( auto it = current->cbegin(); it != current->cend(); ++it )
+    {
+        const StreamProfile &profile = *it->second;
+
+        tt__VideoSourceConfiguration  *vsc = NULL;
+        tt__VideoEncoderConfiguration *vec = NULL;
+
+        if( profile.has_config(StreamProfile::VIDEO_SOURCE) )
+            vsc = cache.video_src_cfgs[profile.get_cfg_token()];
+
+        if( profile.has_config(StreamProfile::VIDEO_ENCODER) )
+            vec = cache.video_enc_cfgs[profile.get_cfg_token()];
+
+        cache.profiles[profile.get_name()] =
+            profile.get_profile(cache.soap, vsc, vec, profile.has_config(StreamProfile::PTZ) ? ptz_cfg : NULL);
+    }
+
+
+    return cache;
+}
+
+
+
+void ServiceContext::dump_stats(FILE *fp) const
+{
+    if( ptz_node.enable )
+        ptz_backend.dump_stats(fp);
+
+    if( snapshot_proxy.enable )
+        snapshot_proxy.dump_stats(fp);
+
+    event_broker.dump_stats(fp);
+    pullpoint_waiters.dump_stats(fp);
+    notify_delivery.dump_stats(fp);
+
+    if( event_ingest.enabled() )
+        event_ingest.dump_stats(fp);
+
+    if( discovery.enable )
+        discovery.dump_stats(fp);
+
+    if( rate_limiter.enabled() )
+        rate_limiter.dump_stats(fp);
+
+    kept_connections.dump_stats(fp);
+
+#ifdef WITH_OPENSSL
+    if( !user_store.get_users()->empty() )
+    {
+        wsse_auth.dump_stats(fp);
+        http_digest.dump_stats(fp);
+        auth_sessions.dump_stats(fp);
+    }
+
+    if( tls_listener.enabled() )
+        tls_listener.dump_stats(fp);
+#endif
+
+    fflush(fp);
+}
+
+
+
+
+// ------------------------------- VideoSource -------------------------------
+
+
+
+
+tt__VideoSource* VideoSource::get_video_src(struct soap *soap) const
+{
+    tt__VideoSource* video_src = soap_new_tt__VideoSource(soap);
+
+    video_src->token      = token;
+    video_src->Framerate  = framerate;
+    video_src->Resolution = soap_new_req_tt__VideoResolution(soap, width, height);
+    video_src->Imaging    = soap_new_tt__ImagingSettings(soap);
+
+    return video_src;
+}
+
+
+
+bool VideoSource::set_spec(const char *new_val)
+{
+    std::string spec(new_val ? new_val : "");
+    size_t      colon = spec.find(':');
 
-    pSpace2DDescription = soap_new_tt__Space2DDescription (soap);
-    pSpace2DDescription->URI = "http://www.onvif.org/ver10/tptz/ZoomSpaces/TranslationGenericSpace";
-    pSpace2DDescription->XRange = soap_new_set_tt__FloatRange (soap, -1.0, 1.0);
-    pSpace2DDescription->YRange = soap_new_set_tt__FloatRange (soap, -1.0, 1.0);
-    /// Optional element 'tt:RelativePanTiltTranslationSpace' of XML schema type 'tt:Space2DDescription'
-    pOptions->Spaces->RelativePanTiltTranslationSpace.push_back (pSpace2DDescription);
 
+    if( (colon == std::string::npos) || !colon )
+    {
+        str_err = "video source must be like token:WIDTHxHEIGHT[@FPS]";
+        return false;
+    }
 
-    pSpace1DDescription = soap_new_tt__Space1DDescription (soap);
-    pSpace1DDescription->URI = "http://www.onvif.org/ver10/tptz/PanTiltSpaces/PositionGenericSpace";
-    pSpace1DDescription->XRange = soap_new_set_tt__FloatRange (soap, -1.0, 1.0);
-    /// Optional element 'tt:RelativeZoomTranslationSpace' of XML schema type 'tt:Space1DDescription'
-    pOptions->Spaces->RelativeZoomTranslationSpace.push_back (pSpace1DDescription);
 
-    pSpace2DDescription = soap_new_tt__Space2DDescription (soap);
-    pSpace2DDescription->URI = "http://www.onvif.org/ver10/tptz/PanTiltSpaces/VelocityGenericSpace";
-    pSpace2DDescription->XRange = soap_new_set_tt__FloatRange (soap, -1.0, 1.0);
-    pSpace2DDescription->YRange = soap_new_set_tt__FloatRange (soap, -1.0, 1.0);
-    /// Optional element 'tt:ContinuousPanTiltVelocitySpace' of XML schema type 'tt:Space2DDescription'
-    pOptions->Spaces->ContinuousPanTiltVelocitySpace.push_back (pSpace2DDescription);
+    for( size_t i = 0; i < colon; ++i )
+    {
+        if( !isalnum((unsigned char)spec[i]) && !strchr("_-.", spec[i]) )
+        {
+            str_err = "token of video source has wrong chars (allowed: A-Z a-z 0-9 _ - .)";
+            return false;
+        }
+    }
 
-    pSpace1DDescription = soap_new_tt__Space1DDescription (soap);
-    pSpace1DDescription->URI = "http://www.onvif.org/ver10/tptz/ZoomSpaces/VelocityGenericSpace";
-    pSpace1DDescription->XRange = soap_new_set_tt__FloatRange (soap, 0.0, 1.0);
-    /// Optional element 'tt:ContinuousZoomVelocitySpace' of XML schema type 'tt:Space1DDescription'
-    pOptions->Spaces->ContinuousZoomVelocitySpace.push_back (pSpace1DDescription);
 
-    pSpace1DDescription = soap_new_tt__Space1DDescription (soap);
-    pSpace1DDescription->URI = "http://www.onvif.org/ver10/tptz/PanTiltSpaces/GenericSpeedSpace";
-    pSpace1DDescription->XRange = soap_new_set_tt__FloatRange (soap, -1.0, 1.0);
-    /// Optional element 'tt:PanTiltSpeedSpace' of XML schema type 'tt:Space1DDescription'
-    pOptions->Spaces->PanTiltSpeedSpace.push_back (pSpace1DDescription);
+    int   new_width  = 0;
+    int   new_height = 0;
+    float new_fps    = 0;
 
-    pSpace1DDescription = soap_new_tt__Space1DDescription (soap);
-    pSpace1DDescription->URI = "http://www.onvif.org/ver10/tptz/ZoomSpaces/ZoomGenericSpeedSpace";
-    pSpace1DDescription->XRange = soap_new_set_tt__FloatRange (soap, -1.0, 1.0);
-    /// Optional element 'tt:ZoomSpeedSpace' of XML schema type 'tt:Space1DDescription'
-    pOptions->Spaces->ZoomSpeedSpace.push_back (pSpace1DDescription);
+    if( (sscanf(spec.c_str() + colon + 1, "%dx%d@%f", &new_width, &new_height, &new_fps) < 2) ||
+        (new_width < 100) || (new_width >= 10000) || (new_height < 100) || (new_height >= 10000) )
+    {
+        str_err = "size of video source is bad, correct range: 100-10000";
+        return false;
+    }
 
 
-    /// Required element 'tt:PTZTimeout' of XML schema type 'tt:DurationRange'
-    pOptions->PTZTimeout = soap_new_set_tt__DurationRange (soap, 1000, 100000);
+    if( (new_fps < 0) || (new_fps > 1000) )
+    {
+        str_err = "framerate of video source is bad, correct range: 0-1000";
+        return false;
+    }
 
-    /// Optional element 'tt:PTControlDirection' of XML schema type 'tt:PTControlDirectionOptions'
-    pOptions->PTControlDirection = soap_new_tt__PTControlDirectionOptions (soap);
-    pOptions->PTControlDirection->EFlip = soap_new_tt__EFlipOptions (soap);
-    pOptions->PTControlDirection->EFlip->Mode.push_back (tt__EFlipMode__OFF);
-    pOptions->PTControlDirection->EFlip->Mode.push_back (tt__EFlipMode__ON);
-    pOptions->PTControlDirection->Reverse = soap_new_tt__ReverseOptions (soap);
-    pOptions->PTControlDirection->Reverse->Mode.push_back (tt__ReverseMode__OFF);
-    pOptions->PTControlDirection->Reverse->Mode.push_back (tt__ReverseMode__ON);
-    pOptions->PTControlDirection->Reverse->Mode.push_back (tt__ReverseMode__AUTO);
-    return pOptions;
+
+    set(spec.substr(0, colon), new_width, new_height);
+    framerate = new_fps;
+
+    return true;
 }
 
-tptz__Capabilities *ServiceContext::getPTZServiceCapabilities(soap *soap)
-{
-    tptz__Capabilities *capabilities = soap_new_tptz__Capabilities(soap);
 
-    return capabilities;
+
+void VideoSource::set(const std::string &new_token, int new_width, int new_height)
+{
+    token     = new_token;
+    width     = new_width;
+    height    = new_height;
+    framerate = 0;
 }
 
 
@@ -363,9 +1415,9 @@ tt__VideoSourceConfiguration* StreamProfile::get_video_src_cnf(struct soap *soap
 {
     tt__VideoSourceConfiguration* src_cfg = soap_new_tt__VideoSourceConfiguration(soap);
 
-    src_cfg->token       = name;
-    src_cfg->SourceToken = name;
-    src_cfg->Bounds      = soap_new_req_tt__IntRectangle(soap, 0, 0, width, height);
+    src_cfg->token       = get_cfg_token();
+    src_cfg->SourceToken = source;
+    src_cfg->Bounds      = soap_new_req_tt__IntRectangle(soap, bounds_x, bounds_y, bounds_width, bounds_height);
 
     return src_cfg;
 }
@@ -376,23 +1428,106 @@ tt__VideoEncoderConfiguration* StreamProfile::get_video_enc_cfg(struct soap *soa
 {
     tt__VideoEncoderConfiguration* enc_cfg = soap_new_tt__VideoEncoderConfiguration(soap);
 
-    enc_cfg->Name               = name;
-    enc_cfg->token              = name;
+    enc_cfg->Name               = get_cfg_token();
+    enc_cfg->token              = get_cfg_token();
     enc_cfg->Resolution         = soap_new_req_tt__VideoResolution(soap, width, height);
-    enc_cfg->RateControl        = soap_new_req_tt__VideoRateControl(soap, 0, 0, 0);
+    enc_cfg->Quality            = quality;
+    enc_cfg->RateControl        = soap_new_req_tt__VideoRateControl(soap, fps, interval, bitrate);
     enc_cfg->Multicast          = soap_new_tt__MulticastConfiguration(soap);
     enc_cfg->Multicast->Address = soap_new_tt__IPAddress(soap);
     enc_cfg->Encoding           = static_cast<tt__VideoEncoding>(type);
 //    enc_cfg->GuaranteedFrameRate= soap_new_ptr(soap, true);
     enc_cfg->H264               = soap_new_tt__H264Configuration(soap);
-    enc_cfg->H264->GovLength    = 40;
+    enc_cfg->H264->GovLength    = gov;
     enc_cfg->H264->H264Profile  = tt__H264Profile__Main;
 
+    if (type == tt__VideoEncoding__MPEG4) {
+        enc_cfg->MPEG4               = soap_new_tt__Mpeg4Configuration(soap);
+        enc_cfg->MPEG4->GovLength    = gov;
+        enc_cfg->MPEG4->Mpeg4Profile = tt__Mpeg4Profile__SP;
+    }
+
+    return enc_cfg;
+}
+
+
+
+tt__VideoEncoder2Configuration* StreamProfile::get_video_enc2_cfg(struct soap *soap) const
+{
+    tt__VideoEncoder2Configuration* enc_cfg = soap_new_tt__VideoEncoder2Configuration(soap);
+
+    enc_cfg->Name               = get_cfg_token();
+    enc_cfg->token              = get_cfg_token();
+    enc_cfg->Encoding           = get_media2_encoding(type);
+    enc_cfg->Resolution         = soap_new_req_tt__VideoResolution2(soap, width, height);
+    enc_cfg->Quality            = quality;
+    enc_cfg->RateControl        = soap_new_req_tt__VideoRateControl2(soap, fps, bitrate);
+    enc_cfg->Multicast          = soap_new_tt__MulticastConfiguration(soap);
+    enc_cfg->Multicast->Address = soap_new_tt__IPAddress(soap);
+
+    if (type != tt__VideoEncoding__JPEG) {
+        enc_cfg->GovLength = soap_new_ptr(soap, gov);
+    }
+
+    if (type == tt__VideoEncoding__H264) {
+        enc_cfg->Profile  = soap_new_std__string(soap);
+        *enc_cfg->Profile = "Main";
+    }
+
     return enc_cfg;
 }
 
 
 
+// index: tt__VideoEncoding (JPEG, MPEG4, H264)
+static const char *media2_encodings[] = { "JPEG", "MPV4-ES", "H264" };
+
+
+
+const char *StreamProfile::get_media2_encoding(int encoding)
+{
+    if( (encoding < 0) || (encoding >= (int)COUNT_ELEMENTS(media2_encodings)) )
+        return "";
+
+    return media2_encodings[encoding];
+}
+
+
+
+int StreamProfile::find_media2_encoding(const std::string &name)
+{
+    for( size_t i = 0; i < COUNT_ELEMENTS(media2_encodings); ++i )
+    {
+        if( name == media2_encodings[i] )
+            return i;
+    }
+
+    return -1;
+}
+
+
+
+void StreamProfile::get_encoder_ctl(EncCtlConfig &cfg) const
+{
+    memset(&cfg, 0, sizeof(cfg));
+    strncpy(cfg.token, get_cfg_token().c_str(), sizeof(cfg.token) - 1);
+
+    cfg.encoding      = type;
+    cfg.width         = width;
+    cfg.height        = height;
+    cfg.quality       = quality;
+    cfg.fps           = fps;
+    cfg.interval      = interval;
+    cfg.bitrate       = bitrate;
+    cfg.gov           = gov;
+    cfg.bounds_x      = bounds_x;
+    cfg.bounds_y      = bounds_y;
+    cfg.bounds_width  = bounds_width;
+    cfg.bounds_height = bounds_height;
+}
+
+
+
 tt__PTZConfiguration* StreamProfile::get_ptz_cfg(struct soap *soap) const
 {
     ServiceContext* ctx = (ServiceContext*)soap->user;
@@ -406,32 +1541,28 @@ tt__Profile* StreamProfile::get_profile(struct soap *soap) const
 {
     ServiceContext* ctx = (ServiceContext*)soap->user;
 
-    tt__Profile* profile = soap_new_tt__Profile(soap);
-
-    profile->Name  = name;
-    profile->token = name;
-    profile->fixed = soap_new_ptr(soap, true);
-
-    profile->VideoSourceConfiguration  = get_video_src_cnf(soap);
-    profile->VideoEncoderConfiguration = get_video_enc_cfg(soap);
-    if (ctx->get_ptz_node()->enable) {
-        profile->PTZConfiguration = get_ptz_cfg(soap);
-    }
-
-    return profile;
+    return get_profile(soap,
+                       has_config(VIDEO_SOURCE)  ? get_video_src_cnf(soap) : NULL,
+                       has_config(VIDEO_ENCODER) ? get_video_enc_cfg(soap) : NULL,
+                       (ctx->get_ptz_node()->enable && has_config(PTZ)) ? get_ptz_cfg(soap) : NULL);
 }
 
 
 
-tt__VideoSource* StreamProfile::get_video_src(soap *soap) const
+tt__Profile* StreamProfile::get_profile(struct soap *soap, tt__VideoSourceConfiguration *vsc,
+                                        tt__VideoEncoderConfiguration *vec, tt__PTZConfiguration *ptz) const
 {
-    tt__VideoSource* video_src = soap_new_tt__VideoSource(soap);
+    tt__Profile* profile = soap_new_tt__Profile(soap);
 
-    video_src->token      = name;
-    video_src->Resolution = soap_new_req_tt__VideoResolution(soap, width, height);
-    video_src->Imaging    = soap_new_tt__ImagingSettings(soap);
+    profile->Name  = get_title();
+    profile->token = name;
+    profile->fixed = soap_new_ptr(soap, fixed);
 
-    return video_src;
+    profile->VideoSourceConfiguration  = vsc;
+    profile->VideoEncoderConfiguration = vec;
+    profile->PTZConfiguration          = ptz;
+
+    return profile;
 }
 
 
@@ -502,6 +1633,7 @@ bool StreamProfile::set_url(const char *new_val)
 
 
     url = new_val;
+    url_tpl.compile(new_val);
     return true;
 }
 
@@ -517,6 +1649,37 @@ bool StreamProfile::set_snapurl(const char *new_val)
 
 
     snapurl = new_val;
+    snapurl_tpl.compile(new_val);
+    return true;
+}
+
+
+
+bool StreamProfile::set_snapshm(const char *new_val)
+{
+    if( !new_val || (new_val[0] != '/') || !new_val[1] )
+    {
+        str_err = "shm name must be like /name";
+        return false;
+    }
+
+
+    snapshm = new_val;
+    return true;
+}
+
+
+
+bool StreamProfile::set_snapraw(const char *new_val)
+{
+    if( !new_val || !new_val[0] )
+    {
+        str_err = "raw frame is empty";
+        return false;
+    }
+
+
+    snapraw = new_val; // checked by the snapshot proxy, size of frame is not known yet
     return true;
 }
 
@@ -545,15 +1708,243 @@ bool StreamProfile::set_type(const char *new_val)
 
 
 
+bool StreamProfile::set_source(const char *new_val)
+{
+    if( !new_val || !new_val[0] )
+    {
+        str_err = "video source is empty";
+        return false;
+    }
+
+
+    source = new_val;
+    return true;
+}
+
+
+
+void StreamProfile::set_dynamic(const std::string &new_title)
+{
+    title   = new_title;
+    fixed   = false;
+    configs = 0;
+}
+
+
+
+void StreamProfile::add_video_config(Config cfg, const StreamProfile &owner)
+{
+    if( cfg_token != owner.name )
+        configs &= ~(VIDEO_SOURCE | VIDEO_ENCODER); // other source, both are changed
+
+
+    cfg_token   = owner.name;
+    source      = owner.source;
+    caps        = owner.caps;
+    width       = owner.width;
+    height      = owner.height;
+    url         = owner.url;
+    snapurl     = owner.snapurl;
+    url_tpl     = owner.url_tpl;
+    snapurl_tpl = owner.snapurl_tpl;
+    snapshm     = owner.snapshm;
+    snapraw     = owner.snapraw;
+    type        = owner.type;
+
+    quality       = owner.quality;
+    fps           = owner.fps;
+    interval      = owner.interval;
+    bitrate       = owner.bitrate;
+    gov           = owner.gov;
+    bounds_x      = owner.bounds_x;
+    bounds_y      = owner.bounds_y;
+    bounds_width  = owner.bounds_width;
+    bounds_height = owner.bounds_height;
+
+    configs |= cfg;
+}
+
+
+
+void StreamProfile::remove_config(Config cfg)
+{
+    configs &= ~cfg;
+
+    if( configs & (VIDEO_SOURCE | VIDEO_ENCODER) )
+        return;
+
+
+    // no video - no stream
+    std::string old_name  = name;
+    std::string old_title = title;
+    unsigned    old_cfgs  = configs;
+
+    clear();
+
+    name    = old_name;
+    title   = old_title;
+    fixed   = false;
+    configs = old_cfgs;
+}
+
+
+
+// value which is already set is accepted as is (clients send back the whole configuration)
+static bool check_range(const EncoderCaps::Range &range, int value, int cur_value,
+                        const char *param, std::string &str_err)
+{
+    if( (value == cur_value) || ((value >= range.min) && (value <= range.max)) )
+        return true;
+
+
+    str_err = std::string(param) + ": " + std::to_string(value) + " is out of range " +
+              std::to_string(range.min) + "-" + std::to_string(range.max);
+    return false;
+}
+
+
+
+bool StreamProfile::set_video_enc_cfg(const tt__VideoEncoderConfiguration &cfg)
+{
+    if( cfg.Encoding != type )
+    {
+        str_err = "encoding can't be changed";
+        return false;
+    }
+
+
+    EncoderCaps all = caps.resolve(type, width, height);
+
+    int new_width    = cfg.Resolution ? cfg.Resolution->Width  : width;
+    int new_height   = cfg.Resolution ? cfg.Resolution->Height : height;
+    int new_quality  = (int)(cfg.Quality + 0.5f);
+    int new_fps      = cfg.RateControl ? cfg.RateControl->FrameRateLimit   : fps;
+    int new_interval = cfg.RateControl ? cfg.RateControl->EncodingInterval : interval;
+    int new_bitrate  = cfg.RateControl ? cfg.RateControl->BitrateLimit     : bitrate;
+    int new_gov      = gov;
+
+    if( (type == tt__VideoEncoding__H264) && cfg.H264 )
+        new_gov = cfg.H264->GovLength;
+
+    if( (type == tt__VideoEncoding__MPEG4) && cfg.MPEG4 )
+        new_gov = cfg.MPEG4->GovLength;
+
+
+    bool res_found = false;
+
+    for( size_t i = 0; i < all.resolutions.size(); ++i )
+    {
+        if( (all.resolutions[i].width == new_width) && (all.resolutions[i].height == new_height) )
+            res_found = true;
+    }
+
+    if( !res_found )
+    {
+        str_err = "resolution: " + std::to_string(new_width) + "x" + std::to_string(new_height) +
+                  " is not supported";
+        return false;
+    }
+
+
+    // 0 - not limited (encoder default) for framerate and bitrate
+    if( !check_range(all.quality, new_quality, quality, "quality", str_err)                   ||
+        (new_fps && !check_range(all.fps, new_fps, fps, "framerate", str_err))                ||
+        !check_range(all.interval, new_interval, interval, "encoding interval", str_err)     ||
+        (new_bitrate && !check_range(all.bitrate, new_bitrate, bitrate, "bitrate", str_err)) ||
+        !check_range(all.gov, new_gov, gov, "GOV length", str_err) )
+        return false;
+
+
+    width    = new_width;
+    height   = new_height;
+    quality  = new_quality;
+    fps      = new_fps;
+    interval = new_interval;
+    bitrate  = new_bitrate;
+    gov      = new_gov;
+
+    return true;
+}
+
+
+
+bool StreamProfile::set_video_src_cfg(const tt__VideoSourceConfiguration &cfg, const VideoSource &src)
+{
+    if( cfg.SourceToken != source )
+    {
+        str_err = "video source can't be changed";
+        return false;
+    }
+
+
+    if( !cfg.Bounds )
+    {
+        str_err = "bounds are not set";
+        return false;
+    }
+
+
+    const tt__IntRectangle &bounds = *cfg.Bounds;
+
+    if( (bounds.x < 0) || (bounds.y < 0) || (bounds.width <= 0) || (bounds.height <= 0) ||
+        (bounds.x + bounds.width  > src.get_width()) ||
+        (bounds.y + bounds.height > src.get_height()) )
+    {
+        str_err = "bounds are out of video source: " + source;
+        return false;
+    }
+
+
+    bounds_x      = bounds.x;
+    bounds_y      = bounds.y;
+    bounds_width  = bounds.width;
+    bounds_height = bounds.height;
+
+    return true;
+}
+
+
+
+void StreamProfile::reset_bounds(const VideoSource &src)
+{
+    bounds_x      = 0;
+    bounds_y      = 0;
+    bounds_width  = src.get_width();
+    bounds_height = src.get_height();
+}
+
+
+
 void StreamProfile::clear()
 {
     name.clear();
+    title.clear();
+    cfg_token.clear();
+    source.clear();
+    caps.clear();
+    fixed   = true;
+    configs = VIDEO_SOURCE | VIDEO_ENCODER | PTZ;
     url.clear();
     snapurl.clear();
+    url_tpl.clear();
+    snapurl_tpl.clear();
+    snapshm.clear();
+    snapraw.clear();
 
     width  = -1;
     height = -1;
     type   = -1;
+
+    quality  = 0;
+    fps      = 0;
+    interval = 0;
+    bitrate  = 0;
+    gov      = 40;
+
+    bounds_x      = 0;
+    bounds_y      = 0;
+    bounds_width  = 0;
+    bounds_height = 0;
 }
 
 
@@ -587,7 +1978,7 @@ void PTZNode::clear()
 
 
 
-bool PTZNode::set_str_value(const char* new_val, std::string& value)
+bool PTZNode::set_tpl_value(const char* new_val, UriTemplate& value)
 {
     if(!new_val)
     {
@@ -596,6 +1987,32 @@ bool PTZNode::set_str_value(const char* new_val, std::string& value)
     }
 
 
-    value = new_val;
+    value.compile(new_val);
+    return true;
+}
+
+
+
+bool PTZNode::set_move_continuous(const char *new_val)
+{
+    if( !set_tpl_value(new_val, move_continuous) )
+        return false;
+
+
+    // Old configs give only the base URL, the vector was always appended as query
+    if( !move_continuous.has_field(UriTemplate::X)             &&
+        !move_continuous.has_field(UriTemplate::Y)             &&
+        !move_continuous.has_field(UriTemplate::Z)             &&
+        !move_continuous.has_field(UriTemplate::ONLY_PAN_TILT) &&
+        !move_continuous.has_field(UriTemplate::ONLY_ZOOM) )
+    {
+        // the base URL can have its own query, the vector is added to it
+        std::string src = move_continuous.get_src();
+        src += (src.find('?') == std::string::npos) ? '?' : '&';
+        src += "x=%x&y=%y&z=%z&onlySendPanTilt=%P&onlySendZoom=%Z";
+        move_continuous.compile(src.c_str());
+    }
+
+
     return true;
 }
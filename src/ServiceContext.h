@@ -4,28 +4,107 @@
 #include <string>
 #include <vector>
 #include <map>
+#include <memory>
+#include <mutex>
+#include <functional>
 
 #include "soapH.h"
 #include "eth_dev_param.h"
+#include "ptz_backend.h"
+#include "uri_template.h"
+#include "snapshot_proxy.h"
+#include "profile_store.h"
+#include "encoder_caps.h"
+#include "encoder_control.h"
+#include "event_broker.h"
+#include "pullpoint_waiters.h"
+#include "notify_delivery.h"
+#include "event_ingest.h"
+#include "discovery_responder.h"
+#include "rate_limiter.h"
+#include "access_policy.h"
+#include "kept_connections.h"
+
+#ifdef WITH_OPENSSL
+#include "wsse_auth.h"
+#include "http_digest.h"
+#include "auth_sessions.h"
+#include "tls_listener.h"
+#endif
+
+class VideoSource
+{
+public:
+    VideoSource() : width(0), height(0), framerate(0) {}
+
+    const std::string &get_token(void) const { return token; }
+    int get_width(void) const { return width; }
+    int get_height(void) const { return height; }
+    float get_framerate(void) const { return framerate; }
+
+    tt__VideoSource *get_video_src(struct soap *soap) const;
+
+    //methods for parsing opt from cmd
+    bool set_spec(const char *new_val); // token:WIDTHxHEIGHT[@FPS]
+    void set(const std::string &new_token, int new_width, int new_height);
+
+    std::string get_str_err() const { return str_err; }
+    const char *get_cstr_err() const { return str_err.c_str(); }
+
+private:
+    std::string token; // it is the token for the Imaging service too
+    int width;
+    int height;
+    float framerate;
+
+    std::string str_err;
+};
 
 class StreamProfile
 {
 public:
     StreamProfile() { clear(); }
 
-    std::string get_name(void) const { return name; }
+    // configurations of the profile, fixed profiles have all of them
+    enum Config
+    {
+        VIDEO_SOURCE  = 1 << 0,
+        VIDEO_ENCODER = 1 << 1,
+        PTZ           = 1 << 2
+    };
+
+    const std::string &get_name(void) const { return name; }
+    const std::string &get_title(void) const { return title.empty() ? name : title; }
+    const std::string &get_cfg_token(void) const { return cfg_token.empty() ? name : cfg_token; }
+    const std::string &get_source(void) const { return source; }
+    const EncoderCaps &get_caps(void) const { return caps; }
+    bool is_fixed(void) const { return fixed; }
+    bool has_config(Config cfg) const { return (configs & cfg) != 0; }
     int get_width(void) const { return width; }
     int get_height(void) const { return height; }
     std::string get_url(void) const { return url; }
     std::string get_snapurl(void) const { return snapurl; }
+    const UriTemplate &get_url_tpl(void) const { return url_tpl; }
+    const UriTemplate &get_snapurl_tpl(void) const { return snapurl_tpl; }
+    std::string get_snapshm(void) const { return snapshm; }
+    std::string get_snapraw(void) const { return snapraw; }
+    bool has_snapshot(void) const { return !snapurl.empty() || !snapshm.empty() || !snapraw.empty(); }
     int get_type(void) const { return type; }
 
-    tt__Profile *get_profile(struct soap *soap) const;
-    tt__VideoSource *get_video_src(struct soap *soap) const;
+    // names of encodings in Media2 (MIME subtypes), -1 - unknown name
+    static const char *get_media2_encoding(int encoding);
+    static int find_media2_encoding(const std::string &name);
 
+    tt__Profile *get_profile(struct soap *soap) const;
+    // profile with the given configurations (can be shared by many profiles)
+    tt__Profile *get_profile(struct soap *soap, tt__VideoSourceConfiguration *vsc,
+                             tt__VideoEncoderConfiguration *vec, tt__PTZConfiguration *ptz) const;
     tt__VideoSourceConfiguration *get_video_src_cnf(struct soap *soap) const;
     tt__VideoEncoderConfiguration *get_video_enc_cfg(struct soap *soap) const;
+    tt__VideoEncoder2Configuration *get_video_enc2_cfg(struct soap *soap) const; // Media2
     tt__PTZConfiguration *get_ptz_cfg(struct soap *soap) const;
+    // values of the configurations for the encoder (see EncoderControl)
+    void get_encoder_ctl(EncCtlConfig &cfg) const;
 
     //methods for parsing opt from cmd
     bool set_name(const char *new_val);
@@ -33,7 +112,27 @@ public:
     bool set_height(const char *new_val);
     bool set_url(const char *new_val);
     bool set_snapurl(const char *new_val);
+    bool set_snapshm(const char *new_val);
+    bool set_snapraw(const char *new_val);
     bool set_type(const char *new_val);
+    bool set_source(const char *new_val);
+    bool set_resolutions(const char *new_val)   { return check_caps(caps.set_resolutions(new_val)); }
+    bool set_fps_range(const char *new_val)     { return check_caps(caps.set_fps_range(new_val)); }
+    bool set_gov_range(const char *new_val)     { return check_caps(caps.set_gov_range(new_val)); }
+    bool set_bitrate_range(const char *new_val) { return check_caps(caps.set_bitrate_range(new_val)); }
+
+    // profile created by the client, it has no configurations yet
+    void set_dynamic(const std::string &new_title);
+
+    // take the video configuration (source and encoder are the same fixed profile)
+    void add_video_config(Config cfg, const StreamProfile &owner);
+    void add_ptz_config(void) { configs |= PTZ; }
+    void remove_config(Config cfg);
+
+    // Media SetVideo*Configuration, values are checked with caps of the profile
+    bool set_video_enc_cfg(const tt__VideoEncoderConfiguration &cfg);
+    bool set_video_src_cfg(const tt__VideoSourceConfiguration &cfg, const VideoSource &src);
+    void reset_bounds(const VideoSource &src); // whole source
 
     std::string get_str_err() const { return str_err; }
     const char *get_cstr_err() const { return str_err.c_str(); }
@@ -43,13 +142,36 @@ public:
 
 private:
     std::string name;
+    std::string title;
+    std::string cfg_token;
+    std::string source; // token of VideoSource
+    bool fixed;
+    unsigned configs;
     int width;
     int height;
     std::string url;
     std::string snapurl;
+    UriTemplate url_tpl;
+    UriTemplate snapurl_tpl;
+    std::string snapshm;
+    std::string snapraw;
     int type;
+    EncoderCaps caps;
+
+    // current values of the configurations, 0 - not set (encoder default)
+    int quality;
+    int fps;
+    int interval;
+    int bitrate;
+    int gov;
+    int bounds_x;
+    int bounds_y;
+    int bounds_width;
+    int bounds_height;
 
     std::string str_err;
+
+    bool check_caps(bool ok) { if( !ok ) str_err = caps.get_str_err(); return ok; }
 };
 
 class PTZNode
@@ -58,24 +180,16 @@ public:
     PTZNode() { clear(); }
 
     bool enable;
-    std::string get_move_stop(void) const { return move_stop; }
-    std::string get_goto_preset(void) const { return goto_preset; }
-    std::string get_goto_home(void) const { return goto_home; }
-    std::string get_move_continuous(float x, float y, float z, bool onlySendPanTilt, bool onlySendZoom) const
-    {
-        return move_continuous +
-               std::string("?x=") + std::to_string(x) +
-               std::string("&y=") + std::to_string(y) +
-               std::string("&z=") + std::to_string(z) +
-               std::string("&onlySendPanTilt=") + std::string(onlySendPanTilt ? "true" : "false") +
-               std::string("&onlySendZoom=") + std::string(onlySendZoom ? "true" : "false");
-    }
+    const UriTemplate &get_move_stop(void) const { return move_stop; }
+    const UriTemplate &get_goto_preset(void) const { return goto_preset; }
+    const UriTemplate &get_goto_home(void) const { return goto_home; }
+    const UriTemplate &get_move_continuous(void) const { return move_continuous; }
 
     //methods for parsing opt from cmd
-    bool set_move_stop(const char *new_val) { return set_str_value(new_val, move_stop); }
-    bool set_goto_preset(const char *new_val) { return set_str_value(new_val, goto_preset); }
-    bool set_goto_home(const char *new_val) { return set_str_value(new_val, goto_home); }
-    bool set_move_continuous(const char *new_val) { return set_str_value(new_val, move_continuous); }
+    bool set_move_stop(const char *new_val) { return set_tpl_value(new_val, move_stop); }
+    bool set_goto_preset(const char *new_val) { return set_tpl_value(new_val, goto_preset); }
+    bool set_goto_home(const char *new_val) { return set_tpl_value(new_val, goto_home); }
+    bool set_move_continuous(const char *new_val);
 
     std::string get_str_err() const { return str_err; }
     const char *get_cstr_err() const { return str_err.c_str(); }
@@ -83,22 +197,51 @@ public:
     void clear(void);
 
 private:
-    std::string move_stop;
-    std::string goto_preset;
-    std::string goto_home;
+    UriTemplate move_stop;
+    UriTemplate goto_preset;
+    UriTemplate goto_home;
 
-    std::string move_continuous;
+    UriTemplate move_continuous;
 
     std::string str_err;
 
-    bool set_str_value(const char *new_val, std::string &value);
+    bool set_tpl_value(const char *new_val, UriTemplate &value);
 };
 
+typedef std::map<std::string, std::shared_ptr<const StreamProfile>> ProfileMap;
+typedef std::shared_ptr<const ProfileMap> ProfileMapPtr;
+
 class ServiceContext
 {
 public:
     ServiceContext();
 
+    static const size_t MAX_DYNAMIC_PROFILES = 32;
+
+    // gSOAP objects of one set of profiles, they are built once for the set and
+    // shared by all responses (configurations are shared by the profiles too)
+    struct ProfilesCache
+    {
+        ProfilesCache() : soap(NULL), ptz_cfg(NULL) {}
+
+        ProfileMapPtr src;  // set of profiles the objects are built for
+        struct soap  *soap; // context that owns the objects
+
+        std::map<std::string, tt__Profile *>                   profiles;
+        std::map<std::string, tt__VideoSource *>               video_srcs; // by token of source
+        std::map<std::string, tt__VideoSourceConfiguration *>  video_src_cfgs;
+        std::map<std::string, tt__VideoEncoderConfiguration *> video_enc_cfgs;
+
+        // options by token of configuration, "" - options of all configurations
+        std::map<std::string, tt__VideoSourceConfigurationOptions *>  video_src_opts;
+        std::map<std::string, tt__VideoEncoderConfigurationOptions *> video_enc_opts;
+
+        // Media2 has own encoder types, other configurations are the same objects
+        std::map<std::string, tt__VideoEncoder2Configuration *> video_enc2_cfgs;
+        std::map<std::string, std::vector<tt__VideoEncoder2ConfigurationOptions *>> video_enc2_opts;
+        tt__PTZConfiguration *ptz_cfg;
+    };
+
     int port;
     std::string user;
     std::string password;
@@ -115,39 +258,120 @@ public:
     std::vector<Eth_Dev_Param> eth_ifs; //ethernet interfaces
 
     std::string getServerIpFromClientIp(uint32_t client_ip) const;
-    std::string getXAddr(struct soap *soap) const;
+    void getServerIpFromClientIp(uint32_t client_ip, char *server_ip) const; // INET_ADDRSTRLEN
+    std::string getXAddr(struct soap *soap) const; // https:// for the clients of HTTPS
+    bool is_tls_enabled(void) const;
+    int get_tls_port(void) const; // 0 if HTTPS is not served
 
     std::string get_str_err() const { return str_err; }
     const char *get_cstr_err() const { return str_err.c_str(); }
 
     bool add_profile(const StreamProfile &profile);
 
-    std::string get_stream_uri(const std::string &profile_url, uint32_t client_ip) const;
-    std::string get_snapshot_uri(const std::string &profile_url, uint32_t client_ip) const;
-
-    const std::map<std::string, StreamProfile> &get_profiles(void) { return profiles; }
+    // sensors of the device, they are set before the profiles which use them
+    bool add_video_source(const VideoSource &source);
+    const VideoSource *get_video_source(const std::string &token) const;
+
+    // profiles managed by the clients (Media CreateProfile etc.)
+    bool create_profile(std::string &token, const std::string &title);
+    bool delete_profile(const std::string &token);
+    bool add_profile_config(const std::string &token, StreamProfile::Config cfg, const std::string &cfg_token);
+    bool remove_profile_config(const std::string &token, StreamProfile::Config cfg);
+    bool load_profiles(void);
+
+    // users of the store (opt users_file) or the Administrator of opt user
+    bool load_users(void);
+
+    // Media SetVideo*Configuration: change the configuration of the fixed profile
+    // (and of the profiles which use it) and publish it to the encoder
+    bool set_video_enc_cfg(const tt__VideoEncoderConfiguration &cfg);
+    bool set_video_src_cfg(const tt__VideoSourceConfiguration &cfg);
+    bool open_encoder_control(void);
+
+    // render URI of the profile into buf, returns length or -1
+    int get_stream_uri(const StreamProfile &profile, uint32_t client_ip, char *buf, size_t size) const;
+    int get_snapshot_uri(const StreamProfile &profile, uint32_t client_ip, char *buf, size_t size) const;
+    // snapurl of the profile (source of the snapshot proxy)
+    int get_snapshot_src_uri(const StreamProfile &profile, uint32_t client_ip, char *buf, size_t size) const;
+
+    // current set of profiles, it is never changed (a change publishes new set),
+    // so the caller can use it without locks while it holds the pointer.
+    // std::atomic_load of shared_ptr is not lock-free (libstdc++ takes a mutex
+    // from its pool for the copy), but readers never wait for profiles_mtx
+    ProfileMapPtr get_profiles(void) const { return std::atomic_load(&profiles); }
+    // objects of the current set (rebuilt after a change), for the main loop only
+    const ProfilesCache &get_profiles_cache(void);
     PTZNode *get_ptz_node(void) { return &ptz_node; }
+    PTZBackend *get_ptz_backend(void) { return &ptz_backend; }
+    SnapshotProxy *get_snapshot_proxy(void) { return &snapshot_proxy; }
+    ProfileStore *get_profile_store(void) { return &profile_store; }
+    EncoderControl *get_encoder_control(void) { return &encoder_control; }
+    EventBroker *get_event_broker(void) { return &event_broker; }
+    PullPointWaiters *get_pullpoint_waiters(void) { return &pullpoint_waiters; }
+    NotifyDelivery *get_notify_delivery(void) { return &notify_delivery; }
+    EventIngest *get_event_ingest(void) { return &event_ingest; }
+    DiscoveryResponder *get_discovery(void) { return &discovery; }
+    RateLimiter *get_rate_limiter(void) { return &rate_limiter; }
+    KeptConnections *get_kept_connections(void) { return &kept_connections; }
+#ifdef WITH_OPENSSL
+    WsseAuth *get_wsse_auth(void) { return &wsse_auth; }
+    HttpDigest *get_http_digest(void) { return &http_digest; }
+    UserStore *get_user_store(void) { return &user_store; }
+    AuthSessions *get_auth_sessions(void) { return &auth_sessions; }
+    TlsListener *get_tls_listener(void) { return &tls_listener; }
+#endif
     tt__PTZConfiguration *GetPTZConfiguration(struct soap *soap);
     tt__PTZConfigurationOptions *GetPTZConfigurationOptions(struct soap *soap);
 
     // service capabilities
     tds__DeviceServiceCapabilities *getDeviceServiceCapabilities(struct soap *soap);
     trt__Capabilities *getMediaServiceCapabilities(struct soap *soap);
+    tr2__Capabilities2 *getMedia2ServiceCapabilities(struct soap *soap);
     tptz__Capabilities *getPTZServiceCapabilities(struct soap *soap);
+    tev__Capabilities *getEventServiceCapabilities(struct soap *soap);
     //        timg__Capabilities* getImagingServiceCapabilities  (struct soap* soap);
     //        trc__Capabilities*  getRecordingServiceCapabilities(struct soap* soap);
     //        tse__Capabilities*  getSearchServiceCapabilities   (struct soap* soap);
     //        trv__Capabilities*  getReceiverServiceCapabilities (struct soap* soap);
     //        trp__Capabilities*  getReplayServiceCapabilities   (struct soap* soap);
-    //        tev__Capabilities*  getEventServiceCapabilities    (struct soap* soap);
     //        tls__Capabilities*  getDisplayServiceCapabilities  (struct soap* soap);
     //        tmd__Capabilities*  getDeviceIOServiceCapabilities (struct soap* soap);
 
+    void dump_stats(FILE *fp) const;
+
 private:
-    std::map<std::string, StreamProfile> profiles;
+    std::map<std::string, VideoSource> video_sources; // not changed after startup
+    ProfileMapPtr profiles;
+    std::mutex profiles_mtx; // writers only
     PTZNode ptz_node;
+    PTZBackend ptz_backend;
+    SnapshotProxy snapshot_proxy;
+    ProfileStore profile_store;
+    EncoderControl encoder_control;
+    EventBroker event_broker;
+    PullPointWaiters pullpoint_waiters;
+    NotifyDelivery notify_delivery;
+    EventIngest event_ingest;
+    DiscoveryResponder discovery;
+    RateLimiter rate_limiter;
+    KeptConnections kept_connections;
+#ifdef WITH_OPENSSL
+    WsseAuth wsse_auth;
+    HttpDigest http_digest;
+    UserStore user_store;
+    AuthSessions auth_sessions;
+    TlsListener tls_listener;
+#endif
+    ProfilesCache profiles_cache;
 
     std::string str_err;
+
+    bool update_profiles(const std::function<bool(ProfileMap &)> &fn, bool persist);
+    bool check_profile_token(const std::string &token);
+    void publish_encoder_ctl(const StreamProfile &profile);
+
+    int render_uri(const UriTemplate &tpl, const StreamProfile &profile, uint32_t client_ip,
+                   char *buf, size_t size) const;
 };
 
 #endif // SERVICECONTEXT_H
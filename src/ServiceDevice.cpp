@@ -54,6 +54,30 @@ int DeviceBindingService::GetServices(_tds__GetServices *tds__GetServices, _tds_
         tds__GetServicesResponse.Service.back()->Capabilities->__any = soap_dom_element(this->soap, NULL, "trt:Capabilities", capabilities, capabilities->soap_type());
     }
 
+
+    tds__GetServicesResponse.Service.push_back(soap_new_tds__Service(this->soap));
+    tds__GetServicesResponse.Service.back()->Namespace  = "http://www.onvif.org/ver20/media/wsdl";
+    tds__GetServicesResponse.Service.back()->XAddr      = XAddr + "/onvif/media2_service";
+    tds__GetServicesResponse.Service.back()->Version    = soap_new_req_tt__OnvifVersion(this->soap, 20, 12);
+    if (tds__GetServices->IncludeCapability)
+    {
+        tds__GetServicesResponse.Service.back()->Capabilities        = soap_new__tds__Service_Capabilities(this->soap);
+        tr2__Capabilities2 *capabilities                             = ctx->getMedia2ServiceCapabilities(this->soap);
+        tds__GetServicesResponse.Service.back()->Capabilities->__any = soap_dom_element(this->soap, NULL, "tr2:Capabilities", capabilities, capabilities->soap_type());
+    }
+
+
+    tds__GetServicesResponse.Service.push_back(soap_new_tds__Service(this->soap));
+    tds__GetServicesResponse.Service.back()->Namespace  = "http://www.onvif.org/ver10/events/wsdl";
+    tds__GetServicesResponse.Service.back()->XAddr      = XAddr + "/onvif/event_service";
+    tds__GetServicesResponse.Service.back()->Version    = soap_new_req_tt__OnvifVersion(this->soap, 20, 12);
+    if (tds__GetServices->IncludeCapability)
+    {
+        tds__GetServicesResponse.Service.back()->Capabilities        = soap_new__tds__Service_Capabilities(this->soap);
+        tev__Capabilities *capabilities                              = ctx->getEventServiceCapabilities(this->soap);
+        tds__GetServicesResponse.Service.back()->Capabilities->__any = soap_dom_element(this->soap, NULL, "tev:Capabilities", capabilities, capabilities->soap_type());
+    }
+
     if (ctx->get_ptz_node()->enable) {
         tds__GetServicesResponse.Service.push_back(soap_new_tds__Service(this->soap));
         tds__GetServicesResponse.Service.back()->Namespace  = "http://www.onvif.org/ver20/ptz/wsdl";
@@ -225,14 +249,35 @@ int DeviceBindingService::RemoveScopes(_tds__RemoveScopes *tds__RemoveScopes, _t
 
 int DeviceBindingService::GetDiscoveryMode(_tds__GetDiscoveryMode *tds__GetDiscoveryMode, _tds__GetDiscoveryModeResponse &tds__GetDiscoveryModeResponse)
 {
-    SOAP_EMPTY_HANDLER(tds__GetDiscoveryMode, "Device");
+    UNUSED(tds__GetDiscoveryMode);
+    DEBUG_MSG("Device: %s\n", __FUNCTION__);
+
+
+    ServiceContext* ctx = (ServiceContext*)this->soap->user;
+
+    tds__GetDiscoveryModeResponse.DiscoveryMode = ctx->get_discovery()->is_discoverable() ?
+                                                  tt__DiscoveryMode__Discoverable : tt__DiscoveryMode__NonDiscoverable;
+
+    return SOAP_OK;
 }
 
 
 
 int DeviceBindingService::SetDiscoveryMode(_tds__SetDiscoveryMode *tds__SetDiscoveryMode, _tds__SetDiscoveryModeResponse &tds__SetDiscoveryModeResponse)
 {
-    SOAP_EMPTY_HANDLER(tds__SetDiscoveryMode, "Device");
+    UNUSED(tds__SetDiscoveryModeResponse);
+    DEBUG_MSG("Device: %s\n", __FUNCTION__);
+
+
+    ServiceContext* ctx = (ServiceContext*)this->soap->user;
+
+    // the discovery of the external daemon (wsdd) can't be controlled
+    if( !ctx->get_discovery()->enable )
+        return soap_sender_fault(this->soap, "WS-Discovery is not served by the daemon (see opt discovery)", NULL);
+
+    ctx->get_discovery()->set_discoverable(tds__SetDiscoveryMode->DiscoveryMode == tt__DiscoveryMode__Discoverable);
+
+    return SOAP_OK;
 }
 
 
@@ -279,6 +324,83 @@ int DeviceBindingService::SetRemoteUser(_tds__SetRemoteUser *tds__SetRemoteUser,
 
 
 
+#ifdef WITH_OPENSSL
+
+static bool has_administrator(const UserMap &users)
+{
+    for( auto it = users.cbegin(); it != users.cend(); ++it )
+    {
+        if( it->second.level == USER_LEVEL_ADMINISTRATOR )
+            return true;
+    }
+
+    return false;
+}
+
+
+
+// checks the fields of tt:User, returns the fault or SOAP_OK
+static int check_user(struct soap *soap, const tt__User *user, bool need_password)
+{
+    if( !user || user->Username.empty() )
+        return soap_sender_fault_subcode(soap, "ter:UsernameMissing", "Username is missing", NULL);
+
+    if( user->Username.size() > UserStore::MAX_NAME_LEN )
+        return soap_sender_fault_subcode(soap, "ter:UsernameTooLong", "Username is too long", NULL);
+
+    for( size_t i = 0; i < user->Username.size(); ++i )
+    {
+        unsigned char c = user->Username[i];
+
+        if( (c < 0x20) || (c == 0x7F) )
+            return soap_sender_fault_subcode(soap, "ter:InvalidArgVal", "Username has control characters", NULL);
+    }
+
+    if( user->Password && (user->Password->size() > UserStore::MAX_PASSWORD_LEN) )
+        return soap_sender_fault_subcode(soap, "ter:PasswordTooLong", "Password is too long", NULL);
+
+    if( need_password && (!user->Password || user->Password->empty()) )
+        return soap_sender_fault_subcode(soap, "ter:PasswordTooWeak", "Password is too weak", NULL);
+
+    if( user->UserLevel == tt__UserLevel__Anonymous )
+        return soap_sender_fault_subcode(soap, "ter:AnonymousNotAllowed", "Anonymous users are not allowed", NULL);
+
+    if( (user->UserLevel != tt__UserLevel__Administrator) && (user->UserLevel != tt__UserLevel__Operator) &&
+        (user->UserLevel != tt__UserLevel__User) )
+        return soap_sender_fault(soap, "Unknown UserLevel", NULL);
+
+    return SOAP_OK;
+}
+
+
+
+// the fault of the update or the error of the store
+static int update_users(struct soap *soap, UserStore *store, const std::function<int(UserMap &)> &fn)
+{
+    int err = SOAP_OK;
+
+    bool ok = store->update([&](UserMap &users)
+    {
+        err = fn(users);
+        if( err == SOAP_OK && !users.empty() && !has_administrator(users) )
+            err = soap_sender_fault_subcode(soap, "ter:FixedUser", "There must be an Administrator", NULL);
+
+        return err == SOAP_OK;
+    });
+
+    if( err != SOAP_OK )
+        return err;
+
+    if( !ok )
+        return soap_receiver_fault(soap, soap_strdup(soap, store->get_cstr_err()), NULL);
+
+    return SOAP_OK;
+}
+
+#endif
+
+
+
 int DeviceBindingService::GetUsers(_tds__GetUsers *tds__GetUsers, _tds__GetUsersResponse &tds__GetUsersResponse)
 {
     UNUSED(tds__GetUsers);
@@ -286,11 +408,22 @@ int DeviceBindingService::GetUsers(_tds__GetUsers *tds__GetUsers, _tds__GetUsers
 
     ServiceContext* ctx = (ServiceContext*)this->soap->user;
 
+#ifdef WITH_OPENSSL
+    UserMapPtr users = ctx->get_user_store()->get_users();
+
+    for( auto it = users->cbegin(); it != users->cend(); ++it )
+    {
+        tds__GetUsersResponse.User.push_back(soap_new_tt__User(this->soap));
+        tds__GetUsersResponse.User.back()->Username  = it->second.name;
+        tds__GetUsersResponse.User.back()->UserLevel = (enum tt__UserLevel)it->second.level;
+    }
+#else
     if( !ctx->user.empty() )
     {
         tds__GetUsersResponse.User.push_back(soap_new_tt__User(this->soap));
         tds__GetUsersResponse.User.back()->Username = ctx->user;
     }
+#endif
 
     return SOAP_OK;
 }
@@ -299,21 +432,112 @@ int DeviceBindingService::GetUsers(_tds__GetUsers *tds__GetUsers, _tds__GetUsers
 
 int DeviceBindingService::CreateUsers(_tds__CreateUsers *tds__CreateUsers, _tds__CreateUsersResponse &tds__CreateUsersResponse)
 {
+#ifdef WITH_OPENSSL
+    UNUSED(tds__CreateUsersResponse);
+    DEBUG_MSG("Device: %s\n", __FUNCTION__);
+
+    ServiceContext* ctx = (ServiceContext*)this->soap->user;
+
+    for( size_t i = 0; i < tds__CreateUsers->User.size(); ++i )
+    {
+        if( check_user(this->soap, tds__CreateUsers->User[i], true) )
+            return this->soap->error;
+    }
+
+
+    // all users are created or none
+    return update_users(this->soap, ctx->get_user_store(), [&](UserMap &users)
+    {
+        for( size_t i = 0; i < tds__CreateUsers->User.size(); ++i )
+        {
+            const tt__User *src = tds__CreateUsers->User[i];
+
+            if( users.count(src->Username) )
+                return soap_sender_fault_subcode(this->soap, "ter:UsernameClash", "Username already exists", NULL);
+
+            if( users.size() >= UserStore::MAX_USERS )
+                return soap_receiver_fault_subcode(this->soap, "ter:TooManyUsers", "Too many users", NULL);
+
+            User &user = users[src->Username];
+            user.name  = src->Username;
+            user.level = (UserLevel)src->UserLevel;
+            UserStore::set_password(user, *src->Password);
+        }
+
+        return SOAP_OK;
+    });
+#else
     SOAP_EMPTY_HANDLER(tds__CreateUsers, "Device");
+#endif
 }
 
 
 
 int DeviceBindingService::DeleteUsers(_tds__DeleteUsers *tds__DeleteUsers, _tds__DeleteUsersResponse &tds__DeleteUsersResponse)
 {
+#ifdef WITH_OPENSSL
+    UNUSED(tds__DeleteUsersResponse);
+    DEBUG_MSG("Device: %s\n", __FUNCTION__);
+
+    ServiceContext* ctx = (ServiceContext*)this->soap->user;
+
+    return update_users(this->soap, ctx->get_user_store(), [&](UserMap &users)
+    {
+        for( size_t i = 0; i < tds__DeleteUsers->Username.size(); ++i )
+        {
+            if( !users.erase(tds__DeleteUsers->Username[i]) )
+                return soap_sender_fault_subcode(this->soap, "ter:UsernameMissing", "Username not recognized", NULL);
+        }
+
+        // the daemon would be open for all
+        if( users.empty() )
+            return soap_sender_fault_subcode(this->soap, "ter:FixedUser", "The last user can't be deleted", NULL);
+
+        return SOAP_OK;
+    });
+#else
     SOAP_EMPTY_HANDLER(tds__DeleteUsers, "Device");
+#endif
 }
 
 
 
 int DeviceBindingService::SetUser(_tds__SetUser *tds__SetUser, _tds__SetUserResponse &tds__SetUserResponse)
 {
+#ifdef WITH_OPENSSL
+    UNUSED(tds__SetUserResponse);
+    DEBUG_MSG("Device: %s\n", __FUNCTION__);
+
+    ServiceContext* ctx = (ServiceContext*)this->soap->user;
+
+    for( size_t i = 0; i < tds__SetUser->User.size(); ++i )
+    {
+        if( check_user(this->soap, tds__SetUser->User[i], false) )
+            return this->soap->error;
+    }
+
+
+    return update_users(this->soap, ctx->get_user_store(), [&](UserMap &users)
+    {
+        for( size_t i = 0; i < tds__SetUser->User.size(); ++i )
+        {
+            const tt__User *src = tds__SetUser->User[i];
+
+            UserMap::iterator it = users.find(src->Username);
+            if( it == users.end() )
+                return soap_sender_fault_subcode(this->soap, "ter:UsernameMissing", "Username not recognized", NULL);
+
+            it->second.level = (UserLevel)src->UserLevel;
+
+            if( src->Password ) // the password is kept if it is not set
+                UserStore::set_password(it->second, *src->Password);
+        }
+
+        return SOAP_OK;
+    });
+#else
     SOAP_EMPTY_HANDLER(tds__SetUser, "Device");
+#endif
 }
 
 
@@ -364,6 +588,7 @@ int DeviceBindingService::GetCapabilities(_tds__GetCapabilities *tds__GetCapabil
             tds__GetCapabilitiesResponse.Capabilities->Device->System->SupportedVersions.push_back(soap_new_req_tt__OnvifVersion(this->soap, 2, 0));
             tds__GetCapabilitiesResponse.Capabilities->Device->Network = soap_new_tt__NetworkCapabilities(this->soap);
             tds__GetCapabilitiesResponse.Capabilities->Device->Security = soap_new_tt__SecurityCapabilities(this->soap);
+            tds__GetCapabilitiesResponse.Capabilities->Device->Security->TLS1_x002e2 = ctx->is_tls_enabled();
             tds__GetCapabilitiesResponse.Capabilities->Device->IO = soap_new_tt__IOCapabilities(this->soap);
         }
 
@@ -378,6 +603,16 @@ int DeviceBindingService::GetCapabilities(_tds__GetCapabilities *tds__GetCapabil
             tds__GetCapabilitiesResponse.Capabilities->Media->StreamingCapabilities->RTP_USCORERTSP_USCORETCP = soap_new_ptr(soap, true);
         }
 
+
+        if(!tds__GetCapabilitiesResponse.Capabilities->Events && ( (category == tt__CapabilityCategory__All) || (category == tt__CapabilityCategory__Events) ) )
+        {
+            tds__GetCapabilitiesResponse.Capabilities->Events = soap_new_tt__EventCapabilities(this->soap);
+            tds__GetCapabilitiesResponse.Capabilities->Events->XAddr = XAddr + "/onvif/event_service";
+            tds__GetCapabilitiesResponse.Capabilities->Events->WSPullPointSupport = true;
+            tds__GetCapabilitiesResponse.Capabilities->Events->WSSubscriptionPolicySupport = false;
+            tds__GetCapabilitiesResponse.Capabilities->Events->WSPausableSubscriptionManagerInterfaceSupport = false;
+        }
+
         if (ctx->get_ptz_node()->enable) {
             if(!tds__GetCapabilitiesResponse.Capabilities->PTZ && ( (category == tt__CapabilityCategory__All) || (category == tt__CapabilityCategory__PTZ) ) )
             {
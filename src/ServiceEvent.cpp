@@ -0,0 +1,416 @@
+/*
+ --------------------------------------------------------------------------
+ ServiceEvent.cpp
+
+ Implementation of functions (methods) for the service:
+ ONVIF event.wsdl server side (PullPoint and push subscriptions)
+-----------------------------------------------------------------------------
+*/
+
+#include "soapEventBindingService.h"
+#include "soapNotificationProducerBindingService.h"
+#include "soapPullPointSubscriptionBindingService.h"
+#include "soapSubscriptionManagerBindingService.h"
+#include "ServiceContext.h"
+#include "smacros.h"
+#include "stools.h"
+
+#include <stdio.h>
+#include <string.h>
+
+static const char pullpoint_path[]   = "/onvif/pullpoint/";
+static const char subscription_path[] = "/onvif/subscription/";
+static const char topic_dialect[]    = "http://www.onvif.org/ver10/tev/topicExpression/ConcreteSet";
+static const char concrete_dialect[] = "http://docs.oasis-open.org/wsn/t-1/TopicExpression/Concrete";
+static const char content_dialect[]  = "http://www.onvif.org/ver10/tev/messageContentFilter/ItemFilter";
+static const time_t default_lifetime = 60;   // sec, when the client does not set it
+static const time_t max_lifetime     = 3600; // sec
+
+// topics of the device, see EventMessage
+struct EventTopic
+{
+    const char *topic;
+    const char *source_name;
+    const char *source_type;
+    const char *data_name;
+    const char *data_type;
+};
+
+static const EventTopic event_topics[] =
+{
+    { "tns1:VideoSource/MotionAlarm",                   "Source",     "tt:ReferenceToken", "State",        "xs:boolean" },
+    { "tns1:VideoSource/GlobalSceneChange/ImagingService", "Source",  "tt:ReferenceToken", "State",        "xs:boolean" },
+    { "tns1:Device/Trigger/DigitalInput",               "InputToken", "tt:ReferenceToken", "LogicalState", "xs:boolean" },
+};
+
+// wsnt:AbsoluteOrRelativeTimeType: duration (PT60S) or dateTime, NULL - default
+static bool parse_termination_time(struct soap *soap, const std::string *value, time_t now, time_t &termination)
+{
+    termination = now + default_lifetime;
+
+    if (!value || value->empty())
+        return true;
+
+    if ((*value)[0] == 'P')
+    {
+        LONG64 ms = 0;
+
+        if (soap_s2xsd__duration(soap, value->c_str(), &ms) != SOAP_OK)
+            return false;
+
+        termination = now + ms / 1000;
+    }
+    else if (soap_s2dateTime(soap, value->c_str(), &termination) != SOAP_OK)
+    {
+        return false;
+    }
+
+    if (termination <= now)
+        termination = now + 1;
+
+    if (termination > now + max_lifetime)
+        termination = now + max_lifetime;
+
+    return true;
+}
+
+static const char *local_name(const char *name)
+{
+    const char *colon = name ? strchr(name, ':') : NULL;
+
+    return colon ? colon + 1 : (name ? name : "");
+}
+
+// wsnt:Filter with TopicExpression and MessageContent, it is compiled once here (see EventFilter)
+static bool compile_filter(struct soap *soap, wsnt__FilterType *filter, EventFilterPtr &result)
+{
+    if (!filter || filter->__any.empty())
+        return true;
+
+    std::shared_ptr<EventFilter> compiled = std::make_shared<EventFilter>();
+
+    for (size_t i = 0; i < filter->__any.size(); ++i)
+    {
+        soap_dom_element &elt = filter->__any[i];
+        const char *name = local_name(elt.name);
+        const char *text = soap_elt_get_text(&elt);
+        soap_dom_attribute *dialect = soap_att_get(&elt, NULL, "Dialect");
+        const char *dialect_str = dialect ? soap_att_get_text(dialect) : NULL;
+
+        if (!text)
+            text = "";
+
+        if (!strcmp(name, "TopicExpression"))
+        {
+            if (dialect_str && strcmp(dialect_str, topic_dialect) && strcmp(dialect_str, concrete_dialect))
+            {
+                soap_sender_fault(soap, "TopicExpressionDialectUnknownFault", NULL);
+                return false;
+            }
+
+            if (!compiled->set_topics(text))
+            {
+                soap_sender_fault(soap, soap_strdup(soap, compiled->get_cstr_err()), NULL);
+                return false;
+            }
+        }
+        else if (!strcmp(name, "MessageContent"))
+        {
+            if (dialect_str && strcmp(dialect_str, content_dialect))
+            {
+                soap_sender_fault(soap, "InvalidMessageContentExpressionFault", NULL);
+                return false;
+            }
+
+            if (!compiled->set_content(text))
+            {
+                soap_sender_fault(soap, soap_strdup(soap, compiled->get_cstr_err()), NULL);
+                return false;
+            }
+        }
+    }
+
+    if (!compiled->empty())
+        result = compiled;
+
+    return true;
+}
+
+// subscription is the path of the request (address from CreatePullPointSubscription or Subscribe)
+static EventSubscriptionPtr find_subscription(struct soap *soap)
+{
+    static const char *paths[] = { pullpoint_path, subscription_path };
+
+    ServiceContext *ctx = (ServiceContext *)soap->user;
+    unsigned int id = 0;
+
+    for (size_t i = 0; i < COUNT_ELEMENTS(paths); ++i)
+    {
+        const char *pos = strstr(soap->path, paths[i]);
+
+        if (pos && (sscanf(pos + strlen(paths[i]), "%u", &id) == 1))
+            return ctx->get_event_broker()->find(id);
+    }
+
+    return EventSubscriptionPtr();
+}
+
+int EventBindingService::GetServiceCapabilities(_tev__GetServiceCapabilities *tev__GetServiceCapabilities, _tev__GetServiceCapabilitiesResponse &tev__GetServiceCapabilitiesResponse)
+{
+    UNUSED(tev__GetServiceCapabilities);
+    DEBUG_MSG("Event: %s\n", __FUNCTION__);
+
+    ServiceContext *ctx = (ServiceContext *)this->soap->user;
+    tev__GetServiceCapabilitiesResponse.Capabilities = ctx->getEventServiceCapabilities(this->soap);
+
+    return SOAP_OK;
+}
+
+int EventBindingService::CreatePullPointSubscription(_tev__CreatePullPointSubscription *tev__CreatePullPointSubscription, _tev__CreatePullPointSubscriptionResponse &tev__CreatePullPointSubscriptionResponse)
+{
+    DEBUG_MSG("Event: %s\n", __FUNCTION__);
+
+    ServiceContext *ctx = (ServiceContext *)this->soap->user;
+    time_t now = time(NULL);
+    time_t termination;
+
+    EventFilterPtr filter;
+
+    if (!parse_termination_time(this->soap, tev__CreatePullPointSubscription->InitialTerminationTime, now, termination))
+    {
+        return soap_sender_fault(this->soap, "Invalid InitialTerminationTime", NULL);
+    }
+
+    if (!compile_filter(this->soap, tev__CreatePullPointSubscription->Filter, filter))
+    {
+        return this->soap->error;
+    }
+
+    EventSubscriptionPtr sub = ctx->get_event_broker()->subscribe(termination, std::string(), filter);
+
+    if (!sub)
+    {
+        return soap_receiver_fault(this->soap, "Max number of subscriptions is reached", NULL);
+    }
+
+    std::string address = ctx->getXAddr(this->soap) + pullpoint_path + std::to_string(sub->get_id());
+
+    tev__CreatePullPointSubscriptionResponse.SubscriptionReference.Address = soap_strdup(this->soap, address.c_str());
+    tev__CreatePullPointSubscriptionResponse.wsnt__CurrentTime     = now;
+    tev__CreatePullPointSubscriptionResponse.wsnt__TerminationTime = termination;
+
+    return SOAP_OK;
+}
+
+int EventBindingService::GetEventProperties(_tev__GetEventProperties *tev__GetEventProperties, _tev__GetEventPropertiesResponse &tev__GetEventPropertiesResponse)
+{
+    UNUSED(tev__GetEventProperties);
+    DEBUG_MSG("Event: %s\n", __FUNCTION__);
+
+    tev__GetEventPropertiesResponse.TopicNamespaceLocation.push_back("http://www.onvif.org/onvif/ver10/topics/topicns.xml");
+    tev__GetEventPropertiesResponse.wsnt__FixedTopicSet = true;
+    tev__GetEventPropertiesResponse.wsnt__TopicExpressionDialect.push_back(topic_dialect);
+    tev__GetEventPropertiesResponse.wsnt__TopicExpressionDialect.push_back(concrete_dialect);
+    tev__GetEventPropertiesResponse.MessageContentFilterDialect.push_back(content_dialect);
+    tev__GetEventPropertiesResponse.MessageContentSchemaLocation.push_back("http://www.onvif.org/onvif/ver10/schema/onvif.xsd");
+
+    // tree of topics: tns1:VideoSource/MotionAlarm -> <tns1:VideoSource><MotionAlarm wstop:topic="true">
+    tev__GetEventPropertiesResponse.wstop__TopicSet = soap_new_wstop__TopicSetType(this->soap);
+    soap_dom_element root(this->soap);
+
+    for (size_t i = 0; i < COUNT_ELEMENTS(event_topics); ++i)
+    {
+        const EventTopic &topic = event_topics[i];
+        std::string path(topic.topic);
+        soap_dom_element *node = &root;
+
+        for (size_t pos = 0, end; pos < path.size(); pos = end + 1)
+        {
+            end = path.find('/', pos);
+            if (end == std::string::npos)
+                end = path.size();
+
+            node = &node->elt(path.substr(pos, end - pos).c_str());
+        }
+
+        node->att("wstop:topic") = "true";
+
+        soap_dom_element &descr = node->elt("tt:MessageDescription");
+        descr.att("IsProperty") = "true";
+
+        soap_dom_element &src = descr.elt("tt:Source").elt("tt:SimpleItemDescription");
+        src.att("Name") = topic.source_name;
+        src.att("Type") = topic.source_type;
+
+        soap_dom_element &data = descr.elt("tt:Data").elt("tt:SimpleItemDescription");
+        data.att("Name") = topic.data_name;
+        data.att("Type") = topic.data_type;
+    }
+
+    for (soap_dom_element_iterator it = root.elt_begin(); it != root.end(); ++it)
+    {
+        tev__GetEventPropertiesResponse.wstop__TopicSet->__any.push_back(*it);
+    }
+
+    return SOAP_OK;
+}
+
+int EventBindingService::AddEventBroker(_tev__AddEventBroker *tev__AddEventBroker, _tev__AddEventBrokerResponse &tev__AddEventBrokerResponse)
+{
+    SOAP_EMPTY_HANDLER(tev__AddEventBroker, "Event");
+}
+
+int EventBindingService::DeleteEventBroker(_tev__DeleteEventBroker *tev__DeleteEventBroker, _tev__DeleteEventBrokerResponse &tev__DeleteEventBrokerResponse)
+{
+    SOAP_EMPTY_HANDLER(tev__DeleteEventBroker, "Event");
+}
+
+int EventBindingService::GetEventBrokers(_tev__GetEventBrokers *tev__GetEventBrokers, _tev__GetEventBrokersResponse &tev__GetEventBrokersResponse)
+{
+    SOAP_EMPTY_HANDLER(tev__GetEventBrokers, "Event");
+}
+
+int NotificationProducerBindingService::Subscribe(_wsnt__Subscribe *wsnt__Subscribe, _wsnt__SubscribeResponse &wsnt__SubscribeResponse)
+{
+    DEBUG_MSG("Event: %s\n", __FUNCTION__);
+
+    ServiceContext *ctx = (ServiceContext *)this->soap->user;
+    const char *consumer = wsnt__Subscribe->ConsumerReference.Address;
+    time_t now = time(NULL);
+    time_t termination;
+
+    if (!consumer || (strncmp(consumer, "http://", 7) != 0 && strncmp(consumer, "https://", 8) != 0))
+    {
+        return soap_sender_fault(this->soap, "ConsumerReference must be HTTP address", NULL);
+    }
+
+    EventFilterPtr filter;
+
+    if (!parse_termination_time(this->soap, wsnt__Subscribe->InitialTerminationTime, now, termination))
+    {
+        return soap_sender_fault(this->soap, "Invalid InitialTerminationTime", NULL);
+    }
+
+    if (!compile_filter(this->soap, wsnt__Subscribe->Filter, filter))
+    {
+        return this->soap->error;
+    }
+
+    EventSubscriptionPtr sub = ctx->get_event_broker()->subscribe(termination, consumer, filter);
+
+    if (!sub)
+    {
+        return soap_receiver_fault(this->soap, "Max number of subscriptions is reached", NULL);
+    }
+
+    std::string address = ctx->getXAddr(this->soap) + subscription_path + std::to_string(sub->get_id());
+
+    wsnt__SubscribeResponse.SubscriptionReference.Address = soap_strdup(this->soap, address.c_str());
+    wsnt__SubscribeResponse.CurrentTime     = soap_new_ptr(this->soap, now);
+    wsnt__SubscribeResponse.TerminationTime = soap_new_ptr(this->soap, termination);
+
+    return SOAP_OK;
+}
+
+int NotificationProducerBindingService::GetCurrentMessage(_wsnt__GetCurrentMessage *wsnt__GetCurrentMessage, _wsnt__GetCurrentMessageResponse &wsnt__GetCurrentMessageResponse)
+{
+    SOAP_EMPTY_HANDLER(wsnt__GetCurrentMessage, "Event");
+}
+
+int PullPointSubscriptionBindingService::PullMessages(_tev__PullMessages *tev__PullMessages, _tev__PullMessagesResponse &tev__PullMessagesResponse)
+{
+    DEBUG_MSG("Event: %s\n", __FUNCTION__);
+
+    EventSubscriptionPtr sub = find_subscription(this->soap);
+
+    if (!sub || sub->is_push())
+    {
+        return soap_sender_fault(this->soap, "Subscription not found", NULL);
+    }
+
+    ServiceContext   *ctx     = (ServiceContext *)this->soap->user;
+    PullPointWaiters *waiters = ctx->get_pullpoint_waiters();
+    size_t limit = (tev__PullMessages->MessageLimit > 0) ? tev__PullMessages->MessageLimit : 1;
+
+    // nothing to send: wait for events up to Timeout, the response is sent by the main loop
+    if (!sub->get_queued() && (tev__PullMessages->Timeout > 0) &&
+        waiters->park(this->soap, sub, limit, tev__PullMessages->Timeout))
+    {
+        return SOAP_STOP;
+    }
+
+    PullPointWaiters::fill_response(this->soap, *sub, limit, tev__PullMessagesResponse);
+
+    return SOAP_OK;
+}
+
+int PullPointSubscriptionBindingService::Seek(_tev__Seek *tev__Seek, _tev__SeekResponse &tev__SeekResponse)
+{
+    SOAP_EMPTY_HANDLER(tev__Seek, "Event");
+}
+
+int PullPointSubscriptionBindingService::SetSynchronizationPoint(_tev__SetSynchronizationPoint *tev__SetSynchronizationPoint, _tev__SetSynchronizationPointResponse &tev__SetSynchronizationPointResponse)
+{
+    SOAP_EMPTY_HANDLER(tev__SetSynchronizationPoint, "Event");
+}
+
+static int unsubscribe(struct soap *soap)
+{
+    ServiceContext *ctx = (ServiceContext *)soap->user;
+    EventSubscriptionPtr sub = find_subscription(soap);
+
+    if (!sub || !ctx->get_event_broker()->unsubscribe(sub->get_id()))
+    {
+        return soap_sender_fault(soap, "Subscription not found", NULL);
+    }
+
+    return SOAP_OK;
+}
+
+int PullPointSubscriptionBindingService::Unsubscribe(_wsnt__Unsubscribe *wsnt__Unsubscribe, _wsnt__UnsubscribeResponse &wsnt__UnsubscribeResponse)
+{
+    UNUSED(wsnt__Unsubscribe);
+    UNUSED(wsnt__UnsubscribeResponse);
+    DEBUG_MSG("Event: %s\n", __FUNCTION__);
+
+    return unsubscribe(this->soap);
+}
+
+int SubscriptionManagerBindingService::Renew(_wsnt__Renew *wsnt__Renew, _wsnt__RenewResponse &wsnt__RenewResponse)
+{
+    DEBUG_MSG("Event: %s\n", __FUNCTION__);
+
+    ServiceContext *ctx = (ServiceContext *)this->soap->user;
+    EventSubscriptionPtr sub = find_subscription(this->soap);
+    time_t now = time(NULL);
+    time_t termination;
+
+    if (!sub)
+    {
+        return soap_sender_fault(this->soap, "Subscription not found", NULL);
+    }
+
+    if (!parse_termination_time(this->soap, wsnt__Renew->TerminationTime, now, termination))
+    {
+        return soap_sender_fault(this->soap, "Invalid TerminationTime", NULL);
+    }
+
+    if (!ctx->get_event_broker()->renew(sub, termination))
+    {
+        return soap_sender_fault(this->soap, "Subscription not found", NULL);
+    }
+
+    wsnt__RenewResponse.wsnt__TerminationTime = termination;
+    wsnt__RenewResponse.wsnt__CurrentTime     = soap_new_ptr(this->soap, now);
+
+    return SOAP_OK;
+}
+
+int SubscriptionManagerBindingService::Unsubscribe(_wsnt__Unsubscribe *wsnt__Unsubscribe, _wsnt__UnsubscribeResponse &wsnt__UnsubscribeResponse)
+{
+    UNUSED(wsnt__Unsubscribe);
+    UNUSED(wsnt__UnsubscribeResponse);
+    DEBUG_MSG("Event: %s\n", __FUNCTION__);
+
+    return unsubscribe(this->soap);
+}
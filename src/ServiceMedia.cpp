@@ -30,11 +30,11 @@ int MediaBindingService::GetVideoSources(_trt__GetVideoSources *trt__GetVideoSou
 
     ServiceContext *ctx = (ServiceContext *)this->soap->user;
 
-    auto profiles = ctx->get_profiles();
+    const auto &video_srcs = ctx->get_profiles_cache().video_srcs;
 
-    for (auto it = profiles.cbegin(); it != profiles.cend(); ++it)
+    for (auto it = video_srcs.cbegin(); it != video_srcs.cend(); ++it)
     {
-        trt__GetVideoSourcesResponse.VideoSources.push_back(it->second.get_video_src(this->soap));
+        trt__GetVideoSourcesResponse.VideoSources.push_back(it->second);
     }
 
     return SOAP_OK;
@@ -52,7 +52,25 @@ int MediaBindingService::GetAudioOutputs(_trt__GetAudioOutputs *trt__GetAudioOut
 
 int MediaBindingService::CreateProfile(_trt__CreateProfile *trt__CreateProfile, _trt__CreateProfileResponse &trt__CreateProfileResponse)
 {
-    SOAP_EMPTY_HANDLER(trt__CreateProfile, "Media");
+    DEBUG_MSG("Media: %s   name:%s\n", __FUNCTION__, trt__CreateProfile->Name.c_str());
+
+    ServiceContext *ctx = (ServiceContext *)this->soap->user;
+    std::string token = trt__CreateProfile->Token ? *trt__CreateProfile->Token : "";
+
+    if (!ctx->create_profile(token, trt__CreateProfile->Name))
+    {
+        return soap_sender_fault(this->soap, soap_strdup(this->soap, ctx->get_cstr_err()), NULL);
+    }
+
+    auto profiles = ctx->get_profiles();
+    auto it = profiles->find(token);
+
+    if (it != profiles->end())
+    {
+        trt__CreateProfileResponse.Profile = it->second->get_profile(this->soap);
+    }
+
+    return SOAP_OK;
 }
 
 int MediaBindingService::GetProfile(_trt__GetProfile *trt__GetProfile, _trt__GetProfileResponse &trt__GetProfileResponse)
@@ -62,12 +80,12 @@ int MediaBindingService::GetProfile(_trt__GetProfile *trt__GetProfile, _trt__Get
     int ret = SOAP_FAULT;
 
     ServiceContext *ctx = (ServiceContext *)this->soap->user;
-    auto profiles = ctx->get_profiles();
+    const auto &profiles = ctx->get_profiles_cache().profiles;
     auto it = profiles.find(trt__GetProfile->ProfileToken);
 
     if (it != profiles.end())
     {
-        trt__GetProfileResponse.Profile = it->second.get_profile(this->soap);
+        trt__GetProfileResponse.Profile = it->second;
         ret = SOAP_OK;
     }
 
@@ -81,11 +99,14 @@ int MediaBindingService::GetProfiles(_trt__GetProfiles *trt__GetProfiles, _trt__
 
     ServiceContext *ctx = (ServiceContext *)this->soap->user;
 
-    auto profiles = ctx->get_profiles();
+    // objects are built once for the set of profiles, here only the pointers are collected
+    const auto &profiles = ctx->get_profiles_cache().profiles;
+
+    trt__GetProfilesResponse.Profiles.reserve(profiles.size());
 
     for (auto it = profiles.cbegin(); it != profiles.cend(); ++it)
     {
-        trt__GetProfilesResponse.Profiles.push_back(it->second.get_profile(this->soap));
+        trt__GetProfilesResponse.Profiles.push_back(it->second);
     }
 
     return SOAP_OK;
@@ -93,12 +114,32 @@ int MediaBindingService::GetProfiles(_trt__GetProfiles *trt__GetProfiles, _trt__
 
 int MediaBindingService::AddVideoEncoderConfiguration(_trt__AddVideoEncoderConfiguration *trt__AddVideoEncoderConfiguration, _trt__AddVideoEncoderConfigurationResponse &trt__AddVideoEncoderConfigurationResponse)
 {
-    SOAP_EMPTY_HANDLER(trt__AddVideoEncoderConfiguration, "Media");
+    UNUSED(trt__AddVideoEncoderConfigurationResponse);
+    DEBUG_MSG("Media: %s   for profile:%s\n", __FUNCTION__, trt__AddVideoEncoderConfiguration->ProfileToken.c_str());
+
+    ServiceContext *ctx = (ServiceContext *)this->soap->user;
+
+    if (!ctx->add_profile_config(trt__AddVideoEncoderConfiguration->ProfileToken, StreamProfile::VIDEO_ENCODER, trt__AddVideoEncoderConfiguration->ConfigurationToken))
+    {
+        return soap_sender_fault(this->soap, soap_strdup(this->soap, ctx->get_cstr_err()), NULL);
+    }
+
+    return SOAP_OK;
 }
 
 int MediaBindingService::AddVideoSourceConfiguration(_trt__AddVideoSourceConfiguration *trt__AddVideoSourceConfiguration, _trt__AddVideoSourceConfigurationResponse &trt__AddVideoSourceConfigurationResponse)
 {
-    SOAP_EMPTY_HANDLER(trt__AddVideoSourceConfiguration, "Media");
+    UNUSED(trt__AddVideoSourceConfigurationResponse);
+    DEBUG_MSG("Media: %s   for profile:%s\n", __FUNCTION__, trt__AddVideoSourceConfiguration->ProfileToken.c_str());
+
+    ServiceContext *ctx = (ServiceContext *)this->soap->user;
+
+    if (!ctx->add_profile_config(trt__AddVideoSourceConfiguration->ProfileToken, StreamProfile::VIDEO_SOURCE, trt__AddVideoSourceConfiguration->ConfigurationToken))
+    {
+        return soap_sender_fault(this->soap, soap_strdup(this->soap, ctx->get_cstr_err()), NULL);
+    }
+
+    return SOAP_OK;
 }
 
 int MediaBindingService::AddAudioEncoderConfiguration(_trt__AddAudioEncoderConfiguration *trt__AddAudioEncoderConfiguration, _trt__AddAudioEncoderConfigurationResponse &trt__AddAudioEncoderConfigurationResponse)
@@ -113,7 +154,17 @@ int MediaBindingService::AddAudioSourceConfiguration(_trt__AddAudioSourceConfigu
 
 int MediaBindingService::AddPTZConfiguration(_trt__AddPTZConfiguration *trt__AddPTZConfiguration, _trt__AddPTZConfigurationResponse &trt__AddPTZConfigurationResponse)
 {
-    SOAP_EMPTY_HANDLER(trt__AddPTZConfiguration, "Media");
+    UNUSED(trt__AddPTZConfigurationResponse);
+    DEBUG_MSG("Media: %s   for profile:%s\n", __FUNCTION__, trt__AddPTZConfiguration->ProfileToken.c_str());
+
+    ServiceContext *ctx = (ServiceContext *)this->soap->user;
+
+    if (!ctx->add_profile_config(trt__AddPTZConfiguration->ProfileToken, StreamProfile::PTZ, trt__AddPTZConfiguration->ConfigurationToken))
+    {
+        return soap_sender_fault(this->soap, soap_strdup(this->soap, ctx->get_cstr_err()), NULL);
+    }
+
+    return SOAP_OK;
 }
 
 int MediaBindingService::AddVideoAnalyticsConfiguration(_trt__AddVideoAnalyticsConfiguration *trt__AddVideoAnalyticsConfiguration, _trt__AddVideoAnalyticsConfigurationResponse &trt__AddVideoAnalyticsConfigurationResponse)
@@ -138,12 +189,32 @@ int MediaBindingService::AddAudioDecoderConfiguration(_trt__AddAudioDecoderConfi
 
 int MediaBindingService::RemoveVideoEncoderConfiguration(_trt__RemoveVideoEncoderConfiguration *trt__RemoveVideoEncoderConfiguration, _trt__RemoveVideoEncoderConfigurationResponse &trt__RemoveVideoEncoderConfigurationResponse)
 {
-    SOAP_EMPTY_HANDLER(trt__RemoveVideoEncoderConfiguration, "Media");
+    UNUSED(trt__RemoveVideoEncoderConfigurationResponse);
+    DEBUG_MSG("Media: %s   for profile:%s\n", __FUNCTION__, trt__RemoveVideoEncoderConfiguration->ProfileToken.c_str());
+
+    ServiceContext *ctx = (ServiceContext *)this->soap->user;
+
+    if (!ctx->remove_profile_config(trt__RemoveVideoEncoderConfiguration->ProfileToken, StreamProfile::VIDEO_ENCODER))
+    {
+        return soap_sender_fault(this->soap, soap_strdup(this->soap, ctx->get_cstr_err()), NULL);
+    }
+
+    return SOAP_OK;
 }
 
 int MediaBindingService::RemoveVideoSourceConfiguration(_trt__RemoveVideoSourceConfiguration *trt__RemoveVideoSourceConfiguration, _trt__RemoveVideoSourceConfigurationResponse &trt__RemoveVideoSourceConfigurationResponse)
 {
-    SOAP_EMPTY_HANDLER(trt__RemoveVideoSourceConfiguration, "Media");
+    UNUSED(trt__RemoveVideoSourceConfigurationResponse);
+    DEBUG_MSG("Media: %s   for profile:%s\n", __FUNCTION__, trt__RemoveVideoSourceConfiguration->ProfileToken.c_str());
+
+    ServiceContext *ctx = (ServiceContext *)this->soap->user;
+
+    if (!ctx->remove_profile_config(trt__RemoveVideoSourceConfiguration->ProfileToken, StreamProfile::VIDEO_SOURCE))
+    {
+        return soap_sender_fault(this->soap, soap_strdup(this->soap, ctx->get_cstr_err()), NULL);
+    }
+
+    return SOAP_OK;
 }
 
 int MediaBindingService::RemoveAudioEncoderConfiguration(_trt__RemoveAudioEncoderConfiguration *trt__RemoveAudioEncoderConfiguration, _trt__RemoveAudioEncoderConfigurationResponse &trt__RemoveAudioEncoderConfigurationResponse)
@@ -158,7 +229,17 @@ int MediaBindingService::RemoveAudioSourceConfiguration(_trt__RemoveAudioSourceC
 
 int MediaBindingService::RemovePTZConfiguration(_trt__RemovePTZConfiguration *trt__RemovePTZConfiguration, _trt__RemovePTZConfigurationResponse &trt__RemovePTZConfigurationResponse)
 {
-    SOAP_EMPTY_HANDLER(trt__RemovePTZConfiguration, "Media");
+    UNUSED(trt__RemovePTZConfigurationResponse);
+    DEBUG_MSG("Media: %s   for profile:%s\n", __FUNCTION__, trt__RemovePTZConfiguration->ProfileToken.c_str());
+
+    ServiceContext *ctx = (ServiceContext *)this->soap->user;
+
+    if (!ctx->remove_profile_config(trt__RemovePTZConfiguration->ProfileToken, StreamProfile::PTZ))
+    {
+        return soap_sender_fault(this->soap, soap_strdup(this->soap, ctx->get_cstr_err()), NULL);
+    }
+
+    return SOAP_OK;
 }
 
 int MediaBindingService::RemoveVideoAnalyticsConfiguration(_trt__RemoveVideoAnalyticsConfiguration *trt__RemoveVideoAnalyticsConfiguration, _trt__RemoveVideoAnalyticsConfigurationResponse &trt__RemoveVideoAnalyticsConfigurationResponse)
@@ -183,7 +264,17 @@ int MediaBindingService::RemoveAudioDecoderConfiguration(_trt__RemoveAudioDecode
 
 int MediaBindingService::DeleteProfile(_trt__DeleteProfile *trt__DeleteProfile, _trt__DeleteProfileResponse &trt__DeleteProfileResponse)
 {
-    SOAP_EMPTY_HANDLER(trt__DeleteProfile, "Media");
+    UNUSED(trt__DeleteProfileResponse);
+    DEBUG_MSG("Media: %s   for profile:%s\n", __FUNCTION__, trt__DeleteProfile->ProfileToken.c_str());
+
+    ServiceContext *ctx = (ServiceContext *)this->soap->user;
+
+    if (!ctx->delete_profile(trt__DeleteProfile->ProfileToken))
+    {
+        return soap_sender_fault(this->soap, soap_strdup(this->soap, ctx->get_cstr_err()), NULL);
+    }
+
+    return SOAP_OK;
 }
 
 int MediaBindingService::GetVideoSourceConfigurations(_trt__GetVideoSourceConfigurations *trt__GetVideoSourceConfigurations, _trt__GetVideoSourceConfigurationsResponse &trt__GetVideoSourceConfigurationsResponse)
@@ -193,12 +284,11 @@ int MediaBindingService::GetVideoSourceConfigurations(_trt__GetVideoSourceConfig
 
     ServiceContext *ctx = (ServiceContext *)this->soap->user;
 
-    auto profiles = ctx->get_profiles();
+    const auto &cfgs = ctx->get_profiles_cache().video_src_cfgs;
 
-    for (auto it = profiles.cbegin(); it != profiles.cend(); ++it)
+    for (auto it = cfgs.cbegin(); it != cfgs.cend(); ++it)
     {
-        tt__VideoSourceConfiguration *vsc = it->second.get_video_src_cnf(this->soap);
-        trt__GetVideoSourceConfigurationsResponse.Configurations.push_back(vsc);
+        trt__GetVideoSourceConfigurationsResponse.Configurations.push_back(it->second);
     }
 
     return SOAP_OK;
@@ -211,12 +301,11 @@ int MediaBindingService::GetVideoEncoderConfigurations(_trt__GetVideoEncoderConf
 
     ServiceContext *ctx = (ServiceContext *)this->soap->user;
 
-    auto profiles = ctx->get_profiles();
+    const auto &cfgs = ctx->get_profiles_cache().video_enc_cfgs;
 
-    for (auto it = profiles.cbegin(); it != profiles.cend(); ++it)
+    for (auto it = cfgs.cbegin(); it != cfgs.cend(); ++it)
     {
-        tt__VideoEncoderConfiguration *vec = it->second.get_video_enc_cfg(this->soap);
-        trt__GetVideoEncoderConfigurationsResponse.Configurations.push_back(vec);
+        trt__GetVideoEncoderConfigurationsResponse.Configurations.push_back(it->second);
     }
 
     return SOAP_OK;
@@ -258,16 +347,12 @@ int MediaBindingService::GetVideoSourceConfiguration(_trt__GetVideoSourceConfigu
 
     ServiceContext *ctx = (ServiceContext *)this->soap->user;
 
-    auto profiles = ctx->get_profiles();
+    const auto &cfgs = ctx->get_profiles_cache().video_src_cfgs;
+    auto it = cfgs.find(trt__GetVideoSourceConfiguration->ConfigurationToken);
 
-    for (auto it = profiles.cbegin(); it != profiles.cend(); ++it)
+    if (it != cfgs.end())
     {
-        if (trt__GetVideoSourceConfiguration->ConfigurationToken == it->second.get_video_src_cnf(this->soap)->token)
-        {
-            tt__VideoSourceConfiguration *vsc = it->second.get_video_src_cnf(this->soap);
-            trt__GetVideoSourceConfigurationResponse.Configuration = vsc;
-            break;
-        }
+        trt__GetVideoSourceConfigurationResponse.Configuration = it->second;
     }
 
     return SOAP_OK;
@@ -279,16 +364,12 @@ int MediaBindingService::GetVideoEncoderConfiguration(_trt__GetVideoEncoderConfi
 
     ServiceContext *ctx = (ServiceContext *)this->soap->user;
 
-    auto profiles = ctx->get_profiles();
+    const auto &cfgs = ctx->get_profiles_cache().video_enc_cfgs;
+    auto it = cfgs.find(trt__GetVideoEncoderConfiguration->ConfigurationToken);
 
-    for (auto it = profiles.cbegin(); it != profiles.cend(); ++it)
+    if (it != cfgs.end())
     {
-        if (trt__GetVideoEncoderConfiguration->ConfigurationToken == it->second.get_video_enc_cfg(this->soap)->token)
-        {
-            tt__VideoEncoderConfiguration *vec = it->second.get_video_enc_cfg(this->soap);
-            trt__GetVideoEncoderConfigurationResponse.Configuration = vec;
-            break;
-        }
+        trt__GetVideoEncoderConfigurationResponse.Configuration = it->second;
     }
 
     return SOAP_OK;
@@ -366,12 +447,43 @@ int MediaBindingService::GetCompatibleAudioDecoderConfigurations(_trt__GetCompat
 
 int MediaBindingService::SetVideoSourceConfiguration(_trt__SetVideoSourceConfiguration *trt__SetVideoSourceConfiguration, _trt__SetVideoSourceConfigurationResponse &trt__SetVideoSourceConfigurationResponse)
 {
-    SOAP_EMPTY_HANDLER(trt__SetVideoSourceConfiguration, "Media");
+    UNUSED(trt__SetVideoSourceConfigurationResponse);
+    DEBUG_MSG("Media: %s\n", __FUNCTION__);
+
+    ServiceContext *ctx = (ServiceContext *)this->soap->user;
+
+    if (!trt__SetVideoSourceConfiguration->Configuration)
+    {
+        return soap_sender_fault(this->soap, "configuration is not set", NULL);
+    }
+
+    if (!ctx->set_video_src_cfg(*trt__SetVideoSourceConfiguration->Configuration))
+    {
+        return soap_sender_fault(this->soap, soap_strdup(this->soap, ctx->get_cstr_err()), NULL);
+    }
+
+    return SOAP_OK;
 }
 
 int MediaBindingService::SetVideoEncoderConfiguration(_trt__SetVideoEncoderConfiguration *trt__SetVideoEncoderConfiguration, _trt__SetVideoEncoderConfigurationResponse &trt__SetVideoEncoderConfigurationResponse)
 {
-    SOAP_EMPTY_HANDLER(trt__SetVideoEncoderConfiguration, "Media");
+    UNUSED(trt__SetVideoEncoderConfigurationResponse);
+    DEBUG_MSG("Media: %s\n", __FUNCTION__);
+
+    ServiceContext *ctx = (ServiceContext *)this->soap->user;
+
+    if (!trt__SetVideoEncoderConfiguration->Configuration)
+    {
+        return soap_sender_fault(this->soap, "configuration is not set", NULL);
+    }
+
+    // values are checked with the same caps as GetVideoEncoderConfigurationOptions
+    if (!ctx->set_video_enc_cfg(*trt__SetVideoEncoderConfiguration->Configuration))
+    {
+        return soap_sender_fault(this->soap, soap_strdup(this->soap, ctx->get_cstr_err()), NULL);
+    }
+
+    return SOAP_OK;
 }
 
 int MediaBindingService::SetAudioSourceConfiguration(_trt__SetAudioSourceConfiguration *trt__SetAudioSourceConfiguration, _trt__SetAudioSourceConfigurationResponse &trt__SetAudioSourceConfigurationResponse)
@@ -404,172 +516,57 @@ int MediaBindingService::SetAudioDecoderConfiguration(_trt__SetAudioDecoderConfi
     SOAP_EMPTY_HANDLER(trt__SetAudioDecoderConfiguration, "Media");
 }
 
-int MediaBindingService::GetVideoSourceConfigurationOptions(_trt__GetVideoSourceConfigurationOptions *trt__GetVideoSourceConfigurationOptions, _trt__GetVideoSourceConfigurationOptionsResponse &trt__GetVideoSourceConfigurationOptionsResponse)
+// token of configuration for Get*ConfigurationOptions, "" - all configurations
+static std::string get_options_cfg_token(ServiceContext *ctx, const std::string *cfg_token, const std::string *profile_token)
 {
-    DEBUG_MSG("Media: %s\n", __FUNCTION__);
+    if (cfg_token != NULL)
+        return *cfg_token;
 
-    std::string token;
-    int width;
-    int height;
-    ServiceContext *ctx = (ServiceContext *)this->soap->user;
-
-    auto profiles = ctx->get_profiles();
-
-    if (trt__GetVideoSourceConfigurationOptions->ConfigurationToken != NULL)
-    {
-        for (auto it = profiles.cbegin(); it != profiles.cend(); ++it)
-        {
-            if (*(trt__GetVideoSourceConfigurationOptions->ConfigurationToken) == it->second.get_video_enc_cfg(this->soap)->token)
-            {
-                token.assign(it->second.get_video_enc_cfg(this->soap)->token);
-            }
-        }
-    }
-    else if (trt__GetVideoSourceConfigurationOptions->ProfileToken != NULL)
+    if (profile_token != NULL)
     {
-        for (auto it = profiles.cbegin(); it != profiles.cend(); ++it)
-        {
-            if (*(trt__GetVideoSourceConfigurationOptions->ProfileToken) == it->second.get_video_src_cnf(this->soap)->token)
-            {
-                token.assign(it->second.get_video_src_cnf(this->soap)->token);
-            }
-        }
-    }
+        auto profiles = ctx->get_profiles();
+        auto it = profiles->find(*profile_token);
 
-    for (auto it = profiles.cbegin(); it != profiles.cend(); ++it)
-    {
-        if ((token.empty()) || (token == it->second.get_video_src_cnf(this->soap)->token))
-        {
-            width = it->second.get_width();
-            height = it->second.get_height();
-
-            trt__GetVideoSourceConfigurationOptionsResponse.Options = soap_new_tt__VideoSourceConfigurationOptions(soap);
-
-            trt__GetVideoSourceConfigurationOptionsResponse.Options->BoundsRange = soap_new_tt__IntRectangleRange(soap);
-            trt__GetVideoSourceConfigurationOptionsResponse.Options->BoundsRange->XRange = soap_new_tt__IntRange(soap);
-            trt__GetVideoSourceConfigurationOptionsResponse.Options->BoundsRange->XRange->Min = 0;     //dummy
-            trt__GetVideoSourceConfigurationOptionsResponse.Options->BoundsRange->XRange->Max = width; //dummy
-            trt__GetVideoSourceConfigurationOptionsResponse.Options->BoundsRange->YRange = soap_new_tt__IntRange(soap);
-            trt__GetVideoSourceConfigurationOptionsResponse.Options->BoundsRange->YRange->Min = 0;      //dummy
-            trt__GetVideoSourceConfigurationOptionsResponse.Options->BoundsRange->YRange->Max = height; //dummy
-            trt__GetVideoSourceConfigurationOptionsResponse.Options->BoundsRange->WidthRange = soap_new_tt__IntRange(soap);
-            trt__GetVideoSourceConfigurationOptionsResponse.Options->BoundsRange->WidthRange->Min = 0;     //dummy
-            trt__GetVideoSourceConfigurationOptionsResponse.Options->BoundsRange->WidthRange->Max = width; //dummy
-            trt__GetVideoSourceConfigurationOptionsResponse.Options->BoundsRange->HeightRange = soap_new_tt__IntRange(soap);
-            trt__GetVideoSourceConfigurationOptionsResponse.Options->BoundsRange->HeightRange->Min = 0;      //dummy
-            trt__GetVideoSourceConfigurationOptionsResponse.Options->BoundsRange->HeightRange->Max = height; //dummy
-
-            trt__GetVideoSourceConfigurationOptionsResponse.Options->VideoSourceTokensAvailable.push_back(it->second.get_video_src_cnf(this->soap)->token);
-
-            break;
-        }
+        if (it != profiles->end())
+            return it->second->get_cfg_token();
     }
 
-    return SOAP_OK;
+    return "";
 }
 
-int MediaBindingService::GetVideoEncoderConfigurationOptions(_trt__GetVideoEncoderConfigurationOptions *trt__GetVideoEncoderConfigurationOptions, _trt__GetVideoEncoderConfigurationOptionsResponse &trt__GetVideoEncoderConfigurationOptionsResponse)
+template <typename T>
+static T *find_options(const std::map<std::string, T *> &opts, const std::string &token)
+{
+    auto it = opts.find(token);
+
+    if (it == opts.end())
+        it = opts.find(""); // unknown token - options of all configurations
+
+    return (it != opts.end()) ? it->second : NULL;
+}
+
+int MediaBindingService::GetVideoSourceConfigurationOptions(_trt__GetVideoSourceConfigurationOptions *trt__GetVideoSourceConfigurationOptions, _trt__GetVideoSourceConfigurationOptionsResponse &trt__GetVideoSourceConfigurationOptionsResponse)
 {
     DEBUG_MSG("Media: %s\n", __FUNCTION__);
 
-    std::string token;
     ServiceContext *ctx = (ServiceContext *)this->soap->user;
+    std::string token = get_options_cfg_token(ctx, trt__GetVideoSourceConfigurationOptions->ConfigurationToken, trt__GetVideoSourceConfigurationOptions->ProfileToken);
 
-    auto profiles = ctx->get_profiles();
+    // options are built once for the set of profiles
+    trt__GetVideoSourceConfigurationOptionsResponse.Options = find_options(ctx->get_profiles_cache().video_src_opts, token);
 
-    if (trt__GetVideoEncoderConfigurationOptions->ConfigurationToken != NULL)
-    {
-        for (auto it = profiles.cbegin(); it != profiles.cend(); ++it)
-        {
-            if (*(trt__GetVideoEncoderConfigurationOptions->ConfigurationToken) == it->second.get_video_enc_cfg(this->soap)->token)
-            {
-                token.assign(it->second.get_video_enc_cfg(this->soap)->token);
-            }
-        }
-    }
-    else if (trt__GetVideoEncoderConfigurationOptions->ProfileToken != NULL)
-    {
-        for (auto it = profiles.cbegin(); it != profiles.cend(); ++it)
-        {
-            if (*(trt__GetVideoEncoderConfigurationOptions->ProfileToken) == it->second.get_video_src_cnf(this->soap)->token)
-            {
-                token.assign(it->second.get_video_src_cnf(this->soap)->token);
-            }
-        }
-    }
+    return SOAP_OK;
+}
 
-    trt__GetVideoEncoderConfigurationOptionsResponse.Options = soap_new_tt__VideoEncoderConfigurationOptions(soap);
-    trt__GetVideoEncoderConfigurationOptionsResponse.Options->JPEG = NULL;
-    trt__GetVideoEncoderConfigurationOptionsResponse.Options->MPEG4 = NULL;
-    trt__GetVideoEncoderConfigurationOptionsResponse.Options->H264 = NULL;
-    trt__GetVideoEncoderConfigurationOptionsResponse.Options->QualityRange = soap_new_tt__IntRange(soap);
-    trt__GetVideoEncoderConfigurationOptionsResponse.Options->QualityRange->Min = 0;   //dummy
-    trt__GetVideoEncoderConfigurationOptionsResponse.Options->QualityRange->Max = 100; //dummy
-    trt__GetVideoEncoderConfigurationOptionsResponse.Options->Extension = NULL;
+int MediaBindingService::GetVideoEncoderConfigurationOptions(_trt__GetVideoEncoderConfigurationOptions *trt__GetVideoEncoderConfigurationOptions, _trt__GetVideoEncoderConfigurationOptionsResponse &trt__GetVideoEncoderConfigurationOptionsResponse)
+{
+    DEBUG_MSG("Media: %s\n", __FUNCTION__);
 
-    for (auto it = profiles.cbegin(); it != profiles.cend(); ++it)
-    {
-        if ((token.empty()) || (token == it->second.get_video_src_cnf(this->soap)->token))
-        {
-            if (it->second.get_type() == tt__VideoEncoding__JPEG)
-            {
-                trt__GetVideoEncoderConfigurationOptionsResponse.Options->JPEG = soap_new_tt__JpegOptions(soap);
-
-                tt__VideoResolution *vr = soap_new_tt__VideoResolution(soap);
-                vr->Width = it->second.get_width();
-                vr->Height = it->second.get_height();
-                trt__GetVideoEncoderConfigurationOptionsResponse.Options->JPEG->ResolutionsAvailable.push_back(vr);
-
-                trt__GetVideoEncoderConfigurationOptionsResponse.Options->JPEG->FrameRateRange = soap_new_tt__IntRange(soap);
-                trt__GetVideoEncoderConfigurationOptionsResponse.Options->JPEG->FrameRateRange->Min = 0;  //dummy
-                trt__GetVideoEncoderConfigurationOptionsResponse.Options->JPEG->FrameRateRange->Max = 20; //dummy
-                trt__GetVideoEncoderConfigurationOptionsResponse.Options->JPEG->EncodingIntervalRange = soap_new_tt__IntRange(soap);
-                trt__GetVideoEncoderConfigurationOptionsResponse.Options->JPEG->EncodingIntervalRange->Min = 0; //dummy
-                trt__GetVideoEncoderConfigurationOptionsResponse.Options->JPEG->EncodingIntervalRange->Max = 3; //dummy
-            }
-            else if (it->second.get_type() == tt__VideoEncoding__MPEG4)
-            {
-                trt__GetVideoEncoderConfigurationOptionsResponse.Options->MPEG4 = soap_new_tt__Mpeg4Options(soap);
-
-                tt__VideoResolution *vr = soap_new_tt__VideoResolution(soap);
-                vr->Width = it->second.get_width();
-                vr->Height = it->second.get_height();
-                trt__GetVideoEncoderConfigurationOptionsResponse.Options->MPEG4->ResolutionsAvailable.push_back(vr);
-
-                trt__GetVideoEncoderConfigurationOptionsResponse.Options->MPEG4->GovLengthRange = soap_new_tt__IntRange(soap);
-                trt__GetVideoEncoderConfigurationOptionsResponse.Options->MPEG4->GovLengthRange->Min = 0;  //dummy
-                trt__GetVideoEncoderConfigurationOptionsResponse.Options->MPEG4->GovLengthRange->Max = 40; //dummy
-                trt__GetVideoEncoderConfigurationOptionsResponse.Options->MPEG4->FrameRateRange = soap_new_tt__IntRange(soap);
-                trt__GetVideoEncoderConfigurationOptionsResponse.Options->MPEG4->FrameRateRange->Min = 0;  //dummy
-                trt__GetVideoEncoderConfigurationOptionsResponse.Options->MPEG4->FrameRateRange->Max = 20; //dummy
-                trt__GetVideoEncoderConfigurationOptionsResponse.Options->MPEG4->EncodingIntervalRange = soap_new_tt__IntRange(soap);
-                trt__GetVideoEncoderConfigurationOptionsResponse.Options->MPEG4->EncodingIntervalRange->Min = 0; //dummy
-                trt__GetVideoEncoderConfigurationOptionsResponse.Options->MPEG4->EncodingIntervalRange->Max = 3; //dummy
-                trt__GetVideoEncoderConfigurationOptionsResponse.Options->MPEG4->Mpeg4ProfilesSupported.push_back(tt__Mpeg4Profile__SP);
-            }
-            else if (it->second.get_type() == tt__VideoEncoding__H264)
-            {
-                trt__GetVideoEncoderConfigurationOptionsResponse.Options->H264 = soap_new_tt__H264Options(soap);
-
-                tt__VideoResolution *vr = soap_new_tt__VideoResolution(soap);
-                vr->Width = it->second.get_width();
-                vr->Height = it->second.get_height();
-                trt__GetVideoEncoderConfigurationOptionsResponse.Options->H264->ResolutionsAvailable.push_back(vr);
-
-                trt__GetVideoEncoderConfigurationOptionsResponse.Options->H264->GovLengthRange = soap_new_tt__IntRange(soap);
-                trt__GetVideoEncoderConfigurationOptionsResponse.Options->H264->GovLengthRange->Min = 0;  //dummy
-                trt__GetVideoEncoderConfigurationOptionsResponse.Options->H264->GovLengthRange->Max = 40; //dummy
-                trt__GetVideoEncoderConfigurationOptionsResponse.Options->H264->FrameRateRange = soap_new_tt__IntRange(soap);
-                trt__GetVideoEncoderConfigurationOptionsResponse.Options->H264->FrameRateRange->Min = 0;  //dummy
-                trt__GetVideoEncoderConfigurationOptionsResponse.Options->H264->FrameRateRange->Max = 20; //dummy
-                trt__GetVideoEncoderConfigurationOptionsResponse.Options->H264->EncodingIntervalRange = soap_new_tt__IntRange(soap);
-                trt__GetVideoEncoderConfigurationOptionsResponse.Options->H264->EncodingIntervalRange->Min = 0; //dummy
-                trt__GetVideoEncoderConfigurationOptionsResponse.Options->H264->EncodingIntervalRange->Max = 3; //dummy
-                trt__GetVideoEncoderConfigurationOptionsResponse.Options->H264->H264ProfilesSupported.push_back(tt__H264Profile__Main);
-                trt__GetVideoEncoderConfigurationOptionsResponse.Options->H264->H264ProfilesSupported.push_back(tt__H264Profile__Main);
-            }
-        }
-    }
+    ServiceContext *ctx = (ServiceContext *)this->soap->user;
+    std::string token = get_options_cfg_token(ctx, trt__GetVideoEncoderConfigurationOptions->ConfigurationToken, trt__GetVideoEncoderConfigurationOptions->ProfileToken);
+
+    // options are built once for the set of profiles
+    trt__GetVideoEncoderConfigurationOptionsResponse.Options = find_options(ctx->get_profiles_cache().video_enc_opts, token);
 
     return SOAP_OK;
 }
@@ -613,17 +610,20 @@ int MediaBindingService::GetGuaranteedNumberOfVideoEncoderInstances(_trt__GetGua
     int mpeg4InstancesNumber = 0;
     int h264InstancesNumber = 0;
 
-    for (auto it = profiles.cbegin(); it != profiles.cend(); ++it)
+    for (auto it = profiles->cbegin(); it != profiles->cend(); ++it)
     {
-        if (it->second.get_type() == tt__VideoEncoding__JPEG)
+        if (!it->second->is_fixed())
+            continue;
+
+        if (it->second->get_type() == tt__VideoEncoding__JPEG)
         {
             jpegInstancesNumber += instancesNumber;
         }
-        else if (it->second.get_type() == tt__VideoEncoding__MPEG4)
+        else if (it->second->get_type() == tt__VideoEncoding__MPEG4)
         {
             mpeg4InstancesNumber += instancesNumber;
         }
-        else if (it->second.get_type() == tt__VideoEncoding__H264)
+        else if (it->second->get_type() == tt__VideoEncoding__H264)
         {
             h264InstancesNumber += instancesNumber;
         }
@@ -645,12 +645,24 @@ int MediaBindingService::GetStreamUri(_trt__GetStreamUri *trt__GetStreamUri, _tr
 
     ServiceContext *ctx = (ServiceContext *)this->soap->user;
     auto profiles = ctx->get_profiles();
-    auto it = profiles.find(trt__GetStreamUri->ProfileToken);
+    auto it = profiles->find(trt__GetStreamUri->ProfileToken);
 
-    if (it != profiles.end())
+    if (it != profiles->end())
     {
+        char uri[URI_TEMPLATE_MAX_LEN];
+
+        if (!it->second->has_config(StreamProfile::VIDEO_ENCODER))
+        {
+            return soap_sender_fault(this->soap, "Profile has no video encoder configuration", NULL);
+        }
+
+        if (ctx->get_stream_uri(*it->second, htonl(this->soap->ip), uri, sizeof(uri)) < 0)
+        {
+            return soap_receiver_fault(this->soap, "Stream URI is too long", NULL);
+        }
+
         trt__GetStreamUriResponse.MediaUri = soap_new_tt__MediaUri(this->soap);
-        trt__GetStreamUriResponse.MediaUri->Uri = ctx->get_stream_uri(it->second.get_url(), htonl(this->soap->ip));
+        trt__GetStreamUriResponse.MediaUri->Uri = uri;
         ret = SOAP_OK;
     }
 
@@ -680,15 +692,24 @@ int MediaBindingService::GetSnapshotUri(_trt__GetSnapshotUri *trt__GetSnapshotUr
 
     ServiceContext *ctx = (ServiceContext *)this->soap->user;
     auto profiles = ctx->get_profiles();
-    auto it = profiles.find(trt__GetSnapshotUri->ProfileToken);
+    auto it = profiles->find(trt__GetSnapshotUri->ProfileToken);
 
-    if (it != profiles.end())
+    if (it != profiles->end())
     {
-        trt__GetSnapshotUriResponse.MediaUri = soap_new_tt__MediaUri(this->soap);
+        char uri[URI_TEMPLATE_MAX_LEN];
+
+        if (!it->second->has_config(StreamProfile::VIDEO_ENCODER))
+        {
+            return soap_sender_fault(this->soap, "Profile has no video encoder configuration", NULL);
+        }
 
-        //trt__GetSnapshotUriResponse.MediaUri->Uri = it->second.get_snapurl()  + ctx->getServerIpFromClientIp(htonl(this->soap->ip));
+        if (ctx->get_snapshot_uri(*it->second, htonl(this->soap->ip), uri, sizeof(uri)) < 0)
+        {
+            return soap_receiver_fault(this->soap, "Snapshot URI is too long", NULL);
+        }
 
-        trt__GetSnapshotUriResponse.MediaUri->Uri = ctx->get_snapshot_uri(it->second.get_snapurl(), htonl(this->soap->ip));
+        trt__GetSnapshotUriResponse.MediaUri = soap_new_tt__MediaUri(this->soap);
+        trt__GetSnapshotUriResponse.MediaUri->Uri = uri;
         ret = SOAP_OK;
     }
 
@@ -0,0 +1,621 @@
+/*
+ --------------------------------------------------------------------------
+ ServiceMedia2.cpp
+
+ Implementation of functions (methods) for the service:
+ ONVIF media2.wsdl (ver20) server side
+-----------------------------------------------------------------------------
+*/
+
+#include "soapMedia2BindingService.h"
+#include "ServiceContext.h"
+#include "smacros.h"
+#include "stools.h"
+
+#include <arpa/inet.h>
+
+// bits of StreamProfile::Config for tr2:ConfigurationEnumeration, 0 - not supported
+static unsigned get_config_type(const std::string &type)
+{
+    if (type == "All")
+        return StreamProfile::VIDEO_SOURCE | StreamProfile::VIDEO_ENCODER | StreamProfile::PTZ;
+
+    if (type == "VideoSource")
+        return StreamProfile::VIDEO_SOURCE;
+
+    if (type == "VideoEncoder")
+        return StreamProfile::VIDEO_ENCODER;
+
+    if (type == "PTZ")
+        return StreamProfile::PTZ;
+
+    return 0;
+}
+
+template <typename T>
+static T *find_cfg(const std::map<std::string, T *> &cfgs, const std::string &token)
+{
+    auto it = cfgs.find(token);
+
+    return (it != cfgs.end()) ? it->second : NULL;
+}
+
+// profile with the requested configurations only, configurations are the shared objects of the cache
+static tr2__MediaProfile *new_media_profile(struct soap *soap, const ServiceContext::ProfilesCache &cache,
+                                            const StreamProfile &profile, unsigned configs)
+{
+    tr2__MediaProfile *media_profile = soap_new_tr2__MediaProfile(soap);
+
+    media_profile->Name  = profile.get_title();
+    media_profile->token = profile.get_name();
+    media_profile->fixed = soap_new_ptr(soap, profile.is_fixed());
+
+    if (!configs)
+        return media_profile;
+
+    media_profile->Configurations = soap_new_tr2__ConfigurationSet(soap);
+
+    const std::string &cfg_token = profile.get_cfg_token();
+
+    if ((configs & StreamProfile::VIDEO_SOURCE) && profile.has_config(StreamProfile::VIDEO_SOURCE))
+        media_profile->Configurations->VideoSource = find_cfg(cache.video_src_cfgs, cfg_token);
+
+    if ((configs & StreamProfile::VIDEO_ENCODER) && profile.has_config(StreamProfile::VIDEO_ENCODER))
+        media_profile->Configurations->VideoEncoder = find_cfg(cache.video_enc2_cfgs, cfg_token);
+
+    if ((configs & StreamProfile::PTZ) && profile.has_config(StreamProfile::PTZ))
+        media_profile->Configurations->PTZ = cache.ptz_cfg;
+
+    return media_profile;
+}
+
+// apply tr2:ConfigurationRef list to the profile
+static int add_configurations(struct soap *soap, ServiceContext *ctx, const std::string &profile_token,
+                              const std::vector<tr2__ConfigurationRef *> &refs)
+{
+    for (size_t i = 0; i < refs.size(); ++i)
+    {
+        if (!refs[i])
+            continue;
+
+        unsigned    type  = get_config_type(refs[i]->Type);
+        std::string token = refs[i]->Token ? *refs[i]->Token : "";
+
+        if ((type != StreamProfile::VIDEO_SOURCE) && (type != StreamProfile::VIDEO_ENCODER) && (type != StreamProfile::PTZ))
+        {
+            std::string err = "configuration type: " + refs[i]->Type + " is not supported";
+            return soap_sender_fault(soap, soap_strdup(soap, err.c_str()), NULL);
+        }
+
+        if (token.empty() && (type != StreamProfile::PTZ))
+        {
+            return soap_sender_fault(soap, "token of configuration is not set", NULL);
+        }
+
+        if (!ctx->add_profile_config(profile_token, (StreamProfile::Config)type, token))
+        {
+            return soap_sender_fault(soap, soap_strdup(soap, ctx->get_cstr_err()), NULL);
+        }
+    }
+
+    return SOAP_OK;
+}
+
+// token of configuration from tr2:GetConfiguration, "" - all configurations
+static std::string get_cfg_token(ServiceContext *ctx, const tr2__GetConfiguration *req)
+{
+    if (req && req->ConfigurationToken)
+        return *req->ConfigurationToken;
+
+    if (req && req->ProfileToken)
+    {
+        auto profiles = ctx->get_profiles();
+        auto it = profiles->find(*req->ProfileToken);
+
+        if (it != profiles->end())
+            return it->second->get_cfg_token();
+    }
+
+    return "";
+}
+
+int Media2BindingService::GetServiceCapabilities(_tr2__GetServiceCapabilities *tr2__GetServiceCapabilities, _tr2__GetServiceCapabilitiesResponse &tr2__GetServiceCapabilitiesResponse)
+{
+    UNUSED(tr2__GetServiceCapabilities);
+    DEBUG_MSG("Media2: %s\n", __FUNCTION__);
+
+    ServiceContext *ctx = (ServiceContext *)this->soap->user;
+    tr2__GetServiceCapabilitiesResponse.Capabilities = ctx->getMedia2ServiceCapabilities(this->soap);
+
+    return SOAP_OK;
+}
+
+int Media2BindingService::CreateProfile(_tr2__CreateProfile *tr2__CreateProfile, _tr2__CreateProfileResponse &tr2__CreateProfileResponse)
+{
+    DEBUG_MSG("Media2: %s   name:%s\n", __FUNCTION__, tr2__CreateProfile->Name.c_str());
+
+    ServiceContext *ctx = (ServiceContext *)this->soap->user;
+    std::string token;
+
+    if (!ctx->create_profile(token, tr2__CreateProfile->Name))
+    {
+        return soap_sender_fault(this->soap, soap_strdup(this->soap, ctx->get_cstr_err()), NULL);
+    }
+
+    int ret = add_configurations(this->soap, ctx, token, tr2__CreateProfile->Configuration);
+    if (ret != SOAP_OK)
+    {
+        ctx->delete_profile(token); // profile is created with all configurations or not at all
+        return ret;
+    }
+
+    tr2__CreateProfileResponse.Token = token;
+
+    return SOAP_OK;
+}
+
+int Media2BindingService::GetProfiles(_tr2__GetProfiles *tr2__GetProfiles, _tr2__GetProfilesResponse &tr2__GetProfilesResponse)
+{
+    DEBUG_MSG("Media2: %s\n", __FUNCTION__);
+
+    ServiceContext *ctx = (ServiceContext *)this->soap->user;
+
+    // without Type the profiles are sent without configurations
+    unsigned configs = 0;
+
+    for (size_t i = 0; i < tr2__GetProfiles->Type.size(); ++i)
+    {
+        configs |= get_config_type(tr2__GetProfiles->Type[i]);
+    }
+
+    const ServiceContext::ProfilesCache &cache = ctx->get_profiles_cache();
+    const ProfileMap &profiles = *cache.src;
+
+    if (tr2__GetProfiles->Token)
+    {
+        auto it = profiles.find(*tr2__GetProfiles->Token);
+
+        if (it == profiles.end())
+        {
+            return soap_sender_fault(this->soap, "Profile not found", NULL);
+        }
+
+        tr2__GetProfilesResponse.Profiles.push_back(new_media_profile(this->soap, cache, *it->second, configs));
+        return SOAP_OK;
+    }
+
+    tr2__GetProfilesResponse.Profiles.reserve(profiles.size());
+
+    for (auto it = profiles.cbegin(); it != profiles.cend(); ++it)
+    {
+        tr2__GetProfilesResponse.Profiles.push_back(new_media_profile(this->soap, cache, *it->second, configs));
+    }
+
+    return SOAP_OK;
+}
+
+int Media2BindingService::AddConfiguration(_tr2__AddConfiguration *tr2__AddConfiguration, _tr2__AddConfigurationResponse &tr2__AddConfigurationResponse)
+{
+    UNUSED(tr2__AddConfigurationResponse);
+    DEBUG_MSG("Media2: %s   for profile:%s\n", __FUNCTION__, tr2__AddConfiguration->ProfileToken.c_str());
+
+    ServiceContext *ctx = (ServiceContext *)this->soap->user;
+
+    return add_configurations(this->soap, ctx, tr2__AddConfiguration->ProfileToken, tr2__AddConfiguration->Configuration);
+}
+
+int Media2BindingService::RemoveConfiguration(_tr2__RemoveConfiguration *tr2__RemoveConfiguration, _tr2__RemoveConfigurationResponse &tr2__RemoveConfigurationResponse)
+{
+    UNUSED(tr2__RemoveConfigurationResponse);
+    DEBUG_MSG("Media2: %s   for profile:%s\n", __FUNCTION__, tr2__RemoveConfiguration->ProfileToken.c_str());
+
+    ServiceContext *ctx = (ServiceContext *)this->soap->user;
+
+    for (size_t i = 0; i < tr2__RemoveConfiguration->Configuration.size(); ++i)
+    {
+        const tr2__ConfigurationRef *ref = tr2__RemoveConfiguration->Configuration[i];
+        unsigned type = ref ? get_config_type(ref->Type) : 0;
+
+        if ((type != StreamProfile::VIDEO_SOURCE) && (type != StreamProfile::VIDEO_ENCODER) && (type != StreamProfile::PTZ))
+            continue; // it is not in the profile
+
+        if (!ctx->remove_profile_config(tr2__RemoveConfiguration->ProfileToken, (StreamProfile::Config)type))
+        {
+            return soap_sender_fault(this->soap, soap_strdup(this->soap, ctx->get_cstr_err()), NULL);
+        }
+    }
+
+    return SOAP_OK;
+}
+
+int Media2BindingService::DeleteProfile(_tr2__DeleteProfile *tr2__DeleteProfile, _tr2__DeleteProfileResponse &tr2__DeleteProfileResponse)
+{
+    UNUSED(tr2__DeleteProfileResponse);
+    DEBUG_MSG("Media2: %s   for profile:%s\n", __FUNCTION__, tr2__DeleteProfile->Token.c_str());
+
+    ServiceContext *ctx = (ServiceContext *)this->soap->user;
+
+    if (!ctx->delete_profile(tr2__DeleteProfile->Token))
+    {
+        return soap_sender_fault(this->soap, soap_strdup(this->soap, ctx->get_cstr_err()), NULL);
+    }
+
+    return SOAP_OK;
+}
+
+int Media2BindingService::GetVideoSourceConfigurations(tr2__GetConfiguration *tr2__GetVideoSourceConfigurations, _tr2__GetVideoSourceConfigurationsResponse &tr2__GetVideoSourceConfigurationsResponse)
+{
+    DEBUG_MSG("Media2: %s\n", __FUNCTION__);
+
+    ServiceContext *ctx = (ServiceContext *)this->soap->user;
+    std::string token = get_cfg_token(ctx, tr2__GetVideoSourceConfigurations);
+
+    const auto &cfgs = ctx->get_profiles_cache().video_src_cfgs;
+
+    for (auto it = cfgs.cbegin(); it != cfgs.cend(); ++it)
+    {
+        if (token.empty() || (it->first == token))
+            tr2__GetVideoSourceConfigurationsResponse.Configurations.push_back(it->second);
+    }
+
+    return SOAP_OK;
+}
+
+int Media2BindingService::GetVideoEncoderConfigurations(tr2__GetConfiguration *tr2__GetVideoEncoderConfigurations, _tr2__GetVideoEncoderConfigurationsResponse &tr2__GetVideoEncoderConfigurationsResponse)
+{
+    DEBUG_MSG("Media2: %s\n", __FUNCTION__);
+
+    ServiceContext *ctx = (ServiceContext *)this->soap->user;
+    std::string token = get_cfg_token(ctx, tr2__GetVideoEncoderConfigurations);
+
+    const auto &cfgs = ctx->get_profiles_cache().video_enc2_cfgs;
+
+    for (auto it = cfgs.cbegin(); it != cfgs.cend(); ++it)
+    {
+        if (token.empty() || (it->first == token))
+            tr2__GetVideoEncoderConfigurationsResponse.Configurations.push_back(it->second);
+    }
+
+    return SOAP_OK;
+}
+
+int Media2BindingService::GetAudioSourceConfigurations(tr2__GetConfiguration *tr2__GetAudioSourceConfigurations, _tr2__GetAudioSourceConfigurationsResponse &tr2__GetAudioSourceConfigurationsResponse)
+{
+    SOAP_EMPTY_HANDLER(tr2__GetAudioSourceConfigurations, "Media2");
+}
+
+int Media2BindingService::GetAudioEncoderConfigurations(tr2__GetConfiguration *tr2__GetAudioEncoderConfigurations, _tr2__GetAudioEncoderConfigurationsResponse &tr2__GetAudioEncoderConfigurationsResponse)
+{
+    SOAP_EMPTY_HANDLER(tr2__GetAudioEncoderConfigurations, "Media2");
+}
+
+int Media2BindingService::GetAnalyticsConfigurations(tr2__GetConfiguration *tr2__GetAnalyticsConfigurations, _tr2__GetAnalyticsConfigurationsResponse &tr2__GetAnalyticsConfigurationsResponse)
+{
+    SOAP_EMPTY_HANDLER(tr2__GetAnalyticsConfigurations, "Media2");
+}
+
+int Media2BindingService::GetMetadataConfigurations(tr2__GetConfiguration *tr2__GetMetadataConfigurations, _tr2__GetMetadataConfigurationsResponse &tr2__GetMetadataConfigurationsResponse)
+{
+    SOAP_EMPTY_HANDLER(tr2__GetMetadataConfigurations, "Media2");
+}
+
+int Media2BindingService::GetAudioOutputConfigurations(tr2__GetConfiguration *tr2__GetAudioOutputConfigurations, _tr2__GetAudioOutputConfigurationsResponse &tr2__GetAudioOutputConfigurationsResponse)
+{
+    SOAP_EMPTY_HANDLER(tr2__GetAudioOutputConfigurations, "Media2");
+}
+
+int Media2BindingService::GetAudioDecoderConfigurations(tr2__GetConfiguration *tr2__GetAudioDecoderConfigurations, _tr2__GetAudioDecoderConfigurationsResponse &tr2__GetAudioDecoderConfigurationsResponse)
+{
+    SOAP_EMPTY_HANDLER(tr2__GetAudioDecoderConfigurations, "Media2");
+}
+
+int Media2BindingService::SetVideoSourceConfiguration(_tr2__SetVideoSourceConfiguration *tr2__SetVideoSourceConfiguration, tr2__SetConfigurationResponse &tr2__SetVideoSourceConfigurationResponse)
+{
+    UNUSED(tr2__SetVideoSourceConfigurationResponse);
+    DEBUG_MSG("Media2: %s\n", __FUNCTION__);
+
+    ServiceContext *ctx = (ServiceContext *)this->soap->user;
+
+    if (!tr2__SetVideoSourceConfiguration->Configuration)
+    {
+        return soap_sender_fault(this->soap, "configuration is not set", NULL);
+    }
+
+    if (!ctx->set_video_src_cfg(*tr2__SetVideoSourceConfiguration->Configuration))
+    {
+        return soap_sender_fault(this->soap, soap_strdup(this->soap, ctx->get_cstr_err()), NULL);
+    }
+
+    return SOAP_OK;
+}
+
+int Media2BindingService::SetVideoEncoderConfiguration(_tr2__SetVideoEncoderConfiguration *tr2__SetVideoEncoderConfiguration, tr2__SetConfigurationResponse &tr2__SetVideoEncoderConfigurationResponse)
+{
+    UNUSED(tr2__SetVideoEncoderConfigurationResponse);
+    DEBUG_MSG("Media2: %s\n", __FUNCTION__);
+
+    ServiceContext *ctx = (ServiceContext *)this->soap->user;
+    const tt__VideoEncoder2Configuration *cfg2 = tr2__SetVideoEncoderConfiguration->Configuration;
+
+    if (!cfg2)
+    {
+        return soap_sender_fault(this->soap, "configuration is not set", NULL);
+    }
+
+    const tt__VideoEncoderConfiguration *cur = find_cfg(ctx->get_profiles_cache().video_enc_cfgs, cfg2->token);
+    int encoding = StreamProfile::find_media2_encoding(cfg2->Encoding);
+
+    if (!cur || (encoding < 0))
+    {
+        return soap_sender_fault(this->soap, "Configuration not found or encoding is not supported", NULL);
+    }
+
+    // the same change in terms of Media (ver10), values which Media2 has not are kept
+    tt__VideoEncoderConfiguration *cfg = soap_new_tt__VideoEncoderConfiguration(this->soap);
+
+    cfg->token       = cfg2->token;
+    cfg->Encoding    = static_cast<tt__VideoEncoding>(encoding);
+    cfg->Quality     = cfg2->Quality;
+    cfg->Resolution  = cfg2->Resolution ? soap_new_req_tt__VideoResolution(this->soap, cfg2->Resolution->Width, cfg2->Resolution->Height) : cur->Resolution;
+    cfg->RateControl = cur->RateControl;
+
+    if (cfg2->RateControl)
+    {
+        cfg->RateControl = soap_new_req_tt__VideoRateControl(this->soap, (int)(cfg2->RateControl->FrameRateLimit + 0.5f),
+                                                             cur->RateControl->EncodingInterval, cfg2->RateControl->BitrateLimit);
+    }
+
+    if (cfg2->GovLength)
+    {
+        cfg->H264  = soap_new_req_tt__H264Configuration(this->soap, *cfg2->GovLength, tt__H264Profile__Main);
+        cfg->MPEG4 = soap_new_req_tt__Mpeg4Configuration(this->soap, *cfg2->GovLength, tt__Mpeg4Profile__SP);
+    }
+
+    if (!ctx->set_video_enc_cfg(*cfg))
+    {
+        return soap_sender_fault(this->soap, soap_strdup(this->soap, ctx->get_cstr_err()), NULL);
+    }
+
+    return SOAP_OK;
+}
+
+int Media2BindingService::SetAudioSourceConfiguration(_tr2__SetAudioSourceConfiguration *tr2__SetAudioSourceConfiguration, tr2__SetConfigurationResponse &tr2__SetAudioSourceConfigurationResponse)
+{
+    SOAP_EMPTY_HANDLER(tr2__SetAudioSourceConfiguration, "Media2");
+}
+
+int Media2BindingService::SetAudioEncoderConfiguration(_tr2__SetAudioEncoderConfiguration *tr2__SetAudioEncoderConfiguration, tr2__SetConfigurationResponse &tr2__SetAudioEncoderConfigurationResponse)
+{
+    SOAP_EMPTY_HANDLER(tr2__SetAudioEncoderConfiguration, "Media2");
+}
+
+int Media2BindingService::SetMetadataConfiguration(_tr2__SetMetadataConfiguration *tr2__SetMetadataConfiguration, tr2__SetConfigurationResponse &tr2__SetMetadataConfigurationResponse)
+{
+    SOAP_EMPTY_HANDLER(tr2__SetMetadataConfiguration, "Media2");
+}
+
+int Media2BindingService::SetAudioOutputConfiguration(_tr2__SetAudioOutputConfiguration *tr2__SetAudioOutputConfiguration, tr2__SetConfigurationResponse &tr2__SetAudioOutputConfigurationResponse)
+{
+    SOAP_EMPTY_HANDLER(tr2__SetAudioOutputConfiguration, "Media2");
+}
+
+int Media2BindingService::SetAudioDecoderConfiguration(_tr2__SetAudioDecoderConfiguration *tr2__SetAudioDecoderConfiguration, tr2__SetConfigurationResponse &tr2__SetAudioDecoderConfigurationResponse)
+{
+    SOAP_EMPTY_HANDLER(tr2__SetAudioDecoderConfiguration, "Media2");
+}
+
+int Media2BindingService::GetVideoSourceConfigurationOptions(tr2__GetConfiguration *tr2__GetVideoSourceConfigurationOptions, _tr2__GetVideoSourceConfigurationOptionsResponse &tr2__GetVideoSourceConfigurationOptionsResponse)
+{
+    DEBUG_MSG("Media2: %s\n", __FUNCTION__);
+
+    ServiceContext *ctx = (ServiceContext *)this->soap->user;
+    const auto &opts = ctx->get_profiles_cache().video_src_opts;
+
+    auto it = opts.find(get_cfg_token(ctx, tr2__GetVideoSourceConfigurationOptions));
+    if (it == opts.end())
+        it = opts.find("");
+
+    if (it != opts.end())
+        tr2__GetVideoSourceConfigurationOptionsResponse.Options = it->second;
+
+    return SOAP_OK;
+}
+
+int Media2BindingService::GetVideoEncoderConfigurationOptions(tr2__GetConfiguration *tr2__GetVideoEncoderConfigurationOptions, _tr2__GetVideoEncoderConfigurationOptionsResponse &tr2__GetVideoEncoderConfigurationOptionsResponse)
+{
+    DEBUG_MSG("Media2: %s\n", __FUNCTION__);
+
+    ServiceContext *ctx = (ServiceContext *)this->soap->user;
+    const auto &opts = ctx->get_profiles_cache().video_enc2_opts;
+
+    auto it = opts.find(get_cfg_token(ctx, tr2__GetVideoEncoderConfigurationOptions));
+    if (it == opts.end())
+        it = opts.find("");
+
+    if (it != opts.end())
+        tr2__GetVideoEncoderConfigurationOptionsResponse.Options = it->second;
+
+    return SOAP_OK;
+}
+
+int Media2BindingService::GetAudioSourceConfigurationOptions(tr2__GetConfiguration *tr2__GetAudioSourceConfigurationOptions, _tr2__GetAudioSourceConfigurationOptionsResponse &tr2__GetAudioSourceConfigurationOptionsResponse)
+{
+    SOAP_EMPTY_HANDLER(tr2__GetAudioSourceConfigurationOptions, "Media2");
+}
+
+int Media2BindingService::GetAudioEncoderConfigurationOptions(tr2__GetConfiguration *tr2__GetAudioEncoderConfigurationOptions, _tr2__GetAudioEncoderConfigurationOptionsResponse &tr2__GetAudioEncoderConfigurationOptionsResponse)
+{
+    SOAP_EMPTY_HANDLER(tr2__GetAudioEncoderConfigurationOptions, "Media2");
+}
+
+int Media2BindingService::GetMetadataConfigurationOptions(tr2__GetConfiguration *tr2__GetMetadataConfigurationOptions, _tr2__GetMetadataConfigurationOptionsResponse &tr2__GetMetadataConfigurationOptionsResponse)
+{
+    SOAP_EMPTY_HANDLER(tr2__GetMetadataConfigurationOptions, "Media2");
+}
+
+int Media2BindingService::GetAudioOutputConfigurationOptions(tr2__GetConfiguration *tr2__GetAudioOutputConfigurationOptions, _tr2__GetAudioOutputConfigurationOptionsResponse &tr2__GetAudioOutputConfigurationOptionsResponse)
+{
+    SOAP_EMPTY_HANDLER(tr2__GetAudioOutputConfigurationOptions, "Media2");
+}
+
+int Media2BindingService::GetAudioDecoderConfigurationOptions(tr2__GetConfiguration *tr2__GetAudioDecoderConfigurationOptions, _tr2__GetAudioDecoderConfigurationOptionsResponse &tr2__GetAudioDecoderConfigurationOptionsResponse)
+{
+    SOAP_EMPTY_HANDLER(tr2__GetAudioDecoderConfigurationOptions, "Media2");
+}
+
+int Media2BindingService::GetVideoEncoderInstances(_tr2__GetVideoEncoderInstances *tr2__GetVideoEncoderInstances, _tr2__GetVideoEncoderInstancesResponse &tr2__GetVideoEncoderInstancesResponse)
+{
+    DEBUG_MSG("Media2: %s\n", __FUNCTION__);
+
+    ServiceContext *ctx = (ServiceContext *)this->soap->user;
+    auto profiles = ctx->get_profiles();
+    auto it = profiles->find(tr2__GetVideoEncoderInstances->ConfigurationToken);
+
+    if ((it == profiles->end()) || !it->second->is_fixed())
+    {
+        return soap_sender_fault(this->soap, "Configuration not found", NULL);
+    }
+
+    // one encoder for each configuration
+    tr2__GetVideoEncoderInstancesResponse.Info = soap_new_tr2__EncoderInstanceInfo(this->soap);
+    tr2__GetVideoEncoderInstancesResponse.Info->Total = 1;
+    tr2__GetVideoEncoderInstancesResponse.Info->Codec.push_back(
+        soap_new_req_tr2__EncoderInstance(this->soap, StreamProfile::get_media2_encoding(it->second->get_type()), 1));
+
+    return SOAP_OK;
+}
+
+int Media2BindingService::GetStreamUri(_tr2__GetStreamUri *tr2__GetStreamUri, _tr2__GetStreamUriResponse &tr2__GetStreamUriResponse)
+{
+    DEBUG_MSG("Media2: %s   for profile:%s\n", __FUNCTION__, tr2__GetStreamUri->ProfileToken.c_str());
+
+    ServiceContext *ctx = (ServiceContext *)this->soap->user;
+    auto profiles = ctx->get_profiles();
+    auto it = profiles->find(tr2__GetStreamUri->ProfileToken);
+
+    if (it == profiles->end())
+    {
+        return soap_sender_fault(this->soap, "Profile not found", NULL);
+    }
+
+    if (!it->second->has_config(StreamProfile::VIDEO_ENCODER))
+    {
+        return soap_sender_fault(this->soap, "Profile has no video encoder configuration", NULL);
+    }
+
+    char uri[URI_TEMPLATE_MAX_LEN];
+
+    if (ctx->get_stream_uri(*it->second, htonl(this->soap->ip), uri, sizeof(uri)) < 0)
+    {
+        return soap_receiver_fault(this->soap, "Stream URI is too long", NULL);
+    }
+
+    tr2__GetStreamUriResponse.Uri = uri;
+
+    return SOAP_OK;
+}
+
+int Media2BindingService::StartMulticastStreaming(tr2__StartStopMulticastStreaming *tr2__StartMulticastStreaming, tr2__SetConfigurationResponse &tr2__StartMulticastStreamingResponse)
+{
+    SOAP_EMPTY_HANDLER(tr2__StartMulticastStreaming, "Media2");
+}
+
+int Media2BindingService::StopMulticastStreaming(tr2__StartStopMulticastStreaming *tr2__StopMulticastStreaming, tr2__SetConfigurationResponse &tr2__StopMulticastStreamingResponse)
+{
+    SOAP_EMPTY_HANDLER(tr2__StopMulticastStreaming, "Media2");
+}
+
+int Media2BindingService::SetSynchronizationPoint(_tr2__SetSynchronizationPoint *tr2__SetSynchronizationPoint, _tr2__SetSynchronizationPointResponse &tr2__SetSynchronizationPointResponse)
+{
+    SOAP_EMPTY_HANDLER(tr2__SetSynchronizationPoint, "Media2");
+}
+
+int Media2BindingService::GetSnapshotUri(_tr2__GetSnapshotUri *tr2__GetSnapshotUri, _tr2__GetSnapshotUriResponse &tr2__GetSnapshotUriResponse)
+{
+    DEBUG_MSG("Media2: %s   for profile:%s\n", __FUNCTION__, tr2__GetSnapshotUri->ProfileToken.c_str());
+
+    ServiceContext *ctx = (ServiceContext *)this->soap->user;
+    auto profiles = ctx->get_profiles();
+    auto it = profiles->find(tr2__GetSnapshotUri->ProfileToken);
+
+    if (it == profiles->end())
+    {
+        return soap_sender_fault(this->soap, "Profile not found", NULL);
+    }
+
+    if (!it->second->has_config(StreamProfile::VIDEO_ENCODER))
+    {
+        return soap_sender_fault(this->soap, "Profile has no video encoder configuration", NULL);
+    }
+
+    char uri[URI_TEMPLATE_MAX_LEN];
+
+    if (ctx->get_snapshot_uri(*it->second, htonl(this->soap->ip), uri, sizeof(uri)) < 0)
+    {
+        return soap_receiver_fault(this->soap, "Snapshot URI is too long", NULL);
+    }
+
+    tr2__GetSnapshotUriResponse.Uri = uri;
+
+    return SOAP_OK;
+}
+
+int Media2BindingService::GetVideoSourceModes(_tr2__GetVideoSourceModes *tr2__GetVideoSourceModes, _tr2__GetVideoSourceModesResponse &tr2__GetVideoSourceModesResponse)
+{
+    SOAP_EMPTY_HANDLER(tr2__GetVideoSourceModes, "Media2");
+}
+
+int Media2BindingService::SetVideoSourceMode(_tr2__SetVideoSourceMode *tr2__SetVideoSourceMode, _tr2__SetVideoSourceModeResponse &tr2__SetVideoSourceModeResponse)
+{
+    SOAP_EMPTY_HANDLER(tr2__SetVideoSourceMode, "Media2");
+}
+
+int Media2BindingService::GetOSDs(_tr2__GetOSDs *tr2__GetOSDs, _tr2__GetOSDsResponse &tr2__GetOSDsResponse)
+{
+    SOAP_EMPTY_HANDLER(tr2__GetOSDs, "Media2");
+}
+
+int Media2BindingService::GetOSDOptions(_tr2__GetOSDOptions *tr2__GetOSDOptions, _tr2__GetOSDOptionsResponse &tr2__GetOSDOptionsResponse)
+{
+    SOAP_EMPTY_HANDLER(tr2__GetOSDOptions, "Media2");
+}
+
+int Media2BindingService::SetOSD(_tr2__SetOSD *tr2__SetOSD, tr2__SetConfigurationResponse &tr2__SetOSDResponse)
+{
+    SOAP_EMPTY_HANDLER(tr2__SetOSD, "Media2");
+}
+
+int Media2BindingService::CreateOSD(_tr2__CreateOSD *tr2__CreateOSD, _tr2__CreateOSDResponse &tr2__CreateOSDResponse)
+{
+    SOAP_EMPTY_HANDLER(tr2__CreateOSD, "Media2");
+}
+
+int Media2BindingService::DeleteOSD(_tr2__DeleteOSD *tr2__DeleteOSD, tr2__SetConfigurationResponse &tr2__DeleteOSDResponse)
+{
+    SOAP_EMPTY_HANDLER(tr2__DeleteOSD, "Media2");
+}
+
+int Media2BindingService::GetMasks(_tr2__GetMasks *tr2__GetMasks, _tr2__GetMasksResponse &tr2__GetMasksResponse)
+{
+    SOAP_EMPTY_HANDLER(tr2__GetMasks, "Media2");
+}
+
+int Media2BindingService::GetMaskOptions(_tr2__GetMaskOptions *tr2__GetMaskOptions, _tr2__GetMaskOptionsResponse &tr2__GetMaskOptionsResponse)
+{
+    SOAP_EMPTY_HANDLER(tr2__GetMaskOptions, "Media2");
+}
+
+int Media2BindingService::SetMask(_tr2__SetMask *tr2__SetMask, tr2__SetConfigurationResponse &tr2__SetMaskResponse)
+{
+    SOAP_EMPTY_HANDLER(tr2__SetMask, "Media2");
+}
+
+int Media2BindingService::CreateMask(_tr2__CreateMask *tr2__CreateMask, _tr2__CreateMaskResponse &tr2__CreateMaskResponse)
+{
+    SOAP_EMPTY_HANDLER(tr2__CreateMask, "Media2");
+}
+
+int Media2BindingService::DeleteMask(_tr2__DeleteMask *tr2__DeleteMask, tr2__SetConfigurationResponse &tr2__DeleteMaskResponse)
+{
+    SOAP_EMPTY_HANDLER(tr2__DeleteMask, "Media2");
+}
@@ -12,40 +12,66 @@
 #include "smacros.h"
 #include "stools.h"
 //#include "api.h"
-#include "curl/curl.h"
 
-size_t writeFunction(void *ptr, size_t size, size_t nmemb, std::string *data)
-{
-    data->append((char *)ptr, size * nmemb);
-    return size * nmemb;
-}
+#include <arpa/inet.h>
 
-const char *curl_get(const char *url)
+// Render the command URL and send it to the motor controller, map the result to a SOAP fault
+static int ptz_backend_request(struct soap *soap, PTZBackend::Command cmd, const UriTemplate &tpl, UriTemplateArgs &args)
 {
-    auto curl = curl_easy_init();
-    if (curl)
+    ServiceContext *ctx = (ServiceContext *)soap->user;
+
+    if (tpl.empty())
+    {
+        return SOAP_OK; // command is not configured
+    }
+
+    char url[URI_TEMPLATE_MAX_LEN];
+    char server_ip[INET_ADDRSTRLEN];
+    char client_ip[INET_ADDRSTRLEN];
+    uint32_t client_ip_n = htonl(soap->ip);
+
+    if (tpl.has_field(UriTemplate::SERVER_IP))
     {
-        curl_easy_setopt(curl, CURLOPT_URL, url);
-        curl_easy_setopt(curl, CURLOPT_NOPROGRESS, 1L);
-        curl_easy_setopt(curl, CURLOPT_MAXREDIRS, 50L);
-        curl_easy_setopt(curl, CURLOPT_TCP_KEEPALIVE, 1L);
-
-        std::string response_string;
-        std::string header_string;
-        curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, writeFunction);
-        curl_easy_setopt(curl, CURLOPT_WRITEDATA, &response_string);
-        curl_easy_setopt(curl, CURLOPT_HEADERDATA, &header_string);
-
-        curl_easy_perform(curl);
-        curl_easy_cleanup(curl);
-        return response_string.c_str();
+        ctx->getServerIpFromClientIp(client_ip_n, server_ip);
+        args.server_ip = server_ip;
     }
-    else
+    if (tpl.has_field(UriTemplate::CLIENT_IP) && inet_ntop(AF_INET, &client_ip_n, client_ip, sizeof(client_ip)))
     {
-        return NULL;
+        args.client_ip = client_ip;
+    }
+    args.port = ctx->port;
+
+    if (tpl.render(url, sizeof(url), args) < 0)
+    {
+        return soap_receiver_fault(soap, "PTZ backend URL is too long", NULL);
+    }
+
+    switch (ctx->get_ptz_backend()->request(cmd, url))
+    {
+    case PTZBackend::RES_OK:
+        return SOAP_OK;
+
+    case PTZBackend::RES_REJECTED:
+        return soap_receiver_fault(soap, "PTZ backend is unavailable", NULL);
+
+    case PTZBackend::RES_TIMEOUT:
+        return soap_receiver_fault(soap, "PTZ backend timeout", NULL);
+
+    default:
+        return soap_receiver_fault(soap, "PTZ backend error", NULL);
     }
 }
 
+// Set the PTZ vector for the move_continuous template
+static void ptz_move_args(UriTemplateArgs &args, const tt__Vector2D *pan_tilt, const tt__Vector1D *zoom)
+{
+    args.x             = pan_tilt ? pan_tilt->x : 0;
+    args.y             = pan_tilt ? pan_tilt->y : 0;
+    args.z             = zoom ? zoom->x : 0;
+    args.only_pan_tilt = (pan_tilt != NULL) && (zoom == NULL);
+    args.only_zoom     = (pan_tilt == NULL) && (zoom != NULL);
+}
+
 int PTZBindingService::GetServiceCapabilities(_tptz__GetServiceCapabilities *tptz__GetServiceCapabilities, _tptz__GetServiceCapabilitiesResponse &tptz__GetServiceCapabilitiesResponse)
 {
     SOAP_EMPTY_HANDLER(tptz__GetServiceCapabilities, "PTZ");
@@ -110,8 +136,6 @@ int PTZBindingService::GotoPreset(_tptz__GotoPreset *tptz__GotoPreset, _tptz__Go
     UNUSED(tptz__GotoPresetResponse);
     DEBUG_MSG("PTZ: %s\n", __FUNCTION__);
 
-    std::string preset_cmd;
-
     ServiceContext *ctx = (ServiceContext *)this->soap->user;
 
     if (tptz__GotoPreset == NULL)
@@ -127,26 +151,15 @@ int PTZBindingService::GotoPreset(_tptz__GotoPreset *tptz__GotoPreset, _tptz__Go
         return SOAP_OK;
     }
 
-    if (!ctx->get_ptz_node()->get_goto_preset().empty())
-    {
-        preset_cmd = ctx->get_ptz_node()->get_goto_preset().c_str();
-    }
-    else
-    {
-        return SOAP_OK;
-    }
-
-    std::string template_str_t("%t");
-
-    auto it_t = preset_cmd.find(template_str_t, 0);
-
-    if (it_t != std::string::npos)
+    UriTemplateArgs args;
+    args.profile = tptz__GotoPreset->ProfileToken.c_str();
+    args.preset  = tptz__GotoPreset->PresetToken.c_str();
+    if (tptz__GotoPreset->Speed != NULL && tptz__GotoPreset->Speed->PanTilt != NULL)
     {
-        preset_cmd.replace(it_t, template_str_t.size(), tptz__GotoPreset->PresetToken.c_str());
+        args.speed = tptz__GotoPreset->Speed->PanTilt->x;
     }
-    curl_get(preset_cmd.c_str());
 
-    return SOAP_OK;
+    return ptz_backend_request(this->soap, PTZBackend::GOTO_PRESET, ctx->get_ptz_node()->get_goto_preset(), args);
 }
 
 int PTZBindingService::GetStatus(_tptz__GetStatus *tptz__GetStatus, _tptz__GetStatusResponse &tptz__GetStatusResponse)
@@ -286,16 +299,10 @@ int PTZBindingService::GotoHomePosition(_tptz__GotoHomePosition *tptz__GotoHomeP
         return SOAP_OK;
     }
 
-    if (!ctx->get_ptz_node()->get_goto_home().empty())
-    {
-        curl_get(ctx->get_ptz_node()->get_goto_home().c_str());
-    }
-    else
-    {
-        return SOAP_OK;
-    }
+    UriTemplateArgs args;
+    args.profile = tptz__GotoHomePosition->ProfileToken.c_str();
 
-    return SOAP_OK;
+    return ptz_backend_request(this->soap, PTZBackend::GOTO_HOME, ctx->get_ptz_node()->get_goto_home(), args);
 }
 
 int PTZBindingService::SetHomePosition(_tptz__SetHomePosition *tptz__SetHomePosition, _tptz__SetHomePositionResponse &tptz__SetHomePositionResponse)
@@ -323,32 +330,11 @@ int PTZBindingService::ContinuousMove(_tptz__ContinuousMove *tptz__ContinuousMov
         return SOAP_OK;
     }
 
-    if (tptz__ContinuousMove->Velocity->PanTilt != NULL && tptz__ContinuousMove->Velocity->Zoom != NULL)
-    {
-        curl_get(ctx->get_ptz_node()->get_move_continuous(
-                                        tptz__ContinuousMove->Velocity->PanTilt->x,
-                                        tptz__ContinuousMove->Velocity->PanTilt->y,
-                                        tptz__ContinuousMove->Velocity->Zoom->x, false, false)
-                     .c_str());
-    }
-    else if (tptz__ContinuousMove->Velocity->PanTilt != NULL)
-    {
-        curl_get(ctx->get_ptz_node()->get_move_continuous(
-                                        tptz__ContinuousMove->Velocity->PanTilt->x,
-                                        tptz__ContinuousMove->Velocity->PanTilt->y,
-                                        0, true, false)
-                     .c_str());
-    }
-    else if (tptz__ContinuousMove->Velocity->Zoom != NULL)
-    {
-        curl_get(ctx->get_ptz_node()->get_move_continuous(
-                                        0,
-                                        0,
-                                        tptz__ContinuousMove->Velocity->Zoom->x, false, true)
-                     .c_str());
-    }
+    UriTemplateArgs args;
+    args.profile = tptz__ContinuousMove->ProfileToken.c_str();
+    ptz_move_args(args, tptz__ContinuousMove->Velocity->PanTilt, tptz__ContinuousMove->Velocity->Zoom);
 
-    return SOAP_OK;
+    return ptz_backend_request(this->soap, PTZBackend::MOVE_CONTINUOUS, ctx->get_ptz_node()->get_move_continuous(), args);
 }
 
 int PTZBindingService::RelativeMove(_tptz__RelativeMove *tptz__RelativeMove, _tptz__RelativeMoveResponse &tptz__RelativeMoveResponse)
@@ -371,34 +357,20 @@ int PTZBindingService::RelativeMove(_tptz__RelativeMove *tptz__RelativeMove, _tp
         return SOAP_OK;
     }
 
-    if (tptz__RelativeMove->Translation->PanTilt != NULL && tptz__RelativeMove->Translation->Zoom != NULL)
-    {
-        curl_get(ctx->get_ptz_node()->get_move_continuous(
-                                        tptz__RelativeMove->Translation->PanTilt->x,
-                                        tptz__RelativeMove->Translation->PanTilt->y,
-                                        tptz__RelativeMove->Translation->Zoom->x, false, false)
-                     .c_str());
-        usleep(300000);
-        curl_get(ctx->get_ptz_node()->get_move_stop().c_str());
-    }
-    else if (tptz__RelativeMove->Translation->PanTilt != NULL)
-    {
-        curl_get(ctx->get_ptz_node()->get_move_continuous(
-                                        tptz__RelativeMove->Translation->PanTilt->x,
-                                        tptz__RelativeMove->Translation->PanTilt->y,
-                                        0, true, false)
-                     .c_str());
-    }
-    else if (tptz__RelativeMove->Translation->Zoom != NULL)
+    UriTemplateArgs args;
+    args.profile = tptz__RelativeMove->ProfileToken.c_str();
+    ptz_move_args(args, tptz__RelativeMove->Translation->PanTilt, tptz__RelativeMove->Translation->Zoom);
+
+    int ret = ptz_backend_request(this->soap, PTZBackend::MOVE_CONTINUOUS, ctx->get_ptz_node()->get_move_continuous(), args);
+
+    if (ret != SOAP_OK || args.only_pan_tilt || args.only_zoom)
     {
-        curl_get(ctx->get_ptz_node()->get_move_continuous(
-                                        0,
-                                        0,
-                                        tptz__RelativeMove->Translation->Zoom->x, false, true)
-                     .c_str());
+        return ret;
     }
 
-    return SOAP_OK;
+    // pan+tilt+zoom: the backend has no relative move, so stop after a short move
+    usleep(300000);
+    return ptz_backend_request(this->soap, PTZBackend::MOVE_STOP, ctx->get_ptz_node()->get_move_stop(), args);
 }
 
 int PTZBindingService::SendAuxiliaryCommand(_tptz__SendAuxiliaryCommand *tptz__SendAuxiliaryCommand, _tptz__SendAuxiliaryCommandResponse &tptz__SendAuxiliaryCommandResponse)
@@ -413,15 +385,18 @@ int PTZBindingService::AbsoluteMove(_tptz__AbsoluteMove *tptz__AbsoluteMove, _tp
 
 int PTZBindingService::Stop(_tptz__Stop *tptz__Stop, _tptz__StopResponse &tptz__StopResponse)
 {
-    UNUSED(tptz__Stop);
     UNUSED(tptz__StopResponse);
     DEBUG_MSG("PTZ: %s\n", __FUNCTION__);
 
     ServiceContext *ctx = (ServiceContext *)this->soap->user;
 
-    curl_get(ctx->get_ptz_node()->get_move_stop().c_str());
+    UriTemplateArgs args;
+    if (tptz__Stop != NULL)
+    {
+        args.profile = tptz__Stop->ProfileToken.c_str();
+    }
 
-    return SOAP_OK;
+    return ptz_backend_request(this->soap, PTZBackend::MOVE_STOP, ctx->get_ptz_node()->get_move_stop(), args);
 }
 
 int PTZBindingService::GetPresetTours(_tptz__GetPresetTours *tptz__GetPresetTours, _tptz__GetPresetToursResponse &tptz__GetPresetToursResponse)
@@ -0,0 +1,173 @@
+#include <string.h>
+
+#include "access_policy.h"
+#include "smacros.h"
+
+
+
+
+
+struct Operation
+{
+    const char  *name;
+    AccessClass  access;
+};
+
+
+
+// sorted by name (strcmp), the operations which are not covered by the default rule
+// (the changes of the profiles, the media configurations and the presets are ACTUATE)
+static const Operation operations[] =
+{
+    { "AbsoluteMove",                      ACCESS_ACTUATE               },
+    { "AddAudioDecoderConfiguration",      ACCESS_ACTUATE               },
+    { "AddAudioEncoderConfiguration",      ACCESS_ACTUATE               },
+    { "AddAudioOutputConfiguration",       ACCESS_ACTUATE               },
+    { "AddAudioSourceConfiguration",       ACCESS_ACTUATE               },
+    { "AddConfiguration",                  ACCESS_ACTUATE               },
+    { "AddMetadataConfiguration",          ACCESS_ACTUATE               },
+    { "AddPTZConfiguration",               ACCESS_ACTUATE               },
+    { "AddVideoAnalyticsConfiguration",    ACCESS_ACTUATE               },
+    { "AddVideoEncoderConfiguration",      ACCESS_ACTUATE               },
+    { "AddVideoSourceConfiguration",       ACCESS_ACTUATE               },
+    { "ContinuousMove",                    ACCESS_ACTUATE               },
+    { "CreateOSD",                         ACCESS_ACTUATE               },
+    { "CreateProfile",                     ACCESS_ACTUATE               },
+    { "CreatePullPointSubscription",       ACCESS_READ_MEDIA            },
+    { "CreateUsers",                       ACCESS_WRITE_SYSTEM          },
+    { "DeleteOSD",                         ACCESS_ACTUATE               },
+    { "DeleteProfile",                     ACCESS_ACTUATE               },
+    { "GeoMove",                           ACCESS_ACTUATE               },
+    { "GetAccessPolicy",                   ACCESS_READ_SYSTEM_SECRET    },
+    { "GetCapabilities",                   ACCESS_PRE_AUTH              },
+    { "GetEndpointReference",              ACCESS_PRE_AUTH              },
+    { "GetEventProperties",                ACCESS_READ_MEDIA            },
+    { "GetProfile",                        ACCESS_READ_MEDIA            },
+    { "GetProfiles",                       ACCESS_READ_MEDIA            },
+    { "GetRemoteUser",                     ACCESS_READ_SYSTEM_SECRET    },
+    { "GetServiceCapabilities",            ACCESS_PRE_AUTH              },
+    { "GetServices",                       ACCESS_PRE_AUTH              },
+    { "GetSnapshotUri",                    ACCESS_READ_MEDIA            },
+    { "GetStreamUri",                      ACCESS_READ_MEDIA            },
+    { "GetSystemBackup",                   ACCESS_READ_SYSTEM_SECRET    },
+    { "GetSystemDateAndTime",              ACCESS_PRE_AUTH              },
+    { "GetSystemLog",                      ACCESS_READ_SYSTEM_SENSITIVE },
+    { "GetSystemSupportInformation",       ACCESS_READ_SYSTEM_SENSITIVE },
+    { "GetUsers",                          ACCESS_READ_SYSTEM_SECRET    },
+    { "GetWsdlUrl",                        ACCESS_PRE_AUTH              },
+    { "GotoHomePosition",                  ACCESS_ACTUATE               },
+    { "GotoPreset",                        ACCESS_ACTUATE               },
+    { "MoveAndStartTracking",              ACCESS_ACTUATE               },
+    { "OperatePresetTour",                 ACCESS_ACTUATE               },
+    { "PullMessages",                      ACCESS_READ_MEDIA            },
+    { "RelativeMove",                      ACCESS_ACTUATE               },
+    { "RemoveAudioDecoderConfiguration",   ACCESS_ACTUATE               },
+    { "RemoveAudioEncoderConfiguration",   ACCESS_ACTUATE               },
+    { "RemoveAudioOutputConfiguration",    ACCESS_ACTUATE               },
+    { "RemoveAudioSourceConfiguration",    ACCESS_ACTUATE               },
+    { "RemoveConfiguration",               ACCESS_ACTUATE               },
+    { "RemoveMetadataConfiguration",       ACCESS_ACTUATE               },
+    { "RemovePTZConfiguration",            ACCESS_ACTUATE               },
+    { "RemovePreset",                      ACCESS_ACTUATE               },
+    { "RemoveVideoAnalyticsConfiguration", ACCESS_ACTUATE               },
+    { "RemoveVideoEncoderConfiguration",   ACCESS_ACTUATE               },
+    { "RemoveVideoSourceConfiguration",    ACCESS_ACTUATE               },
+    { "Renew",                             ACCESS_READ_MEDIA            },
+    { "RestoreSystem",                     ACCESS_UNRECOVERABLE         },
+    { "Seek",                              ACCESS_READ_MEDIA            },
+    { "SendAuxiliaryCommand",              ACCESS_ACTUATE               },
+    { "SetAudioDecoderConfiguration",      ACCESS_ACTUATE               },
+    { "SetAudioEncoderConfiguration",      ACCESS_ACTUATE               },
+    { "SetAudioOutputConfiguration",       ACCESS_ACTUATE               },
+    { "SetAudioSourceConfiguration",       ACCESS_ACTUATE               },
+    { "SetConfiguration",                  ACCESS_ACTUATE               },
+    { "SetHomePosition",                   ACCESS_ACTUATE               },
+    { "SetMetadataConfiguration",          ACCESS_ACTUATE               },
+    { "SetOSD",                            ACCESS_ACTUATE               },
+    { "SetPreset",                         ACCESS_ACTUATE               },
+    { "SetRelayOutputState",               ACCESS_ACTUATE               },
+    { "SetSynchronizationPoint",           ACCESS_READ_MEDIA            },
+    { "SetSystemFactoryDefault",           ACCESS_UNRECOVERABLE         },
+    { "SetVideoAnalyticsConfiguration",    ACCESS_ACTUATE               },
+    { "SetVideoEncoderConfiguration",      ACCESS_ACTUATE               },
+    { "SetVideoSourceConfiguration",       ACCESS_ACTUATE               },
+    { "SetVideoSourceMode",                ACCESS_ACTUATE               },
+    { "StartFirmwareUpgrade",              ACCESS_UNRECOVERABLE         },
+    { "StartMulticastStreaming",           ACCESS_ACTUATE               },
+    { "StartSystemRestore",                ACCESS_UNRECOVERABLE         },
+    { "Stop",                              ACCESS_ACTUATE               },
+    { "StopMulticastStreaming",            ACCESS_ACTUATE               },
+    { "Subscribe",                         ACCESS_READ_MEDIA            },
+    { "SystemReboot",                      ACCESS_UNRECOVERABLE         },
+    { "Unsubscribe",                       ACCESS_READ_MEDIA            },
+    { "UpgradeSystemFirmware",             ACCESS_UNRECOVERABLE         }
+};
+
+
+
+AccessClass get_access_class(const char *operation)
+{
+    const char *name = strchr(operation, ':');
+    name = name ? name + 1 : operation;
+
+
+    size_t lo = 0;
+    size_t hi = COUNT_ELEMENTS(operations);
+
+    while( lo < hi )
+    {
+        size_t mid = (lo + hi) / 2;
+        int    cmp = strcmp(name, operations[mid].name);
+
+        if( !cmp )
+            return operations[mid].access;
+
+        if( cmp < 0 )
+            hi = mid;
+        else
+            lo = mid + 1;
+    }
+
+
+    return strncmp(name, "Get", 3) ? ACCESS_WRITE_SYSTEM : ACCESS_READ_SYSTEM;
+}
+
+
+
+const char *get_access_class_name(AccessClass access)
+{
+    static const char *names[] =
+    {
+        "PRE_AUTH",
+        "READ_SYSTEM",
+        "READ_SYSTEM_SENSITIVE",
+        "READ_SYSTEM_SECRET",
+        "WRITE_SYSTEM",
+        "UNRECOVERABLE",
+        "READ_MEDIA",
+        "ACTUATE"
+    };
+
+    return ((size_t)access < COUNT_ELEMENTS(names)) ? names[access] : "";
+}
+
+
+
+bool is_allowed(UserLevel level, AccessClass access)
+{
+    switch( level )
+    {
+        case USER_LEVEL_ADMINISTRATOR:
+            return true;
+
+        case USER_LEVEL_OPERATOR:
+            return (access != ACCESS_READ_SYSTEM_SECRET) && (access != ACCESS_WRITE_SYSTEM) &&
+                   (access != ACCESS_UNRECOVERABLE);
+
+        case USER_LEVEL_USER:
+            return (access == ACCESS_PRE_AUTH) || (access == ACCESS_READ_SYSTEM) || (access == ACCESS_READ_MEDIA);
+
+        default:
+            return access == ACCESS_PRE_AUTH;
+    }
+}
@@ -0,0 +1,52 @@
+#ifndef ACCESS_POLICY_H
+#define ACCESS_POLICY_H
+
+
+
+
+
+/*
+ * Access classes of the operations (ONVIF Core, Default Access Policy).
+ * PRE_AUTH operations are served without credentials: a client needs them to
+ * find the services and to synchronize its clock for the digest.
+ */
+enum AccessClass
+{
+    ACCESS_PRE_AUTH,
+    ACCESS_READ_SYSTEM,
+    ACCESS_READ_SYSTEM_SENSITIVE,
+    ACCESS_READ_SYSTEM_SECRET,
+    ACCESS_WRITE_SYSTEM,
+    ACCESS_UNRECOVERABLE,
+    ACCESS_READ_MEDIA,
+    ACCESS_ACTUATE
+};
+
+
+
+// levels of the users (ONVIF tt:UserLevel, the same values)
+enum UserLevel
+{
+    USER_LEVEL_ADMINISTRATOR,
+    USER_LEVEL_OPERATOR,
+    USER_LEVEL_USER,
+    USER_LEVEL_ANONYMOUS
+};
+
+
+
+// operation is the name of the request element, the prefix is ignored
+// (tds:GetServices), unknown operations are READ_SYSTEM (Get*) or WRITE_SYSTEM
+AccessClass get_access_class(const char *operation);
+
+const char *get_access_class_name(AccessClass access);
+
+// default access policy: Administrator - all, Operator - all but the secrets
+// and the changes of the system, User - reading, Anonymous - PRE_AUTH
+bool is_allowed(UserLevel level, AccessClass access);
+
+
+
+
+
+#endif // ACCESS_POLICY_H
@@ -0,0 +1,139 @@
+#include "auth_sessions.h"
+
+
+
+
+
+static time_t get_uptime(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return ts.tv_sec;
+}
+
+
+
+AuthSessions::AuthSessions():
+    hits  ( 0 ),
+    misses( 0 )
+{
+    for( size_t i = 0; i < SESSIONS; ++i )
+    {
+        sessions[i].connection = 0;
+        sessions[i].ip         = 0;
+        sessions[i].scheme     = HTTP_DIGEST;
+        sessions[i].user       = NULL;
+        sessions[i].expires    = 0;
+        sessions[i].used       = 0;
+    }
+}
+
+
+
+AuthSessions::Session *AuthSessions::get_session(uint64_t connection)
+{
+    for( size_t i = 0; i < SESSIONS; ++i )
+    {
+        if( sessions[i].connection == connection )
+            return &sessions[i];
+    }
+
+    return NULL;
+}
+
+
+
+const User *AuthSessions::find(uint64_t connection, unsigned long client_ip, Scheme scheme,
+                               const UserMapPtr &current_users)
+{
+    Session *session = connection ? get_session(connection) : NULL;
+    time_t   now     = get_uptime();
+
+    if( !session || (session->users != current_users) || (session->ip != client_ip) ||
+        (session->scheme != scheme) || (now >= session->expires) )
+        return NULL;
+
+
+    session->used = now;
+    return session->user;
+}
+
+
+
+void AuthSessions::verified(uint64_t connection, unsigned long client_ip, Scheme scheme,
+                            const UserMapPtr &current_users, const User *verified_user, bool hit)
+{
+    if( hit )
+    {
+        hits++; // the session is not extended, TTL bounds it
+        return;
+    }
+
+
+    misses++;
+
+    if( !connection )
+        return;
+
+
+    Session *session = get_session(connection);
+
+    for( size_t i = 0; !session && (i < SESSIONS); ++i )
+    {
+        if( !sessions[i].connection )
+            session = &sessions[i];
+    }
+
+    if( !session ) // the least recently used one
+    {
+        session = &sessions[0];
+
+        for( size_t i = 1; i < SESSIONS; ++i )
+        {
+            if( sessions[i].used < session->used )
+                session = &sessions[i];
+        }
+    }
+
+
+    time_t now = get_uptime();
+
+    session->connection = connection;
+    session->ip         = client_ip;
+    session->scheme     = scheme;
+    session->users      = current_users;
+    session->user       = verified_user;
+    session->expires    = now + TTL;
+    session->used       = now;
+}
+
+
+
+void AuthSessions::close(uint64_t connection)
+{
+    Session *session = connection ? get_session(connection) : NULL;
+    if( !session )
+        return;
+
+
+    session->connection = 0;
+    session->users.reset();
+    session->user = NULL;
+}
+
+
+
+void AuthSessions::dump_stats(FILE *fp) const
+{
+    size_t open = 0;
+
+    for( size_t i = 0; i < SESSIONS; ++i )
+        open += (sessions[i].connection != 0);
+
+
+    fprintf(fp, "Auth sessions: open %zu  hits %llu  misses %llu (users looked up)\n",
+            open,
+            (unsigned long long)hits,
+            (unsigned long long)misses);
+}
@@ -0,0 +1,85 @@
+#ifndef AUTH_SESSIONS_H
+#define AUTH_SESSIONS_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <time.h>
+
+#include "user_store.h"
+
+
+
+
+
+/*
+ * Authenticated sessions of the kept-alive connections.
+ *
+ * A client that keeps the connection open (a VMS polling GetStatus) sends
+ * many requests on it. When the credentials of a request are verified, the
+ * session of the connection remembers the client IP, the scheme (HTTP Digest
+ * or UsernameToken), the user and the set of users. The next requests of the
+ * same user with the same scheme on the connection are verified as usual
+ * (fresh nonce, the digest is compared), the session only saves the lookup of
+ * the user, the derived keys are cached by the schemes (H(A1) in User, H(A2)
+ * in HttpDigest).
+ *
+ * The sessions are kept in a fixed table of SESSIONS (more than the kept
+ * connections, see KeptConnections), a new session takes the least recently
+ * used one. The connections are numbered by the main loop, a number is never
+ * reused. A session ends with its connection, after TTL and when the users
+ * are changed.
+ */
+class AuthSessions
+{
+public:
+    AuthSessions();
+
+    static const size_t SESSIONS = 32;
+    static const time_t TTL      = 60; // sec
+
+    enum Scheme
+    {
+        HTTP_DIGEST,
+        WSSE
+    };
+
+    // user of the session of the connection if it is open for the client, the scheme and the users
+    const User *find(uint64_t connection, unsigned long client_ip, Scheme scheme,
+                     const UserMapPtr &current_users);
+
+    // credentials of user are verified with the user of the session (hit) or
+    // the looked up one (miss, opens the session of the connection)
+    void verified(uint64_t connection, unsigned long client_ip, Scheme scheme,
+                  const UserMapPtr &current_users, const User *verified_user, bool hit);
+
+    // the connection is closed
+    void close(uint64_t connection);
+
+    void dump_stats(FILE *fp) const;
+
+private:
+    struct Session
+    {
+        uint64_t      connection; // 0 - free
+        unsigned long ip;
+        Scheme        scheme;
+        UserMapPtr    users;      // holds user
+        const User   *user;
+        time_t        expires;    // CLOCK_MONOTONIC
+        time_t        used;
+    };
+
+    Session sessions[SESSIONS];
+
+    uint64_t hits;
+    uint64_t misses;
+
+    Session *get_session(uint64_t connection);
+};
+
+
+
+
+
+#endif // AUTH_SESSIONS_H
@@ -0,0 +1,945 @@
+#include <errno.h>
+#include <string.h>
+#include <ctype.h>
+#include <time.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <net/if.h>
+#include <sys/socket.h>
+#include <linux/netlink.h>
+#include <linux/rtnetlink.h>
+
+#include "discovery_responder.h"
+#include "ServiceContext.h"
+#include "smacros.h"
+
+
+
+
+
+static const char multicast_group[] = "239.255.255.250";
+
+static const char probe_matches_action[]   = "http://schemas.xmlsoap.org/ws/2005/04/discovery/ProbeMatches";
+static const char resolve_matches_action[] = "http://schemas.xmlsoap.org/ws/2005/04/discovery/ResolveMatches";
+static const char hello_action[]           = "http://schemas.xmlsoap.org/ws/2005/04/discovery/Hello";
+static const char bye_action[]             = "http://schemas.xmlsoap.org/ws/2005/04/discovery/Bye";
+static const char anonymous_to[]           = "http://schemas.xmlsoap.org/ws/2004/08/addressing/role/anonymous";
+static const char discovery_to[]           = "urn:schemas-xmlsoap-org:ws:2005:04:discovery";
+
+static const char match_by_rfc3986[] = "http://schemas.xmlsoap.org/ws/2005/04/discovery/rfc3986";
+static const char match_by_strcmp0[] = "http://schemas.xmlsoap.org/ws/2005/04/discovery/strcmp0";
+
+static const char device_types[] = "dn:NetworkVideoTransmitter tds:Device";
+
+static const char envelope_head[] =
+    "<?xml version=\"1.0\" encoding=\"UTF-8\"?>"
+    "<SOAP-ENV:Envelope"
+    " xmlns:SOAP-ENV=\"http://www.w3.org/2003/05/soap-envelope\""
+    " xmlns:wsa=\"http://schemas.xmlsoap.org/ws/2004/08/addressing\""
+    " xmlns:wsd=\"http://schemas.xmlsoap.org/ws/2005/04/discovery\""
+    " xmlns:dn=\"http://www.onvif.org/ver10/network/wsdl\""
+    " xmlns:tds=\"http://www.onvif.org/ver10/device/wsdl\">"
+    "<SOAP-ENV:Header>";
+
+
+
+static int64_t now_ms(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return (int64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+
+
+static void append_escaped(std::string &out, const char *str, size_t len)
+{
+    for( size_t i = 0; i < len; ++i )
+    {
+        switch( str[i] )
+        {
+            case '&':  out += "&amp;";  break;
+            case '<':  out += "&lt;";   break;
+            case '>':  out += "&gt;";   break;
+            case '"':  out += "&quot;"; break;
+            default:   out += str[i];   break;
+        }
+    }
+}
+
+
+
+// EndpointReference, Types, Scopes, XAddrs and MetadataVersion of Hello and the matches
+static std::string build_endpoint_info(const std::string &endpoint, const std::string &scopes, const std::string &xaddr)
+{
+    std::string out;
+
+    out += "<wsa:EndpointReference><wsa:Address>";
+    out += endpoint;
+    out += "</wsa:Address></wsa:EndpointReference><wsd:Types>";
+    out += device_types;
+    out += "</wsd:Types><wsd:Scopes>";
+    append_escaped(out, scopes.data(), scopes.size());
+    out += "</wsd:Scopes><wsd:XAddrs>";
+    append_escaped(out, xaddr.data(), xaddr.size());
+    out += "</wsd:XAddrs><wsd:MetadataVersion>1</wsd:MetadataVersion>";
+
+    return out;
+}
+
+
+
+static std::string build_body(const char *open_tags, const std::string &content, const char *close_tags)
+{
+    return "<SOAP-ENV:Body>" + (open_tags + content) + close_tags + "</SOAP-ENV:Body></SOAP-ENV:Envelope>";
+}
+
+
+
+/*
+ * The requests are small and flat, they are scanned for the elements by
+ * local name (the prefixes are not resolved), the content is the text up to
+ * the first child or end tag.
+ */
+struct XmlElement
+{
+    const char *attrs;     // after the name
+    const char *attrs_end;
+    const char *text;      // trimmed
+    const char *text_end;
+};
+
+
+
+static bool find_element(const char *pos, const char *end, const char *name, XmlElement &elem)
+{
+    size_t name_len = strlen(name);
+
+    while( (pos < end) && (pos = (const char *)memchr(pos, '<', end - pos)) )
+    {
+        const char *tag = ++pos;
+
+        while( (pos < end) && !isspace((unsigned char)*pos) && (*pos != '>') && (*pos != '/') )
+            pos++;
+
+        if( (tag == pos) || (*tag == '?') || (*tag == '!') )
+            continue; // end tag, declaration or comment
+
+        const char *colon = (const char *)memchr(tag, ':', pos - tag);
+        const char *local = colon ? colon + 1 : tag;
+
+        if( ((size_t)(pos - local) != name_len) || memcmp(local, name, name_len) )
+            continue;
+
+
+        const char *gt = (const char *)memchr(pos, '>', end - pos);
+        if( !gt )
+            return false;
+
+        elem.attrs     = pos;
+        elem.attrs_end = gt;
+
+        if( gt[-1] == '/' )
+        {
+            elem.attrs_end = gt - 1;
+            elem.text      = gt;
+            elem.text_end  = gt;
+            return true;
+        }
+
+
+        elem.text     = gt + 1;
+        elem.text_end = (const char *)memchr(elem.text, '<', end - elem.text);
+        if( !elem.text_end )
+            elem.text_end = end;
+
+        while( (elem.text < elem.text_end) && isspace((unsigned char)*elem.text) )
+            elem.text++;
+
+        while( (elem.text_end > elem.text) && isspace((unsigned char)elem.text_end[-1]) )
+            elem.text_end--;
+
+        return true;
+    }
+
+    return false;
+}
+
+
+
+// value of the attribute (any prefix), empty if it is not set
+static std::string get_attr(const XmlElement &elem, const char *name)
+{
+    size_t len = strlen(name);
+
+    for( const char *pos = elem.attrs; pos + len + 2 < elem.attrs_end; ++pos )
+    {
+        if( memcmp(pos, name, len) || ((pos[-1] != ':') && !isspace((unsigned char)pos[-1])) )
+            continue;
+
+        const char *eq = pos + len;
+        while( (eq < elem.attrs_end) && isspace((unsigned char)*eq) )
+            eq++;
+
+        if( (eq + 1 >= elem.attrs_end) || (*eq != '=') )
+            continue;
+
+        const char *quote = eq + 1;
+        while( (quote < elem.attrs_end) && isspace((unsigned char)*quote) )
+            quote++;
+
+        if( (quote >= elem.attrs_end) || ((*quote != '"') && (*quote != '\'')) )
+            continue;
+
+        const char *value_end = (const char *)memchr(quote + 1, *quote, elem.attrs_end - quote - 1);
+        if( value_end )
+            return std::string(quote + 1, value_end);
+    }
+
+    return std::string();
+}
+
+
+
+// the next word of a list (Types, Scopes), false at the end
+static bool next_word(const char *&pos, const char *end, const char *&word, size_t &len)
+{
+    while( (pos < end) && isspace((unsigned char)*pos) )
+        pos++;
+
+    word = pos;
+
+    while( (pos < end) && !isspace((unsigned char)*pos) )
+        pos++;
+
+    len = pos - word;
+
+    return len > 0;
+}
+
+
+
+// all types of the Probe are the types of the device (the prefixes are not resolved)
+static bool match_types(const XmlElement &types)
+{
+    const char *pos = types.text;
+    const char *word;
+    size_t      len;
+
+    while( next_word(pos, types.text_end, word, len) )
+    {
+        const char *colon = (const char *)memchr(word, ':', len);
+        if( colon )
+        {
+            len -= colon + 1 - word;
+            word = colon + 1;
+        }
+
+        std::string type(word, len);
+
+        if( (type != "NetworkVideoTransmitter") && (type != "Device") )
+            return false;
+    }
+
+    return true;
+}
+
+
+
+// RFC 3986 matching is simplified to the match of whole segments of the path
+static bool match_scope(const std::string &scope, const char *probe, size_t len, bool rfc3986)
+{
+    if( scope.size() == len )
+        return !memcmp(scope.data(), probe, len);
+
+    if( !rfc3986 || (scope.size() < len) || memcmp(scope.data(), probe, len) )
+        return false;
+
+    return (probe[len - 1] == '/') || (scope[len] == '/');
+}
+
+
+
+// all scopes of the Probe are the scopes of the device
+static bool match_scopes(const XmlElement &probe_scopes, const std::vector<std::string> &scopes)
+{
+    std::string match_by = get_attr(probe_scopes, "MatchBy");
+    bool rfc3986 = match_by.empty() || (match_by == match_by_rfc3986);
+
+    if( !rfc3986 && (match_by != match_by_strcmp0) )
+        return false;
+
+
+    const char *pos = probe_scopes.text;
+    const char *word;
+    size_t      len;
+
+    while( next_word(pos, probe_scopes.text_end, word, len) )
+    {
+        bool found = false;
+
+        for( size_t i = 0; (i < scopes.size()) && !found; ++i )
+            found = match_scope(scopes[i], word, len, rfc3986);
+
+        if( !found )
+            return false;
+    }
+
+    return true;
+}
+
+
+
+DiscoveryResponder::DiscoveryResponder():
+    enable        ( false ),
+    fd            ( -1 ),
+    netlink_fd    ( -1 ),
+    ctx           ( NULL ),
+    discoverable  ( true ),
+    instance_id   ( 0 ),
+    message_number( 0 ),
+    rng           ( 0 ),
+    pending       ( MAX_PENDING ),
+    timers        ( now_ms() / TICK_MS ),
+    seen_pos      ( 0 ),
+    probes        ( 0 ),
+    resolves      ( 0 ),
+    duplicates    ( 0 ),
+    responses     ( 0 ),
+    changes       ( 0 )
+{
+    memset(seen, 0, sizeof(seen));
+
+    for( size_t i = MAX_PENDING; i > 0; --i )
+    {
+        pending[i - 1].in_use = false;
+        pending[i - 1].timer  = TimerWheel::NO_TIMER;
+        free_pending.push_back(&pending[i - 1]);
+    }
+}
+
+
+
+bool DiscoveryResponder::open(const ServiceContext &service_ctx)
+{
+    close();
+
+    ctx = &service_ctx;
+
+
+    // the endpoint must not change between restarts, it is made from the MAC
+    uint8_t mac[6] = { 0 };
+    char    uuid[64];
+
+    if( !ctx->eth_ifs.empty() )
+        ctx->eth_ifs[0].get_hwaddr(mac);
+
+    snprintf(uuid, sizeof(uuid), "urn:uuid:6f6e7669-6673-7276-8000-%02x%02x%02x%02x%02x%02x",
+             mac[0], mac[1], mac[2], mac[3], mac[4], mac[5]);
+
+    endpoint       = uuid;
+    bye            = build_body("<wsd:Bye><wsa:EndpointReference><wsa:Address>", endpoint,
+                                "</wsa:Address></wsa:EndpointReference></wsd:Bye>");
+    instance_id    = time(NULL);
+    message_number = 0;
+    rng            = ((uint64_t)time(NULL) << 20) ^ ((uint64_t)getpid() << 8) ^ mac[5] ^ 0x9E3779B97F4A7C15ULL;
+
+
+    fd = socket(AF_INET, SOCK_DGRAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if( fd < 0 )
+    {
+        str_err = "can't create discovery socket";
+        return false;
+    }
+
+
+    int on  = 1;
+    int off = 0;
+    setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+    setsockopt(fd, IPPROTO_IP, IP_PKTINFO, &on, sizeof(on)); // interface and destination of the request
+    setsockopt(fd, IPPROTO_IP, IP_MULTICAST_LOOP, &off, sizeof(off));
+
+    struct sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family      = AF_INET;
+    addr.sin_port        = htons(PORT);
+    addr.sin_addr.s_addr = htonl(INADDR_ANY);
+
+    if( bind(fd, (struct sockaddr *)&addr, sizeof(addr)) != 0 )
+    {
+        close();
+        str_err = "can't bind discovery socket to port 3702";
+        return false;
+    }
+
+
+    if( !update() )
+    {
+        close();
+        return false;
+    }
+
+
+    // new addresses of the interfaces
+    netlink_fd = socket(AF_NETLINK, SOCK_RAW | SOCK_NONBLOCK | SOCK_CLOEXEC, NETLINK_ROUTE);
+
+    struct sockaddr_nl nl_addr;
+    memset(&nl_addr, 0, sizeof(nl_addr));
+    nl_addr.nl_family = AF_NETLINK;
+    nl_addr.nl_groups = RTMGRP_IPV4_IFADDR;
+
+    if( (netlink_fd < 0) || (bind(netlink_fd, (struct sockaddr *)&nl_addr, sizeof(nl_addr)) != 0) )
+    {
+        close();
+        str_err = "can't open netlink socket for the address changes";
+        return false;
+    }
+
+
+    for( size_t i = 0; discoverable && (i < ifaces.size()); ++i )
+        announce(ifaces[i], true);
+
+    return true;
+}
+
+
+
+void DiscoveryResponder::close(void)
+{
+    if( netlink_fd >= 0 )
+    {
+        ::close(netlink_fd);
+        netlink_fd = -1;
+    }
+
+    if( fd < 0 )
+        return;
+
+
+    for( size_t i = 0; discoverable && (i < ifaces.size()); ++i )
+        announce(ifaces[i], false);
+
+    ::close(fd);
+    fd = -1;
+}
+
+
+
+void DiscoveryResponder::set_discoverable(bool new_val)
+{
+    if( new_val == discoverable )
+        return;
+
+
+    // Bye is sent while the device is still discoverable, Hello after it is
+    discoverable = true;
+
+    for( size_t i = 0; (fd >= 0) && (i < ifaces.size()); ++i )
+        announce(ifaces[i], new_val);
+
+    discoverable = new_val;
+}
+
+
+
+bool DiscoveryResponder::update(void)
+{
+    // the waiting responses refer to the old interfaces, the clients repeat the Probe
+    for( size_t i = 0; i < pending.size(); ++i )
+    {
+        if( !pending[i].in_use )
+            continue;
+
+        timers.cancel(pending[i].timer);
+        pending[i].in_use = false;
+        pending[i].timer  = TimerWheel::NO_TIMER;
+        free_pending.push_back(&pending[i]);
+    }
+
+
+    scopes = ctx->scopes;
+
+    std::string all_scopes;
+
+    for( size_t i = 0; i < scopes.size(); ++i )
+    {
+        if( i )
+            all_scopes += ' ';
+
+        all_scopes += scopes[i];
+    }
+
+
+    ifaces.clear();
+
+    for( size_t i = 0; i < ctx->eth_ifs.size(); ++i )
+    {
+        Interface iface;
+        uint32_t  ip = 0;
+
+        iface.index = if_nametoindex(ctx->eth_ifs[i].dev_name());
+
+        if( !iface.index || (ctx->eth_ifs[i].get_ip(&ip) != 0) || !ip )
+            continue; // no address yet
+
+        iface.addr.s_addr = ip;
+
+
+        char ip_str[INET_ADDRSTRLEN];
+        char xaddr[160];
+        int  len;
+
+        inet_ntop(AF_INET, &iface.addr, ip_str, sizeof(ip_str));
+        len = snprintf(xaddr, sizeof(xaddr), "http://%s:%d/onvif/device_service", ip_str, ctx->port);
+
+        // XAddrs is a list, the clients of HTTPS take the second address
+        if( ctx->is_tls_enabled() )
+            snprintf(xaddr + len, sizeof(xaddr) - len, " https://%s:%d/onvif/device_service",
+                     ip_str, ctx->get_tls_port());
+
+        std::string info = build_endpoint_info(endpoint, all_scopes, xaddr);
+
+        iface.probe_matches   = build_body("<wsd:ProbeMatches><wsd:ProbeMatch>", info,
+                                           "</wsd:ProbeMatch></wsd:ProbeMatches>");
+        iface.resolve_matches = build_body("<wsd:ResolveMatches><wsd:ResolveMatch>", info,
+                                           "</wsd:ResolveMatch></wsd:ResolveMatches>");
+        iface.hello           = build_body("<wsd:Hello>", info, "</wsd:Hello>");
+
+
+        // the group is joined once per interface, EADDRINUSE for the next calls
+        struct ip_mreqn mreq;
+        memset(&mreq, 0, sizeof(mreq));
+        inet_pton(AF_INET, multicast_group, &mreq.imr_multiaddr);
+        mreq.imr_ifindex = iface.index;
+
+        setsockopt(fd, IPPROTO_IP, IP_ADD_MEMBERSHIP, &mreq, sizeof(mreq));
+
+        ifaces.push_back(iface);
+    }
+
+
+    if( ifaces.empty() )
+    {
+        str_err = "no interface with IPv4 address for discovery";
+        return false;
+    }
+
+    return true;
+}
+
+
+
+// an address of our interface was added or removed: the responses are built
+// for the new addresses, Bye and Hello are sent where the address is changed
+void DiscoveryResponder::on_netlink(void)
+{
+    uint32_t buf[2048]; // aligned for nlmsghdr
+    bool     changed = false;
+
+    while( true )
+    {
+        int len = recv(netlink_fd, buf, sizeof(buf), MSG_DONTWAIT);
+
+        if( len < 0 )
+        {
+            if( errno == ENOBUFS )
+            {
+                changed = true; // messages are lost, read the addresses anyway
+                continue;
+            }
+
+            break;
+        }
+
+
+        for( struct nlmsghdr *nh = (struct nlmsghdr *)buf; NLMSG_OK(nh, (unsigned)len); nh = NLMSG_NEXT(nh, len) )
+        {
+            if( (nh->nlmsg_type != RTM_NEWADDR) && (nh->nlmsg_type != RTM_DELADDR) )
+                continue;
+
+            const struct ifaddrmsg *ifa = (const struct ifaddrmsg *)NLMSG_DATA(nh);
+
+            for( size_t i = 0; i < ctx->eth_ifs.size(); ++i )
+            {
+                if( if_nametoindex(ctx->eth_ifs[i].dev_name()) == ifa->ifa_index )
+                    changed = true;
+            }
+        }
+    }
+
+    if( !changed )
+        return;
+
+
+    std::vector<Interface> old;
+    old.swap(ifaces);
+
+    update();
+
+    for( size_t i = 0; i < old.size(); ++i )
+    {
+        bool found = false;
+
+        for( size_t j = 0; j < ifaces.size(); ++j )
+        {
+            if( old[i].index != ifaces[j].index )
+                continue;
+
+            found = true;
+
+            if( old[i].addr.s_addr == ifaces[j].addr.s_addr )
+                continue;
+
+            changes++;
+            DEBUG_MSG("Discovery: address of interface %d is changed\n", ifaces[j].index);
+
+            // the old address is gone, Bye goes out from the new one
+            if( discoverable )
+                announce(ifaces[j], false);
+        }
+
+        if( found )
+            continue;
+
+
+        // the last address of the interface is gone: Bye goes out of the
+        // interface with the source address chosen by the kernel
+        changes++;
+        DEBUG_MSG("Discovery: interface %d has no address\n", old[i].index);
+
+        if( discoverable )
+        {
+            old[i].addr.s_addr = htonl(INADDR_ANY);
+            announce(old[i], false);
+        }
+    }
+
+    for( size_t j = 0; discoverable && (j < ifaces.size()); ++j )
+    {
+        bool same = false;
+
+        for( size_t i = 0; (i < old.size()) && !same; ++i )
+            same = (old[i].index == ifaces[j].index) && (old[i].addr.s_addr == ifaces[j].addr.s_addr);
+
+        if( !same )
+            announce(ifaces[j], true);
+    }
+}
+
+
+
+void DiscoveryResponder::announce(const Interface &iface, bool hello)
+{
+    sockaddr_in to;
+    memset(&to, 0, sizeof(to));
+    to.sin_family = AF_INET;
+    to.sin_port   = htons(PORT);
+    inet_pton(AF_INET, multicast_group, &to.sin_addr);
+
+    send_message(to, iface, discovery_to, hello ? hello_action : bye_action, NULL, hello ? iface.hello : bye);
+}
+
+
+
+// xorshift64*, for the delays and MessageIDs
+uint64_t DiscoveryResponder::random(void)
+{
+    rng ^= rng >> 12;
+    rng ^= rng << 25;
+    rng ^= rng >> 27;
+
+    return rng * 2685821657736338717ULL;
+}
+
+
+
+bool DiscoveryResponder::is_seen(const char *msg_id, size_t len)
+{
+    // FNV-1a, 0 is an empty entry
+    uint64_t hash = 14695981039346656037ULL;
+
+    for( size_t i = 0; i < len; ++i )
+        hash = (hash ^ (uint8_t)msg_id[i]) * 1099511628211ULL;
+
+    hash |= 1;
+
+
+    for( size_t i = 0; i < SEEN_IDS; ++i )
+    {
+        if( seen[i] == hash )
+            return true;
+    }
+
+    seen[seen_pos] = hash;
+    seen_pos = (seen_pos + 1) % SEEN_IDS;
+
+    return false;
+}
+
+
+
+void DiscoveryResponder::process(bool readable, bool netlink_readable)
+{
+    if( netlink_readable )
+        on_netlink();
+
+    for( size_t n = 0; readable && (n < 64); ++n )
+    {
+        char        buf[4096];
+        char        control[CMSG_SPACE(sizeof(struct in_pktinfo))];
+        sockaddr_in from;
+        struct iovec iov = { buf, sizeof(buf) };
+
+        struct msghdr msg;
+        memset(&msg, 0, sizeof(msg));
+        msg.msg_name       = &from;
+        msg.msg_namelen    = sizeof(from);
+        msg.msg_iov        = &iov;
+        msg.msg_iovlen     = 1;
+        msg.msg_control    = control;
+        msg.msg_controllen = sizeof(control);
+
+        ssize_t len = recvmsg(fd, &msg, MSG_DONTWAIT);
+        if( len <= 0 )
+            break;
+
+        if( msg.msg_flags & MSG_TRUNC )
+            continue;
+
+
+        const struct in_pktinfo *info = NULL;
+
+        for( struct cmsghdr *cmsg = CMSG_FIRSTHDR(&msg); cmsg; cmsg = CMSG_NXTHDR(&msg, cmsg) )
+        {
+            if( (cmsg->cmsg_level == IPPROTO_IP) && (cmsg->cmsg_type == IP_PKTINFO) )
+                info = (const struct in_pktinfo *)CMSG_DATA(cmsg);
+        }
+
+        if( info )
+            receive(buf, len, from, info->ipi_ifindex, IN_MULTICAST(ntohl(info->ipi_addr.s_addr)));
+    }
+
+
+    expired.clear();
+    timers.advance(now_ms() / TICK_MS, expired);
+
+    for( size_t i = 0; i < expired.size(); ++i )
+    {
+        Pending &response = *(Pending *)expired[i];
+
+        send(response);
+
+        response.in_use = false;
+        response.timer  = TimerWheel::NO_TIMER; // it is freed by the wheel
+        free_pending.push_back(&response);
+    }
+}
+
+
+
+void DiscoveryResponder::receive(const char *data, size_t len, const sockaddr_in &from, int if_index, bool multicast)
+{
+    size_t iface = 0;
+
+    while( (iface < ifaces.size()) && (ifaces[iface].index != if_index) )
+        iface++;
+
+    if( iface == ifaces.size() )
+        return; // not our interface
+
+
+    const char *end = data + len;
+    XmlElement  body, msg_id, elem;
+
+    if( !find_element(data, end, "Body", body) ||
+        !find_element(data, body.attrs, "MessageID", msg_id) || (msg_id.text == msg_id.text_end) )
+        return;
+
+
+    bool probe;
+
+    if( find_element(body.text, end, "Probe", elem) )
+    {
+        probes++;
+        probe = true;
+
+        if( multicast && !discoverable )
+            return;
+
+        if( is_seen(msg_id.text, msg_id.text_end - msg_id.text) )
+        {
+            duplicates++;
+            return;
+        }
+
+        XmlElement list;
+
+        if( find_element(elem.attrs, end, "Types", list) && !match_types(list) )
+            return;
+
+        if( find_element(elem.attrs, end, "Scopes", list) && !match_scopes(list, scopes) )
+            return;
+    }
+    else if( find_element(body.text, end, "Resolve", elem) )
+    {
+        resolves++;
+        probe = false;
+
+        if( is_seen(msg_id.text, msg_id.text_end - msg_id.text) )
+        {
+            duplicates++;
+            return;
+        }
+
+        XmlElement address;
+
+        if( !find_element(elem.attrs, end, "Address", address) ||
+            ((size_t)(address.text_end - address.text) != endpoint.size()) ||
+            memcmp(address.text, endpoint.data(), endpoint.size()) )
+            return;
+    }
+    else
+    {
+        return; // Hello, Bye or matches of other devices
+    }
+
+
+    // a multicast request is answered after a random delay (the responses of
+    // all devices of the network must not come at once)
+    int64_t delay_ms = multicast ? (int64_t)(random() % (MAX_DELAY_MS + 1)) : 0;
+
+    schedule(from, iface, probe, msg_id.text, msg_id.text_end - msg_id.text, delay_ms);
+}
+
+
+
+void DiscoveryResponder::schedule(const sockaddr_in &to, size_t iface, bool probe,
+                                  const char *relates_to, size_t relates_len, int64_t delay_ms)
+{
+    if( free_pending.empty() )
+        return; // a storm of Probes, the clients repeat them
+
+
+    // the text of the request is XML already (it has no '<')
+    if( relates_len >= sizeof(Pending::relates_to) )
+        return;
+
+
+    Pending &response = *free_pending.back();
+    free_pending.pop_back();
+
+    response.to     = to;
+    response.iface  = iface;
+    response.probe  = probe;
+    response.in_use = true;
+    memcpy(response.relates_to, relates_to, relates_len);
+    response.relates_to[relates_len] = '\0';
+
+    response.timer = timers.insert((now_ms() + delay_ms) / TICK_MS, &response);
+}
+
+
+
+void DiscoveryResponder::send(const Pending &response)
+{
+    const Interface &iface = ifaces[response.iface];
+
+    if( send_message(response.to, iface, anonymous_to,
+                     response.probe ? probe_matches_action : resolve_matches_action, response.relates_to,
+                     response.probe ? iface.probe_matches : iface.resolve_matches) )
+        responses++;
+}
+
+
+
+bool DiscoveryResponder::send_message(const sockaddr_in &to, const Interface &iface, const char *msg_to,
+                                      const char *action, const char *relates_to, const std::string &body)
+{
+    uint64_t a = random();
+    uint64_t b = random();
+    char     header[512];
+    int      len = 0;
+
+    len += snprintf(header, sizeof(header),
+                    "<wsa:MessageID>urn:uuid:%08x-%04x-4%03x-%04x-%012llx</wsa:MessageID>",
+                    (unsigned)a, (unsigned)(a >> 32) & 0xFFFF, (unsigned)(a >> 48) & 0xFFF,
+                    0x8000 | ((unsigned)b & 0x3FFF), (unsigned long long)(b >> 16) & 0xFFFFFFFFFFFFULL);
+
+    if( relates_to )
+        len += snprintf(header + len, sizeof(header) - len, "<wsa:RelatesTo>%s</wsa:RelatesTo>", relates_to);
+
+    len += snprintf(header + len, sizeof(header) - len,
+                    "<wsa:To>%s</wsa:To>"
+                    "<wsa:Action>%s</wsa:Action>"
+                    "<wsd:AppSequence InstanceId=\"%llu\" MessageNumber=\"%llu\"/>"
+                    "</SOAP-ENV:Header>",
+                    msg_to,
+                    action,
+                    (unsigned long long)instance_id,
+                    (unsigned long long)++message_number);
+
+    if( (size_t)len >= sizeof(header) )
+        return false;
+
+
+    struct iovec iov[3];
+    iov[0].iov_base = (void *)envelope_head;
+    iov[0].iov_len  = sizeof(envelope_head) - 1;
+    iov[1].iov_base = header;
+    iov[1].iov_len  = len;
+    iov[2].iov_base = (void *)body.data();
+    iov[2].iov_len  = body.size();
+
+
+    // the message goes out of the interface, from its address
+    char control[CMSG_SPACE(sizeof(struct in_pktinfo))];
+    memset(control, 0, sizeof(control));
+
+    struct msghdr msg;
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_name       = (void *)&to;
+    msg.msg_namelen    = sizeof(to);
+    msg.msg_iov        = iov;
+    msg.msg_iovlen     = COUNT_ELEMENTS(iov);
+    msg.msg_control    = control;
+    msg.msg_controllen = sizeof(control);
+
+    struct cmsghdr *cmsg = CMSG_FIRSTHDR(&msg);
+    cmsg->cmsg_level = IPPROTO_IP;
+    cmsg->cmsg_type  = IP_PKTINFO;
+    cmsg->cmsg_len   = CMSG_LEN(sizeof(struct in_pktinfo));
+
+    struct in_pktinfo *info = (struct in_pktinfo *)CMSG_DATA(cmsg);
+    info->ipi_ifindex  = iface.index;
+    info->ipi_spec_dst = iface.addr;
+
+    return sendmsg(fd, &msg, MSG_DONTWAIT) > 0;
+}
+
+
+
+int DiscoveryResponder::get_timeout_ms(int max_ms) const
+{
+    int64_t now   = now_ms();
+    int64_t ticks = timers.get_next(max_ms / TICK_MS + 1);
+    int64_t ms    = (timers.get_tick() + ticks) * TICK_MS - now;
+
+    if( ms < 0 )
+        return 0;
+
+    return (ms < max_ms) ? (int)ms : max_ms;
+}
+
+
+
+void DiscoveryResponder::dump_stats(FILE *fp) const
+{
+    fprintf(fp, "Discovery: probes %llu  resolves %llu  duplicates %llu  responses %llu  waiting %zu  address changes %llu\n",
+            (unsigned long long)probes,
+            (unsigned long long)resolves,
+            (unsigned long long)duplicates,
+            (unsigned long long)responses,
+            MAX_PENDING - free_pending.size(),
+            (unsigned long long)changes);
+}
@@ -0,0 +1,153 @@
+#ifndef DISCOVERY_RESPONDER_H
+#define DISCOVERY_RESPONDER_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <netinet/in.h>
+#include <string>
+#include <vector>
+
+#include "timer_wheel.h"
+
+
+
+
+
+class ServiceContext;
+
+
+
+/*
+ * WS-Discovery (2005/04) target service on UDP 3702, it replaces the wsdd
+ * daemon: the interfaces, scopes and XAddr come from ServiceContext.
+ *
+ * ProbeMatches and ResolveMatches are serialized once per interface, only the
+ * header (MessageID, RelatesTo, AppSequence) is made per response. A Probe
+ * which came by multicast is answered after a random delay up to
+ * MAX_DELAY_MS: the response waits in a timer wheel served by the main loop,
+ * so a storm of Probes does not block it. Probes and Resolves which were seen
+ * already (retransmissions, MessageID in the cache) are dropped.
+ *
+ * The addresses of the interfaces are watched with netlink (RTMGRP_IPV4_IFADDR):
+ * when an address changes the responses are built again and Bye (for the old
+ * address) and Hello (with the new XAddr) are sent at once, the clients do not
+ * wait for their next Probe. An interface which loses its last address sends
+ * Bye. Hello is sent on start and Bye on exit too. With HTTPS the XAddrs have
+ * the https:// address after the http:// one.
+ * In NonDiscoverable mode (SetDiscoveryMode) multicast Probes are not
+ * answered and Hello is not sent. The mode is kept in memory only, the daemon
+ * starts Discoverable.
+ */
+class DiscoveryResponder
+{
+public:
+    DiscoveryResponder();
+    ~DiscoveryResponder() { close(); }
+
+    static const uint16_t PORT         = 3702;
+    static const int64_t  MAX_DELAY_MS = 500;  // APP_MAX_DELAY
+    static const int64_t  TICK_MS      = 10;
+    static const size_t   MAX_PENDING  = 64;   // responses which wait for the delay
+    static const size_t   SEEN_IDS     = 128;  // MessageIDs of the last requests
+
+    bool enable;
+
+    // socket, multicast group on the interfaces of ctx and the responses,
+    // ctx must live until close() (the interfaces are read on changes)
+    bool open(const ServiceContext &ctx);
+
+    // Bye and close of the sockets
+    void close(void);
+
+    int get_fd(void) const { return fd; }
+    int get_netlink_fd(void) const { return netlink_fd; }
+
+    const std::string &get_endpoint(void) const { return endpoint; }
+
+    bool is_discoverable(void) const { return discoverable; }
+    void set_discoverable(bool new_val);
+
+    // read the requests (if readable), the address changes (if netlink_readable)
+    // and send the responses which are due
+    void process(bool readable, bool netlink_readable);
+
+    // time until the next response (for poll), not more than max_ms
+    int get_timeout_ms(int max_ms) const;
+
+    void dump_stats(FILE *fp) const;
+
+    std::string get_str_err() const { return str_err; }
+    const char *get_cstr_err() const { return str_err.c_str(); }
+
+private:
+    struct Interface
+    {
+        int         index;           // if_nametoindex
+        in_addr     addr;
+        std::string probe_matches;   // body of the response (after the header)
+        std::string resolve_matches;
+        std::string hello;
+    };
+
+    struct Pending
+    {
+        sockaddr_in         to;
+        size_t              iface;           // in ifaces
+        bool                probe;           // else Resolve
+        bool                in_use;
+        char                relates_to[128]; // MessageID of the request
+        TimerWheel::TimerId timer;
+    };
+
+    int                    fd;
+    int                    netlink_fd;
+    const ServiceContext  *ctx;
+    bool                   discoverable;
+    std::string            endpoint;   // urn:uuid: of the device
+    std::string            bye;        // body, the same for all interfaces
+    std::vector<Interface> ifaces;
+    std::vector<std::string> scopes;
+    uint64_t               instance_id;
+    uint64_t               message_number;
+    uint64_t               rng;
+
+    std::vector<Pending>   pending;    // MAX_PENDING, the timers point to them
+    std::vector<Pending *> free_pending;
+    TimerWheel             timers;
+    std::vector<void *>    expired;
+
+    uint64_t               seen[SEEN_IDS]; // hashes of MessageIDs, ring
+    size_t                 seen_pos;
+
+    uint64_t               probes;
+    uint64_t               resolves;
+    uint64_t               duplicates;
+    uint64_t               responses;
+    uint64_t               changes;    // of addresses
+
+    std::string str_err;
+
+    bool update(void);
+    void on_netlink(void);
+    void announce(const Interface &iface, bool hello);
+
+    uint64_t random(void);
+    bool is_seen(const char *msg_id, size_t len);
+
+    void receive(const char *data, size_t len, const sockaddr_in &from, int if_index, bool multicast);
+    void schedule(const sockaddr_in &to, size_t iface, bool probe,
+                  const char *relates_to, size_t relates_len, int64_t delay_ms);
+    void send(const Pending &response);
+    bool send_message(const sockaddr_in &to, const Interface &iface, const char *msg_to, const char *action,
+                      const char *relates_to, const std::string &body);
+
+    DiscoveryResponder(const DiscoveryResponder &);
+    DiscoveryResponder &operator=(const DiscoveryResponder &);
+};
+
+
+
+
+
+#endif // DISCOVERY_RESPONDER_H
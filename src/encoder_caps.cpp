@@ -0,0 +1,182 @@
+#include <stdio.h>
+#include <string.h>
+#include <algorithm>
+
+#include "encoder_caps.h"
+#include "smacros.h"
+
+
+
+
+
+struct EncodingDefaults
+{
+    EncoderCaps::Range quality;
+    EncoderCaps::Range fps;
+    EncoderCaps::Range interval;
+    EncoderCaps::Range gov;
+    EncoderCaps::Range bitrate;
+};
+
+
+
+// index: tt__VideoEncoding (JPEG, MPEG4, H264)
+static const EncodingDefaults encoding_defaults[] =
+{
+    //  quality      fps          interval    gov          bitrate
+    { { 0, 100 }, { 0, 20 }, { 0, 3 }, { 0, -1 }, { 64, 16000 } }, // JPEG
+    { { 0, 100 }, { 0, 20 }, { 0, 3 }, { 0, 40 }, { 64,  8000 } }, // MPEG4
+    { { 0, 100 }, { 0, 20 }, { 0, 3 }, { 0, 40 }, { 64,  8000 } }, // H264
+};
+
+
+
+EncoderCaps EncoderCaps::resolve(int encoding, int width, int height) const
+{
+    EncoderCaps caps(*this);
+
+    if( (encoding < 0) || (encoding >= (int)COUNT_ELEMENTS(encoding_defaults)) )
+        encoding = 0;
+
+
+    const EncodingDefaults &def = encoding_defaults[encoding];
+
+    if( !caps.quality.is_set() )
+        caps.quality = def.quality;
+
+    if( !caps.fps.is_set() )
+        caps.fps = def.fps;
+
+    if( !caps.interval.is_set() )
+        caps.interval = def.interval;
+
+    if( !caps.gov.is_set() )
+        caps.gov = def.gov;
+
+    if( !caps.bitrate.is_set() )
+        caps.bitrate = def.bitrate;
+
+    if( caps.resolutions.empty() )
+    {
+        Resolution res = { width, height };
+        caps.resolutions.push_back(res);
+    }
+
+
+    return caps;
+}
+
+
+
+static void merge_range(EncoderCaps::Range &range, const EncoderCaps::Range &other)
+{
+    if( !other.is_set() )
+        return;
+
+    if( !range.is_set() )
+    {
+        range = other;
+        return;
+    }
+
+
+    range.min = std::min(range.min, other.min);
+    range.max = std::max(range.max, other.max);
+}
+
+
+
+void EncoderCaps::merge(const EncoderCaps &other)
+{
+    for( size_t i = 0; i < other.resolutions.size(); ++i )
+    {
+        const Resolution &res = other.resolutions[i];
+        bool              found = false;
+
+        for( size_t j = 0; (j < resolutions.size()) && !found; ++j )
+            found = (resolutions[j].width == res.width) && (resolutions[j].height == res.height);
+
+        if( !found )
+            resolutions.push_back(res);
+    }
+
+
+    merge_range(quality,  other.quality);
+    merge_range(fps,      other.fps);
+    merge_range(interval, other.interval);
+    merge_range(gov,      other.gov);
+    merge_range(bitrate,  other.bitrate);
+}
+
+
+
+bool EncoderCaps::set_resolutions(const char *new_val)
+{
+    std::vector<Resolution> new_resolutions;
+    const char             *str = new_val ? new_val : "";
+
+
+    while( *str )
+    {
+        Resolution res;
+        int        len = 0;
+
+        if( (sscanf(str, "%dx%d%n", &res.width, &res.height, &len) != 2) ||
+            (res.width < 16) || (res.width >= 10000) || (res.height < 16) || (res.height >= 10000) )
+        {
+            str_err = "resolutions must be like 1920x1080,1280x720 (16-10000)";
+            return false;
+        }
+
+        new_resolutions.push_back(res);
+
+        str += len;
+        if( *str == ',' )
+            str++;
+    }
+
+
+    if( new_resolutions.empty() )
+    {
+        str_err = "resolutions are empty";
+        return false;
+    }
+
+
+    resolutions.swap(new_resolutions);
+    return true;
+}
+
+
+
+bool EncoderCaps::set_range(const char *new_val, int min_val, int max_val, Range &range)
+{
+    Range new_range;
+    int   len = 0;
+
+    if( !new_val ||
+        (sscanf(new_val, "%d-%d%n", &new_range.min, &new_range.max, &len) != 2) || new_val[len] ||
+        (new_range.min < min_val) || (new_range.max > max_val) || !new_range.is_set() )
+    {
+        str_err = "range must be like MIN-MAX, correct range: " + std::to_string(min_val) +
+                  "-" + std::to_string(max_val);
+        return false;
+    }
+
+
+    range = new_range;
+    return true;
+}
+
+
+
+void EncoderCaps::clear()
+{
+    resolutions.clear();
+
+    quality  = Range();
+    fps      = Range();
+    interval = Range();
+    gov      = Range();
+    bitrate  = Range();
+}
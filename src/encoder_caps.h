@@ -0,0 +1,72 @@
+#ifndef ENCODER_CAPS_H
+#define ENCODER_CAPS_H
+
+#include <string>
+#include <vector>
+
+
+
+
+
+/*
+ * Capabilities of the encoder of the profile, they are reported by
+ * GetVideoEncoderConfigurationOptions. Values which are not set for the
+ * profile are taken from the table of defaults of the encoding (see
+ * encoder_caps.cpp), the default resolution is the resolution of the profile.
+ */
+class EncoderCaps
+{
+public:
+    struct Range
+    {
+        Range(int min_val = 0, int max_val = -1) : min(min_val), max(max_val) {}
+
+        bool is_set(void) const { return min <= max; }
+
+        int min;
+        int max;
+    };
+
+    struct Resolution
+    {
+        int width;
+        int height;
+    };
+
+
+    std::vector<Resolution> resolutions;
+    Range quality;
+    Range fps;
+    Range interval;
+    Range gov;      // not used by JPEG
+    Range bitrate;  // kbit/s
+
+
+    // caps with all values set, encoding is tt__VideoEncoding (JPEG, MPEG4, H264)
+    EncoderCaps resolve(int encoding, int width, int height) const;
+
+    // widen the caps to cover other: all resolutions of both, min/max of the ranges
+    void merge(const EncoderCaps &other);
+
+    //methods for parsing opt from cmd
+    bool set_resolutions(const char *new_val); // 1920x1080,1280x720,...
+    bool set_fps_range(const char *new_val)     { return set_range(new_val, 1, 1000, fps); }
+    bool set_gov_range(const char *new_val)     { return set_range(new_val, 1, 10000, gov); }
+    bool set_bitrate_range(const char *new_val) { return set_range(new_val, 1, 1000000, bitrate); }
+
+    std::string get_str_err() const { return str_err; }
+    const char *get_cstr_err() const { return str_err.c_str(); }
+
+    void clear(void);
+
+private:
+    std::string str_err;
+
+    bool set_range(const char *new_val, int min_val, int max_val, Range &range); // MIN-MAX
+};
+
+
+
+
+
+#endif // ENCODER_CAPS_H
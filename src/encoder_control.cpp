@@ -0,0 +1,232 @@
+#include <fcntl.h>
+#include <limits.h>
+#include <string.h>
+#include <unistd.h>
+#include <linux/futex.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+
+#include "encoder_control.h"
+#include "smacros.h"
+
+
+
+
+
+// the layout is shared with the encoder, it must not depend on the compiler
+STATIC_ASSERT( sizeof(EncCtlHeader) == 64 );
+STATIC_ASSERT( sizeof(EncCtlSlot)   == 128 );
+
+
+
+bool EncoderControl::set_name(const char *new_val)
+{
+    if( !new_val || (new_val[0] != '/') || !new_val[1] )
+    {
+        str_err = "shm name must be like /name";
+        return false;
+    }
+
+
+    name = new_val;
+    return true;
+}
+
+
+
+bool EncoderControl::open(const std::vector<EncCtlConfig> &configs)
+{
+    close();
+
+
+    size_t size = sizeof(EncCtlHeader) + configs.size() * sizeof(EncCtlSlot);
+
+    // the object of the previous run can be in use by the encoder, it is kept if it has the same layout
+    int fd = shm_open(name.c_str(), O_RDWR, 0);
+    if( fd >= 0 )
+    {
+        bool attached = attach(fd, size, configs);
+        ::close(fd);
+
+        if( attached )
+            return true;
+
+
+        // other layout: the old object is invalidated, the encoder opens the new one by name
+        shm_unlink(name.c_str());
+    }
+
+
+    return create(size, configs);
+}
+
+
+
+bool EncoderControl::attach(int fd, size_t size, const std::vector<EncCtlConfig> &configs)
+{
+    struct stat st;
+
+    if( (fstat(fd, &st) != 0) || ((size_t)st.st_size < sizeof(EncCtlHeader)) )
+        return false;
+
+
+    void *ptr = mmap(NULL, st.st_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    if( ptr == MAP_FAILED )
+        return false;
+
+
+    map      = (uint8_t *)ptr;
+    map_size = st.st_size;
+
+
+    EncCtlHeader *hdr   = (EncCtlHeader *)map;
+    bool          valid = ((size_t)st.st_size == size) &&
+                          (__atomic_load_n(&hdr->magic, __ATOMIC_ACQUIRE) == ENC_CTL_MAGIC) &&
+                          (hdr->version == ENC_CTL_VERSION) && (hdr->slot_count == configs.size()) &&
+                          (hdr->slot_size == sizeof(EncCtlSlot));
+
+    EncCtlSlot *slot = (EncCtlSlot *)(map + sizeof(EncCtlHeader));
+
+    for( size_t i = 0; valid && (i < configs.size()); ++i, ++slot )
+    {
+        valid = memchr(slot->config.token, '\0', sizeof(slot->config.token)) != NULL;
+
+        if( valid )
+            slots[slot->config.token] = slot;
+    }
+
+    for( size_t i = 0; valid && (i < configs.size()); ++i )
+        valid = slots.count(configs[i].token) != 0;
+
+
+    if( !valid )
+    {
+        // the encoder must see that the object is not valid, the waiters are woken up
+        __atomic_store_n(&hdr->magic, 0, __ATOMIC_RELEASE);
+        __atomic_add_fetch(&hdr->changes, 1, __ATOMIC_RELEASE);
+        syscall(SYS_futex, &hdr->changes, FUTEX_WAKE, INT_MAX, NULL, NULL, 0);
+
+        close();
+        return false;
+    }
+
+
+    // the daemon starts with its configurations: the slots which differ are published
+    // (odd seq - the previous run died in the middle of publish)
+    for( size_t i = 0; i < configs.size(); ++i )
+    {
+        slot = slots[configs[i].token];
+
+        if( (slot->seq & 1) || (memcmp(&slot->config, &configs[i], sizeof(EncCtlConfig)) != 0) )
+            publish(configs[i]);
+    }
+
+
+    return true;
+}
+
+
+
+bool EncoderControl::create(size_t size, const std::vector<EncCtlConfig> &configs)
+{
+    // only the creator initializes the object
+    int fd = shm_open(name.c_str(), O_RDWR | O_CREAT | O_EXCL, 0644);
+    if( fd < 0 )
+    {
+        str_err = "can't create shm: " + name;
+        return false;
+    }
+
+
+    if( ftruncate(fd, size) != 0 )
+    {
+        ::close(fd);
+        shm_unlink(name.c_str());
+        str_err = "can't set size of shm: " + name;
+        return false;
+    }
+
+
+    void *ptr = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    ::close(fd);
+
+    if( ptr == MAP_FAILED )
+    {
+        shm_unlink(name.c_str());
+        str_err = "can't map shm: " + name;
+        return false;
+    }
+
+
+    map      = (uint8_t *)ptr;
+    map_size = size;
+    memset(map, 0, size);
+
+
+    EncCtlHeader *hdr  = (EncCtlHeader *)map;
+    EncCtlSlot   *slot = (EncCtlSlot *)(map + sizeof(EncCtlHeader));
+
+    for( size_t i = 0; i < configs.size(); ++i, ++slot )
+    {
+        slot->config = configs[i];
+        slot->config.token[sizeof(slot->config.token) - 1] = '\0';
+
+        slots[slot->config.token] = slot;
+    }
+
+
+    hdr->version    = ENC_CTL_VERSION;
+    hdr->slot_count = configs.size();
+    hdr->slot_size  = sizeof(EncCtlSlot);
+
+    __atomic_store_n(&hdr->magic, ENC_CTL_MAGIC, __ATOMIC_RELEASE); // header is complete
+
+    return true;
+}
+
+
+
+void EncoderControl::close()
+{
+    slots.clear();
+
+    if( map )
+        munmap(map, map_size);
+
+    map      = NULL;
+    map_size = 0;
+}
+
+
+
+bool EncoderControl::publish(const EncCtlConfig &config)
+{
+    auto it = slots.find(config.token);
+
+    if( it == slots.end() )
+    {
+        str_err = std::string("no slot for configuration: ") + config.token;
+        return false;
+    }
+
+
+    EncCtlSlot   *slot = it->second;
+    EncCtlHeader *hdr  = (EncCtlHeader *)map;
+    uint32_t      seq  = (slot->seq + 1) & ~1u; // even, also after a publish interrupted by a crash
+
+    __atomic_store_n(&slot->seq, seq + 1, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE); // odd seq is seen before the data
+
+    memcpy(&slot->config, &config, sizeof(config));
+    slot->version++;
+
+    __atomic_store_n(&slot->seq, seq + 2, __ATOMIC_RELEASE);
+
+
+    // shared futex (the encoder is other process), nobody waits - nothing to do
+    __atomic_add_fetch(&hdr->changes, 1, __ATOMIC_RELEASE);
+    syscall(SYS_futex, &hdr->changes, FUTEX_WAKE, INT_MAX, NULL, NULL, 0);
+
+    return true;
+}
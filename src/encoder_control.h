@@ -0,0 +1,151 @@
+#ifndef ENCODER_CONTROL_H
+#define ENCODER_CONTROL_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#include <string>
+#include <vector>
+#include <map>
+
+
+
+
+
+/*
+ * Layout of the POSIX shared memory object (shm_open) written by the daemon
+ * and read by the encoder. All fields are in host byte order, the object is:
+ *
+ *   EncCtlHeader
+ *   slot_count * EncCtlSlot (one slot for each video encoder configuration)
+ *
+ * Writer (daemon), for each change of the configuration:
+ *   1. seq++ (odd - slot is being written), release
+ *   2. write config, version++
+ *   3. seq++ (even - slot is complete), release
+ *   4. changes++, release, FUTEX_WAKE (not private) on changes
+ *
+ * The encoder polls changes (or waits on it with FUTEX_WAIT) and takes a copy
+ * of the slot with enc_ctl_read, it never blocks the daemon. The header is
+ * valid while magic is set, the daemon clears it when it recreates the object.
+ */
+#define ENC_CTL_MAGIC    0x4345564Fu  // "OVEC"
+#define ENC_CTL_VERSION  1
+
+
+
+struct EncCtlHeader
+{
+    uint32_t magic;
+    uint32_t version;
+    uint32_t slot_count;
+    uint32_t slot_size;   // sizeof(EncCtlSlot)
+    uint32_t changes;     // number of published changes, futex word
+    uint32_t reserved[11];
+};
+
+
+
+// values of Video Encoder and Video Source configurations of Media
+struct EncCtlConfig
+{
+    char    token[64];     // token of the configuration, '\0' terminated
+    int32_t encoding;      // 0 - JPEG, 1 - MPEG4, 2 - H264
+    int32_t width;
+    int32_t height;
+    int32_t quality;
+    int32_t fps;           // FrameRateLimit, 0 - not set
+    int32_t interval;      // EncodingInterval, 0 - not set
+    int32_t bitrate;       // BitrateLimit in kbit/s, 0 - not set
+    int32_t gov;           // GovLength (MPEG4, H264)
+    int32_t bounds_x;      // Bounds of the video source (crop of the sensor)
+    int32_t bounds_y;
+    int32_t bounds_width;
+    int32_t bounds_height;
+};
+
+
+
+struct EncCtlSlot
+{
+    uint32_t     seq;      // odd while the daemon updates the slot
+    uint32_t     version;  // number of changes of the slot
+    EncCtlConfig config;
+    uint8_t      reserved[8];
+};
+
+
+
+// copy of the slot for the encoder, false - slot was changed (try again)
+static inline bool enc_ctl_read(const EncCtlSlot *slot, EncCtlConfig *config)
+{
+    uint32_t seq = __atomic_load_n(&slot->seq, __ATOMIC_ACQUIRE);
+
+    if( seq & 1 )
+        return false;
+
+    memcpy(config, &slot->config, sizeof(*config));
+    __atomic_thread_fence(__ATOMIC_ACQUIRE);
+
+    return __atomic_load_n(&slot->seq, __ATOMIC_RELAXED) == seq;
+}
+
+
+
+
+
+/*
+ * Daemon side of the control block. The object is created at startup with
+ * the initial configurations, after that only publish() changes it. There is
+ * one writer: the caller serializes publish() (changes of profiles are done
+ * under the lock of the profiles).
+ *
+ * The object of the previous run of the daemon can be in use by the encoder:
+ * if its magic and size match the configurations it is kept as is (the
+ * changes counter is not reset) and only the slots which differ are
+ * published. Otherwise its magic is cleared and it is created again.
+ */
+class EncoderControl
+{
+public:
+    EncoderControl() : map(NULL), map_size(0) {}
+    ~EncoderControl() { close(); }
+
+    bool enabled(void) const { return !name.empty(); }
+
+    //methods for parsing opt from cmd
+    bool set_name(const char *new_val); // /name
+    const std::string &get_name(void) const { return name; }
+
+    // open the object with one slot for each configuration (see above)
+    bool open(const std::vector<EncCtlConfig> &configs);
+
+    // write the configuration into the slot with the same token and wake up the encoder
+    bool publish(const EncCtlConfig &config);
+
+    std::string get_str_err() const { return str_err; }
+    const char *get_cstr_err() const { return str_err.c_str(); }
+
+private:
+    std::string name;
+
+    uint8_t *map;
+    size_t   map_size;
+
+    std::map<std::string, EncCtlSlot *> slots; // by token of configuration
+
+    std::string str_err;
+
+    bool attach(int fd, size_t size, const std::vector<EncCtlConfig> &configs);
+    bool create(size_t size, const std::vector<EncCtlConfig> &configs);
+    void close(void);
+
+    EncoderControl(const EncoderControl &);
+    EncoderControl &operator=(const EncoderControl &);
+};
+
+
+
+
+
+#endif // ENCODER_CONTROL_H
@@ -0,0 +1,575 @@
+#include <string.h>
+#include <unistd.h>
+#include <sys/eventfd.h>
+
+#include <algorithm>
+
+#include "event_broker.h"
+#include "smacros.h"
+
+
+
+
+
+static void copy_str(char *dst, size_t size, const char *src)
+{
+    strncpy(dst, src ? src : "", size - 1);
+    dst[size - 1] = '\0';
+}
+
+
+
+void EventMessage::set(const char *new_topic, const char *src_name, const char *src_value,
+                       const char *new_data_name, const char *new_data_value, Operation op)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_REALTIME, &ts);
+
+    utc_time_ms = (int64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+    operation   = op;
+
+    copy_str(topic,        sizeof(topic),        new_topic);
+    copy_str(source_name,  sizeof(source_name),  src_name);
+    copy_str(source_value, sizeof(source_value), src_value);
+    copy_str(data_name,    sizeof(data_name),    new_data_name);
+    copy_str(data_value,   sizeof(data_value),   new_data_value);
+}
+
+
+
+static int64_t monotonic_ms(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return (int64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+
+
+static uint32_t round_up_pow2(size_t val)
+{
+    uint32_t res = 1;
+
+    while( res < val )
+        res <<= 1;
+
+    return res;
+}
+
+
+
+EventSubscription::EventSubscription(uint32_t new_id, size_t capacity, time_t new_termination_time,
+                                     const std::string &consumer_address, const EventFilterPtr &event_filter):
+    id(new_id),
+    mask(round_up_pow2(capacity) - 1),
+    consumer(consumer_address),
+    filter(event_filter),
+    ring(new EventMessage[mask + 1]),
+    head(0),
+    tail(0),
+    overflows(0),
+    termination_time(new_termination_time),
+    closed(false),
+    timer(TimerWheel::NO_TIMER)
+{
+}
+
+
+
+bool EventSubscription::push(const EventMessage &msg)
+{
+    uint32_t h = head.load(std::memory_order_relaxed);
+
+    if( h - tail.load(std::memory_order_acquire) > mask )
+    {
+        overflows.fetch_add(1, std::memory_order_relaxed);
+        return false;
+    }
+
+
+    ring[h & mask] = msg;
+    head.store(h + 1, std::memory_order_release);
+
+    return true;
+}
+
+
+
+size_t EventSubscription::pop(EventMessage *out, size_t max_count)
+{
+    uint32_t t = tail.load(std::memory_order_relaxed);
+    uint32_t h = head.load(std::memory_order_acquire);
+    size_t   count = std::min((size_t)(h - t), max_count);
+
+    for( size_t i = 0; i < count; ++i )
+        out[i] = ring[(t + i) & mask];
+
+    tail.store(t + count, std::memory_order_release);
+
+    return count;
+}
+
+
+
+size_t EventSubscription::get_queued() const
+{
+    return head.load(std::memory_order_acquire) - tail.load(std::memory_order_acquire);
+}
+
+
+
+const size_t EventBroker::MAX_SUBSCRIPTIONS;
+const size_t EventBroker::QUEUE_SIZE;
+
+
+
+EventNotifier::EventNotifier():
+    fd     ( eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC) ),
+    pending( false )
+{
+}
+
+
+
+EventNotifier::~EventNotifier()
+{
+    if( fd >= 0 )
+        close(fd);
+}
+
+
+
+void EventNotifier::signal(void)
+{
+    if( (fd >= 0) && !pending.exchange(true) )
+    {
+        uint64_t one = 1;
+        ssize_t  res = write(fd, &one, sizeof(one));
+        UNUSED(res);
+    }
+}
+
+
+
+void EventNotifier::clear(void)
+{
+    uint64_t val;
+    ssize_t  res = read(fd, &val, sizeof(val));
+    UNUSED(res);
+
+    pending.store(false);
+}
+
+
+
+// a matches every topic which b matches
+static bool covers(const EventFilter::TopicPath &a, const EventFilter::TopicPath &b)
+{
+    if( a.segments.size() > b.segments.size() )
+        return false;
+
+    if( !a.subtree && (b.subtree || (a.segments.size() != b.segments.size())) )
+        return false;
+
+    return std::equal(a.segments.begin(), a.segments.end(), b.segments.begin());
+}
+
+
+
+TopicIndex::TopicIndex(const EventSubscriptionListPtr &subscriptions):
+    list(subscriptions),
+    nodes(1)
+{
+    for( size_t i = 0; i < list->size(); ++i )
+    {
+        EventSubscription *sub    = (*list)[i].get();
+        const EventFilter *filter = sub->get_filter();
+
+        if( !filter || filter->get_topics().empty() )
+        {
+            all.push_back(sub);
+            continue;
+        }
+
+
+        // a path which is covered by other path of the filter is not added,
+        // so the walk of a topic meets the subscription only once
+        const std::vector<EventFilter::TopicPath> &topics = filter->get_topics();
+
+        for( size_t j = 0; j < topics.size(); ++j )
+        {
+            bool covered = false;
+
+            for( size_t k = 0; (k < topics.size()) && !covered; ++k )
+            {
+                if( k != j )
+                    covered = covers(topics[k], topics[j]) && (!covers(topics[j], topics[k]) || (k < j));
+            }
+
+            if( !covered )
+                add(sub, topics[j]);
+        }
+    }
+}
+
+
+
+uint32_t TopicIndex::find_child(uint32_t node, const char *segment, size_t len) const
+{
+    const std::vector<uint32_t> &children = nodes[node].children;
+
+    for( size_t i = 0; i < children.size(); ++i )
+    {
+        const std::string &name = nodes[children[i]].segment;
+
+        if( (name.size() == len) && !memcmp(name.data(), segment, len) )
+            return children[i];
+    }
+
+    return 0; // root is never a child
+}
+
+
+
+void TopicIndex::add(EventSubscription *sub, const EventFilter::TopicPath &path)
+{
+    uint32_t node = 0;
+
+    for( size_t i = 0; i < path.segments.size(); ++i )
+    {
+        const std::string &segment = path.segments[i];
+        uint32_t child = find_child(node, segment.data(), segment.size());
+
+        if( !child )
+        {
+            child = nodes.size();
+            nodes.push_back(Node());
+            nodes[child].segment = segment;
+            nodes[node].children.push_back(child);
+        }
+
+        node = child;
+    }
+
+
+    if( path.subtree )
+        nodes[node].subtree.push_back(sub);
+    else
+        nodes[node].exact.push_back(sub);
+}
+
+
+
+size_t TopicIndex::match(const char *topic, EventSubscription **out) const
+{
+    size_t count = all.size();
+    std::copy(all.begin(), all.end(), out);
+
+    if( nodes.size() == 1 )
+        return count;
+
+
+    uint32_t    node = 0;
+    const char *pos  = topic;
+
+    while( true )
+    {
+        const char *end = strchr(pos, '/');
+        if( !end )
+            end = pos + strlen(pos);
+
+        // "tns1:VideoSource" -> "VideoSource"
+        const char *colon = (const char *)memchr(pos, ':', end - pos);
+        if( colon )
+            pos = colon + 1;
+
+
+        node = find_child(node, pos, end - pos);
+        if( !node )
+            break;
+
+        const Node &cur = nodes[node];
+
+        std::copy(cur.subtree.begin(), cur.subtree.end(), out + count);
+        count += cur.subtree.size();
+
+        if( !*end )
+        {
+            std::copy(cur.exact.begin(), cur.exact.end(), out + count);
+            count += cur.exact.size();
+            break;
+        }
+
+        pos = end + 1;
+    }
+
+    return count;
+}
+
+
+
+EventBroker::EventBroker():
+    subscriptions ( std::make_shared<SubscriptionList>() ),
+    index         ( std::make_shared<TopicIndex>(subscriptions) ),
+    next_id       ( 1 ),
+    expiry        ( monotonic_ms() / 1000 ),
+    published     ( 0 ),
+    delivered     ( 0 ),
+    dropped       ( 0 )
+{
+}
+
+
+
+void EventBroker::set_subscriptions(const std::shared_ptr<SubscriptionList> &list)
+{
+    std::atomic_store(&index, TopicIndexPtr(std::make_shared<TopicIndex>(list)));
+    std::atomic_store(&subscriptions, SubscriptionListPtr(list));
+}
+
+
+
+// the timer of the expiry, the wall clock time is converted to a monotonic tick
+void EventBroker::schedule(EventSubscription &sub)
+{
+    time_t lifetime = sub.get_termination_time() - time(NULL);
+
+    expiry.cancel(sub.timer);
+    sub.timer = expiry.insert(monotonic_ms() / 1000 + ((lifetime > 0) ? lifetime : 0), &sub);
+}
+
+
+
+// the queue is freed when the last holder (publisher, NotifyDelivery,
+// waiting PullMessages) drops the subscription, the waiters are woken up
+void EventBroker::close(EventSubscription &sub)
+{
+    expiry.cancel(sub.timer);
+    sub.timer = TimerWheel::NO_TIMER;
+    sub.closed.store(true, std::memory_order_release);
+
+    if( sub.is_push() )
+        push_notifier.signal();
+    else
+        pull_notifier.signal();
+}
+
+
+
+EventSubscriptionPtr EventBroker::subscribe(time_t termination_time, const std::string &consumer_address,
+                                            const EventFilterPtr &filter)
+{
+    std::lock_guard<std::mutex> lock(subscriptions_mtx);
+
+    SubscriptionListPtr current = get_subscriptions();
+
+    if( current->size() >= MAX_SUBSCRIPTIONS )
+        return EventSubscriptionPtr();
+
+
+    EventSubscriptionPtr sub = std::make_shared<EventSubscription>(next_id++, QUEUE_SIZE, termination_time,
+                                                                   consumer_address, filter);
+
+    std::shared_ptr<SubscriptionList> next = std::make_shared<SubscriptionList>(*current);
+    next->push_back(sub);
+    set_subscriptions(next);
+    schedule(*sub);
+
+    return sub;
+}
+
+
+
+EventSubscriptionPtr EventBroker::find(uint32_t id) const
+{
+    SubscriptionListPtr current = get_subscriptions();
+
+    for( size_t i = 0; i < current->size(); ++i )
+    {
+        if( (*current)[i]->get_id() == id )
+            return (*current)[i];
+    }
+
+    return EventSubscriptionPtr();
+}
+
+
+
+bool EventBroker::unsubscribe(uint32_t id)
+{
+    std::lock_guard<std::mutex> lock(subscriptions_mtx);
+
+    SubscriptionListPtr current = get_subscriptions();
+    std::shared_ptr<SubscriptionList> next = std::make_shared<SubscriptionList>();
+    EventSubscription *removed = NULL;
+
+    for( size_t i = 0; i < current->size(); ++i )
+    {
+        if( (*current)[i]->get_id() != id )
+            next->push_back((*current)[i]);
+        else
+            removed = (*current)[i].get();
+    }
+
+    if( !removed )
+        return false;
+
+
+    set_subscriptions(next);
+    close(*removed);
+
+    return true;
+}
+
+
+
+bool EventBroker::renew(const EventSubscriptionPtr &sub, time_t termination_time)
+{
+    std::lock_guard<std::mutex> lock(subscriptions_mtx);
+
+    if( sub->is_closed() )
+        return false;
+
+
+    sub->termination_time.store(termination_time, std::memory_order_relaxed);
+    schedule(*sub);
+
+    return true;
+}
+
+
+
+size_t EventBroker::expire(void)
+{
+    std::lock_guard<std::mutex> lock(subscriptions_mtx);
+
+    // it is called from the main loop on each wakeup, usually no timer expires
+    expired.clear();
+    expiry.advance(monotonic_ms() / 1000, expired);
+
+    if( expired.empty() )
+        return 0;
+
+
+    time_t now   = time(NULL);
+    size_t count = 0;
+
+    for( size_t i = 0; i < expired.size(); ++i )
+    {
+        EventSubscription *sub = (EventSubscription *)expired[i];
+
+        sub->timer = TimerWheel::NO_TIMER;
+
+        // the wall clock was set back, the subscription lives longer
+        if( sub->get_termination_time() > now )
+        {
+            schedule(*sub);
+            continue;
+        }
+
+        DEBUG_MSG("Event subscription %u expired\n", sub->get_id());
+        sub->closed.store(true, std::memory_order_release);
+        count++;
+    }
+
+    if( !count )
+        return 0;
+
+
+    SubscriptionListPtr current = get_subscriptions();
+    std::shared_ptr<SubscriptionList> next = std::make_shared<SubscriptionList>();
+    next->reserve(current->size() - count);
+
+    for( size_t i = 0; i < current->size(); ++i )
+    {
+        if( !(*current)[i]->is_closed() )
+            next->push_back((*current)[i]);
+    }
+
+    set_subscriptions(next);
+
+
+    for( size_t i = 0; i < expired.size(); ++i )
+    {
+        EventSubscription *sub = (EventSubscription *)expired[i];
+
+        if( sub->is_closed() )
+            close(*sub);
+    }
+
+    return count;
+}
+
+
+
+int EventBroker::get_timeout_ms(int max_ms)
+{
+    std::lock_guard<std::mutex> lock(subscriptions_mtx);
+
+    int64_t now   = monotonic_ms();
+    int64_t ticks = expiry.get_next(max_ms / 1000 + 1);
+    int64_t ms    = (expiry.get_tick() + ticks) * 1000 - now;
+
+    if( ms < 0 )
+        return 0;
+
+    return (ms < max_ms) ? (int)ms : max_ms;
+}
+
+
+
+void EventBroker::publish(const EventMessage *msgs, size_t count)
+{
+    TopicIndexPtr current = std::atomic_load(&index);
+    bool pull = false;
+    bool push = false;
+
+    std::lock_guard<std::mutex> lock(publish_mtx);
+
+    published.fetch_add(count, std::memory_order_relaxed);
+
+    for( size_t n = 0; n < count; ++n )
+    {
+        const EventMessage &msg = msgs[n];
+        size_t matched_count = current->match(msg.topic, matched);
+
+        for( size_t i = 0; i < matched_count; ++i )
+        {
+            EventSubscription *sub    = matched[i];
+            const EventFilter *filter = sub->get_filter();
+
+            if( filter && !filter->match_content(msg) )
+                continue;
+
+            if( sub->push(msg) )
+                delivered.fetch_add(1, std::memory_order_relaxed);
+            else
+                dropped.fetch_add(1, std::memory_order_relaxed);
+
+            if( sub->is_push() )
+                push = true;
+            else
+                pull = true;
+        }
+    }
+
+
+    // events are in the queues before the waiters are signaled
+    if( pull )
+        pull_notifier.signal();
+
+    if( push )
+        push_notifier.signal();
+}
+
+
+
+void EventBroker::dump_stats(FILE *fp) const
+{
+    fprintf(fp, "Events: subscriptions %zu  published %llu  delivered %llu  dropped %llu\n",
+            get_count(),
+            (unsigned long long)published.load(),
+            (unsigned long long)delivered.load(),
+            (unsigned long long)dropped.load());
+}
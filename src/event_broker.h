@@ -0,0 +1,261 @@
+#ifndef EVENT_BROKER_H
+#define EVENT_BROKER_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <time.h>
+#include <string>
+#include <vector>
+#include <memory>
+#include <mutex>
+#include <atomic>
+
+#include "event_filter.h"
+#include "timer_wheel.h"
+
+
+
+
+
+// one event (tt:Message with one SimpleItem in Source and Data), it is copied
+// into the queues of subscriptions as is, so it has no pointers
+struct EventMessage
+{
+    enum Operation
+    {
+        INITIALIZED = 0, // the same order as tt__PropertyOperation
+        DELETED     = 1,
+        CHANGED     = 2
+    };
+
+    int64_t utc_time_ms;
+    uint8_t operation;
+    char    topic[64];          // tns1:VideoSource/MotionAlarm
+    char    source_name[24];    // VideoSourceConfigurationToken
+    char    source_value[40];
+    char    data_name[24];      // State
+    char    data_value[40];     // true
+
+    void set(const char *new_topic, const char *src_name, const char *src_value,
+             const char *new_data_name, const char *new_data_value, Operation op = CHANGED);
+};
+
+
+
+/*
+ * Subscription (PullPoint) with a bounded queue of events.
+ *
+ * The queue is a single producer / single consumer ring: the producer is the
+ * publisher of the broker (publish() calls are serialized by the broker), the
+ * consumer is PullMessages. Both sides only use head/tail, there are no locks.
+ * If the queue is full the new event is dropped and counted in overflows.
+ */
+class EventSubscription
+{
+public:
+    EventSubscription(uint32_t new_id, size_t capacity, time_t termination_time,
+                      const std::string &consumer_address, const EventFilterPtr &event_filter);
+
+    uint32_t get_id(void) const { return id; }
+
+    // push subscription (Subscribe): events are sent to the consumer by NotifyDelivery,
+    // else (PullPoint) they are taken by PullMessages
+    bool is_push(void) const { return !consumer.empty(); }
+    const std::string &get_consumer(void) const { return consumer; }
+
+    // NULL - all events
+    const EventFilter *get_filter(void) const { return filter.get(); }
+
+    time_t get_termination_time(void) const { return termination_time.load(std::memory_order_relaxed); }
+
+    // removed from the broker (unsubscribed or expired)
+    bool is_closed(void) const { return closed.load(std::memory_order_acquire); }
+
+    // producer
+    bool push(const EventMessage &msg);
+
+    // consumer: copy up to max_count events to out, returns count
+    size_t pop(EventMessage *out, size_t max_count);
+
+    size_t   get_queued(void) const;
+    uint64_t get_overflows(void) const { return overflows.load(std::memory_order_relaxed); }
+
+private:
+    const uint32_t    id;
+    const uint32_t    mask;  // capacity - 1, capacity is power of 2
+    const std::string consumer;
+    const EventFilterPtr filter;
+
+    std::unique_ptr<EventMessage[]> ring;
+
+    alignas(64) std::atomic<uint32_t> head; // next slot to write (producer)
+    alignas(64) std::atomic<uint32_t> tail; // next slot to read (consumer)
+
+    std::atomic<uint64_t> overflows;
+    std::atomic<time_t>   termination_time;
+    std::atomic<bool>     closed;
+
+    TimerWheel::TimerId   timer; // of the expiry, under the lock of the broker
+
+    friend class EventBroker;
+};
+
+
+
+typedef std::shared_ptr<EventSubscription> EventSubscriptionPtr;
+
+typedef std::vector<EventSubscriptionPtr>            EventSubscriptionList;
+typedef std::shared_ptr<const EventSubscriptionList> EventSubscriptionListPtr;
+
+
+
+/*
+ * Subscriptions by topic: a trie over the segments of the topics of their
+ * filters (see EventFilter). publish() walks the path of the topic of the
+ * event and gets only the subscriptions whose TopicExpression matches it, so
+ * the cost of an event depends on the number of matching subscriptions.
+ * The index is built for every new list of subscriptions and is not changed.
+ */
+class TopicIndex
+{
+public:
+    explicit TopicIndex(const EventSubscriptionListPtr &subscriptions);
+
+    // subscriptions which match the topic, each one once,
+    // out must have room for all subscriptions of the index
+    size_t match(const char *topic, EventSubscription **out) const;
+
+private:
+    struct Node
+    {
+        std::string                     segment;   // without namespace prefix
+        std::vector<uint32_t>           children;  // indexes of nodes
+        std::vector<EventSubscription*> exact;     // topic of the node
+        std::vector<EventSubscription*> subtree;   // topic of the node and all below it
+    };
+
+    EventSubscriptionListPtr        list;  // owner of the subscriptions
+    std::vector<Node>               nodes; // [0] - root
+    std::vector<EventSubscription*> all;   // without topic filter
+
+    uint32_t find_child(uint32_t node, const char *segment, size_t len) const;
+    void add(EventSubscription *sub, const EventFilter::TopicPath &path);
+};
+
+
+
+// eventfd which is readable after events were published, for the waiters of
+// the queues (the main loop for PullPoint, NotifyDelivery for push)
+class EventNotifier
+{
+public:
+    EventNotifier();
+    ~EventNotifier();
+
+    int get_fd(void) const { return fd; }
+
+    // at most one write to fd per wakeup of the waiter
+    void signal(void);
+
+    // the waiter calls it before it checks the queues: a signal() which sees
+    // the old flag was given after its events were queued
+    void clear(void);
+
+private:
+    int               fd;
+    std::atomic<bool> pending;
+
+    EventNotifier(const EventNotifier &);
+    EventNotifier &operator=(const EventNotifier &);
+};
+
+
+
+/*
+ * Subscriptions of the Event service and fan-out of events to them.
+ *
+ * The list of subscriptions is published like the set of profiles: a change
+ * makes a new list (and its TopicIndex), publish() takes the current index and
+ * copies the event into the queues of the subscriptions whose filters match.
+ * No memory is allocated per event.
+ *
+ * The termination times are kept in a timer wheel with 1 second ticks of
+ * CLOCK_MONOTONIC (the clock of the device can be set by NTP at any time):
+ * Renew moves the timer of the subscription, expire() costs nothing until a
+ * timer expires and then makes one new list for all expired subscriptions.
+ */
+class EventBroker
+{
+public:
+    EventBroker();
+
+    static const size_t MAX_SUBSCRIPTIONS = 1024; // a queue of QUEUE_SIZE events (50 KB) each
+    static const size_t QUEUE_SIZE        = 256; // events per subscription
+
+    typedef EventSubscriptionList    SubscriptionList;
+    typedef EventSubscriptionListPtr SubscriptionListPtr;
+
+    // new subscription or NULL if the limit is reached,
+    // consumer_address is set for push subscriptions only
+    EventSubscriptionPtr subscribe(time_t termination_time, const std::string &consumer_address = std::string(),
+                                   const EventFilterPtr &filter = EventFilterPtr());
+    EventSubscriptionPtr find(uint32_t id) const;
+    bool unsubscribe(uint32_t id);
+
+    // new termination time, false if the subscription is removed already
+    bool renew(const EventSubscriptionPtr &sub, time_t termination_time);
+
+    // remove subscriptions which were not renewed, returns count of removed
+    size_t expire(void);
+
+    // time until the next expire() has work (for poll), not more than max_ms
+    int get_timeout_ms(int max_ms);
+
+    void publish(const EventMessage &msg) { publish(&msg, 1); }
+
+    // events of a batch are published under one lock with one wakeup of the waiters
+    void publish(const EventMessage *msgs, size_t count);
+
+    EventNotifier *get_pull_notifier(void) { return &pull_notifier; }
+    EventNotifier *get_push_notifier(void) { return &push_notifier; }
+
+    // current list, it is never changed (like the set of profiles)
+    SubscriptionListPtr get_subscriptions(void) const { return std::atomic_load(&subscriptions); }
+
+    size_t get_count(void) const { return get_subscriptions()->size(); }
+
+    void dump_stats(FILE *fp) const;
+
+private:
+    typedef std::shared_ptr<const TopicIndex> TopicIndexPtr;
+
+    SubscriptionListPtr subscriptions;
+    TopicIndexPtr       index;             // of subscriptions
+    std::mutex          subscriptions_mtx; // writers only
+    std::mutex          publish_mtx;       // one producer for the queues
+    EventSubscription  *matched[MAX_SUBSCRIPTIONS]; // of the event, under publish_mtx
+    uint32_t            next_id;
+    TimerWheel          expiry;            // of subscriptions, under subscriptions_mtx
+    std::vector<void *> expired;           // of expire(), capacity is reused
+
+    EventNotifier       pull_notifier;
+    EventNotifier       push_notifier;
+
+    std::atomic<uint64_t> published;
+    std::atomic<uint64_t> delivered;
+    std::atomic<uint64_t> dropped;   // by full queues
+
+    void set_subscriptions(const std::shared_ptr<SubscriptionList> &list);
+    void schedule(EventSubscription &sub);
+    void close(EventSubscription &sub);
+
+    EventBroker(const EventBroker &);
+    EventBroker &operator=(const EventBroker &);
+};
+
+
+
+
+
+#endif // EVENT_BROKER_H
@@ -0,0 +1,402 @@
+#include <string.h>
+#include <ctype.h>
+
+#include "event_filter.h"
+#include "event_broker.h"
+#include "smacros.h"
+
+
+
+
+
+// "tns1:VideoSource" -> "VideoSource"
+static std::string local_name(const char *begin, const char *end)
+{
+    const char *colon = (const char *)memchr(begin, ':', end - begin);
+
+    return colon ? std::string(colon + 1, end) : std::string(begin, end);
+}
+
+
+
+static void trim(const char *&begin, const char *&end)
+{
+    while( (begin < end) && isspace((unsigned char)*begin) )
+        begin++;
+
+    while( (end > begin) && isspace((unsigned char)end[-1]) )
+        end--;
+}
+
+
+
+bool EventFilter::set_topics(const char *expr)
+{
+    topics.clear();
+
+    const char *pos = expr;
+
+    while( true )
+    {
+        const char *next = strchr(pos, '|');
+        const char *begin = pos;
+        const char *end   = next ? next : pos + strlen(pos);
+
+        trim(begin, end);
+
+        TopicPath path;
+        path.subtree = false;
+
+        if( (end - begin >= 3) && !strncmp(end - 3, "//.", 3) )
+        {
+            path.subtree = true;
+            end -= 3;
+        }
+
+
+        for( const char *seg = begin; seg < end; )
+        {
+            const char *seg_end = (const char *)memchr(seg, '/', end - seg);
+            if( !seg_end )
+                seg_end = end;
+
+            std::string name = local_name(seg, seg_end);
+
+            if( name.empty() || (name.find_first_of("*. \t") != std::string::npos) )
+            {
+                str_err = "unsupported TopicExpression: " + std::string(expr);
+                return false;
+            }
+
+            path.segments.push_back(name);
+            seg = seg_end + 1;
+        }
+
+
+        if( path.segments.empty() )
+        {
+            str_err = "empty topic in TopicExpression: " + std::string(expr);
+            return false;
+        }
+
+        topics.push_back(path);
+
+        if( !next )
+            break;
+
+        pos = next + 1;
+    }
+
+    return true;
+}
+
+
+
+/*
+ * Recursive descent parser of the ItemFilter expression, it emits the program
+ * in postfix order:
+ *
+ *   expr   := term ('or' term)*
+ *   term   := factor ('and' factor)*
+ *   factor := 'not' '(' expr ')' | 'boolean' '(' expr ')' | '(' expr ')' | item
+ *   item   := '//' [qname '/'] qname '[' attr ('and' attr)* ']'
+ *   attr   := ('@Name' | '@Value') '=' string
+ */
+class ContentParser
+{
+public:
+    ContentParser(EventFilter &new_filter, const char *expr) : filter(new_filter), pos(expr), level(0) {}
+
+    bool parse(void)
+    {
+        if( !expr() )
+            return false;
+
+        skip_spaces();
+
+        return !*pos;
+    }
+
+private:
+    EventFilter &filter;
+    const char  *pos;
+    size_t       level; // of nested expressions, the input comes from clients
+
+    void skip_spaces(void)
+    {
+        while( isspace((unsigned char)*pos) )
+            pos++;
+    }
+
+    bool accept(const char *token)
+    {
+        skip_spaces();
+
+        size_t len = strlen(token);
+        if( strncmp(pos, token, len) )
+            return false;
+
+        // keywords must not be a part of a name
+        if( isalpha((unsigned char)token[len - 1]) && (isalnum((unsigned char)pos[len]) || pos[len] == '_') )
+            return false;
+
+        pos += len;
+        return true;
+    }
+
+    void emit(uint8_t code, uint8_t scope = 0, uint16_t name = EventFilter::NO_STRING,
+              uint16_t value = EventFilter::NO_STRING)
+    {
+        EventFilter::Op op = { code, scope, name, value };
+        filter.program.push_back(op);
+    }
+
+    bool expr(void)
+    {
+        if( !term() )
+            return false;
+
+        while( accept("or") )
+        {
+            if( !term() )
+                return false;
+
+            emit(EventFilter::OP_OR);
+        }
+
+        return true;
+    }
+
+    bool term(void)
+    {
+        if( !factor() )
+            return false;
+
+        while( accept("and") )
+        {
+            if( !factor() )
+                return false;
+
+            emit(EventFilter::OP_AND);
+        }
+
+        return true;
+    }
+
+    bool factor(void)
+    {
+        if( ++level > EventFilter::MAX_DEPTH )
+            return false;
+
+        bool res = nested_factor();
+        level--;
+
+        return res;
+    }
+
+    bool nested_factor(void)
+    {
+        if( accept("not") )
+        {
+            if( !accept("(") || !expr() || !accept(")") )
+                return false;
+
+            emit(EventFilter::OP_NOT);
+            return true;
+        }
+
+        if( accept("boolean") )
+            return accept("(") && expr() && accept(")");
+
+        if( accept("(") )
+            return expr() && accept(")");
+
+        return item();
+    }
+
+    bool qname(std::string &name)
+    {
+        skip_spaces();
+
+        const char *begin = pos;
+
+        while( isalnum((unsigned char)*pos) || (*pos == ':') || (*pos == '_') || (*pos == '-') )
+            pos++;
+
+        name = local_name(begin, pos);
+
+        return !name.empty();
+    }
+
+    bool string_literal(uint16_t &index)
+    {
+        skip_spaces();
+
+        char quote = *pos;
+        if( (quote != '"') && (quote != '\'') )
+            return false;
+
+        const char *end = strchr(pos + 1, quote);
+        if( !end )
+            return false;
+
+        if( filter.strings.size() >= EventFilter::NO_STRING )
+            return false;
+
+        index = filter.strings.size();
+        filter.strings.push_back(std::string(pos + 1, end));
+        pos = end + 1;
+
+        return true;
+    }
+
+    bool item(void)
+    {
+        std::string name;
+        uint8_t scope = EventFilter::SCOPE_ANY;
+
+        if( !accept("//") || !qname(name) )
+            return false;
+
+        if( name != "SimpleItem" )
+        {
+            if( name == "Source" )
+                scope = EventFilter::SCOPE_SOURCE;
+            else if( name == "Data" )
+                scope = EventFilter::SCOPE_DATA;
+            else
+                return false;
+
+            if( !accept("/") || !qname(name) || (name != "SimpleItem") )
+                return false;
+        }
+
+
+        uint16_t item_name  = EventFilter::NO_STRING;
+        uint16_t item_value = EventFilter::NO_STRING;
+
+        if( !accept("[") )
+            return false;
+
+        do
+        {
+            if( accept("@Name") )
+            {
+                if( !accept("=") || !string_literal(item_name) )
+                    return false;
+            }
+            else if( accept("@Value") )
+            {
+                if( !accept("=") || !string_literal(item_value) )
+                    return false;
+            }
+            else
+            {
+                return false;
+            }
+        }
+        while( accept("and") );
+
+        if( !accept("]") )
+            return false;
+
+
+        emit(EventFilter::OP_ITEM, scope, item_name, item_value);
+        return true;
+    }
+};
+
+
+
+bool EventFilter::set_content(const char *expr)
+{
+    program.clear();
+    strings.clear();
+
+    if( !ContentParser(*this, expr).parse() || program.empty() )
+    {
+        program.clear();
+        str_err = "unsupported MessageContent: " + std::string(expr);
+        return false;
+    }
+
+
+    // depth of the stack, it is fixed in match_content()
+    size_t depth = 0;
+
+    for( size_t i = 0; i < program.size(); ++i )
+    {
+        if( program[i].code == OP_ITEM )
+            depth++;
+        else if( program[i].code != OP_NOT )
+            depth--;
+
+        if( depth > MAX_DEPTH )
+        {
+            program.clear();
+            str_err = "MessageContent is too complex: " + std::string(expr);
+            return false;
+        }
+    }
+
+    return true;
+}
+
+
+
+static bool match_item(const std::string *name, const std::string *value, const char *item_name, const char *item_value)
+{
+    return (!name || (*name == item_name)) && (!value || (*value == item_value));
+}
+
+
+
+bool EventFilter::match_content(const EventMessage &msg) const
+{
+    if( program.empty() )
+        return true;
+
+
+    bool   stack[MAX_DEPTH];
+    size_t sp = 0;
+
+    for( size_t i = 0; i < program.size(); ++i )
+    {
+        const Op &op = program[i];
+
+        switch( op.code )
+        {
+            case OP_ITEM:
+            {
+                const std::string *name  = (op.name  != NO_STRING) ? &strings[op.name]  : NULL;
+                const std::string *value = (op.value != NO_STRING) ? &strings[op.value] : NULL;
+                bool res = false;
+
+                if( op.scope != SCOPE_DATA )
+                    res = match_item(name, value, msg.source_name, msg.source_value);
+
+                if( !res && (op.scope != SCOPE_SOURCE) )
+                    res = match_item(name, value, msg.data_name, msg.data_value);
+
+                stack[sp++] = res;
+                break;
+            }
+
+            case OP_AND:
+                sp--;
+                stack[sp - 1] = stack[sp - 1] && stack[sp];
+                break;
+
+            case OP_OR:
+                sp--;
+                stack[sp - 1] = stack[sp - 1] || stack[sp];
+                break;
+
+            case OP_NOT:
+                stack[sp - 1] = !stack[sp - 1];
+                break;
+        }
+    }
+
+    return stack[0];
+}
@@ -0,0 +1,100 @@
+#ifndef EVENT_FILTER_H
+#define EVENT_FILTER_H
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+#include <memory>
+
+
+
+
+
+struct EventMessage;
+
+
+
+/*
+ * Filter of a subscription, compiled once when the subscription is created.
+ *
+ * TopicExpression (ConcreteSet dialect): alternatives separated by '|', each
+ * is a path of topics, "//." at the end selects the topic and all topics
+ * below it: "tns1:VideoSource/MotionAlarm|tns1:Device//.". The paths are kept
+ * as segments for TopicIndex of the broker. Namespace prefixes are not
+ * compared (tns1:Device and tns:Device are the same topic).
+ *
+ * MessageContent (ItemFilter dialect) is compiled into a small stack program:
+ *   boolean((//tt:Source/tt:SimpleItem[@Name="Source" and @Value="1"]) or
+ *           not(//tt:SimpleItem[@Name="State" and @Value="false"]))
+ * Items can be searched in tt:Source, tt:Data or both (//tt:SimpleItem),
+ * @Name and @Value are optional.
+ */
+class EventFilter
+{
+public:
+    struct TopicPath
+    {
+        std::vector<std::string> segments; // without namespace prefixes
+        bool subtree;                      // "//."
+    };
+
+    static const size_t MAX_DEPTH = 16; // of the stack of the content program
+
+    bool set_topics(const char *expr);
+    bool set_content(const char *expr);
+
+    bool empty(void) const { return topics.empty() && program.empty(); }
+
+    // empty - all topics
+    const std::vector<TopicPath> &get_topics(void) const { return topics; }
+
+    // true if there is no content filter
+    bool match_content(const EventMessage &msg) const;
+
+    std::string get_str_err() const { return str_err; }
+    const char *get_cstr_err() const { return str_err.c_str(); }
+
+private:
+    enum OpCode
+    {
+        OP_ITEM,
+        OP_AND,
+        OP_OR,
+        OP_NOT
+    };
+
+    enum Scope
+    {
+        SCOPE_ANY,
+        SCOPE_SOURCE,
+        SCOPE_DATA
+    };
+
+    struct Op
+    {
+        uint8_t  code;
+        uint8_t  scope;
+        uint16_t name;  // index in strings, NO_STRING - any
+        uint16_t value;
+    };
+
+    static const uint16_t NO_STRING = 0xFFFF;
+
+    std::vector<TopicPath>   topics;
+    std::vector<Op>          program;
+    std::vector<std::string> strings;
+
+    std::string str_err;
+
+    friend class ContentParser;
+};
+
+
+
+typedef std::shared_ptr<const EventFilter> EventFilterPtr;
+
+
+
+
+
+#endif // EVENT_FILTER_H
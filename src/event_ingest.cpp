@@ -0,0 +1,243 @@
+#include <time.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+#include "event_ingest.h"
+#include "smacros.h"
+
+
+
+
+
+// the layout is shared with the senders, it must not depend on the compiler
+STATIC_ASSERT( sizeof(EventIngestRecord) == 8 );
+
+
+
+static const size_t CONTROL_SIZE = CMSG_SPACE(sizeof(struct timespec));
+
+
+
+bool EventIngest::set_path(const char *new_val)
+{
+    struct sockaddr_un addr;
+
+    if( !new_val || !*new_val || (strlen(new_val) >= sizeof(addr.sun_path)) )
+    {
+        str_err = "path of event socket is empty or too long";
+        return false;
+    }
+
+
+    path = new_val;
+    return true;
+}
+
+
+
+bool EventIngest::open(void)
+{
+    close();
+
+
+    fd = socket(AF_UNIX, SOCK_DGRAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if( fd < 0 )
+    {
+        str_err = "can't create event socket";
+        return false;
+    }
+
+
+    struct sockaddr_un addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    strncpy(addr.sun_path, path.c_str(), sizeof(addr.sun_path) - 1);
+
+    unlink(path.c_str()); // left by the previous run
+
+    if( bind(fd, (struct sockaddr *)&addr, sizeof(addr)) != 0 )
+    {
+        close();
+        str_err = "can't bind event socket: " + path;
+        return false;
+    }
+
+
+    // bursts of events wait in the socket while the main loop serves a request,
+    // the kernel timestamps the datagrams when they are queued
+    int rcvbuf = 4 * 1024 * 1024;
+    int on     = 1;
+    setsockopt(fd, SOL_SOCKET, SO_RCVBUF, &rcvbuf, sizeof(rcvbuf));
+    setsockopt(fd, SOL_SOCKET, SO_TIMESTAMPNS, &on, sizeof(on));
+
+
+    buffers.resize(BATCH * EVENT_INGEST_MAX_DGRAM);
+    controls.resize(BATCH * CONTROL_SIZE);
+    events.resize(MAX_EVENTS);
+
+    return true;
+}
+
+
+
+void EventIngest::close(void)
+{
+    if( fd < 0 )
+        return;
+
+    ::close(fd);
+    fd = -1;
+
+    unlink(path.c_str());
+}
+
+
+
+static int64_t get_utc_time_ms(struct msghdr &hdr, const struct timespec &now)
+{
+    const struct timespec *ts = &now;
+
+    for( struct cmsghdr *cmsg = CMSG_FIRSTHDR(&hdr); cmsg; cmsg = CMSG_NXTHDR(&hdr, cmsg) )
+    {
+        if( (cmsg->cmsg_level == SOL_SOCKET) && (cmsg->cmsg_type == SCM_TIMESTAMPNS) )
+            ts = (const struct timespec *)CMSG_DATA(cmsg);
+    }
+
+    return (int64_t)ts->tv_sec * 1000 + ts->tv_nsec / 1000000;
+}
+
+
+
+static bool copy_field(char *dst, size_t size, const uint8_t *&pos, size_t len)
+{
+    if( len >= size )
+        return false;
+
+    memcpy(dst, pos, len);
+    dst[len] = '\0';
+    pos += len;
+
+    return true;
+}
+
+
+
+bool EventIngest::parse_record(const uint8_t *&pos, const uint8_t *end, EventMessage &event)
+{
+    EventIngestRecord rec;
+
+    if( (size_t)(end - pos) < sizeof(rec) )
+        return false;
+
+    memcpy(&rec, pos, sizeof(rec));
+
+    size_t len = sizeof(rec) + rec.topic_len + rec.source_name_len + rec.source_value_len +
+                 rec.data_name_len + rec.data_value_len;
+
+    if( (rec.version != EVENT_INGEST_VERSION) || (rec.operation > EventMessage::CHANGED) ||
+        !rec.topic_len || ((size_t)(end - pos) < len) )
+        return false;
+
+
+    const uint8_t *str = pos + sizeof(rec);
+
+    event.operation = rec.operation;
+
+    if( !copy_field(event.topic,        sizeof(event.topic),        str, rec.topic_len)        ||
+        !copy_field(event.source_name,  sizeof(event.source_name),  str, rec.source_name_len)  ||
+        !copy_field(event.source_value, sizeof(event.source_value), str, rec.source_value_len) ||
+        !copy_field(event.data_name,    sizeof(event.data_name),    str, rec.data_name_len)    ||
+        !copy_field(event.data_value,   sizeof(event.data_value),   str, rec.data_value_len) )
+        return false;
+
+
+    pos += len;
+    return true;
+}
+
+
+
+void EventIngest::process(EventBroker &broker)
+{
+    struct mmsghdr msgs[BATCH];
+    struct iovec   iovs[BATCH];
+    size_t         count = 0;  // events to publish
+
+    for( size_t batch = 0; batch < MAX_BATCHES; ++batch )
+    {
+        for( size_t i = 0; i < BATCH; ++i )
+        {
+            iovs[i].iov_base = &buffers[i * EVENT_INGEST_MAX_DGRAM];
+            iovs[i].iov_len  = EVENT_INGEST_MAX_DGRAM;
+
+            memset(&msgs[i].msg_hdr, 0, sizeof(msgs[i].msg_hdr));
+            msgs[i].msg_hdr.msg_iov        = &iovs[i];
+            msgs[i].msg_hdr.msg_iovlen     = 1;
+            msgs[i].msg_hdr.msg_control    = &controls[i * CONTROL_SIZE];
+            msgs[i].msg_hdr.msg_controllen = CONTROL_SIZE;
+        }
+
+
+        int res = recvmmsg(fd, msgs, BATCH, MSG_DONTWAIT, NULL);
+        if( res <= 0 )
+            break;
+
+
+        // for the datagrams without kernel timestamp
+        struct timespec now;
+        clock_gettime(CLOCK_REALTIME, &now);
+
+        batches++;
+        datagrams += res;
+
+        for( int i = 0; i < res; ++i )
+        {
+            const uint8_t *pos = &buffers[i * EVENT_INGEST_MAX_DGRAM];
+            const uint8_t *end = pos + msgs[i].msg_len;
+            int64_t utc_time_ms = get_utc_time_ms(msgs[i].msg_hdr, now);
+
+            if( msgs[i].msg_hdr.msg_flags & MSG_TRUNC )
+            {
+                invalid++;
+                continue;
+            }
+
+            while( pos < end )
+            {
+                if( !parse_record(pos, end, events[count]) )
+                {
+                    invalid++; // the rest of the datagram can't be parsed
+                    break;
+                }
+
+                events[count].utc_time_ms = utc_time_ms;
+                records++;
+
+                if( ++count == MAX_EVENTS )
+                {
+                    broker.publish(&events[0], count);
+                    count = 0;
+                }
+            }
+        }
+
+        if( (size_t)res < BATCH )
+            break; // the socket is empty
+    }
+
+
+    if( count )
+        broker.publish(&events[0], count);
+}
+
+
+
+void EventIngest::dump_stats(FILE *fp) const
+{
+    fprintf(fp, "Event socket: datagrams %llu  records %llu  invalid %llu  batches %llu\n",
+            (unsigned long long)datagrams,
+            (unsigned long long)records,
+            (unsigned long long)invalid,
+            (unsigned long long)batches);
+}
@@ -0,0 +1,155 @@
+#ifndef EVENT_INGEST_H
+#define EVENT_INGEST_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <string>
+#include <vector>
+
+#include "event_broker.h"
+
+
+
+
+
+/*
+ * Format of the datagrams sent by local processes (motion, tamper, I/O) to the
+ * UNIX datagram socket of the daemon. A datagram has one or more records, a
+ * record is EventIngestRecord followed by the strings (without '\0') in the
+ * order of their lengths:
+ *
+ *   topic        tns1:VideoSource/MotionAlarm
+ *   source_name  Source
+ *   source_value VideoSourceToken
+ *   data_name    State
+ *   data_value   true
+ *
+ * The lengths must fit the fields of EventMessage (topic < 64, names < 24,
+ * values < 40), else the record is dropped. Put several events into one
+ * datagram (up to EVENT_INGEST_MAX_DGRAM bytes) when they come in bursts:
+ * the kernel queues only net.unix.max_dgram_qlen datagrams for the socket,
+ * so send with MSG_DONTWAIT to never block on a busy daemon.
+ * The events are timestamped by the daemon when the datagram is received.
+ */
+#define EVENT_INGEST_VERSION    1
+#define EVENT_INGEST_MAX_DGRAM  4096
+
+
+
+struct EventIngestRecord
+{
+    uint8_t version;          // EVENT_INGEST_VERSION
+    uint8_t operation;        // EventMessage::Operation
+    uint8_t topic_len;
+    uint8_t source_name_len;
+    uint8_t source_value_len;
+    uint8_t data_name_len;
+    uint8_t data_value_len;
+    uint8_t reserved;
+};
+
+
+
+// append the record to buf (for the sender), returns new size of buf or 0 if it does not fit
+static inline size_t event_ingest_pack(uint8_t *buf, size_t size, size_t capacity, uint8_t operation,
+                                       const char *topic, const char *source_name, const char *source_value,
+                                       const char *data_name, const char *data_value)
+{
+    const char *strs[5] = { topic, source_name, source_value, data_name, data_value };
+    size_t      lens[5];
+    size_t      need = sizeof(EventIngestRecord);
+
+    for( int i = 0; i < 5; ++i )
+    {
+        lens[i] = strlen(strs[i]);
+        if( lens[i] > 255 )
+            return 0;
+
+        need += lens[i];
+    }
+
+    if( size + need > capacity )
+        return 0;
+
+
+    EventIngestRecord rec = { EVENT_INGEST_VERSION, operation, (uint8_t)lens[0], (uint8_t)lens[1],
+                              (uint8_t)lens[2], (uint8_t)lens[3], (uint8_t)lens[4], 0 };
+
+    memcpy(buf + size, &rec, sizeof(rec));
+    size += sizeof(rec);
+
+    for( int i = 0; i < 5; ++i )
+    {
+        memcpy(buf + size, strs[i], lens[i]);
+        size += lens[i];
+    }
+
+    return size;
+}
+
+
+
+
+
+/*
+ * Daemon side: the socket is read by the main loop (it polls the fd) with
+ * recvmmsg(), BATCH datagrams per call, and the events of a batch are
+ * published to the broker at once (one lock, one wakeup of the waiters).
+ */
+class EventIngest
+{
+public:
+    EventIngest() : fd(-1), datagrams(0), records(0), invalid(0), batches(0) {}
+    ~EventIngest() { close(); }
+
+    static const size_t BATCH       = 64;   // datagrams per recvmmsg()
+    static const size_t MAX_BATCHES = 16;   // per call of process(), then the loop goes on
+    static const size_t MAX_EVENTS  = 1024; // published at once
+
+    bool enabled(void) const { return !path.empty(); }
+
+    //methods for parsing opt from cmd
+    bool set_path(const char *new_val);
+    const std::string &get_path(void) const { return path; }
+
+    bool open(void);
+
+    int get_fd(void) const { return fd; }
+
+    // read the queued datagrams and publish their events
+    void process(EventBroker &broker);
+
+    void dump_stats(FILE *fp) const;
+
+    std::string get_str_err() const { return str_err; }
+    const char *get_cstr_err() const { return str_err.c_str(); }
+
+private:
+    std::string path;
+    int         fd;
+
+    std::vector<uint8_t>      buffers;  // BATCH * EVENT_INGEST_MAX_DGRAM
+    std::vector<uint8_t>      controls; // BATCH * cmsg with the timestamp
+    std::vector<EventMessage> events;   // MAX_EVENTS
+
+    uint64_t datagrams;
+    uint64_t records;
+    uint64_t invalid;
+    uint64_t batches;
+
+    std::string str_err;
+
+    void close(void);
+    static bool parse_record(const uint8_t *&pos, const uint8_t *end, EventMessage &event);
+
+    EventIngest(const EventIngest &);
+    EventIngest &operator=(const EventIngest &);
+};
+
+
+
+
+
+#endif // EVENT_INGEST_H
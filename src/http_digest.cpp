@@ -0,0 +1,458 @@
+#include <ctype.h>
+#include <stdlib.h>
+#include <string.h>
+#include <openssl/crypto.h>
+#include <openssl/evp.h>
+#include <openssl/rand.h>
+
+#include "http_digest.h"
+#include "smacros.h"
+
+
+
+
+
+const char *HttpDigest::REALM = "onvif";
+
+
+
+static const size_t MAX_FIELD = 256;   // of the parts of the digest
+static const size_t MAX_HEX   = 2 * EVP_MAX_MD_SIZE + 1;
+
+
+
+// value of a field of the header, it points into the header
+struct Field
+{
+    const char *str;
+    size_t      len;
+
+    bool equals(const char *val) const { return (len == strlen(val)) && !strncasecmp(str, val, len); }
+    bool same(const char *val) const { return (len == strlen(val)) && !memcmp(str, val, len); }
+};
+
+
+
+struct Authorization
+{
+    Field username, realm, nonce, uri, response, algorithm, qop, nc, cnonce;
+};
+
+
+
+static bool parse_authorization(const char *str, Authorization &auth)
+{
+    memset(&auth, 0, sizeof(auth));
+
+    struct { const char *name; Field *field; } names[] =
+    {
+        { "username",  &auth.username  },
+        { "realm",     &auth.realm     },
+        { "nonce",     &auth.nonce     },
+        { "uri",       &auth.uri       },
+        { "response",  &auth.response  },
+        { "algorithm", &auth.algorithm },
+        { "qop",       &auth.qop       },
+        { "nc",        &auth.nc        },
+        { "cnonce",    &auth.cnonce    }
+    };
+
+
+    while( *str )
+    {
+        while( isspace((unsigned char)*str) || (*str == ',') )
+            str++;
+
+        if( !*str )
+            break;
+
+
+        const char *name = str;
+        while( *str && (*str != '=') && !isspace((unsigned char)*str) )
+            str++;
+
+        size_t name_len = str - name;
+
+        while( isspace((unsigned char)*str) )
+            str++;
+
+        if( *str++ != '=' )
+            return false;
+
+        while( isspace((unsigned char)*str) )
+            str++;
+
+
+        Field val;
+
+        if( *str == '"' )
+        {
+            val.str = ++str;
+            while( *str && (*str != '"') )
+                str += (*str == '\\' && str[1]) ? 2 : 1;
+
+            if( !*str )
+                return false;
+
+            val.len = str++ - val.str;
+        }
+        else
+        {
+            val.str = str;
+            while( *str && (*str != ',') && !isspace((unsigned char)*str) )
+                str++;
+
+            val.len = str - val.str;
+        }
+
+
+        for( size_t i = 0; i < COUNT_ELEMENTS(names); ++i )
+        {
+            if( (strlen(names[i].name) == name_len) && !strncasecmp(name, names[i].name, name_len) )
+                *names[i].field = val;
+        }
+    }
+
+
+    return auth.username.str && auth.nonce.str && auth.uri.str && auth.response.str &&
+           auth.qop.str && auth.nc.str && auth.cnonce.str;
+}
+
+
+
+// hex of the hash of the parts joined by ':'
+static bool get_hash(const EVP_MD *md, const Field *parts, size_t count, char *hex)
+{
+    char   buf[MAX_HEX * 2 + MAX_FIELD * 4];
+    size_t len = 0;
+
+    for( size_t i = 0; i < count; ++i )
+    {
+        if( len + parts[i].len + 1 > sizeof(buf) )
+            return false;
+
+        if( i )
+            buf[len++] = ':';
+
+        memcpy(buf + len, parts[i].str, parts[i].len);
+        len += parts[i].len;
+    }
+
+
+    unsigned char hash[EVP_MAX_MD_SIZE];
+    unsigned int  hash_len;
+
+    if( !EVP_Digest(buf, len, hash, &hash_len, md, NULL) )
+        return false;
+
+    for( unsigned int i = 0; i < hash_len; ++i )
+        sprintf(hex + 2 * i, "%02x", hash[i]);
+
+    return true;
+}
+
+
+
+static time_t get_uptime(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return ts.tv_sec;
+}
+
+
+
+static Field to_field(const char *str)
+{
+    Field field = { str, strlen(str) };
+    return field;
+}
+
+
+
+HttpDigest::HttpDigest():
+    next      ( 0 ),
+    ha2_next  ( 0 ),
+    ha2_hits  ( 0 ),
+    verified  ( 0 ),
+    failed    ( 0 ),
+    stale     ( 0 ),
+    challenges( 0 )
+{
+    memset(nonces, 0, sizeof(nonces));
+    memset(ha2_cache, 0, sizeof(ha2_cache));
+}
+
+
+
+HttpDigest::Result HttpDigest::verify(const char *authorization, const char *method, const char *uri,
+                                      const UserMap &users, const User *session, const User *&user)
+{
+    Authorization auth;
+
+    if( !parse_authorization(authorization, auth) || (auth.nonce.len != NONCE_LEN) ||
+        (auth.username.len > MAX_FIELD) || (auth.uri.len > MAX_FIELD) || (auth.cnonce.len > MAX_FIELD) ||
+        (auth.nc.len != 8) )
+    {
+        failed++;
+        return BAD_REQUEST;
+    }
+
+
+    const EVP_MD *md;
+    bool          sha256 = false;
+
+    if( !auth.algorithm.str || auth.algorithm.equals("MD5") )
+        md = EVP_md5();
+    else if( auth.algorithm.equals("SHA-256") )
+    {
+        md     = EVP_sha256();
+        sha256 = true;
+    }
+    else
+    {
+        failed++;
+        return BAD_REQUEST;
+    }
+
+
+    // the request line and the header must name the same resource
+    if( !auth.qop.equals("auth") || !auth.realm.same(REALM) ||
+        (strlen(uri) != auth.uri.len) || strncmp(uri, auth.uri.str, auth.uri.len) )
+    {
+        failed++;
+        return BAD_REQUEST;
+    }
+
+
+    char     field[NONCE_LEN + 1];
+    char    *end;
+    uint32_t nc;
+    size_t   slot;
+    uint64_t tag;
+
+    memcpy(field, auth.nc.str, 8);
+    field[8] = '\0';
+    nc = strtoul(field, &end, 16);
+    if( *end || !nc )
+    {
+        failed++;
+        return BAD_REQUEST;
+    }
+
+    memcpy(field, auth.nonce.str, NONCE_LEN);
+    field[NONCE_LEN] = '\0';
+    tag = strtoull(field + 4, &end, 16);
+    field[4] = '\0';
+    slot = strtoul(field, NULL, 16);
+
+    if( *end || (slot >= NONCES) || !tag || (nonces[slot].tag != tag) ||
+        (get_uptime() - nonces[slot].issued > NONCE_TTL) )
+    {
+        stale++;
+        return STALE;
+    }
+
+
+    // the user of the session (the same connection) is not looked up, H(A1)
+    // of the users is derived when the password is set
+    const User *found = (session && auth.username.same(session->name.c_str())) ? session : NULL;
+
+    if( !found )
+    {
+        UserMap::const_iterator it = users.find(std::string(auth.username.str, auth.username.len));
+        if( it == users.end() )
+        {
+            failed++;
+            return NOT_AUTHORIZED;
+        }
+
+        found = &it->second;
+    }
+
+    const std::string &ha1 = sha256 ? found->ha1_sha256 : found->ha1_md5;
+
+
+    char        expected[MAX_HEX];
+    const char *ha2 = get_ha2(md, sha256, method, auth.uri.str, auth.uri.len);
+
+    if( !ha2 )
+    {
+        failed++;
+        return BAD_REQUEST;
+    }
+
+    // the response is always checked, the session only saves the lookups
+    Field resp[] = { { ha1.data(), ha1.size() }, auth.nonce, auth.nc, auth.cnonce, auth.qop, to_field(ha2) };
+
+    if( !get_hash(md, resp, COUNT_ELEMENTS(resp), expected) )
+    {
+        failed++;
+        return BAD_REQUEST;
+    }
+
+
+    char   received[MAX_HEX];
+    size_t len = strlen(expected);
+
+    if( auth.response.len != len )
+    {
+        failed++;
+        return NOT_AUTHORIZED;
+    }
+
+    for( size_t i = 0; i < len; ++i )
+        received[i] = tolower((unsigned char)auth.response.str[i]);
+
+
+    // the credentials are checked before nc, a wrong request does not use nc
+    if( CRYPTO_memcmp(expected, received, len) || !use_nc(nonces[slot], nc) )
+    {
+        failed++;
+        return NOT_AUTHORIZED;
+    }
+
+
+    user = found;
+    verified++;
+    return OK;
+}
+
+
+
+// H(A2) = H(method:uri) is the same for all requests of a service, the last ones are kept
+const char *HttpDigest::get_ha2(const EVP_MD *md, bool sha256, const char *method, const char *uri, size_t uri_len)
+{
+    size_t method_len = strlen(method);
+
+    if( (method_len >= sizeof(ha2_cache[0].method)) || (uri_len >= sizeof(ha2_cache[0].uri)) )
+        return NULL;
+
+
+    for( size_t i = 0; i < HA2_CACHE; ++i )
+    {
+        Ha2 &entry = ha2_cache[i];
+
+        if( entry.hex[0] && (entry.sha256 == sha256) && !strcmp(entry.method, method) &&
+            (strlen(entry.uri) == uri_len) && !memcmp(entry.uri, uri, uri_len) )
+        {
+            ha2_hits++;
+            return entry.hex;
+        }
+    }
+
+
+    Ha2  &entry = ha2_cache[ha2_next];
+    Field a2[]  = { to_field(method), { uri, uri_len } };
+
+    ha2_next = (ha2_next + 1) % HA2_CACHE;
+
+    if( !get_hash(md, a2, COUNT_ELEMENTS(a2), entry.hex) )
+    {
+        entry.hex[0] = '\0';
+        return NULL;
+    }
+
+    entry.sha256 = sha256;
+    memcpy(entry.method, method, method_len + 1);
+    memcpy(entry.uri, uri, uri_len);
+    entry.uri[uri_len] = '\0';
+
+    return entry.hex;
+}
+
+
+
+std::string HttpDigest::get_ha1(Algorithm algorithm, const std::string &name, const std::string &password)
+{
+    char  hex[MAX_HEX];
+    Field a1[] = { { name.data(), name.size() }, to_field(REALM), { password.data(), password.size() } };
+
+    if( !get_hash((algorithm == SHA256) ? EVP_sha256() : EVP_md5(), a1, COUNT_ELEMENTS(a1), hex) )
+        return std::string();
+
+    return hex;
+}
+
+
+
+bool HttpDigest::use_nc(Nonce &nonce, uint32_t nc)
+{
+    if( nc > nonce.nc_max )
+    {
+        uint32_t shift = nc - nonce.nc_max;
+
+        nonce.nc_seen = (shift < 64) ? (nonce.nc_seen << shift) | 1 : 1;
+        nonce.nc_max  = nc;
+        return true;
+    }
+
+
+    // the requests of several connections can come out of order
+    uint32_t age = nonce.nc_max - nc;
+
+    if( (age >= 64) || (nonce.nc_seen & ((uint64_t)1 << age)) )
+        return false;
+
+    nonce.nc_seen |= (uint64_t)1 << age;
+    return true;
+}
+
+
+
+void HttpDigest::issue_nonce(char *buf)
+{
+    Nonce &nonce = nonces[next];
+
+    do
+    {
+        if( RAND_bytes((unsigned char *)&nonce.tag, sizeof(nonce.tag)) != 1 )
+            nonce.tag = ((uint64_t)rand() << 32) ^ rand() ^ (uint64_t)time(NULL);
+    } while( !nonce.tag );
+
+    nonce.issued  = get_uptime();
+    nonce.nc_max  = 0;
+    nonce.nc_seen = 0;
+
+    sprintf(buf, "%04x%016llx", (unsigned)next, (unsigned long long)nonce.tag);
+
+    next = (next + 1) % NONCES;
+    challenges++;
+}
+
+
+
+int HttpDigest::get_challenge(char *buf, size_t size, const char *nonce, Algorithm algorithm, bool stale) const
+{
+    return snprintf(buf, size, "Digest realm=\"%s\", qop=\"auth\", algorithm=%s, nonce=\"%s\"%s",
+                    REALM, (algorithm == SHA256) ? "SHA-256" : "MD5", nonce,
+                    stale ? ", stale=true" : "");
+}
+
+
+
+const char *HttpDigest::get_result_str(Result result)
+{
+    switch( result )
+    {
+        case OK:             return "OK";
+        case STALE:          return "stale nonce";
+        case NOT_AUTHORIZED: return "wrong user or password";
+        case BAD_REQUEST:    return "wrong Authorization header";
+    }
+
+    return "";
+}
+
+
+
+void HttpDigest::dump_stats(FILE *fp) const
+{
+    fprintf(fp, "HTTP Digest: verified %llu  failed %llu  stale %llu  challenges %llu  cached H(A2) %llu\n",
+            (unsigned long long)verified,
+            (unsigned long long)failed,
+            (unsigned long long)stale,
+            (unsigned long long)challenges,
+            (unsigned long long)ha2_hits);
+}
@@ -0,0 +1,112 @@
+#ifndef HTTP_DIGEST_H
+#define HTTP_DIGEST_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <time.h>
+#include <string>
+#include <openssl/evp.h>
+
+#include "user_store.h"
+
+
+
+
+
+/*
+ * HTTP Digest authentication (RFC 7616, qop=auth, MD5 and SHA-256).
+ *
+ * The server nonces live in a fixed table of NONCES slots: a nonce is the
+ * index of its slot and a random tag, a challenge takes the oldest slot (round
+ * robin), so the table is never allocated and a flood of challenges only makes
+ * the clients of the dropped nonces retry (stale=true). A slot tracks the
+ * nonce counts (nc) of the requests in a window of 64 counts, a repeated nc
+ * is a replay. The Authorization header is parsed in place, without copies,
+ * H(A1) of the users is taken from UserStore and H(A2) of the last method and
+ * URI pairs is kept, a request computes only the response.
+ */
+class HttpDigest
+{
+public:
+    HttpDigest();
+
+    static const size_t NONCES    = 1024;
+    static const time_t NONCE_TTL = 300;    // sec
+    static const size_t NONCE_LEN = 20;     // hex: slot (4) and tag (16)
+    static const size_t HA2_CACHE = 8;
+    static const char  *REALM;
+
+    enum Algorithm
+    {
+        MD5,
+        SHA256
+    };
+
+    enum Result
+    {
+        OK,
+        STALE,          // the nonce is unknown or expired, the client must retry with new one
+        NOT_AUTHORIZED, // wrong credentials or replayed nc
+        BAD_REQUEST     // the header can't be parsed
+    };
+
+    // authorization is the value of the header after "Digest", method and uri
+    // are of the request line, user is set if it is OK; the user of session
+    // (AuthSessions, can be NULL) is not looked up, the response is checked always
+    Result verify(const char *authorization, const char *method, const char *uri,
+                  const UserMap &users, const User *session, const User *&user);
+
+    // H(A1) = H(name:REALM:password), hex
+    static std::string get_ha1(Algorithm algorithm, const std::string &name, const std::string &password);
+
+    // new nonce for a challenge, buf must have NONCE_LEN + 1 chars
+    void issue_nonce(char *buf);
+
+    // value of WWW-Authenticate with the nonce
+    int get_challenge(char *buf, size_t size, const char *nonce, Algorithm algorithm, bool stale) const;
+
+    static const char *get_result_str(Result result);
+
+    void dump_stats(FILE *fp) const;
+
+private:
+    struct Nonce
+    {
+        uint64_t tag;      // 0 - free
+        time_t   issued;   // CLOCK_MONOTONIC
+        uint32_t nc_max;   // the highest nc of the nonce
+        uint64_t nc_seen;  // bit n - nc_max - n was used
+    };
+
+    struct Ha2
+    {
+        bool sha256;
+        char method[8];
+        char uri[256];
+        char hex[2 * EVP_MAX_MD_SIZE + 1];  // "" - free
+    };
+
+    Nonce    nonces[NONCES];
+    size_t   next;         // the slot for the next nonce
+    Ha2      ha2_cache[HA2_CACHE];
+    size_t   ha2_next;
+    uint64_t ha2_hits;
+
+    uint64_t verified;
+    uint64_t failed;
+    uint64_t stale;
+    uint64_t challenges;
+
+    bool use_nc(Nonce &nonce, uint32_t nc);
+    const char *get_ha2(const EVP_MD *md, bool sha256, const char *method, const char *uri, size_t uri_len);
+
+    HttpDigest(const HttpDigest &);
+    HttpDigest &operator=(const HttpDigest &);
+};
+
+
+
+
+
+#endif // HTTP_DIGEST_H
@@ -0,0 +1,459 @@
+#include "jpeg_encoder.h"
+
+
+
+
+
+static const unsigned char zigzag[64] =
+{
+     0,  1,  8, 16,  9,  2,  3, 10, 17, 24, 32, 25, 18, 11,  4,  5,
+    12, 19, 26, 33, 40, 48, 41, 34, 27, 20, 13,  6,  7, 14, 21, 28,
+    35, 42, 49, 56, 57, 50, 43, 36, 29, 22, 15, 23, 30, 37, 44, 51,
+    58, 59, 52, 45, 38, 31, 39, 46, 53, 60, 61, 54, 47, 55, 62, 63
+};
+
+
+
+// ITU T.81 Annex K, natural order
+static const unsigned char std_qt_y[64] =
+{
+    16, 11, 10, 16,  24,  40,  51,  61,
+    12, 12, 14, 19,  26,  58,  60,  55,
+    14, 13, 16, 24,  40,  57,  69,  56,
+    14, 17, 22, 29,  51,  87,  80,  62,
+    18, 22, 37, 56,  68, 109, 103,  77,
+    24, 35, 55, 64,  81, 104, 113,  92,
+    49, 64, 78, 87, 103, 121, 120, 101,
+    72, 92, 95, 98, 112, 100, 103,  99
+};
+
+
+
+static const unsigned char std_qt_c[64] =
+{
+    17, 18, 24, 47, 99, 99, 99, 99,
+    18, 21, 26, 66, 99, 99, 99, 99,
+    24, 26, 56, 99, 99, 99, 99, 99,
+    47, 66, 99, 99, 99, 99, 99, 99,
+    99, 99, 99, 99, 99, 99, 99, 99,
+    99, 99, 99, 99, 99, 99, 99, 99,
+    99, 99, 99, 99, 99, 99, 99, 99,
+    99, 99, 99, 99, 99, 99, 99, 99
+};
+
+
+
+// Standard Huffman tables (ITU T.81 Annex K.3): counts of codes of length 1..16 and values
+static const unsigned char dc_y_bits[16] = { 0, 1, 5, 1, 1, 1, 1, 1, 1, 0, 0, 0, 0, 0, 0, 0 };
+static const unsigned char dc_c_bits[16] = { 0, 3, 1, 1, 1, 1, 1, 1, 1, 1, 1, 0, 0, 0, 0, 0 };
+static const unsigned char dc_vals[12]   = { 0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11 };
+
+static const unsigned char ac_y_bits[16] = { 0, 2, 1, 3, 3, 2, 4, 3, 5, 5, 4, 4, 0, 0, 1, 0x7d };
+static const unsigned char ac_y_vals[162] =
+{
+    0x01, 0x02, 0x03, 0x00, 0x04, 0x11, 0x05, 0x12, 0x21, 0x31, 0x41, 0x06, 0x13, 0x51, 0x61, 0x07,
+    0x22, 0x71, 0x14, 0x32, 0x81, 0x91, 0xa1, 0x08, 0x23, 0x42, 0xb1, 0xc1, 0x15, 0x52, 0xd1, 0xf0,
+    0x24, 0x33, 0x62, 0x72, 0x82, 0x09, 0x0a, 0x16, 0x17, 0x18, 0x19, 0x1a, 0x25, 0x26, 0x27, 0x28,
+    0x29, 0x2a, 0x34, 0x35, 0x36, 0x37, 0x38, 0x39, 0x3a, 0x43, 0x44, 0x45, 0x46, 0x47, 0x48, 0x49,
+    0x4a, 0x53, 0x54, 0x55, 0x56, 0x57, 0x58, 0x59, 0x5a, 0x63, 0x64, 0x65, 0x66, 0x67, 0x68, 0x69,
+    0x6a, 0x73, 0x74, 0x75, 0x76, 0x77, 0x78, 0x79, 0x7a, 0x83, 0x84, 0x85, 0x86, 0x87, 0x88, 0x89,
+    0x8a, 0x92, 0x93, 0x94, 0x95, 0x96, 0x97, 0x98, 0x99, 0x9a, 0xa2, 0xa3, 0xa4, 0xa5, 0xa6, 0xa7,
+    0xa8, 0xa9, 0xaa, 0xb2, 0xb3, 0xb4, 0xb5, 0xb6, 0xb7, 0xb8, 0xb9, 0xba, 0xc2, 0xc3, 0xc4, 0xc5,
+    0xc6, 0xc7, 0xc8, 0xc9, 0xca, 0xd2, 0xd3, 0xd4, 0xd5, 0xd6, 0xd7, 0xd8, 0xd9, 0xda, 0xe1, 0xe2,
+    0xe3, 0xe4, 0xe5, 0xe6, 0xe7, 0xe8, 0xe9, 0xea, 0xf1, 0xf2, 0xf3, 0xf4, 0xf5, 0xf6, 0xf7, 0xf8,
+    0xf9, 0xfa
+};
+
+static const unsigned char ac_c_bits[16] = { 0, 2, 1, 2, 4, 4, 3, 4, 7, 5, 4, 4, 0, 1, 2, 0x77 };
+static const unsigned char ac_c_vals[162] =
+{
+    0x00, 0x01, 0x02, 0x03, 0x11, 0x04, 0x05, 0x21, 0x31, 0x06, 0x12, 0x41, 0x51, 0x07, 0x61, 0x71,
+    0x13, 0x22, 0x32, 0x81, 0x08, 0x14, 0x42, 0x91, 0xa1, 0xb1, 0xc1, 0x09, 0x23, 0x33, 0x52, 0xf0,
+    0x15, 0x62, 0x72, 0xd1, 0x0a, 0x16, 0x24, 0x34, 0xe1, 0x25, 0xf1, 0x17, 0x18, 0x19, 0x1a, 0x26,
+    0x27, 0x28, 0x29, 0x2a, 0x35, 0x36, 0x37, 0x38, 0x39, 0x3a, 0x43, 0x44, 0x45, 0x46, 0x47, 0x48,
+    0x49, 0x4a, 0x53, 0x54, 0x55, 0x56, 0x57, 0x58, 0x59, 0x5a, 0x63, 0x64, 0x65, 0x66, 0x67, 0x68,
+    0x69, 0x6a, 0x73, 0x74, 0x75, 0x76, 0x77, 0x78, 0x79, 0x7a, 0x82, 0x83, 0x84, 0x85, 0x86, 0x87,
+    0x88, 0x89, 0x8a, 0x92, 0x93, 0x94, 0x95, 0x96, 0x97, 0x98, 0x99, 0x9a, 0xa2, 0xa3, 0xa4, 0xa5,
+    0xa6, 0xa7, 0xa8, 0xa9, 0xaa, 0xb2, 0xb3, 0xb4, 0xb5, 0xb6, 0xb7, 0xb8, 0xb9, 0xba, 0xc2, 0xc3,
+    0xc4, 0xc5, 0xc6, 0xc7, 0xc8, 0xc9, 0xca, 0xd2, 0xd3, 0xd4, 0xd5, 0xd6, 0xd7, 0xd8, 0xd9, 0xda,
+    0xe2, 0xe3, 0xe4, 0xe5, 0xe6, 0xe7, 0xe8, 0xe9, 0xea, 0xf2, 0xf3, 0xf4, 0xf5, 0xf6, 0xf7, 0xf8,
+    0xf9, 0xfa
+};
+
+
+
+struct HuffCode
+{
+    unsigned short code;
+    unsigned short len;
+};
+
+
+
+struct HuffTable
+{
+    HuffCode codes[256];
+
+    HuffTable(const unsigned char *bits, const unsigned char *vals)
+    {
+        unsigned int code = 0;
+        int          k    = 0;
+
+        for(int i = 0; i < 256; ++i)
+            codes[i].code = codes[i].len = 0;
+
+        for(int len = 1; len <= 16; ++len)
+        {
+            for(int i = 0; i < bits[len - 1]; ++i, ++k, ++code)
+            {
+                codes[vals[k]].code = code;
+                codes[vals[k]].len  = len;
+            }
+
+            code <<= 1;
+        }
+    }
+};
+
+
+
+static const HuffTable huff_dc_y(dc_y_bits, dc_vals);
+static const HuffTable huff_dc_c(dc_c_bits, dc_vals);
+static const HuffTable huff_ac_y(ac_y_bits, ac_y_vals);
+static const HuffTable huff_ac_c(ac_c_bits, ac_c_vals);
+
+
+
+// Entropy coded segment writer (with 0xFF byte stuffing)
+class BitWriter
+{
+public:
+    explicit BitWriter(std::string &out) : out(out), acc(0), nbits(0) {}
+
+    void put(unsigned int code, int len)
+    {
+        acc    = (acc << len) | (code & ((1u << len) - 1));
+        nbits += len;
+
+        while( nbits >= 8 )
+        {
+            unsigned char c = (unsigned char)(acc >> (nbits - 8));
+            out += (char)c;
+
+            if( c == 0xFF )
+                out += (char)0;
+
+            nbits -= 8;
+        }
+    }
+
+    void put(const HuffCode &hc) { put(hc.code, hc.len); }
+
+    void flush(void)
+    {
+        if( nbits )
+            put(0x7F, 7); // pad with 1 bits
+    }
+
+private:
+    std::string &out;
+    uint32_t     acc;
+    int          nbits;
+};
+
+
+
+static void put_u16(std::string &out, unsigned int v)
+{
+    out += (char)(v >> 8);
+    out += (char)(v & 0xFF);
+}
+
+
+
+static void put_marker(std::string &out, unsigned char marker, unsigned int len)
+{
+    out += (char)0xFF;
+    out += (char)marker;
+    put_u16(out, len);
+}
+
+
+
+static void put_dht(std::string &out, unsigned char cls_id, const unsigned char *bits,
+                    const unsigned char *vals, int nvals)
+{
+    put_marker(out, 0xC4, 2 + 1 + 16 + nvals);
+    out += (char)cls_id;
+    out.append((const char *)bits, 16);
+    out.append((const char *)vals, nvals);
+}
+
+
+
+void JpegEncoder::set_quality(int new_quality)
+{
+    static const float aan_scale[8] =
+    {
+        1.0f, 1.387039845f, 1.306562965f, 1.175875602f,
+        1.0f, 0.785694958f, 0.541196100f, 0.275899379f
+    };
+
+
+    if( new_quality < 1 )
+        new_quality = 1;
+
+    if( new_quality > 100 )
+        new_quality = 100;
+
+    quality = new_quality;
+
+
+    int scale = (quality < 50) ? (5000 / quality) : (200 - quality * 2);
+    int q_y[64], q_c[64];
+
+    for(int i = 0; i < 64; ++i)
+    {
+        q_y[i] = (std_qt_y[i] * scale + 50) / 100;
+        q_c[i] = (std_qt_c[i] * scale + 50) / 100;
+
+        q_y[i] = (q_y[i] < 1) ? 1 : (q_y[i] > 255) ? 255 : q_y[i];
+        q_c[i] = (q_c[i] < 1) ? 1 : (q_c[i] > 255) ? 255 : q_c[i];
+
+        float s = aan_scale[i / 8] * aan_scale[i % 8] * 8.0f;
+
+        fdtbl_y[i] = 1.0f / (q_y[i] * s);
+        fdtbl_c[i] = 1.0f / (q_c[i] * s);
+    }
+
+
+    for(int i = 0; i < 64; ++i)
+    {
+        qt_y[i] = (unsigned char)q_y[zigzag[i]];
+        qt_c[i] = (unsigned char)q_c[zigzag[i]];
+    }
+}
+
+
+
+// AAN forward DCT of 8 values (stride apart), output is scaled (see aan_scale)
+static inline void fdct8(float *d, int stride)
+{
+    float d0 = d[0],          d1 = d[stride],     d2 = d[2 * stride], d3 = d[3 * stride];
+    float d4 = d[4 * stride], d5 = d[5 * stride], d6 = d[6 * stride], d7 = d[7 * stride];
+
+    float tmp0 = d0 + d7, tmp7 = d0 - d7;
+    float tmp1 = d1 + d6, tmp6 = d1 - d6;
+    float tmp2 = d2 + d5, tmp5 = d2 - d5;
+    float tmp3 = d3 + d4, tmp4 = d3 - d4;
+
+    // even part
+    float tmp10 = tmp0 + tmp3, tmp13 = tmp0 - tmp3;
+    float tmp11 = tmp1 + tmp2, tmp12 = tmp1 - tmp2;
+
+    d[0]          = tmp10 + tmp11;
+    d[4 * stride] = tmp10 - tmp11;
+
+    float z1 = (tmp12 + tmp13) * 0.707106781f;
+    d[2 * stride] = tmp13 + z1;
+    d[6 * stride] = tmp13 - z1;
+
+    // odd part
+    tmp10 = tmp4 + tmp5;
+    tmp11 = tmp5 + tmp6;
+    tmp12 = tmp6 + tmp7;
+
+    float z5  = (tmp10 - tmp12) * 0.382683433f;
+    float z2  = tmp10 * 0.541196100f + z5;
+    float z4  = tmp12 * 1.306562965f + z5;
+    float z3  = tmp11 * 0.707106781f;
+    float z11 = tmp7 + z3;
+    float z13 = tmp7 - z3;
+
+    d[5 * stride] = z13 + z2;
+    d[3 * stride] = z13 - z2;
+    d[1 * stride] = z11 + z4;
+    d[7 * stride] = z11 - z4;
+}
+
+
+
+static int encode_block(BitWriter &bw, float *blk, const float *fdtbl, int prev_dc,
+                        const HuffTable &dc, const HuffTable &ac)
+{
+    for(int i = 0; i < 8; ++i)
+        fdct8(blk + i * 8, 1);  // rows
+
+    for(int i = 0; i < 8; ++i)
+        fdct8(blk + i, 8);      // columns
+
+
+    int q[64];
+
+    for(int i = 0; i < 64; ++i)
+    {
+        float v = blk[zigzag[i]] * fdtbl[zigzag[i]];
+        q[i] = (int)(v < 0 ? v - 0.5f : v + 0.5f);
+    }
+
+
+    // DC: difference with the previous block, category + bits
+    int diff = q[0] - prev_dc;
+    int adiff = diff < 0 ? -diff : diff;
+    int cat = 0;
+
+    while( adiff >> cat )
+        ++cat;
+
+    bw.put(dc.codes[cat]);
+    if( cat )
+        bw.put(diff < 0 ? diff - 1 : diff, cat);
+
+
+    // AC: run of zeros + category
+    int last = 63;
+    while( (last > 0) && !q[last] )
+        --last;
+
+    for(int i = 1, run = 0; i <= last; ++i)
+    {
+        if( !q[i] )
+        {
+            ++run;
+            continue;
+        }
+
+        while( run > 15 )
+        {
+            bw.put(ac.codes[0xF0]); // ZRL
+            run -= 16;
+        }
+
+        int v  = q[i];
+        int av = v < 0 ? -v : v;
+        int c  = 0;
+
+        while( av >> c )
+            ++c;
+
+        bw.put(ac.codes[(run << 4) | c]);
+        bw.put(v < 0 ? v - 1 : v, c);
+
+        run = 0;
+    }
+
+    if( last < 63 )
+        bw.put(ac.codes[0x00]); // EOB
+
+
+    return q[0];
+}
+
+
+
+static void load_block(float *blk, const uint8_t *plane, int w, int h, int x0, int y0)
+{
+    for(int y = 0; y < 8; ++y)
+    {
+        int sy = (y0 + y < h) ? y0 + y : h - 1;
+        const uint8_t *row = plane + sy * w;
+
+        for(int x = 0; x < 8; ++x)
+        {
+            int sx = (x0 + x < w) ? x0 + x : w - 1;
+            blk[y * 8 + x] = (float)row[sx] - 128.0f;
+        }
+    }
+}
+
+
+
+void JpegEncoder::encode(const YuvImage &img, std::string &out) const
+{
+    out.reserve(out.size() + img.width * img.height / 4);
+
+
+    // SOI, APP0 (JFIF 1.1, no density)
+    out += (char)0xFF;
+    out += (char)0xD8;
+
+    put_marker(out, 0xE0, 16);
+    out.append("JFIF\0", 5);
+    out += (char)1;
+    out += (char)1;
+    out += (char)0;
+    put_u16(out, 1);
+    put_u16(out, 1);
+    out += (char)0;
+    out += (char)0;
+
+
+    // DQT
+    put_marker(out, 0xDB, 2 + 2 * 65);
+    out += (char)0;
+    out.append((const char *)qt_y, 64);
+    out += (char)1;
+    out.append((const char *)qt_c, 64);
+
+
+    // SOF0: Y 2x2, Cb 1x1, Cr 1x1
+    put_marker(out, 0xC0, 17);
+    out += (char)8;
+    put_u16(out, img.height);
+    put_u16(out, img.width);
+    out += (char)3;
+    out += (char)1; out += (char)0x22; out += (char)0;
+    out += (char)2; out += (char)0x11; out += (char)1;
+    out += (char)3; out += (char)0x11; out += (char)1;
+
+
+    // DHT
+    put_dht(out, 0x00, dc_y_bits, dc_vals, sizeof(dc_vals));
+    put_dht(out, 0x10, ac_y_bits, ac_y_vals, sizeof(ac_y_vals));
+    put_dht(out, 0x01, dc_c_bits, dc_vals, sizeof(dc_vals));
+    put_dht(out, 0x11, ac_c_bits, ac_c_vals, sizeof(ac_c_vals));
+
+
+    // SOS
+    put_marker(out, 0xDA, 12);
+    out += (char)3;
+    out += (char)1; out += (char)0x00;
+    out += (char)2; out += (char)0x11;
+    out += (char)3; out += (char)0x11;
+    out += (char)0;
+    out += (char)63;
+    out += (char)0;
+
+
+    BitWriter bw(out);
+    float blk[64];
+    int   dc_y = 0, dc_u = 0, dc_v = 0;
+
+    int uv_w = img.get_uv_width();
+    int uv_h = img.get_uv_height();
+
+    for(int my = 0; my < img.height; my += 16)
+    {
+        for(int mx = 0; mx < img.width; mx += 16)
+        {
+            for(int b = 0; b < 4; ++b)
+            {
+                load_block(blk, img.y(), img.width, img.height, mx + (b & 1) * 8, my + (b >> 1) * 8);
+                dc_y = encode_block(bw, blk, fdtbl_y, dc_y, huff_dc_y, huff_ac_y);
+            }
+
+            load_block(blk, img.u(), uv_w, uv_h, mx / 2, my / 2);
+            dc_u = encode_block(bw, blk, fdtbl_c, dc_u, huff_dc_c, huff_ac_c);
+
+            load_block(blk, img.v(), uv_w, uv_h, mx / 2, my / 2);
+            dc_v = encode_block(bw, blk, fdtbl_c, dc_v, huff_dc_c, huff_ac_c);
+        }
+    }
+
+    bw.flush();
+
+
+    // EOI
+    out += (char)0xFF;
+    out += (char)0xD9;
+}
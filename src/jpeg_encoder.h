@@ -0,0 +1,40 @@
+#ifndef JPEG_ENCODER_H
+#define JPEG_ENCODER_H
+
+#include <string>
+
+#include "yuv_scale.h"
+
+
+
+
+
+/*
+ * Baseline JPEG (JFIF, 4:2:0, standard Huffman tables) from I420 image.
+ * Small and without dependencies, it is used for snapshot thumbnails.
+ */
+class JpegEncoder
+{
+public:
+    JpegEncoder() { set_quality(75); }
+
+    // 1..100, like libjpeg
+    void set_quality(int quality);
+    int get_quality(void) const { return quality; }
+
+    // append JPEG to out
+    void encode(const YuvImage &img, std::string &out) const;
+
+private:
+    int   quality;
+    float fdtbl_y[64];  // 1 / (quant * AAN scale), natural order
+    float fdtbl_c[64];
+    unsigned char qt_y[64]; // quant tables in zigzag order (for DQT)
+    unsigned char qt_c[64];
+};
+
+
+
+
+
+#endif // JPEG_ENCODER_H
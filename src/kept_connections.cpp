@@ -0,0 +1,191 @@
+#include <unistd.h>
+
+#include "kept_connections.h"
+
+
+
+
+
+static time_t get_uptime(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return ts.tv_sec;
+}
+
+
+
+KeptConnections::KeptConnections():
+    parked ( 0 ),
+    resumed( 0 ),
+    evicted( 0 ),
+    expired( 0 )
+{
+    for( size_t i = 0; i < MAX_CONNECTIONS; ++i )
+    {
+        connections[i].socket = SOAP_INVALID_SOCKET;
+#ifdef WITH_OPENSSL
+        connections[i].ssl = NULL;
+        connections[i].bio = NULL;
+#endif
+    }
+}
+
+
+
+uint64_t KeptConnections::park(struct soap *soap, uint64_t connection)
+{
+    Connection *conn   = NULL;
+    uint64_t    closed = 0;
+
+    for( size_t i = 0; i < MAX_CONNECTIONS; ++i )
+    {
+        Connection &cur = connections[i];
+
+        if( !soap_valid_socket(cur.socket) )
+        {
+            conn = &cur;
+            break;
+        }
+
+        if( !conn || (cur.since < conn->since) )
+            conn = &cur;
+    }
+
+
+    if( soap_valid_socket(conn->socket) ) // the set is full
+    {
+        closed = conn->connection;
+        close(*conn);
+        evicted++;
+    }
+
+
+    conn->socket     = soap->socket;
+    conn->connection = connection;
+    conn->ip         = soap->ip;
+    conn->port       = soap->port;
+    conn->keep_alive = soap->keep_alive;
+    conn->since      = get_uptime();
+
+    soap->socket     = SOAP_INVALID_SOCKET;
+    soap->keep_alive = 0;
+
+#ifdef WITH_OPENSSL
+    conn->ssl = soap->ssl;
+    conn->bio = soap->bio;
+    soap->ssl = NULL;
+    soap->bio = NULL;
+#endif
+
+    parked++;
+    return closed;
+}
+
+
+
+uint64_t KeptConnections::resume(struct soap *soap, size_t i)
+{
+    Connection &conn = connections[i];
+
+    soap->socket     = conn.socket;
+    soap->ip         = conn.ip;
+    soap->port       = conn.port;
+    soap->keep_alive = conn.keep_alive;
+    soap->bufidx     = 0; // soap_begin() keeps the buffer of a kept-alive connection,
+    soap->buflen     = 0; // it holds the rest of the previous one
+
+#ifdef WITH_OPENSSL
+    soap->ssl = conn.ssl;
+    soap->bio = conn.bio;
+    conn.ssl  = NULL;
+    conn.bio  = NULL;
+#endif
+
+    conn.socket = SOAP_INVALID_SOCKET;
+
+    resumed++;
+    return conn.connection;
+}
+
+
+
+void KeptConnections::expire(void (*on_close)(uint64_t connection))
+{
+    time_t now = get_uptime();
+
+    for( size_t i = 0; i < MAX_CONNECTIONS; ++i )
+    {
+        Connection &conn = connections[i];
+
+        if( !soap_valid_socket(conn.socket) || (now - conn.since <= IDLE_SEC) )
+            continue;
+
+
+        if( on_close )
+            on_close(conn.connection);
+
+        close(conn);
+        expired++;
+    }
+}
+
+
+
+void KeptConnections::get_pollfds(struct pollfd *fds) const
+{
+    for( size_t i = 0; i < MAX_CONNECTIONS; ++i )
+    {
+        fds[i].fd      = soap_valid_socket(connections[i].socket) ? connections[i].socket : -1;
+        fds[i].events  = POLLIN;
+        fds[i].revents = 0;
+    }
+}
+
+
+
+void KeptConnections::clear()
+{
+    for( size_t i = 0; i < MAX_CONNECTIONS; ++i )
+    {
+        if( soap_valid_socket(connections[i].socket) )
+            close(connections[i]);
+    }
+}
+
+
+
+void KeptConnections::close(Connection &conn)
+{
+#ifdef WITH_OPENSSL
+    if( conn.ssl ) // the bio is freed with it
+    {
+        SSL_shutdown(conn.ssl);
+        SSL_free(conn.ssl);
+        conn.ssl = NULL;
+        conn.bio = NULL;
+    }
+#endif
+
+    ::close(conn.socket);
+    conn.socket = SOAP_INVALID_SOCKET;
+}
+
+
+
+void KeptConnections::dump_stats(FILE *fp) const
+{
+    size_t idle = 0;
+
+    for( size_t i = 0; i < MAX_CONNECTIONS; ++i )
+        idle += soap_valid_socket(connections[i].socket);
+
+
+    fprintf(fp, "Kept connections: idle %zu  parked %llu  resumed %llu  evicted %llu  expired %llu\n",
+            idle,
+            (unsigned long long)parked,
+            (unsigned long long)resumed,
+            (unsigned long long)evicted,
+            (unsigned long long)expired);
+}
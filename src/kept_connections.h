@@ -0,0 +1,87 @@
+#ifndef KEPT_CONNECTIONS_H
+#define KEPT_CONNECTIONS_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <time.h>
+#include <poll.h>
+
+#include "soapH.h"
+
+
+
+
+
+/*
+ * Idle kept-alive connections of the clients (HTTP keep-alive).
+ *
+ * The main loop serves one request at a time on its gSOAP context. After the
+ * response a connection which the client keeps open is parked here (the
+ * socket, the TLS of HTTPS and the state of keep-alive are taken from the
+ * context), the main loop polls the parked sockets and resumes a connection
+ * on the context when its next request comes. So several VMS can poll over
+ * their own connections at the same time, each connection keeps its number
+ * (for AuthSessions).
+ *
+ * The set is fixed (MAX_CONNECTIONS): when it is full the longest idle
+ * connection is closed, a connection idle longer than IDLE_SEC is closed too.
+ */
+class KeptConnections
+{
+public:
+    KeptConnections();
+    ~KeptConnections() { clear(); }
+
+    static const size_t MAX_CONNECTIONS = 16;
+    static const time_t IDLE_SEC        = 5;
+
+    // the connection of soap (number connection) waits for its next request,
+    // soap has no connection after it; returns the number of the closed
+    // connection which had to give the place (0 - none)
+    uint64_t park(struct soap *soap, uint64_t connection);
+
+    // the connection i (see get_pollfds) goes back to soap, returns its number
+    uint64_t resume(struct soap *soap, size_t i);
+
+    // close the connections idle longer than IDLE_SEC, their numbers are
+    // passed to on_close (can be NULL)
+    void expire(void (*on_close)(uint64_t connection));
+
+    // MAX_CONNECTIONS entries for poll (-1 for the free places)
+    void get_pollfds(struct pollfd *fds) const;
+
+    void clear(void);
+
+    void dump_stats(FILE *fp) const;
+
+private:
+    struct Connection
+    {
+        SOAP_SOCKET   socket;     // SOAP_INVALID_SOCKET - free
+        uint64_t      connection;
+        unsigned long ip;
+        int           port;
+        short         keep_alive; // requests left
+        time_t        since;      // CLOCK_MONOTONIC
+#ifdef WITH_OPENSSL
+        SSL          *ssl;
+        BIO          *bio;
+#endif
+    };
+
+    Connection connections[MAX_CONNECTIONS];
+
+    uint64_t parked;
+    uint64_t resumed;
+    uint64_t evicted;
+    uint64_t expired;
+
+    void close(Connection &conn);
+};
+
+
+
+
+
+#endif // KEPT_CONNECTIONS_H
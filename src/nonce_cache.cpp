@@ -0,0 +1,112 @@
+#include "nonce_cache.h"
+
+
+
+
+
+// the periods of the window must not share a bucket
+static const time_t MAX_WINDOW = (NonceCache::BUCKETS - 2) * NonceCache::BUCKET_SEC / 2;
+
+
+
+NonceCache::NonceCache(time_t window):
+    window( (window > 0 && window <= MAX_WINDOW) ? window : MAX_WINDOW )
+{
+}
+
+
+
+NonceCache::Result NonceCache::insert(uint64_t hash, time_t created, time_t now)
+{
+    if( (created < now - window) || (created > now + window) )
+        return STALE;
+
+
+    int64_t period = created / BUCKET_SEC;
+    Bucket &bucket = buckets[period & (BUCKETS - 1)];
+
+    if( bucket.period != period )
+    {
+        // the nonces of the old period are out of the window, all of them
+        // are dropped by the new generation
+        bucket.period = period;
+        bucket.count  = 0;
+
+        if( !++bucket.gen )
+        {
+            for( size_t i = 0; i < bucket.slots.size(); ++i )
+                bucket.slots[i].gen = 0;
+
+            bucket.gen = 1;
+        }
+    }
+
+
+    if( (bucket.count + 1) * 4 > bucket.slots.size() * 3 )
+    {
+        if( bucket.slots.size() >= MAX_SLOTS )
+            return FULL;
+
+        grow(bucket);
+    }
+
+    return add(bucket, hash) ? FRESH : REPLAYED;
+}
+
+
+
+size_t NonceCache::get_count(void) const
+{
+    size_t count = 0;
+
+    for( unsigned i = 0; i < BUCKETS; ++i )
+        count += buckets[i].count;
+
+    return count;
+}
+
+
+
+bool NonceCache::add(Bucket &bucket, uint64_t hash)
+{
+    size_t mask = bucket.slots.size() - 1;
+
+    for( size_t i = hash & mask; ; i = (i + 1) & mask )
+    {
+        Entry &entry = bucket.slots[i];
+
+        if( entry.gen != bucket.gen )
+        {
+            entry.hash = hash;
+            entry.gen  = bucket.gen;
+            bucket.count++;
+            return true;
+        }
+
+        if( entry.hash == hash )
+            return false;
+    }
+}
+
+
+
+void NonceCache::grow(Bucket &bucket)
+{
+    std::vector<Entry> old;
+    old.swap(bucket.slots);
+
+    Entry empty = { 0, 0 };
+    bucket.slots.assign(old.empty() ? MIN_SLOTS : old.size() * 2, empty);
+
+
+    uint32_t gen = bucket.gen;
+
+    bucket.gen   = 1;
+    bucket.count = 0;
+
+    for( size_t i = 0; i < old.size(); ++i )
+    {
+        if( old[i].gen == gen )
+            add(bucket, old[i].hash);
+    }
+}
@@ -0,0 +1,80 @@
+#ifndef NONCE_CACHE_H
+#define NONCE_CACHE_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <time.h>
+#include <vector>
+
+
+
+
+
+/*
+ * Replay cache of the nonces of the authenticated requests. A nonce is kept
+ * together with its creation time (Created of UsernameToken), the requests
+ * older than the window are rejected by the time check, so the cache must
+ * remember the nonces of the window only.
+ *
+ * The window is cut into buckets of BUCKET_SEC by the creation time, a bucket
+ * is a hash set (open addressing) of 64-bit hashes of the nonces. A replayed
+ * request has the same creation time (it is signed by the digest), so it is
+ * looked up in its bucket only. A bucket which is reused for a new period is
+ * emptied in O(1): the entries carry the generation of the bucket and the
+ * entries of older generations are free. The sets grow up to MAX_SLOTS and
+ * keep their memory, so the steady state does not allocate.
+ */
+class NonceCache
+{
+public:
+    static const time_t   BUCKET_SEC = 10;
+    static const unsigned BUCKETS    = 64;        // power of 2, more than the window
+    static const size_t   MIN_SLOTS  = 256;
+    static const size_t   MAX_SLOTS  = 1 << 16;   // per bucket (3/4 are used)
+
+    // window: the nonces created in [now - window, now + window] are accepted
+    explicit NonceCache(time_t window = 300);
+
+    time_t get_window(void) const { return window; }
+
+    enum Result
+    {
+        FRESH,      // remembered
+        REPLAYED,   // was seen in the window
+        STALE,      // created out of the window
+        FULL        // the bucket can't remember more nonces
+    };
+
+    Result insert(uint64_t hash, time_t created, time_t now);
+
+    size_t get_count(void) const;
+
+private:
+    struct Entry
+    {
+        uint64_t hash;
+        uint32_t gen;   // the entry is used if it is the generation of the bucket
+    };
+
+    struct Bucket
+    {
+        Bucket() : period(-1), gen(0), count(0) {}
+
+        int64_t            period;  // created / BUCKET_SEC
+        uint32_t           gen;
+        size_t             count;
+        std::vector<Entry> slots;
+    };
+
+    time_t window;
+    Bucket buckets[BUCKETS];
+
+    static bool add(Bucket &bucket, uint64_t hash); // false - it is there
+    static void grow(Bucket &bucket);
+};
+
+
+
+
+
+#endif // NONCE_CACHE_H
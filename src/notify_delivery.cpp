@@ -0,0 +1,383 @@
+#include <time.h>
+#include <curl/curl.h>
+
+#include <algorithm>
+#include <map>
+#include <thread>
+
+#include "notify_delivery.h"
+#include "smacros.h"
+
+
+
+
+
+// state of one push subscription, it is used by the delivery thread only
+struct NotifyConsumer
+{
+    EventSubscriptionPtr sub;
+    CURL        *curl;        // kept for the life of the subscription (persistent connection)
+    bool         busy;        // Notify is in progress
+    bool         seen;        // is in the current list of subscriptions
+    int          backoff_ms;  // 0 - last Notify was sent
+    int64_t      next_try;    // ms, CLOCK_MONOTONIC
+    size_t       batch_count; // events of the Notify (they are kept until it is sent)
+    EventMessage batch[NotifyDelivery::BATCH_SIZE];
+    std::string  body;        // capacity is reused
+};
+
+typedef std::map<uint32_t, NotifyConsumer> NotifyConsumers;
+
+
+
+const size_t NotifyDelivery::BATCH_SIZE;
+const long   NotifyDelivery::TIMEOUT_MS;
+const int    NotifyDelivery::MIN_BACKOFF_MS;
+const int    NotifyDelivery::MAX_BACKOFF_MS;
+
+
+
+static const char notify_action[] = "http://docs.oasis-open.org/wsn/bw-2/NotificationConsumer/Notify";
+
+
+
+static int64_t now_ms(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return (int64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+
+
+static size_t skip_data(void *ptr, size_t size, size_t nmemb, void *userdata)
+{
+    UNUSED(ptr);
+    UNUSED(userdata);
+
+    return size * nmemb;
+}
+
+
+
+static void append_escaped(std::string &out, const char *str)
+{
+    for( ; *str; ++str )
+    {
+        switch( *str )
+        {
+            case '&':  out += "&amp;";  break;
+            case '<':  out += "&lt;";   break;
+            case '>':  out += "&gt;";   break;
+            case '"':  out += "&quot;"; break;
+            default:   out += *str;     break;
+        }
+    }
+}
+
+
+
+static void append_simple_item(std::string &out, const char *name, const char *value)
+{
+    out += "<tt:SimpleItem Name=\"";
+    append_escaped(out, name);
+    out += "\" Value=\"";
+    append_escaped(out, value);
+    out += "\"/>";
+}
+
+
+
+static void append_message(std::string &out, const EventMessage &event)
+{
+    static const char *operations[] = { "Initialized", "Deleted", "Changed" };
+
+    time_t    sec = event.utc_time_ms / 1000;
+    struct tm tm;
+    char      utc_time[32];
+
+    gmtime_r(&sec, &tm);
+    size_t len = strftime(utc_time, sizeof(utc_time), "%Y-%m-%dT%H:%M:%S", &tm);
+    snprintf(utc_time + len, sizeof(utc_time) - len, ".%03dZ", (int)(event.utc_time_ms % 1000));
+
+
+    out += "<wsnt:NotificationMessage>"
+           "<wsnt:Topic Dialect=\"http://www.onvif.org/ver10/tev/topicExpression/ConcreteSet\">";
+    append_escaped(out, event.topic);
+    out += "</wsnt:Topic><wsnt:Message><tt:Message UtcTime=\"";
+    out += utc_time;
+    out += "\" PropertyOperation=\"";
+    out += operations[std::min<size_t>(event.operation, COUNT_ELEMENTS(operations) - 1)];
+    out += "\"><tt:Source>";
+    append_simple_item(out, event.source_name, event.source_value);
+    out += "</tt:Source><tt:Data>";
+    append_simple_item(out, event.data_name, event.data_value);
+    out += "</tt:Data></tt:Message></wsnt:Message></wsnt:NotificationMessage>";
+}
+
+
+
+// SOAP 1.2 envelope with wsnt:Notify, built by hand: the thread has no soap context
+static void build_notify(std::string &out, const std::string &consumer, const EventMessage *events, size_t count)
+{
+    out.clear();
+
+    out += "<?xml version=\"1.0\" encoding=\"UTF-8\"?>"
+           "<SOAP-ENV:Envelope"
+           " xmlns:SOAP-ENV=\"http://www.w3.org/2003/05/soap-envelope\""
+           " xmlns:wsa5=\"http://www.w3.org/2005/08/addressing\""
+           " xmlns:wsnt=\"http://docs.oasis-open.org/wsn/b-2\""
+           " xmlns:tt=\"http://www.onvif.org/ver10/schema\""
+           " xmlns:tns1=\"http://www.onvif.org/ver10/topics\">"
+           "<SOAP-ENV:Header><wsa5:Action>";
+    out += notify_action;
+    out += "</wsa5:Action><wsa5:To>";
+    append_escaped(out, consumer.c_str());
+    out += "</wsa5:To></SOAP-ENV:Header><SOAP-ENV:Body><wsnt:Notify>";
+
+    for( size_t i = 0; i < count; ++i )
+        append_message(out, events[i]);
+
+    out += "</wsnt:Notify></SOAP-ENV:Body></SOAP-ENV:Envelope>";
+}
+
+
+
+static bool new_consumer(NotifyConsumer &consumer, const EventSubscriptionPtr &sub, struct curl_slist *headers)
+{
+    consumer.sub         = sub;
+    consumer.curl        = curl_easy_init();
+    consumer.busy        = false;
+    consumer.seen        = true;
+    consumer.backoff_ms  = 0;
+    consumer.next_try    = 0;
+    consumer.batch_count = 0;
+
+    if( !consumer.curl )
+        return false;
+
+
+    CURL *curl = consumer.curl;
+
+    curl_easy_setopt(curl, CURLOPT_URL, sub->get_consumer().c_str());
+#if LIBCURL_VERSION_NUM >= 0x075500 // 7.85.0, CURLOPT_PROTOCOLS is deprecated
+    curl_easy_setopt(curl, CURLOPT_PROTOCOLS_STR, "http,https");
+#else
+    curl_easy_setopt(curl, CURLOPT_PROTOCOLS, (long)(CURLPROTO_HTTP | CURLPROTO_HTTPS));
+#endif
+    curl_easy_setopt(curl, CURLOPT_NOPROGRESS, 1L);
+    curl_easy_setopt(curl, CURLOPT_NOSIGNAL, 1L);
+    curl_easy_setopt(curl, CURLOPT_TCP_KEEPALIVE, 1L);
+    curl_easy_setopt(curl, CURLOPT_CONNECTTIMEOUT_MS, NotifyDelivery::TIMEOUT_MS);
+    curl_easy_setopt(curl, CURLOPT_TIMEOUT_MS, NotifyDelivery::TIMEOUT_MS);
+    curl_easy_setopt(curl, CURLOPT_HTTPHEADER, headers);
+    curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, skip_data);
+    curl_easy_setopt(curl, CURLOPT_PRIVATE, &consumer);
+
+    return true;
+}
+
+
+
+static void free_consumer(CURLM *multi, NotifyConsumer &consumer)
+{
+    if( !consumer.curl )
+        return;
+
+    if( consumer.busy )
+        curl_multi_remove_handle(multi, consumer.curl);
+
+    curl_easy_cleanup(consumer.curl);
+    consumer.curl = NULL;
+}
+
+
+
+NotifyDelivery::NotifyDelivery():
+    broker   ( NULL  ),
+    started  ( false ),
+    consumers( 0 ),
+    notifies ( 0 ),
+    messages ( 0 ),
+    failures ( 0 )
+{
+}
+
+
+
+void NotifyDelivery::start(EventBroker *event_broker)
+{
+    if( started )
+        return;
+
+
+    broker  = event_broker;
+    started = true;
+    std::thread(&NotifyDelivery::run, this).detach();
+}
+
+
+
+void NotifyDelivery::run(void)
+{
+    CURLM *multi = curl_multi_init();
+
+    struct curl_slist *headers = NULL;
+    headers = curl_slist_append(headers, "Content-Type: application/soap+xml; charset=utf-8");
+    headers = curl_slist_append(headers, "Expect:"); // no 100-continue round trip
+
+
+    EventNotifier *notifier = broker->get_push_notifier();
+    NotifyConsumers list;
+    EventBroker::SubscriptionListPtr subs;
+
+    while( true )
+    {
+        // consumers follow the push subscriptions of the broker
+        EventBroker::SubscriptionListPtr current = broker->get_subscriptions();
+
+        if( current != subs )
+        {
+            subs = current;
+
+            for( NotifyConsumers::iterator it = list.begin(); it != list.end(); ++it )
+                it->second.seen = false;
+
+            for( size_t i = 0; i < subs->size(); ++i )
+            {
+                const EventSubscriptionPtr &sub = (*subs)[i];
+
+                if( !sub->is_push() )
+                    continue;
+
+                NotifyConsumers::iterator it = list.find(sub->get_id());
+                if( it != list.end() )
+                {
+                    it->second.seen = true;
+                    continue;
+                }
+
+                if( !new_consumer(list[sub->get_id()], sub, headers) )
+                    list.erase(sub->get_id());
+            }
+
+            for( NotifyConsumers::iterator it = list.begin(); it != list.end(); )
+            {
+                if( it->second.seen )
+                {
+                    ++it;
+                    continue;
+                }
+
+                free_consumer(multi, it->second);
+                it = list.erase(it);
+            }
+
+            consumers.store(list.size());
+        }
+
+
+        // new Notify for idle consumers with events (or with a failed batch)
+        int64_t now     = now_ms();
+        int64_t timeout = 1000;
+
+        for( NotifyConsumers::iterator it = list.begin(); it != list.end(); ++it )
+        {
+            NotifyConsumer &consumer = it->second;
+
+            if( consumer.busy )
+                continue;
+
+            if( consumer.next_try > now )
+            {
+                timeout = std::min(timeout, consumer.next_try - now);
+                continue;
+            }
+
+            if( !consumer.batch_count )
+                consumer.batch_count = consumer.sub->pop(consumer.batch, BATCH_SIZE);
+
+            if( !consumer.batch_count )
+                continue;
+
+
+            build_notify(consumer.body, consumer.sub->get_consumer(), consumer.batch, consumer.batch_count);
+
+            curl_easy_setopt(consumer.curl, CURLOPT_POSTFIELDS, consumer.body.data());
+            curl_easy_setopt(consumer.curl, CURLOPT_POSTFIELDSIZE, (long)consumer.body.size());
+
+            if( curl_multi_add_handle(multi, consumer.curl) == CURLM_OK )
+                consumer.busy = true;
+        }
+
+
+        int running;
+        curl_multi_perform(multi, &running);
+
+
+        CURLMsg *msg;
+        int      left;
+
+        while( (msg = curl_multi_info_read(multi, &left)) )
+        {
+            if( msg->msg != CURLMSG_DONE )
+                continue;
+
+
+            NotifyConsumer *consumer = NULL;
+            long http_code = 0;
+
+            curl_easy_getinfo(msg->easy_handle, CURLINFO_PRIVATE, (char **)&consumer);
+            curl_easy_getinfo(msg->easy_handle, CURLINFO_RESPONSE_CODE, &http_code);
+
+            bool sent = (msg->data.result == CURLE_OK) && (http_code >= 200) && (http_code < 300);
+
+            curl_multi_remove_handle(multi, msg->easy_handle);
+            consumer->busy = false;
+
+            if( sent )
+            {
+                notifies++;
+                messages += consumer->batch_count;
+
+                consumer->batch_count = 0;
+                consumer->backoff_ms  = 0;
+                consumer->next_try    = 0;
+            }
+            else
+            {
+                DEBUG_MSG("Notify to %s failed\n", consumer->sub->get_consumer().c_str());
+                failures++;
+
+                consumer->backoff_ms = consumer->backoff_ms ? std::min(consumer->backoff_ms * 2, MAX_BACKOFF_MS)
+                                                            : MIN_BACKOFF_MS;
+                consumer->next_try   = now_ms() + consumer->backoff_ms;
+            }
+
+            timeout = 0; // the consumer can have more events
+        }
+
+
+        struct curl_waitfd extra;
+        extra.fd      = notifier->get_fd();
+        extra.events  = CURL_WAIT_POLLIN;
+        extra.revents = 0;
+
+        curl_multi_wait(multi, &extra, 1, (int)timeout, NULL);
+
+        if( extra.revents & CURL_WAIT_POLLIN )
+            notifier->clear();
+    }
+}
+
+
+
+void NotifyDelivery::dump_stats(FILE *fp) const
+{
+    fprintf(fp, "Notify: consumers %llu  sent %llu  messages %llu  failures %llu\n",
+            (unsigned long long)consumers.load(),
+            (unsigned long long)notifies.load(),
+            (unsigned long long)messages.load(),
+            (unsigned long long)failures.load());
+}
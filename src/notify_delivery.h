@@ -0,0 +1,61 @@
+#ifndef NOTIFY_DELIVERY_H
+#define NOTIFY_DELIVERY_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include <string>
+#include <atomic>
+
+#include "event_broker.h"
+
+
+
+
+
+/*
+ * Delivery of the push subscriptions (WS-BaseNotification Subscribe).
+ *
+ * One thread sends the events of all consumers with the curl multi interface,
+ * so a slow consumer does not delay the others and the SOAP requests never
+ * wait for a consumer. Every consumer has its own curl handle, the connection
+ * is kept between Notify requests. The events which are queued when a Notify
+ * is sent (up to BATCH_SIZE) go in one Notify. If a Notify fails it is sent
+ * again after a backoff (doubled after each failure), new events stay in the
+ * queue of the subscription meanwhile (and are dropped if it is full).
+ * The thread sleeps on the push notifier of the broker.
+ */
+class NotifyDelivery
+{
+public:
+    NotifyDelivery();
+
+    static const size_t BATCH_SIZE     = 32;    // NotificationMessages in one Notify
+    static const long   TIMEOUT_MS     = 5000;  // of one Notify
+    static const int    MIN_BACKOFF_MS = 1000;
+    static const int    MAX_BACKOFF_MS = 60000;
+
+    // start the thread (after daemonize), it lives until the process exits
+    void start(EventBroker *event_broker);
+
+    void dump_stats(FILE *fp) const;
+
+private:
+    EventBroker *broker;
+    bool         started;
+
+    std::atomic<uint64_t> consumers;
+    std::atomic<uint64_t> notifies;   // sent successfully
+    std::atomic<uint64_t> messages;   // in these Notify
+    std::atomic<uint64_t> failures;   // Notify which must be sent again
+
+    void run(void);
+
+    NotifyDelivery(const NotifyDelivery &);
+    NotifyDelivery &operator=(const NotifyDelivery &);
+};
+
+
+
+
+
+#endif // NOTIFY_DELIVERY_H
@@ -2,11 +2,15 @@
 #include <stdio.h>
 #include <unistd.h>
 #include <errno.h>
+#include <time.h>
 #include <iostream>
 #include <fstream>
 #include <string.h>
 #include <signal.h>
 #include <getopt.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/resource.h>
 #include <curl/curl.h>
 
 #include "daemon.h"
@@ -17,7 +21,12 @@
 #include "DeviceBinding.nsmap"
 #include "soapDeviceBindingService.h"
 #include "soapMediaBindingService.h"
+#include "soapMedia2BindingService.h"
 #include "soapPTZBindingService.h"
+#include "soapEventBindingService.h"
+#include "soapPullPointSubscriptionBindingService.h"
+#include "soapNotificationProducerBindingService.h"
+#include "soapSubscriptionManagerBindingService.h"
 
 static const char *help_str =
     " ===============  Help  ===============\n"
@@ -36,29 +45,68 @@ static const char *help_str =
     "       --no_close             Don't close standart IO files\n"
     "       --conf_file          [value] Set configuration file name\n"
     "       --pid_file           [value] Set pid file name\n"
-    "       --log_file           [value] Set log file name\n\n"
+    "       --log_file           [value] Set log file name\n"
+    "       --stats_file         [value] Set file name for statistics dump on SIGUSR1 (default = stderr)\n\n"
     "       --port               [value] Set socket port for Services   (default = 1000)\n"
     "       --user               [value] Set user name for Services     (default = admin)\n"
     "       --password           [value] Set user password for Services (default = admin)\n"
+    "       --users_file         [value] Set file to keep users created by clients, the user above is\n"
+    "                                    the first Administrator (default don't keep, needs WSSE_ON)\n"
+    "       --tls_port           [value] Set socket port for Services over HTTPS (default don't serve, needs WSSE_ON)\n"
+    "       --tls_cert           [value] Set PEM file with the key and the certificate chain for HTTPS\n"
+    "       --ktls                       Let the kernel encrypt the records of HTTPS (kTLS) if it can\n"
     "       --model              [value] Set model device for Services  (default = Model)\n"
     "       --scope              [value] Set scope for Services         (default don't set)\n"
     "       --ifs                [value] Set Net interfaces for work    (default don't set)\n"
     "       --hardware_id        [value] Set Hardware ID of device      (default = HardwareID)\n"
     "       --serial_num         [value] Set Serial number of device    (default = SerialNumber)\n"
     "       --firmware_ver       [value] Set firmware version of device (default = FirmwareVersion)\n"
-    "       --manufacturer       [value] Set manufacturer for Services  (default = Manufacturer)\n\n"
+    "       --manufacturer       [value] Set manufacturer for Services  (default = Manufacturer)\n"
+    "       --profiles_file      [value] Set file to keep profiles created by clients (default don't keep)\n"
+    "       --encoder_ctl        [value] Set POSIX shm (/name) to publish encoder configurations changed by\n"
+    "                                    clients (default don't publish)\n"
+    "       --event_socket       [value] Set UNIX datagram socket (/path) to receive events from local\n"
+    "                                    processes (default don't receive, see event_ingest.h)\n\n"
+    "       --video_source       [value] Add video source (sensor) token:WIDTHxHEIGHT[@FPS], must be set\n"
+    "                                    before the profiles which use it (see opt source)\n"
     "       --name               [value] Set Name for Profile Media Services\n"
     "       --width              [value] Set Width for Profile Media Services\n"
     "       --height             [value] Set Height for Profile Media Services\n"
     "       --url                [value] Set URL (or template URL) for Profile Media Services\n"
     "       --snapurl            [value] Set URL (or template URL) for Snapshot\n"
-    "                                    in template mode %s will be changed to IP of interface (see opt ifs)\n"
+    "       --snapshm            [value] Set POSIX shm (/name) with JPEG frames of encoder for Snapshot\n"
+    "                                    (served by the snapshot proxy, see opt snapshot_proxy)\n"
+    "       --snapraw            [value] Set raw frame of encoder (nv12:/path or i420:/path) for thumbnails\n"
+    "                                    /snapshot/<profile>?width=320&height=180 (see opt snapshot_proxy)\n"
+    "                                    in template mode %s will be changed to IP of interface (see opt ifs),\n"
+    "                                    %i to IP of client, %p to port, %n to profile token, %% to '%'\n"
+    "       --source             [value] Set token of video source for Profile (default: own source\n"
+    "                                    with the size of the profile)\n"
+    "       --resolutions        [value] Set resolutions of encoder WxH,WxH,... (default: size of the profile)\n"
+    "       --fps_range          [value] Set range of framerate MIN-MAX (default for the type of profile)\n"
+    "       --gov_range          [value] Set range of GOV length MIN-MAX (default for the type of profile)\n"
+    "       --bitrate_range      [value] Set range of bitrate in kbit/s MIN-MAX (default for the type of profile)\n"
     "       --type               [value] Set Type for Profile Media Services (JPEG|MPEG4|H264)\n"
     "                                    It is also a sign of the end of the profile parameters\n\n"
     "       --ptz                        Enable PTZ support\n"
     "       --move_continuous    [value] Set process to call for PTZ continuous movement\n"
     "       --move_stop          [value] Set process to call for PTZ stop movement\n"
     "       --move_preset        [value] Set process to call for PTZ goto preset movement\n"
+    "                                    PTZ URLs are templates too: %t preset token, %x %y %z vector,\n"
+    "                                    %v speed, %P onlySendPanTilt, %Z onlySendZoom\n"
+    "       --ptz_timeout        [value] Set timeout in ms for PTZ backend requests (default = 1000)\n"
+    "       --ptz_fail_limit     [value] Set count of PTZ backend failures to open the breaker (default = 3)\n"
+    "       --ptz_retry_time     [value] Set time in ms before the open breaker probes backend (default = 5000)\n\n"
+    "       --snapshot_proxy             Serve snapshots on http://<ip>:<port>/snapshot/<profile> (cache of snapurl)\n"
+    "       --snapshot_ttl       [value] Set time in ms to keep the cached snapshot (default = 1000)\n"
+    "       --snapshot_workers   [value] Set count of threads for the snapshot proxy (default = 2)\n"
+    "       --snapshot_timeout   [value] Set timeout in ms for the snapshot fetch from snapurl (default = 3000)\n"
+    "       --snapshot_quality   [value] Set JPEG quality 1-100 for thumbnails from snapraw (default = 75)\n\n"
+    "       --discovery                  Answer WS-Discovery Probe/Resolve on UDP 3702 (instead of wsdd)\n\n"
+    "       --rate_read          [value] Limit all requests of a client IP: RATE[:BURST] per sec (default no limit)\n"
+    "       --rate_ptz           [value] Limit PTZ control of a client IP: RATE[:BURST] per sec (default no limit)\n"
+    "       --rate_expensive     [value] Limit GetProfiles, changes and snapshots of a client IP: RATE[:BURST]\n"
+    "                                    per sec (default no limit)\n"
     "  -v,  --version              Display daemon version\n"
     "  -h,  --help                 Display this help\n\n";
 
@@ -77,11 +125,16 @@ namespace LongOpts
         conf_file,
         pid_file,
         log_file,
+        stats_file,
 
         //ONVIF Service options (context)
         port,
         user,
         password,
+        users_file,
+        tls_port,
+        tls_cert,
+        ktls,
         manufacturer,
         model,
         firmware_ver,
@@ -89,13 +142,24 @@ namespace LongOpts
         hardware_id,
         scope,
         ifs,
+        profiles_file,
+        encoder_ctl,
+        event_socket,
 
         //Media Profile for ONVIF Media Service
+        video_source,
         name,
         width,
         height,
         url,
         snapurl,
+        snapshm,
+        snapraw,
+        source,
+        resolutions,
+        fps_range,
+        gov_range,
+        bitrate_range,
         type,
 
         //PTZ Profile for ONVIF PTZ Service
@@ -103,7 +167,25 @@ namespace LongOpts
         move_continuous,
         move_stop,
         goto_preset,
-        goto_home
+        goto_home,
+        ptz_timeout,
+        ptz_fail_limit,
+        ptz_retry_time,
+
+        //Snapshot proxy
+        snapshot_proxy,
+        snapshot_ttl,
+        snapshot_workers,
+        snapshot_timeout,
+        snapshot_quality,
+
+        //WS-Discovery
+        discovery,
+
+        //Rate limit
+        rate_read,
+        rate_ptz,
+        rate_expensive
     };
 }
 
@@ -121,11 +203,16 @@ static const struct option long_opts[] =
         {"conf_file", required_argument, NULL, LongOpts::conf_file},
         {"pid_file", required_argument, NULL, LongOpts::pid_file},
         {"log_file", required_argument, NULL, LongOpts::log_file},
+        {"stats_file", required_argument, NULL, LongOpts::stats_file},
 
         //ONVIF Service options (context)
         {"port", required_argument, NULL, LongOpts::port},
         {"user", required_argument, NULL, LongOpts::user},
         {"password", required_argument, NULL, LongOpts::password},
+        {"users_file", required_argument, NULL, LongOpts::users_file},
+        {"tls_port", required_argument, NULL, LongOpts::tls_port},
+        {"tls_cert", required_argument, NULL, LongOpts::tls_cert},
+        {"ktls", no_argument, NULL, LongOpts::ktls},
         {"manufacturer", required_argument, NULL, LongOpts::manufacturer},
         {"model", required_argument, NULL, LongOpts::model},
         {"firmware_ver", required_argument, NULL, LongOpts::firmware_ver},
@@ -133,13 +220,24 @@ static const struct option long_opts[] =
         {"hardware_id", required_argument, NULL, LongOpts::hardware_id},
         {"scope", required_argument, NULL, LongOpts::scope},
         {"ifs", required_argument, NULL, LongOpts::ifs},
+        {"profiles_file", required_argument, NULL, LongOpts::profiles_file},
+        {"encoder_ctl", required_argument, NULL, LongOpts::encoder_ctl},
+        {"event_socket", required_argument, NULL, LongOpts::event_socket},
 
         //Media Profile for ONVIF Media Service
+        {"video_source", required_argument, NULL, LongOpts::video_source},
         {"name", required_argument, NULL, LongOpts::name},
         {"width", required_argument, NULL, LongOpts::width},
         {"height", required_argument, NULL, LongOpts::height},
         {"url", required_argument, NULL, LongOpts::url},
         {"snapurl", required_argument, NULL, LongOpts::snapurl},
+        {"snapshm", required_argument, NULL, LongOpts::snapshm},
+        {"snapraw", required_argument, NULL, LongOpts::snapraw},
+        {"source", required_argument, NULL, LongOpts::source},
+        {"resolutions", required_argument, NULL, LongOpts::resolutions},
+        {"fps_range", required_argument, NULL, LongOpts::fps_range},
+        {"gov_range", required_argument, NULL, LongOpts::gov_range},
+        {"bitrate_range", required_argument, NULL, LongOpts::bitrate_range},
         {"type", required_argument, NULL, LongOpts::type},
 
         //PTZ Profile for ONVIF PTZ Service
@@ -148,13 +246,32 @@ static const struct option long_opts[] =
         {"move_stop", required_argument, NULL, LongOpts::move_stop},
         {"goto_preset", required_argument, NULL, LongOpts::goto_preset},
         {"goto_home", required_argument, NULL, LongOpts::goto_home},
+        {"ptz_timeout", required_argument, NULL, LongOpts::ptz_timeout},
+        {"ptz_fail_limit", required_argument, NULL, LongOpts::ptz_fail_limit},
+        {"ptz_retry_time", required_argument, NULL, LongOpts::ptz_retry_time},
+
+        //Snapshot proxy
+        {"snapshot_proxy", no_argument, NULL, LongOpts::snapshot_proxy},
+        {"snapshot_ttl", required_argument, NULL, LongOpts::snapshot_ttl},
+        {"snapshot_workers", required_argument, NULL, LongOpts::snapshot_workers},
+        {"snapshot_timeout", required_argument, NULL, LongOpts::snapshot_timeout},
+        {"snapshot_quality", required_argument, NULL, LongOpts::snapshot_quality},
+        {"discovery", no_argument, NULL, LongOpts::discovery},
+        {"rate_read", required_argument, NULL, LongOpts::rate_read},
+        {"rate_ptz", required_argument, NULL, LongOpts::rate_ptz},
+        {"rate_expensive", required_argument, NULL, LongOpts::rate_expensive},
 
         {NULL, no_argument, NULL, 0}};
 
-#define FOREACH_SERVICE(APPLY, soap)  \
-    APPLY(DeviceBindingService, soap) \
-    APPLY(MediaBindingService, soap)  \
-    APPLY(PTZBindingService, soap)
+#define FOREACH_SERVICE(APPLY, soap)                 \
+    APPLY(DeviceBindingService, soap)                \
+    APPLY(MediaBindingService, soap)                 \
+    APPLY(Media2BindingService, soap)                \
+    APPLY(PTZBindingService, soap)                   \
+    APPLY(EventBindingService, soap)                 \
+    APPLY(PullPointSubscriptionBindingService, soap) \
+    APPLY(NotificationProducerBindingService, soap)  \
+    APPLY(SubscriptionManagerBindingService, soap)
 
 /*
  * If you need support for other services,
@@ -184,13 +301,25 @@ static const struct option long_opts[] =
     else if (service##_inst.dispatch() != SOAP_NO_METHOD) \
     {                                                     \
         soap_send_fault(soap);                            \
-        soap_stream_fault(soap, std::cerr);               \
+        if (soap->error != SOAP_STOP) /* SOAP_STOP: parked PullMessages */ \
+            soap_stream_fault(soap, std::cerr);           \
     }
 
 static struct soap *soap;
 
 ServiceContext service_ctx;
 
+static std::string stats_file;
+static volatile sig_atomic_t stats_requested = 0;
+
+// keep-alive: a client keeps its connection while it sends requests, between
+// the requests the connection waits in KeptConnections
+static const int KEEP_ALIVE_REQUESTS = 100; // then the connection is closed
+
+// the connections are numbered from 1 at accept (AuthSessions), 0 - no connection
+static uint64_t connection_id;
+static uint64_t connections_accepted;
+
 void daemon_exit_handler(int sig)
 {
     //Here we release resources
@@ -207,6 +336,33 @@ void daemon_exit_handler(int sig)
     exit(EXIT_SUCCESS); // good job (we interrupted (finished) main loop)
 }
 
+void daemon_stats_handler(int sig)
+{
+    UNUSED(sig);
+    stats_requested = 1; // dump is done from the main loop
+}
+
+void dump_stats(void)
+{
+    stats_requested = 0;
+
+    if (stats_file.empty())
+    {
+        service_ctx.dump_stats(stderr);
+        return;
+    }
+
+    FILE *fp = fopen(stats_file.c_str(), "w");
+    if (!fp)
+    {
+        DEBUG_MSG("Can't open stats file: %s\n", stats_file.c_str());
+        return;
+    }
+
+    service_ctx.dump_stats(fp);
+    fclose(fp);
+}
+
 void init_signals(void)
 {
     struct sigaction sa;
@@ -216,6 +372,10 @@ void init_signals(void)
     if (sigaction(SIGTERM, &sa, NULL) != 0)
         daemon_error_exit("Can't set daemon_exit_handler: %m\n");
 
+    sa.sa_handler = daemon_stats_handler;
+    if (sigaction(SIGUSR1, &sa, NULL) != 0)
+        daemon_error_exit("Can't set daemon_stats_handler: %m\n");
+
     signal(SIGCHLD, SIG_IGN); // ignore child
     signal(SIGTSTP, SIG_IGN); // ignore tty signals
     signal(SIGTTOU, SIG_IGN);
@@ -228,6 +388,7 @@ void processing_cmd(int argc, char *argv[])
     int opt;
 
     StreamProfile profile;
+    VideoSource video_source;
 
     while ((opt = getopt_long(argc, argv, short_opts, long_opts, NULL)) != -1)
     {
@@ -269,6 +430,10 @@ void processing_cmd(int argc, char *argv[])
             daemon_info.log_file = optarg;
             break;
 
+        case LongOpts::stats_file:
+            stats_file = optarg;
+            break;
+
         //ONVIF Service options (context)
         case LongOpts::port:
             service_ctx.port = atoi(optarg);
@@ -282,6 +447,39 @@ void processing_cmd(int argc, char *argv[])
             service_ctx.password = optarg;
             break;
 
+        case LongOpts::users_file:
+#ifdef WITH_OPENSSL
+            if (!service_ctx.get_user_store()->set_file(optarg))
+                daemon_error_exit("Can't set users file: %s\n", service_ctx.get_user_store()->get_cstr_err());
+#else
+            daemon_error_exit("Users file needs the build with WS-Security (make WSSE_ON=1)\n");
+#endif
+            break;
+
+        case LongOpts::tls_port:
+#ifdef WITH_OPENSSL
+            if (!service_ctx.get_tls_listener()->set_port(optarg))
+                daemon_error_exit("Can't set TLS port: %s\n", service_ctx.get_tls_listener()->get_cstr_err());
+#else
+            daemon_error_exit("HTTPS needs the build with OpenSSL (make WSSE_ON=1)\n");
+#endif
+            break;
+
+        case LongOpts::tls_cert:
+#ifdef WITH_OPENSSL
+            if (!service_ctx.get_tls_listener()->set_cert(optarg))
+                daemon_error_exit("Can't set TLS certificate: %s\n", service_ctx.get_tls_listener()->get_cstr_err());
+#else
+            daemon_error_exit("HTTPS needs the build with OpenSSL (make WSSE_ON=1)\n");
+#endif
+            break;
+
+        case LongOpts::ktls:
+#ifdef WITH_OPENSSL
+            service_ctx.get_tls_listener()->set_ktls(true);
+#endif
+            break;
+
         case LongOpts::manufacturer:
             service_ctx.manufacturer = optarg;
             break;
@@ -314,7 +512,34 @@ void processing_cmd(int argc, char *argv[])
 
             break;
 
+        case LongOpts::profiles_file:
+            if (!service_ctx.get_profile_store()->set_file(optarg))
+                daemon_error_exit("Can't set profiles file: %s\n", service_ctx.get_profile_store()->get_cstr_err());
+
+            break;
+
+        case LongOpts::encoder_ctl:
+            if (!service_ctx.get_encoder_control()->set_name(optarg))
+                daemon_error_exit("Can't set encoder control: %s\n", service_ctx.get_encoder_control()->get_cstr_err());
+
+            break;
+
+        case LongOpts::event_socket:
+            if (!service_ctx.get_event_ingest()->set_path(optarg))
+                daemon_error_exit("Can't set event socket: %s\n", service_ctx.get_event_ingest()->get_cstr_err());
+
+            break;
+
         //Media Profile for ONVIF Media Service
+        case LongOpts::video_source:
+            if (!video_source.set_spec(optarg))
+                daemon_error_exit("Can't set video source: %s\n", video_source.get_cstr_err());
+
+            if (!service_ctx.add_video_source(video_source))
+                daemon_error_exit("Can't add video source: %s\n", service_ctx.get_cstr_err());
+
+            break;
+
         case LongOpts::name:
             if (!profile.set_name(optarg))
                 daemon_error_exit("Can't set name for Profile: %s\n", profile.get_cstr_err());
@@ -345,6 +570,48 @@ void processing_cmd(int argc, char *argv[])
 
             break;
 
+        case LongOpts::snapshm:
+            if (!profile.set_snapshm(optarg))
+                daemon_error_exit("Can't set shm for Snapshot: %s\n", profile.get_cstr_err());
+
+            break;
+
+        case LongOpts::snapraw:
+            if (!profile.set_snapraw(optarg))
+                daemon_error_exit("Can't set raw frame for Snapshot: %s\n", profile.get_cstr_err());
+
+            break;
+
+        case LongOpts::source:
+            if (!profile.set_source(optarg))
+                daemon_error_exit("Can't set video source for Profile: %s\n", profile.get_cstr_err());
+
+            break;
+
+        case LongOpts::resolutions:
+            if (!profile.set_resolutions(optarg))
+                daemon_error_exit("Can't set resolutions for Profile: %s\n", profile.get_cstr_err());
+
+            break;
+
+        case LongOpts::fps_range:
+            if (!profile.set_fps_range(optarg))
+                daemon_error_exit("Can't set framerate range for Profile: %s\n", profile.get_cstr_err());
+
+            break;
+
+        case LongOpts::gov_range:
+            if (!profile.set_gov_range(optarg))
+                daemon_error_exit("Can't set GOV range for Profile: %s\n", profile.get_cstr_err());
+
+            break;
+
+        case LongOpts::bitrate_range:
+            if (!profile.set_bitrate_range(optarg))
+                daemon_error_exit("Can't set bitrate range for Profile: %s\n", profile.get_cstr_err());
+
+            break;
+
         case LongOpts::type:
             if (!profile.set_type(optarg))
                 daemon_error_exit("Can't set type for Profile: %s\n", profile.get_cstr_err());
@@ -383,6 +650,74 @@ void processing_cmd(int argc, char *argv[])
 
             break;
 
+        case LongOpts::ptz_timeout:
+            if (!service_ctx.get_ptz_backend()->set_timeout(optarg))
+                daemon_error_exit("Can't set PTZ backend timeout: %s\n", service_ctx.get_ptz_backend()->get_cstr_err());
+
+            break;
+
+        case LongOpts::ptz_fail_limit:
+            if (!service_ctx.get_ptz_backend()->set_fail_limit(optarg))
+                daemon_error_exit("Can't set PTZ backend fail limit: %s\n", service_ctx.get_ptz_backend()->get_cstr_err());
+
+            break;
+
+        case LongOpts::ptz_retry_time:
+            if (!service_ctx.get_ptz_backend()->set_retry_time(optarg))
+                daemon_error_exit("Can't set PTZ backend retry time: %s\n", service_ctx.get_ptz_backend()->get_cstr_err());
+
+            break;
+
+        //Snapshot proxy
+        case LongOpts::snapshot_proxy:
+            service_ctx.get_snapshot_proxy()->enable = true;
+            break;
+
+        case LongOpts::snapshot_ttl:
+            if (!service_ctx.get_snapshot_proxy()->set_ttl(optarg))
+                daemon_error_exit("Can't set snapshot TTL: %s\n", service_ctx.get_snapshot_proxy()->get_cstr_err());
+
+            break;
+
+        case LongOpts::snapshot_workers:
+            if (!service_ctx.get_snapshot_proxy()->set_workers(optarg))
+                daemon_error_exit("Can't set snapshot workers: %s\n", service_ctx.get_snapshot_proxy()->get_cstr_err());
+
+            break;
+
+        case LongOpts::snapshot_timeout:
+            if (!service_ctx.get_snapshot_proxy()->set_timeout(optarg))
+                daemon_error_exit("Can't set snapshot timeout: %s\n", service_ctx.get_snapshot_proxy()->get_cstr_err());
+
+            break;
+
+        case LongOpts::snapshot_quality:
+            if (!service_ctx.get_snapshot_proxy()->set_quality(optarg))
+                daemon_error_exit("Can't set snapshot quality: %s\n", service_ctx.get_snapshot_proxy()->get_cstr_err());
+
+            break;
+
+        //WS-Discovery
+        case LongOpts::discovery:
+            service_ctx.get_discovery()->enable = true;
+            break;
+
+        //Rate limit
+        case LongOpts::rate_read:
+            if (!service_ctx.get_rate_limiter()->set_rate(RateLimiter::READ, optarg))
+                daemon_error_exit("Can't set rate: %s\n", service_ctx.get_rate_limiter()->get_cstr_err());
+            break;
+
+        case LongOpts::rate_ptz:
+            if (!service_ctx.get_rate_limiter()->set_rate(RateLimiter::PTZ, optarg))
+                daemon_error_exit("Can't set rate: %s\n", service_ctx.get_rate_limiter()->get_cstr_err());
+            break;
+
+        case LongOpts::rate_expensive:
+            if (!service_ctx.get_rate_limiter()->set_rate(RateLimiter::EXPENSIVE, optarg))
+                daemon_error_exit("Can't set rate: %s\n", service_ctx.get_rate_limiter()->get_cstr_err());
+            break;
+
         default:
             puts("for more detail see help\n\n");
             exit_if_not_daemonized(EXIT_FAILURE);
@@ -394,6 +729,7 @@ void processing_cmd(int argc, char *argv[])
 void processing_conf_file()
 {
     StreamProfile profile;
+    VideoSource video_source;
 
     std::string line;
     std::string param;
@@ -470,6 +806,10 @@ void processing_conf_file()
         {
             daemon_info.log_file = (char *)malloc(value.size() + 1);
             strcpy(daemon_info.log_file, value.c_str());
+        }
+        else if (param == "stats_file")
+        {
+            stats_file = value;
 
             //ONVIF Service options (context)
         }
@@ -485,6 +825,39 @@ void processing_conf_file()
         {
             service_ctx.password = value;
         }
+        else if (param == "users_file")
+        {
+#ifdef WITH_OPENSSL
+            if (!service_ctx.get_user_store()->set_file(value.c_str()))
+                daemon_error_exit("Can't set users file: %s\n", service_ctx.get_user_store()->get_cstr_err());
+#else
+            daemon_error_exit("Users file needs the build with WS-Security (make WSSE_ON=1)\n");
+#endif
+        }
+        else if (param == "tls_port")
+        {
+#ifdef WITH_OPENSSL
+            if (!service_ctx.get_tls_listener()->set_port(value.c_str()))
+                daemon_error_exit("Can't set TLS port: %s\n", service_ctx.get_tls_listener()->get_cstr_err());
+#else
+            daemon_error_exit("HTTPS needs the build with OpenSSL (make WSSE_ON=1)\n");
+#endif
+        }
+        else if (param == "tls_cert")
+        {
+#ifdef WITH_OPENSSL
+            if (!service_ctx.get_tls_listener()->set_cert(value.c_str()))
+                daemon_error_exit("Can't set TLS certificate: %s\n", service_ctx.get_tls_listener()->get_cstr_err());
+#else
+            daemon_error_exit("HTTPS needs the build with OpenSSL (make WSSE_ON=1)\n");
+#endif
+        }
+        else if (param == "ktls")
+        {
+#ifdef WITH_OPENSSL
+            service_ctx.get_tls_listener()->set_ktls(true);
+#endif
+        }
         else if (param == "manufacturer")
         {
             service_ctx.manufacturer = value;
@@ -514,9 +887,32 @@ void processing_conf_file()
             service_ctx.eth_ifs.push_back(Eth_Dev_Param());
             if (service_ctx.eth_ifs.back().open(value.c_str()) != 0)
                 daemon_error_exit("Can't open ethernet interface: %s - %m\n", value.c_str());
+        }
+        else if (param == "profiles_file")
+        {
+            if (!service_ctx.get_profile_store()->set_file(value.c_str()))
+                daemon_error_exit("Can't set profiles file: %s\n", service_ctx.get_profile_store()->get_cstr_err());
+        }
+        else if (param == "encoder_ctl")
+        {
+            if (!service_ctx.get_encoder_control()->set_name(value.c_str()))
+                daemon_error_exit("Can't set encoder control: %s\n", service_ctx.get_encoder_control()->get_cstr_err());
+        }
+        else if (param == "event_socket")
+        {
+            if (!service_ctx.get_event_ingest()->set_path(value.c_str()))
+                daemon_error_exit("Can't set event socket: %s\n", service_ctx.get_event_ingest()->get_cstr_err());
 
             //Media Profile for ONVIF Media Service
         }
+        else if (param == "video_source")
+        {
+            if (!video_source.set_spec(value.c_str()))
+                daemon_error_exit("Can't set video source: %s\n", video_source.get_cstr_err());
+
+            if (!service_ctx.add_video_source(video_source))
+                daemon_error_exit("Can't add video source: %s\n", service_ctx.get_cstr_err());
+        }
         else if (param == "name")
         {
             if (!profile.set_name(value.c_str()))
@@ -542,6 +938,41 @@ void processing_conf_file()
             if (!profile.set_snapurl(value.c_str()))
                 daemon_error_exit("Can't set URL for Snapshot: %s\n", profile.get_cstr_err());
         }
+        else if (param == "snapshm")
+        {
+            if (!profile.set_snapshm(value.c_str()))
+                daemon_error_exit("Can't set shm for Snapshot: %s\n", profile.get_cstr_err());
+        }
+        else if (param == "snapraw")
+        {
+            if (!profile.set_snapraw(value.c_str()))
+                daemon_error_exit("Can't set raw frame for Snapshot: %s\n", profile.get_cstr_err());
+        }
+        else if (param == "source")
+        {
+            if (!profile.set_source(value.c_str()))
+                daemon_error_exit("Can't set video source for Profile: %s\n", profile.get_cstr_err());
+        }
+        else if (param == "resolutions")
+        {
+            if (!profile.set_resolutions(value.c_str()))
+                daemon_error_exit("Can't set resolutions for Profile: %s\n", profile.get_cstr_err());
+        }
+        else if (param == "fps_range")
+        {
+            if (!profile.set_fps_range(value.c_str()))
+                daemon_error_exit("Can't set framerate range for Profile: %s\n", profile.get_cstr_err());
+        }
+        else if (param == "gov_range")
+        {
+            if (!profile.set_gov_range(value.c_str()))
+                daemon_error_exit("Can't set GOV range for Profile: %s\n", profile.get_cstr_err());
+        }
+        else if (param == "bitrate_range")
+        {
+            if (!profile.set_bitrate_range(value.c_str()))
+                daemon_error_exit("Can't set bitrate range for Profile: %s\n", profile.get_cstr_err());
+        }
         else if (param == "type")
         {
             if (!profile.set_type(value.c_str()))
@@ -578,6 +1009,66 @@ void processing_conf_file()
             if (!service_ctx.get_ptz_node()->set_goto_home(value.c_str()))
                 daemon_error_exit("Can't set url for goto home movement: %s\n", service_ctx.get_ptz_node()->get_cstr_err());
         }
+        else if (param == "ptz_timeout")
+        {
+            if (!service_ctx.get_ptz_backend()->set_timeout(value.c_str()))
+                daemon_error_exit("Can't set PTZ backend timeout: %s\n", service_ctx.get_ptz_backend()->get_cstr_err());
+        }
+        else if (param == "ptz_fail_limit")
+        {
+            if (!service_ctx.get_ptz_backend()->set_fail_limit(value.c_str()))
+                daemon_error_exit("Can't set PTZ backend fail limit: %s\n", service_ctx.get_ptz_backend()->get_cstr_err());
+        }
+        else if (param == "ptz_retry_time")
+        {
+            if (!service_ctx.get_ptz_backend()->set_retry_time(value.c_str()))
+                daemon_error_exit("Can't set PTZ backend retry time: %s\n", service_ctx.get_ptz_backend()->get_cstr_err());
+
+            //Snapshot proxy
+        }
+        else if (param == "snapshot_proxy")
+        {
+            service_ctx.get_snapshot_proxy()->enable = true;
+        }
+        else if (param == "snapshot_ttl")
+        {
+            if (!service_ctx.get_snapshot_proxy()->set_ttl(value.c_str()))
+                daemon_error_exit("Can't set snapshot TTL: %s\n", service_ctx.get_snapshot_proxy()->get_cstr_err());
+        }
+        else if (param == "snapshot_workers")
+        {
+            if (!service_ctx.get_snapshot_proxy()->set_workers(value.c_str()))
+                daemon_error_exit("Can't set snapshot workers: %s\n", service_ctx.get_snapshot_proxy()->get_cstr_err());
+        }
+        else if (param == "snapshot_timeout")
+        {
+            if (!service_ctx.get_snapshot_proxy()->set_timeout(value.c_str()))
+                daemon_error_exit("Can't set snapshot timeout: %s\n", service_ctx.get_snapshot_proxy()->get_cstr_err());
+        }
+        else if (param == "snapshot_quality")
+        {
+            if (!service_ctx.get_snapshot_proxy()->set_quality(value.c_str()))
+                daemon_error_exit("Can't set snapshot quality: %s\n", service_ctx.get_snapshot_proxy()->get_cstr_err());
+        }
+        else if (param == "discovery")
+        {
+            service_ctx.get_discovery()->enable = true;
+        }
+        else if (param == "rate_read")
+        {
+            if (!service_ctx.get_rate_limiter()->set_rate(RateLimiter::READ, value.c_str()))
+                daemon_error_exit("Can't set rate: %s\n", service_ctx.get_rate_limiter()->get_cstr_err());
+        }
+        else if (param == "rate_ptz")
+        {
+            if (!service_ctx.get_rate_limiter()->set_rate(RateLimiter::PTZ, value.c_str()))
+                daemon_error_exit("Can't set rate: %s\n", service_ctx.get_rate_limiter()->get_cstr_err());
+        }
+        else if (param == "rate_expensive")
+        {
+            if (!service_ctx.get_rate_limiter()->set_rate(RateLimiter::EXPENSIVE, value.c_str()))
+                daemon_error_exit("Can't set rate: %s\n", service_ctx.get_rate_limiter()->get_cstr_err());
+        }
         else
         {
             daemon_error_exit("Unrecognized option: %s\n", line.c_str());
@@ -593,10 +1084,158 @@ void check_service_ctx(void)
     if (service_ctx.scopes.empty())
         daemon_error_exit("Error: not set scopes more details see opt --scope\n");
 
-    if (service_ctx.get_profiles().empty())
+    if (service_ctx.get_profiles()->empty())
         daemon_error_exit("Error: not set no one profile more details see --help\n");
 }
 
+// Value of the integer parameter of the URL query, 0 if it is not set
+static int get_query_int(const std::string &query, const char *name)
+{
+    std::string key = std::string("&") + name + "=";
+    size_t      pos = ("&" + query).find(key);
+
+    if (pos == std::string::npos)
+        return 0;
+
+    return atoi(query.c_str() + pos + key.size() - 1);
+}
+
+#ifdef WITH_OPENSSL
+static char http_authorization[1024]; // HTTP Digest credentials of the request
+static UserMapPtr request_users;      // users at the start of the request
+static const User *digest_user;       // authenticated by HTTP Digest
+static bool digest_stale;             // for the challenge of 401
+#endif
+
+// HTTP GET hook of gSOAP, serves /snapshot/<profile> (see SnapshotProxy)
+int http_get(struct soap *soap)
+{
+    static const char prefix[] = "/snapshot/";
+
+    SnapshotProxy *proxy = service_ctx.get_snapshot_proxy();
+
+    if (!proxy->enable || strncmp(soap->path, prefix, sizeof(prefix) - 1) != 0)
+        return SOAP_GET_METHOD;
+
+#ifdef WITH_OPENSSL
+    if (soap->ssl) // the proxy writes to the socket, GetSnapshotUri gives the URI of HTTP
+        return SOAP_GET_METHOD;
+
+    // a GET has no UsernameToken, the snapshots need HTTP Digest (see
+    // http_parse) when there are users, every level may read the media
+    if (!request_users->empty() && !digest_user)
+    {
+        soap->authrealm = HttpDigest::REALM;
+        return 401;
+    }
+#endif
+
+    std::string token(soap->path + sizeof(prefix) - 1);
+    std::string query;
+
+    size_t qpos = token.find('?');
+    if (qpos != std::string::npos)
+    {
+        query = token.substr(qpos + 1);
+        token.erase(qpos);
+    }
+
+    // the socket now belongs to the proxy, gSOAP must not close it
+    int fd = soap->socket;
+    soap->socket = SOAP_INVALID_SOCKET;
+
+    if (!service_ctx.get_rate_limiter()->allow(soap->ip, RateLimiter::EXPENSIVE))
+    {
+        SnapshotProxy::send_error(fd, 429);
+        return SOAP_OK;
+    }
+
+    auto profiles = service_ctx.get_profiles();
+    auto it = profiles->find(token);
+    char url[URI_TEMPLATE_MAX_LEN] = "";
+
+    if (it == profiles->end() || !it->second->has_snapshot() ||
+        service_ctx.get_snapshot_src_uri(*it->second, htonl(soap->ip), url, sizeof(url)) < 0)
+    {
+        SnapshotProxy::send_error(fd, 404);
+        return SOAP_OK;
+    }
+
+    proxy->enqueue(fd, it->second->get_cfg_token(), url, get_query_int(query, "width"), get_query_int(query, "height"));
+    return SOAP_OK;
+}
+
+#ifdef WITH_OPENSSL
+static int (*default_fparse)(struct soap *);
+static int (*default_fparsehdr)(struct soap *, const char *, const char *);
+static int (*default_fposthdr)(struct soap *, const char *, const char *);
+
+int http_parse_header(struct soap *soap, const char *key, const char *val)
+{
+    if (!soap_tag_cmp(key, "Authorization") && !strncasecmp(val, "Digest ", 7))
+    {
+        snprintf(http_authorization, sizeof(http_authorization), "%s", val + 7);
+        return SOAP_OK;
+    }
+
+    return default_fparsehdr(soap, key, val);
+}
+
+// HTTP headers of the request are parsed, HTTP Digest is checked here:
+// wrong credentials get 401 before the XML is read
+int http_parse(struct soap *soap)
+{
+    http_authorization[0] = '\0';
+    request_users = service_ctx.get_user_store()->get_users();
+    digest_user = NULL;
+    digest_stale = false;
+
+    int err = default_fparse(soap);
+    if (err || !http_authorization[0] || request_users->empty())
+        return err;
+
+    HttpDigest *digest = service_ctx.get_http_digest();
+    AuthSessions *sessions = service_ctx.get_auth_sessions();
+    const User *session_user = sessions->find(connection_id, soap->ip, AuthSessions::HTTP_DIGEST, request_users);
+
+    HttpDigest::Result res = digest->verify(http_authorization, (soap->status == SOAP_GET) ? "GET" : "POST",
+                                            soap->path, *request_users, session_user, digest_user);
+    if (res == HttpDigest::OK)
+    {
+        sessions->verified(connection_id, soap->ip, AuthSessions::HTTP_DIGEST, request_users, digest_user,
+                           session_user && (digest_user == session_user));
+        return SOAP_OK;
+    }
+
+    DEBUG_MSG("HTTP Digest: %s\n", HttpDigest::get_result_str(res));
+    digest_stale = (res == HttpDigest::STALE);
+    soap->authrealm = HttpDigest::REALM;
+    return 401;
+}
+
+// gSOAP sends "Basic realm" of soap->authrealm with 401, it is replaced by the
+// challenges of HTTP Digest (with the same nonce, SHA-256 is preferred)
+int http_post_header(struct soap *soap, const char *key, const char *val)
+{
+    if (!key || soap_tag_cmp(key, "WWW-Authenticate"))
+        return default_fposthdr(soap, key, val);
+
+    HttpDigest *digest = service_ctx.get_http_digest();
+    char nonce[HttpDigest::NONCE_LEN + 1];
+    char challenge[256];
+
+    digest->issue_nonce(nonce);
+
+    digest->get_challenge(challenge, sizeof(challenge), nonce, HttpDigest::SHA256, digest_stale);
+    int err = default_fposthdr(soap, key, challenge);
+    if (err)
+        return err;
+
+    digest->get_challenge(challenge, sizeof(challenge), nonce, HttpDigest::MD5, digest_stale);
+    return default_fposthdr(soap, key, challenge);
+}
+#endif
+
 void init_gsoap(void)
 {
     soap = soap_new();
@@ -604,6 +1243,14 @@ void init_gsoap(void)
     if (!soap)
         daemon_error_exit("Can't get mem for SOAP\n");
 
+    // responses are sent in chunks while they are serialized, without the pass
+    // that counts Content-Length (big GetProfiles would be serialized twice)
+    soap_set_omode(soap, SOAP_IO_CHUNK);
+
+    // a client that polls (GetStatus of a VMS) keeps its connection, see main()
+    soap_set_mode(soap, SOAP_IO_KEEPALIVE);
+    soap->max_keep_alive = KEEP_ALIVE_REQUESTS;
+
     soap->bind_flags = SO_REUSEADDR;
 
     if (!soap_valid_socket(soap_bind(soap, NULL, service_ctx.port, 10)))
@@ -612,20 +1259,303 @@ void init_gsoap(void)
         exit(EXIT_FAILURE);
     }
 
-    soap->send_timeout = 3; // timeout in sec
-    soap->recv_timeout = 3; // timeout in sec
+    soap->send_timeout = 3;   // timeout in sec
+    soap->recv_timeout = 3;   // timeout in sec
+    soap->accept_timeout = 1; // the main loop waits in poll(), see wait_clients()
 
     //save pointer of service_ctx in soap
     soap->user = (void *)&service_ctx;
+
+    soap->fget = http_get;
+
+#ifdef WITH_OPENSSL
+    default_fparse = soap->fparse;
+    default_fparsehdr = soap->fparsehdr;
+    default_fposthdr = soap->fposthdr;
+    soap->fparse = http_parse;
+    soap->fparsehdr = http_parse_header;
+    soap->fposthdr = http_post_header;
+
+    if (service_ctx.get_tls_listener()->enabled() && !service_ctx.get_tls_listener()->open(soap))
+        daemon_error_exit("Can't open HTTPS: %s\n", service_ctx.get_tls_listener()->get_cstr_err());
+#endif
+}
+
+// every subscription may hold a connection (its parked PullMessages or its
+// consumer of push), the soft limit of the descriptors (usually 1024) is
+// raised for them up to the hard one
+void init_fd_limit(void)
+{
+    const rlim_t needed = PullPointWaiters::MAX_WAITERS + EventBroker::MAX_SUBSCRIPTIONS +
+                          KeptConnections::MAX_CONNECTIONS + 64; // the listeners, files and fetches
+
+    struct rlimit rl;
+    if (getrlimit(RLIMIT_NOFILE, &rl) != 0 || rl.rlim_cur >= needed)
+        return;
+
+    rl.rlim_cur = (rl.rlim_max == RLIM_INFINITY || rl.rlim_max > needed) ? needed : rl.rlim_max;
+    setrlimit(RLIMIT_NOFILE, &rl); // else the clients over the limit wait in the backlog
 }
 
 void init(void *data)
 {
     UNUSED(data);
     init_signals();
+    init_fd_limit();
     check_service_ctx();
+
+    if (!service_ctx.load_users())
+        daemon_error_exit("Can't load users: %s\n", service_ctx.get_cstr_err());
+
+    if (!service_ctx.load_profiles())
+        daemon_error_exit("Can't load profiles: %s\n", service_ctx.get_cstr_err());
+
+    if (!service_ctx.open_encoder_control())
+        daemon_error_exit("Can't open encoder control: %s\n", service_ctx.get_cstr_err());
+
+    if (service_ctx.get_event_ingest()->enabled() && !service_ctx.get_event_ingest()->open())
+        daemon_error_exit("Can't open event socket: %s\n", service_ctx.get_event_ingest()->get_cstr_err());
+
+    if (service_ctx.get_discovery()->enable && !service_ctx.get_discovery()->open(service_ctx))
+        daemon_error_exit("Can't open discovery: %s\n", service_ctx.get_discovery()->get_cstr_err());
+
     init_gsoap();
     curl_global_init(CURL_GLOBAL_ALL);
+    service_ctx.get_snapshot_proxy()->start(); // threads must be created after fork
+    service_ctx.get_profile_store()->start();
+    service_ctx.get_notify_delivery()->start(service_ctx.get_event_broker());
+}
+
+// limit of the class of the request (PTZ, expensive, see RateLimiter), it is
+// checked before the WS-Security credentials and the body: the client over the
+// limit gets the fault which is serialized once and the connection is closed
+// (SOAP_STOP); the limit of all requests is checked by main before the request is read
+static int check_rate(void)
+{
+    RateLimiter *limiter = service_ctx.get_rate_limiter();
+    if (!limiter->enabled())
+        return SOAP_OK;
+
+    if (soap_peek_element(soap)) // the request element, the body is not parsed yet
+        return soap->error;
+
+    // the request was admitted before it was read (see main), only the bucket of the class is charged
+    RateLimiter::Class rate_class = RateLimiter::get_class(soap->tag);
+    if (rate_class == RateLimiter::READ || limiter->allow(soap->ip, rate_class))
+        return SOAP_OK;
+
+    const std::string &fault = limiter->get_fault();
+    soap->fsend(soap, fault.data(), fault.size()); // through TLS for HTTPS
+    soap->keep_alive = 0;
+
+    return soap->error = SOAP_STOP;
+}
+
+// credentials of the request (HTTP Digest or WS-Security UsernameToken), the
+// operations of PRE_AUTH are served without them, returns SOAP_OK or the fault
+// for the client
+static int check_access(void)
+{
+#ifdef WITH_OPENSSL
+    if (!request_users) // the request was not HTTP
+        request_users = service_ctx.get_user_store()->get_users();
+
+    if (request_users->empty())
+        return SOAP_OK; // authentication is off
+
+    if (soap_peek_element(soap)) // the request element, the body is not parsed yet
+        return soap->error;
+
+    AccessClass access = get_access_class(soap->tag);
+    if (access == ACCESS_PRE_AUTH)
+        return SOAP_OK;
+
+    const User *user = digest_user;
+
+    if (!user)
+    {
+        const _wsse__UsernameToken *token = NULL;
+        if (soap->header && soap->header->wsse__Security)
+            token = soap->header->wsse__Security->UsernameToken;
+
+        if (!token) // no credentials, the client gets the challenge of HTTP Digest
+        {
+            soap->authrealm = HttpDigest::REALM;
+            return soap->error = 401; // not a hook of gSOAP, soap_send_fault() sends soap->error
+        }
+
+        AuthSessions *sessions = service_ctx.get_auth_sessions();
+        const User *session_user = sessions->find(connection_id, soap->ip, AuthSessions::WSSE, request_users);
+
+        WsseAuth::Result res = service_ctx.get_wsse_auth()->verify(
+            token->Username,
+            token->Password ? token->Password->Type : NULL,
+            token->Password ? token->Password->__item : NULL,
+            token->Nonce ? token->Nonce->__item : NULL,
+            token->wsu__Created,
+            *request_users, session_user, user);
+
+        if (res != WsseAuth::OK)
+        {
+            DEBUG_MSG("%s (%s): %s\n", soap->tag, get_access_class_name(access), WsseAuth::get_result_str(res));
+            return soap_sender_fault_subcode(soap, "ter:NotAuthorized", "Sender not Authorized",
+                                             WsseAuth::get_result_str(res));
+        }
+
+        sessions->verified(connection_id, soap->ip, AuthSessions::WSSE, request_users, user,
+                           session_user && (user == session_user));
+    }
+
+    if (!is_allowed(user->level, access))
+    {
+        DEBUG_MSG("%s (%s): not allowed for %s\n", soap->tag, get_access_class_name(access), user->name.c_str());
+        return soap_sender_fault_subcode(soap, "ter:NotAuthorized", "Sender not Authorized",
+                                         "the level of the user does not allow the operation");
+    }
+#endif
+
+    return SOAP_OK; // without WITH_OPENSSL the build has no authentication (see WSSE_ON in Makefile)
+}
+
+// the session of the connection ends with it
+static void end_session(uint64_t id)
+{
+#ifdef WITH_OPENSSL
+    service_ctx.get_auth_sessions()->close(id);
+#else
+    UNUSED(id);
+#endif
+}
+
+// the connection of soap is closed by the client, by an error or by the limits of keep-alive
+static void close_connection(void)
+{
+    // fclose of gSOAP (tcp_disconnect) shuts down and frees the TLS of HTTPS too
+    soap->keep_alive = 0;
+    soap_closesock(soap);
+
+#ifdef WITH_OPENSSL
+    if (soap->ssl) // the socket was taken (snapshot, parked PullMessages) before the TLS
+    {
+        SSL_free(soap->ssl);
+        soap->ssl = NULL;
+        soap->bio = NULL;
+    }
+#endif
+
+    end_session(connection_id);
+    connection_id = 0;
+}
+
+// the client is over its limit of requests, it gets the fault before its
+// request is read and the connection is closed
+static void reject_request(void)
+{
+    const std::string &fault = service_ctx.get_rate_limiter()->get_fault();
+    soap->fsend(soap, fault.data(), fault.size()); // through TLS for HTTPS
+
+    // the request which has come is dropped, else the close resets the
+    // connection and the client may lose the response (a few reads at most)
+    char buf[1024];
+    for (int i = 0; i < 8 && recv(soap->socket, buf, sizeof(buf), MSG_DONTWAIT) > 0; i++)
+        ;
+
+    close_connection();
+}
+
+// a pipelined request already read by gSOAP (or by the TLS) does not wake poll(),
+// such a connection is closed instead of being kept
+static bool has_buffered_input(void)
+{
+#ifdef WITH_OPENSSL
+    if (soap->ssl && SSL_pending(soap->ssl) > 0)
+        return true;
+#endif
+
+    return soap->bufidx < soap->buflen;
+}
+
+enum Client
+{
+    CLIENT_NONE,    // wakeup of the housekeeping
+    CLIENT_KEPT,    // request on a kept-alive connection
+    CLIENT_NEW,
+    CLIENT_NEW_TLS
+};
+
+// wait for a client, the local events are published, the parked PullMessages
+// are answered when events arrive or time out and the WS-Discovery requests
+// are served here; kept is the index of the kept connection (CLIENT_KEPT)
+static Client wait_clients(size_t &kept)
+{
+    EventBroker *broker = service_ctx.get_event_broker();
+    PullPointWaiters *waiters = service_ctx.get_pullpoint_waiters();
+    EventIngest *ingest = service_ctx.get_event_ingest();
+    DiscoveryResponder *discovery = service_ctx.get_discovery();
+
+    // the clients: the listeners and the kept connections (from fds[4])
+    static const size_t CLIENTS = 2 + KeptConnections::MAX_CONNECTIONS;
+    static size_t next_client; // the ready clients are taken in turn
+
+    struct pollfd fds[4 + CLIENTS];
+    fds[0].fd = broker->get_pull_notifier()->get_fd();
+    fds[0].events = POLLIN;
+    fds[1].fd = ingest->get_fd(); // -1 (ignored by poll) if disabled
+    fds[1].events = POLLIN;
+    fds[2].fd = discovery->get_fd(); // -1 if disabled
+    fds[2].events = POLLIN;
+    fds[3].fd = discovery->get_netlink_fd();
+    fds[3].events = POLLIN;
+    fds[4].fd = soap->master;
+    fds[4].events = POLLIN;
+#ifdef WITH_OPENSSL
+    fds[5].fd = service_ctx.get_tls_listener()->get_fd(); // -1 if disabled
+#else
+    fds[5].fd = -1;
+#endif
+    fds[5].events = POLLIN;
+    service_ctx.get_kept_connections()->get_pollfds(&fds[6]);
+
+    int timeout = discovery->get_timeout_ms(waiters->get_timeout_ms(broker->get_timeout_ms(1000)));
+    int res = poll(fds, COUNT_ELEMENTS(fds), timeout);
+
+    discovery->process(res > 0 && (fds[2].revents & POLLIN), res > 0 && (fds[3].revents & POLLIN));
+
+    if (res > 0 && (fds[1].revents & POLLIN))
+        ingest->process(*broker);
+
+    broker->expire();
+
+    bool signaled = res > 0 && (fds[0].revents & POLLIN);
+    if (signaled)
+        broker->get_pull_notifier()->clear();
+
+    waiters->process(signaled);
+
+    if (res <= 0)
+        return CLIENT_NONE;
+
+    // one request per call, the next ready client is served by the next call
+    // (poll reports it again), so a busy VMS does not hold up the others
+    for (size_t n = 0; n < CLIENTS; n++)
+    {
+        size_t i = (next_client + n) % CLIENTS;
+        if (!(fds[4 + i].revents & (POLLIN | POLLHUP | POLLERR)))
+            continue;
+
+        next_client = i + 1;
+
+        if (i == 0)
+            return CLIENT_NEW;
+
+        if (i == 1)
+            return CLIENT_NEW_TLS;
+
+        kept = i - 2;
+        return CLIENT_KEPT;
+    }
+
+    return CLIENT_NONE;
 }
 
 int main(int argc, char *argv[])
@@ -639,17 +1569,79 @@ int main(int argc, char *argv[])
 
     while (true)
     {
-        // wait new client
-        if (!soap_valid_socket(soap_accept(soap)))
+        if (stats_requested)
+            dump_stats();
+
+        service_ctx.get_kept_connections()->expire(end_session);
+
+        size_t kept_idx = 0;
+        Client client = wait_clients(kept_idx);
+        if (client == CLIENT_NONE)
+            continue;
+
+        bool kept = (client == CLIENT_KEPT);
+
+        if (kept)
+        {
+            connection_id = service_ctx.get_kept_connections()->resume(soap, kept_idx);
+        }
+        else if (client == CLIENT_NEW)
+        {
+            // accept new client
+            if (!soap_valid_socket(soap_accept(soap)))
+            {
+                if (!soap->errnum || soap->errnum == EMFILE || soap->errnum == ENFILE)
+                    continue; // accept timeout or no descriptors (the client waits in the backlog)
+
+                soap_stream_fault(soap, std::cerr);
+                return EXIT_FAILURE;
+            }
+
+            connection_id = ++connections_accepted;
+        }
+#ifdef WITH_OPENSSL
+        else if (client == CLIENT_NEW_TLS)
         {
-            soap_stream_fault(soap, std::cerr);
-            return EXIT_FAILURE;
+            TlsListener *tls = service_ctx.get_tls_listener();
+
+            // a failed client is dropped (see the stats), a client over the
+            // limit of requests is dropped before the handshake
+            if (!tls->accept(soap) || !service_ctx.get_rate_limiter()->admit(soap->ip) || !tls->handshake(soap))
+            {
+                close_connection();
+                continue;
+            }
+
+            connection_id = ++connections_accepted;
+        }
+#endif
+        else
+        {
+            continue;
+        }
+
+        // every request takes a token of its client before it is read (the
+        // HTTP header is not parsed, the digest is not checked), the buckets
+        // of the classes are charged by check_rate()
+        if (client != CLIENT_NEW_TLS && !service_ctx.get_rate_limiter()->admit(soap->ip))
+        {
+            reject_request();
+            continue;
         }
 
         // process service
         if (soap_begin_serve(soap))
         {
-            soap_stream_fault(soap, std::cerr);
+            if (soap->error == 401) // wrong HTTP Digest (see http_parse), the body is not read
+                soap_send_fault(soap);
+            else if (soap->error != SOAP_STOP && !(kept && soap->error == SOAP_EOF))
+                soap_stream_fault(soap, std::cerr); // SOAP_STOP: served by the HTTP GET hook,
+                                                    // SOAP_EOF: the kept connection is closed
+        }
+        else if (check_rate() || check_access())
+        {
+            if (soap->error != SOAP_STOP) // SOAP_STOP: the fault of the rate limit is sent
+                soap_send_fault(soap);
         }
         FOREACH_SERVICE(DISPATCH_SERVICE, soap)
         else
@@ -657,6 +1649,18 @@ int main(int argc, char *argv[])
             DEBUG_MSG("Unknown service\n");
         }
 
+        // the connection waits for the next request if the client keeps it,
+        // the longest idle one is closed when all places are taken
+        if (soap->error || !soap->keep_alive || has_buffered_input())
+        {
+            close_connection();
+        }
+        else
+        {
+            end_session(service_ctx.get_kept_connections()->park(soap, connection_id));
+            connection_id = 0;
+        }
+
         soap_destroy(soap); // delete managed C++ objects
         soap_end(soap);     // delete managed memory
     }
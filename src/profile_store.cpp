@@ -0,0 +1,201 @@
+#include <errno.h>
+#include <stdio.h>
+#include <unistd.h>
+
+#include <fstream>
+#include <thread>
+
+#include "profile_store.h"
+#include "smacros.h"
+
+
+
+
+
+bool ProfileStore::set_file(const char *new_val)
+{
+    if( !new_val || !new_val[0] )
+    {
+        str_err = "file name is empty";
+        return false;
+    }
+
+
+    file = new_val;
+    return true;
+}
+
+
+
+void ProfileStore::start()
+{
+    std::lock_guard<std::mutex> lock(mtx);
+
+    if( started || file.empty() )
+        return;
+
+
+    started = true;
+    std::thread(&ProfileStore::run, this).detach();
+}
+
+
+
+bool ProfileStore::load(std::vector<ProfileRecord> &records)
+{
+    records.clear();
+
+    std::ifstream in(file.c_str());
+    if( !in.is_open() )
+    {
+        if( errno == ENOENT )
+            return true; // nothing was created yet
+
+        str_err = "can't open profiles file: " + file;
+        return false;
+    }
+
+
+    std::string line;
+    int         line_num = 0;
+
+    while( std::getline(in, line) )
+    {
+        line_num++;
+
+        if( line.empty() || (line[0] == '#') )
+            continue;
+
+
+        size_t eq = line.find('=');
+        if( eq == std::string::npos )
+        {
+            str_err = file + ":" + std::to_string(line_num) + ": wrong line";
+            return false;
+        }
+
+
+        std::string key   = line.substr(0, eq);
+        std::string value = line.substr(eq + 1);
+
+        if( key == "profile" )
+        {
+            records.push_back(ProfileRecord());
+            records.back().token = value;
+            continue;
+        }
+
+
+        if( records.empty() )
+        {
+            str_err = file + ":" + std::to_string(line_num) + ": parameter out of profile";
+            return false;
+        }
+
+
+        ProfileRecord &rec = records.back();
+
+        if( key == "name" )
+            rec.title = value;
+        else if( key == "video_source" )
+        {
+            rec.cfg_token = value;
+            rec.video_src = true;
+        }
+        else if( key == "video_encoder" )
+        {
+            rec.cfg_token = value;
+            rec.video_enc = true;
+        }
+        else if( key == "ptz" )
+            rec.ptz = (value == "1");
+        else
+        {
+            str_err = file + ":" + std::to_string(line_num) + ": unknown parameter " + key;
+            return false;
+        }
+    }
+
+
+    return true;
+}
+
+
+
+void ProfileStore::save(std::vector<ProfileRecord> &&records)
+{
+    {
+        std::lock_guard<std::mutex> lock(mtx);
+
+        next    = std::move(records);
+        pending = true;
+    }
+
+    cond.notify_one();
+}
+
+
+
+void ProfileStore::run()
+{
+    std::vector<ProfileRecord> records;
+
+    while( true )
+    {
+        {
+            std::unique_lock<std::mutex> lock(mtx);
+            cond.wait(lock, [this] { return pending; });
+
+            records.swap(next);
+            pending = false;
+        }
+
+
+        if( !write(records) )
+            DEBUG_MSG("Can't write profiles file: %s\n", file.c_str());
+    }
+}
+
+
+
+bool ProfileStore::write(const std::vector<ProfileRecord> &records) const
+{
+    std::string tmp_file = file + ".tmp";
+
+    FILE *fp = fopen(tmp_file.c_str(), "w");
+    if( !fp )
+        return false;
+
+
+    fprintf(fp, "# profiles created by ONVIF clients, written by onvif_srvd\n");
+
+    for(size_t i = 0; i < records.size(); ++i)
+    {
+        const ProfileRecord &rec = records[i];
+
+        fprintf(fp, "\nprofile=%s\n", rec.token.c_str());
+        fprintf(fp, "name=%s\n", rec.title.c_str());
+
+        if( rec.video_src )
+            fprintf(fp, "video_source=%s\n", rec.cfg_token.c_str());
+
+        if( rec.video_enc )
+            fprintf(fp, "video_encoder=%s\n", rec.cfg_token.c_str());
+
+        if( rec.ptz )
+            fprintf(fp, "ptz=1\n");
+    }
+
+
+    bool ok = (fflush(fp) == 0) && (fsync(fileno(fp)) == 0);
+    ok = (fclose(fp) == 0) && ok;
+
+    if( !ok || (rename(tmp_file.c_str(), file.c_str()) != 0) )
+    {
+        unlink(tmp_file.c_str());
+        return false;
+    }
+
+
+    return true;
+}
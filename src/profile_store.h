@@ -0,0 +1,75 @@
+#ifndef PROFILE_STORE_H
+#define PROFILE_STORE_H
+
+#include <string>
+#include <vector>
+#include <mutex>
+#include <condition_variable>
+
+
+
+
+
+// profile created by the client (CreateProfile), as it is kept on disk
+struct ProfileRecord
+{
+    ProfileRecord() : video_src(false), video_enc(false), ptz(false) {}
+
+    std::string token;
+    std::string title;     // Name of the profile
+    std::string cfg_token; // token of the video source/encoder configuration
+    bool        video_src;
+    bool        video_enc;
+    bool        ptz;
+};
+
+
+
+/*
+ * File with the profiles created by the clients.
+ *
+ * save() only hands the new list to the writer thread and returns, so the
+ * SOAP request does not wait for the disk. Several saves in a row are merged,
+ * the writer always writes the latest list (tmp file + rename).
+ */
+class ProfileStore
+{
+public:
+    ProfileStore() : started(false), pending(false) {}
+
+    bool enabled(void) const { return !file.empty(); }
+
+    // start the writer (after daemonize), it lives until the process exits
+    void start(void);
+
+    // read the file, missing file is not an error
+    bool load(std::vector<ProfileRecord> &records);
+
+    void save(std::vector<ProfileRecord> &&records);
+
+    //methods for parsing opt from cmd
+    bool set_file(const char *new_val);
+
+    std::string get_str_err() const { return str_err; }
+    const char *get_cstr_err() const { return str_err.c_str(); }
+
+private:
+    std::string file;
+
+    std::mutex                 mtx;
+    std::condition_variable    cond;
+    bool                       started;
+    bool                       pending;
+    std::vector<ProfileRecord> next;
+
+    std::string str_err;
+
+    void run(void);
+    bool write(const std::vector<ProfileRecord> &records) const;
+};
+
+
+
+
+
+#endif // PROFILE_STORE_H
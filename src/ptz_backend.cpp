@@ -0,0 +1,402 @@
+#include <time.h>
+#include <sstream>
+
+#include <curl/curl.h>
+
+#include "ptz_backend.h"
+#include "smacros.h"
+
+
+
+
+
+static uint64_t monotonic_usec(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return (uint64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+
+
+// ------------------------------- LatencyHistogram -------------------------------
+
+
+
+const uint32_t LatencyHistogram::bounds_ms[LatencyHistogram::BUCKETS - 1] =
+{
+    1, 2, 5, 10, 20, 50, 100, 200, 500, 1000, 2000, 5000
+};
+
+
+
+void LatencyHistogram::add(uint64_t usec)
+{
+    int i = 0;
+
+    while( (i < BUCKETS - 1) && (usec > (uint64_t)bounds_ms[i] * 1000) )
+        ++i;
+
+
+    buckets[i]++;
+    count++;
+    sum_usec += usec;
+
+    if( usec > max_usec )
+        max_usec = usec;
+}
+
+
+
+void LatencyHistogram::clear()
+{
+    for(int i = 0; i < BUCKETS; ++i)
+        buckets[i] = 0;
+
+    count    = 0;
+    sum_usec = 0;
+    max_usec = 0;
+}
+
+
+
+uint32_t LatencyHistogram::get_percentile_ms(int percent) const
+{
+    if( !count )
+        return 0;
+
+
+    uint64_t rank = (count * percent + 99) / 100;
+    uint64_t acc  = 0;
+
+    for(int i = 0; i < BUCKETS - 1; ++i)
+    {
+        acc += buckets[i];
+        if( acc >= rank )
+            return bounds_ms[i];
+    }
+
+
+    return (uint32_t)(max_usec / 1000); // +inf bucket, best we know is max
+}
+
+
+
+// ------------------------------- CircuitBreaker -------------------------------
+
+
+
+bool CircuitBreaker::allow_request(uint64_t now_ms)
+{
+    switch( state )
+    {
+        case CLOSED:
+            return true;
+
+        case OPEN:
+            if( now_ms - opened_at < retry_time )
+                return false;
+
+            state      = HALF_OPEN;
+            probe_sent = false;
+            // fall through
+
+        case HALF_OPEN:
+            if( probe_sent )
+                return false; // only one probe at a time
+
+            probe_sent = true;
+            return true;
+    }
+
+
+    return true;
+}
+
+
+
+void CircuitBreaker::on_success()
+{
+    state = CLOSED;
+    fails = 0;
+}
+
+
+
+void CircuitBreaker::on_failure(uint64_t now_ms)
+{
+    fails++;
+
+    if( (state == HALF_OPEN) || (fails >= fail_limit) )
+    {
+        if( state != OPEN )
+            trips++;
+
+        state     = OPEN;
+        opened_at = now_ms;
+    }
+}
+
+
+
+const char *CircuitBreaker::get_state_str() const
+{
+    switch( state )
+    {
+        case CLOSED:    return "closed";
+        case OPEN:      return "open";
+        case HALF_OPEN: return "half-open";
+    }
+
+    return "unknown";
+}
+
+
+
+void CircuitBreaker::clear()
+{
+    state      = CLOSED;
+    fails      = 0;
+    fail_limit = 3;
+    retry_time = 5000;
+    opened_at  = 0;
+    probe_sent = false;
+    trips      = 0;
+}
+
+
+
+// ------------------------------- PTZBackend -------------------------------
+
+
+
+static size_t discard_data(void *ptr, size_t size, size_t nmemb, void *userdata)
+{
+    UNUSED(ptr);
+    UNUSED(userdata);
+
+    return size * nmemb;
+}
+
+
+
+PTZBackend::Result PTZBackend::do_http_get(const char *url) const
+{
+    CURL *curl = curl_easy_init();
+
+    if( !curl )
+        return RES_ERROR;
+
+
+    curl_easy_setopt(curl, CURLOPT_URL, url);
+    curl_easy_setopt(curl, CURLOPT_NOPROGRESS, 1L);
+    curl_easy_setopt(curl, CURLOPT_NOSIGNAL, 1L);
+    curl_easy_setopt(curl, CURLOPT_MAXREDIRS, 50L);
+    curl_easy_setopt(curl, CURLOPT_TCP_KEEPALIVE, 1L);
+    curl_easy_setopt(curl, CURLOPT_CONNECTTIMEOUT_MS, (long)timeout);
+    curl_easy_setopt(curl, CURLOPT_TIMEOUT_MS, (long)timeout);
+    curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, discard_data);
+
+
+    Result   res      = RES_OK;
+    CURLcode curl_res = curl_easy_perform(curl);
+
+    if( curl_res == CURLE_OPERATION_TIMEDOUT )
+    {
+        res = RES_TIMEOUT;
+    }
+    else if( curl_res != CURLE_OK )
+    {
+        res = RES_ERROR;
+    }
+    else
+    {
+        long http_code = 0;
+        curl_easy_getinfo(curl, CURLINFO_RESPONSE_CODE, &http_code);
+
+        if( http_code >= 400 )
+            res = RES_ERROR;
+    }
+
+
+    curl_easy_cleanup(curl);
+
+    return res;
+}
+
+
+
+PTZBackend::Result PTZBackend::request(Command cmd, const char *url)
+{
+    CommandStats &st = stats[cmd];
+
+    uint64_t start = monotonic_usec();
+
+    if( !breaker.allow_request(start / 1000) )
+    {
+        st.rejected++;
+        return RES_REJECTED;
+    }
+
+
+    Result   res = do_http_get(url);
+    uint64_t end = monotonic_usec();
+
+    st.latency.add(end - start);
+
+
+    switch( res )
+    {
+        case RES_OK:
+            st.ok++;
+            breaker.on_success();
+            break;
+
+        case RES_TIMEOUT:
+            st.timeouts++;
+            breaker.on_failure(end / 1000);
+            break;
+
+        default:
+            st.errors++;
+            breaker.on_failure(end / 1000);
+            break;
+    }
+
+
+    DEBUG_MSG("PTZ backend: %s %s -> %d (%llu us)\n", get_command_str(cmd), url, res,
+              (unsigned long long)(end - start));
+
+    return res;
+}
+
+
+
+const char *PTZBackend::get_command_str(Command cmd)
+{
+    switch( cmd )
+    {
+        case MOVE_CONTINUOUS: return "move_continuous";
+        case MOVE_STOP:       return "move_stop";
+        case GOTO_PRESET:     return "goto_preset";
+        case GOTO_HOME:       return "goto_home";
+        default:              break;
+    }
+
+    return "unknown";
+}
+
+
+
+void PTZBackend::dump_stats(FILE *fp) const
+{
+    fprintf(fp, "PTZ backend: breaker %s, trips %llu\n", breaker.get_state_str(),
+            (unsigned long long)breaker.get_trips());
+
+    for(int i = 0; i < COMMAND_COUNT; ++i)
+    {
+        const CommandStats &st = stats[i];
+
+        fprintf(fp, "  %-16s ok %llu  err %llu  timeout %llu  rejected %llu  "
+                    "avg %llu us  max %llu us  p50 %u ms  p99 %u ms\n",
+                get_command_str((Command)i),
+                (unsigned long long)st.ok,
+                (unsigned long long)st.errors,
+                (unsigned long long)st.timeouts,
+                (unsigned long long)st.rejected,
+                (unsigned long long)st.latency.get_avg_usec(),
+                (unsigned long long)st.latency.get_max_usec(),
+                st.latency.get_percentile_ms(50),
+                st.latency.get_percentile_ms(99));
+
+        if( !st.latency.get_count() )
+            continue;
+
+        fprintf(fp, "  %-16s", "");
+        for(int b = 0; b < LatencyHistogram::BUCKETS; ++b)
+        {
+            if( b < LatencyHistogram::BUCKETS - 1 )
+                fprintf(fp, " <=%ums:%llu", LatencyHistogram::bounds_ms[b],
+                        (unsigned long long)st.latency.get_bucket(b));
+            else
+                fprintf(fp, " inf:%llu", (unsigned long long)st.latency.get_bucket(b));
+        }
+        fprintf(fp, "\n");
+    }
+}
+
+
+
+bool PTZBackend::set_uint_value(const char *new_val, unsigned int min, unsigned int max,
+                                unsigned int &value, const char *name)
+{
+    std::istringstream ss(new_val ? new_val : "");
+    long tmp_val = -1;
+    ss >> tmp_val;
+
+
+    if( ss.fail() || (tmp_val < (long)min) || (tmp_val > (long)max) )
+    {
+        std::ostringstream os;
+        os << name << " is bad, correct range: " << min << "-" << max;
+        str_err = os.str();
+        return false;
+    }
+
+
+    value = (unsigned int)tmp_val;
+    return true;
+}
+
+
+
+bool PTZBackend::set_timeout(const char *new_val)
+{
+    return set_uint_value(new_val, 10, 60000, timeout, "timeout");
+}
+
+
+
+bool PTZBackend::set_fail_limit(const char *new_val)
+{
+    if( !set_uint_value(new_val, 1, 1000, fail_limit, "fail limit") )
+        return false;
+
+    breaker.set_fail_limit(fail_limit);
+    return true;
+}
+
+
+
+bool PTZBackend::set_retry_time(const char *new_val)
+{
+    if( !set_uint_value(new_val, 10, 600000, retry_time, "retry time") )
+        return false;
+
+    breaker.set_retry_time(retry_time);
+    return true;
+}
+
+
+
+void PTZBackend::clear()
+{
+    for(int i = 0; i < COMMAND_COUNT; ++i)
+    {
+        stats[i].latency.clear();
+        stats[i].ok       = 0;
+        stats[i].errors   = 0;
+        stats[i].timeouts = 0;
+        stats[i].rejected = 0;
+    }
+
+    timeout    = 1000;
+    fail_limit = 3;
+    retry_time = 5000;
+
+    breaker.clear();
+    breaker.set_fail_limit(fail_limit);
+    breaker.set_retry_time(retry_time);
+}
@@ -0,0 +1,155 @@
+#ifndef PTZ_BACKEND_H
+#define PTZ_BACKEND_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include <string>
+
+
+
+
+
+// Latency histogram with fixed bucket bounds (in ms), the last bucket is +inf
+class LatencyHistogram
+{
+public:
+    LatencyHistogram() { clear(); }
+
+    static const int BUCKETS = 13;
+    static const uint32_t bounds_ms[BUCKETS - 1];
+
+    void add(uint64_t usec);
+    void clear(void);
+
+    uint64_t get_count(void) const { return count; }
+    uint64_t get_bucket(int i) const { return buckets[i]; }
+    uint64_t get_max_usec(void) const { return max_usec; }
+    uint64_t get_avg_usec(void) const { return count ? sum_usec / count : 0; }
+
+    // approximate percentile (0..100), returns upper bound of the bucket in ms
+    uint32_t get_percentile_ms(int percent) const;
+
+private:
+    uint64_t buckets[BUCKETS];
+    uint64_t count;
+    uint64_t sum_usec;
+    uint64_t max_usec;
+};
+
+
+
+/*
+ * Circuit breaker for the PTZ backend (motor controller).
+ *
+ * CLOSED    - requests go to the backend, failures are counted.
+ * OPEN      - after fail_limit consecutive failures, requests are rejected
+ *             without touching the backend for retry_time ms.
+ * HALF_OPEN - after retry_time one probe request is let through,
+ *             success closes the breaker, failure opens it again.
+ */
+class CircuitBreaker
+{
+public:
+    CircuitBreaker() { clear(); }
+
+    enum State
+    {
+        CLOSED,
+        OPEN,
+        HALF_OPEN
+    };
+
+    bool allow_request(uint64_t now_ms);
+    void on_success(void);
+    void on_failure(uint64_t now_ms);
+
+    State get_state(void) const { return state; }
+    const char *get_state_str(void) const;
+    uint64_t get_trips(void) const { return trips; }
+
+    void set_fail_limit(unsigned int limit) { fail_limit = limit; }
+    void set_retry_time(unsigned int ms) { retry_time = ms; }
+
+    void clear(void);
+
+private:
+    State        state;
+    unsigned int fails;
+    unsigned int fail_limit;
+    unsigned int retry_time; // ms
+    uint64_t     opened_at;  // ms
+    bool         probe_sent;
+    uint64_t     trips;
+};
+
+
+
+class PTZBackend
+{
+public:
+    PTZBackend() { clear(); }
+
+    enum Command
+    {
+        MOVE_CONTINUOUS,
+        MOVE_STOP,
+        GOTO_PRESET,
+        GOTO_HOME,
+
+        COMMAND_COUNT
+    };
+
+    enum Result
+    {
+        RES_OK,
+        RES_ERROR,    // backend returned an error (curl or HTTP status)
+        RES_TIMEOUT,  // backend did not answer in time
+        RES_REJECTED  // circuit breaker is open, backend was not called
+    };
+
+    // Send the command to the backend (HTTP GET) and account the result
+    Result request(Command cmd, const char *url);
+
+    static const char *get_command_str(Command cmd);
+
+    void dump_stats(FILE *fp) const;
+
+    //methods for parsing opt from cmd
+    bool set_timeout(const char *new_val);
+    bool set_fail_limit(const char *new_val);
+    bool set_retry_time(const char *new_val);
+
+    std::string get_str_err() const { return str_err; }
+    const char *get_cstr_err() const { return str_err.c_str(); }
+
+    void clear(void);
+
+private:
+    struct CommandStats
+    {
+        LatencyHistogram latency;
+        uint64_t ok;
+        uint64_t errors;
+        uint64_t timeouts;
+        uint64_t rejected;
+    };
+
+    CommandStats   stats[COMMAND_COUNT];
+    CircuitBreaker breaker;
+
+    unsigned int timeout;    // ms
+    unsigned int fail_limit;
+    unsigned int retry_time; // ms
+
+    std::string str_err;
+
+    Result do_http_get(const char *url) const;
+    bool set_uint_value(const char *new_val, unsigned int min, unsigned int max,
+                        unsigned int &value, const char *name);
+};
+
+
+
+
+
+#endif // PTZ_BACKEND_H
@@ -0,0 +1,291 @@
+#include <time.h>
+
+#include <algorithm>
+
+#include "pullpoint_waiters.h"
+#include "smacros.h"
+#include "stools.h"
+
+
+
+
+
+static const char topic_dialect[] = "http://www.onvif.org/ver10/tev/topicExpression/ConcreteSet";
+
+
+
+static int64_t now_ms(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return (int64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+
+
+static wsnt__NotificationMessageHolderType *new_notification(struct soap *soap, const EventMessage &event)
+{
+    wsnt__NotificationMessageHolderType *holder = soap_new_wsnt__NotificationMessageHolderType(soap);
+
+    holder->Topic          = soap_new_wsnt__TopicExpressionType(soap);
+    holder->Topic->Dialect = topic_dialect;
+    holder->Topic->__mixed = soap_strdup(soap, event.topic);
+
+    _tt__Message *msg = soap_new__tt__Message(soap);
+
+    msg->UtcTime           = event.utc_time_ms / 1000;
+    msg->PropertyOperation = soap_new_ptr(soap, static_cast<tt__PropertyOperation>(event.operation));
+
+    msg->Source = soap_new_tt__ItemList(soap);
+    msg->Source->SimpleItem.push_back(soap_new_req__tt__ItemList_SimpleItem(soap, event.source_name, event.source_value));
+
+    msg->Data = soap_new_tt__ItemList(soap);
+    msg->Data->SimpleItem.push_back(soap_new_req__tt__ItemList_SimpleItem(soap, event.data_name, event.data_value));
+
+    holder->Message.__any = soap_dom_element(soap, NULL, "tt:Message", msg, msg->soap_type());
+
+    return holder;
+}
+
+
+
+// the same as the generated serve function of PullMessages does after the call
+static int send_response(struct soap *soap, _tev__PullMessagesResponse &response)
+{
+    soap->encodingStyle = NULL;
+    soap_serializeheader(soap);
+    response.soap_serialize(soap);
+
+    if( soap_begin_count(soap) )
+        return soap->error;
+
+    if( soap->mode & SOAP_IO_LENGTH )
+    {
+        if( soap_envelope_begin_out(soap) ||
+            soap_putheader(soap)          ||
+            soap_body_begin_out(soap)     ||
+            response.soap_put(soap, "tev:PullMessagesResponse", "") ||
+            soap_body_end_out(soap)       ||
+            soap_envelope_end_out(soap) )
+            return soap->error;
+    }
+
+    if( soap_end_count(soap)            ||
+        soap_response(soap, SOAP_OK)    ||
+        soap_envelope_begin_out(soap)   ||
+        soap_putheader(soap)            ||
+        soap_body_begin_out(soap)       ||
+        response.soap_put(soap, "tev:PullMessagesResponse", "") ||
+        soap_body_end_out(soap)         ||
+        soap_envelope_end_out(soap)     ||
+        soap_end_send(soap) )
+        return soap->error;
+
+    return soap_closesock(soap);
+}
+
+
+
+const int64_t PullPointWaiters::TICK_MS;
+
+
+
+PullPointWaiters::PullPointWaiters():
+    waiters   ( MAX_WAITERS ),
+    count     ( 0 ),
+    timeouts  ( now_ms() / TICK_MS ),
+    parked    ( 0 ),
+    by_events ( 0 ),
+    by_timeout( 0 )
+{
+    for( size_t i = MAX_WAITERS; i > 0; --i )
+    {
+        waiters[i - 1].soap  = NULL;
+        waiters[i - 1].timer = TimerWheel::NO_TIMER;
+        free_waiters.push_back(&waiters[i - 1]);
+    }
+}
+
+
+
+void PullPointWaiters::fill_response(struct soap *soap, EventSubscription &sub, size_t limit,
+                                     _tev__PullMessagesResponse &response)
+{
+    // the queue is drained in batches on the stack
+    EventMessage events[32];
+
+    while( limit > 0 )
+    {
+        size_t count = sub.pop(events, std::min(limit, COUNT_ELEMENTS(events)));
+        if( !count )
+            break;
+
+        for( size_t i = 0; i < count; ++i )
+            response.wsnt__NotificationMessage.push_back(new_notification(soap, events[i]));
+
+        limit -= count;
+    }
+
+
+    response.CurrentTime     = time(NULL);
+    response.TerminationTime = sub.get_termination_time();
+}
+
+
+
+bool PullPointWaiters::park(struct soap *soap, const EventSubscriptionPtr &sub, size_t limit, int64_t timeout_ms)
+{
+    // a new request of the subscription replaces the old one (it gets an empty response)
+    std::map<uint32_t, Waiter *>::iterator it = by_subscription.find(sub->get_id());
+    if( it != by_subscription.end() )
+        complete(*it->second);
+
+
+    if( free_waiters.empty() )
+        return false;
+
+
+    struct soap *copy = soap_copy(soap);
+    if( !copy )
+        return false;
+
+
+    // the copy owns the connection, the data of the request stays in the
+    // original context (it is freed by the main loop)
+    soap->socket     = SOAP_INVALID_SOCKET;
+    copy->master     = SOAP_INVALID_SOCKET;
+    copy->header     = NULL;
+    copy->action     = NULL;
+    copy->keep_alive = 0;
+
+#ifdef WITH_OPENSSL
+    // the TLS of HTTPS goes with the connection
+    copy->ssl = soap->ssl;
+    copy->bio = soap->bio;
+    soap->ssl = NULL;
+    soap->bio = NULL;
+#endif
+
+
+    int64_t deadline = now_ms() + ((timeout_ms < MAX_TIMEOUT_MS) ? timeout_ms : MAX_TIMEOUT_MS);
+
+    Waiter &waiter = *free_waiters.back();
+    free_waiters.pop_back();
+
+    waiter.soap  = copy;
+    waiter.sub   = sub;
+    waiter.limit = limit;
+    waiter.timer = timeouts.insert((deadline + TICK_MS - 1) / TICK_MS, &waiter);
+
+    by_subscription[sub->get_id()] = &waiter;
+    count++;
+    parked++;
+
+    return true;
+}
+
+
+
+void PullPointWaiters::process(bool signaled)
+{
+    expired.clear();
+    timeouts.advance(now_ms() / TICK_MS, expired);
+
+    for( size_t i = 0; i < expired.size(); ++i )
+    {
+        Waiter &waiter = *(Waiter *)expired[i];
+
+        waiter.timer = TimerWheel::NO_TIMER; // it is freed by the wheel
+        by_timeout++;
+        complete(waiter);
+    }
+
+
+    if( !signaled || !count )
+        return;
+
+
+    for( size_t i = 0; i < waiters.size(); ++i )
+    {
+        Waiter &waiter = waiters[i];
+
+        if( !waiter.soap || (!waiter.sub->get_queued() && !waiter.sub->is_closed()) )
+            continue;
+
+        if( waiter.sub->is_closed() )
+            by_timeout++;
+        else
+            by_events++;
+
+        complete(waiter);
+    }
+}
+
+
+
+int PullPointWaiters::get_timeout_ms(int max_ms) const
+{
+    int64_t now   = now_ms();
+    int64_t ticks = timeouts.get_next(max_ms / TICK_MS + 1);
+    int64_t ms    = (timeouts.get_tick() + ticks) * TICK_MS - now;
+
+    if( ms < 0 )
+        return 0;
+
+    return (ms < max_ms) ? (int)ms : max_ms;
+}
+
+
+
+void PullPointWaiters::complete(Waiter &waiter)
+{
+    struct soap *soap = waiter.soap;
+
+    if( !waiter.sub->is_closed() )
+    {
+        _tev__PullMessagesResponse response;
+        fill_response(soap, *waiter.sub, waiter.limit, response);
+        send_response(soap, response);
+    }
+    else
+    {
+        // unsubscribed or expired while the request was waiting
+        soap_sender_fault(soap, "Subscription not found", NULL);
+        soap_send_fault(soap);
+    }
+
+
+    soap_force_closesock(soap); // if the response was not sent
+    soap_destroy(soap);
+    soap_end(soap);
+    soap_free(soap);
+
+    release(waiter);
+}
+
+
+
+void PullPointWaiters::release(Waiter &waiter)
+{
+    timeouts.cancel(waiter.timer);
+    by_subscription.erase(waiter.sub->get_id());
+
+    waiter.soap  = NULL;
+    waiter.timer = TimerWheel::NO_TIMER;
+    waiter.sub.reset(); // the queue of an expired subscription can be freed
+
+    free_waiters.push_back(&waiter);
+    count--;
+}
+
+
+
+void PullPointWaiters::dump_stats(FILE *fp) const
+{
+    fprintf(fp, "PullMessages: waiting %zu  parked %llu  by events %llu  by timeout %llu\n",
+            count,
+            (unsigned long long)parked,
+            (unsigned long long)by_events,
+            (unsigned long long)by_timeout);
+}
@@ -0,0 +1,91 @@
+#ifndef PULLPOINT_WAITERS_H
+#define PULLPOINT_WAITERS_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include <vector>
+#include <map>
+
+#include "soapH.h"
+#include "event_broker.h"
+#include "timer_wheel.h"
+
+
+
+
+
+/*
+ * PullMessages requests which wait for events (long poll).
+ *
+ * If the queue of the subscription is empty, the request is parked: the
+ * connection is moved to a copy of the soap context and the main loop goes on.
+ * The main loop waits on the listening socket and on the pull notifier of the
+ * broker, and calls process() after each wakeup: parked requests whose queue
+ * is not empty (or whose timeout has expired) are answered and closed.
+ * A waiting client costs the soap context only, there are no threads.
+ *
+ * The timeouts are kept in a timer wheel (TICK_MS ticks), so a wakeup without
+ * events costs only the expired timers; the waiters are scanned when the
+ * broker signals new events or removed subscriptions.
+ */
+class PullPointWaiters
+{
+public:
+    PullPointWaiters();
+
+    static const size_t  MAX_WAITERS     = EventBroker::MAX_SUBSCRIPTIONS;
+    static const int64_t MAX_TIMEOUT_MS  = 60000;
+    static const int64_t TICK_MS         = 10;    // of the timeouts
+
+    // response with up to limit queued events of the subscription
+    static void fill_response(struct soap *soap, EventSubscription &sub, size_t limit,
+                              _tev__PullMessagesResponse &response);
+
+    // take the connection of the request (the caller returns SOAP_STOP),
+    // false - can't park, the caller answers at once
+    bool park(struct soap *soap, const EventSubscriptionPtr &sub, size_t limit, int64_t timeout_ms);
+
+    // answer the waiters which are timed out and, if the pull notifier of the
+    // broker was signaled, the ones which have events or lost the subscription
+    void process(bool signaled);
+
+    // time until the nearest timeout (for poll), not more than max_ms
+    int get_timeout_ms(int max_ms) const;
+
+    size_t get_count(void) const { return count; }
+
+    void dump_stats(FILE *fp) const;
+
+private:
+    struct Waiter
+    {
+        struct soap         *soap;     // copy of the context with the client connection, NULL - free
+        EventSubscriptionPtr sub;
+        size_t               limit;
+        TimerWheel::TimerId  timer;    // of the timeout
+    };
+
+    std::vector<Waiter>          waiters;         // MAX_WAITERS, the timers point to them
+    std::vector<Waiter *>        free_waiters;
+    std::map<uint32_t, Waiter *> by_subscription; // id of subscription -> waiter
+    size_t                       count;
+
+    TimerWheel          timeouts;  // ticks of CLOCK_MONOTONIC
+    std::vector<void *> expired;   // of process(), capacity is reused
+
+    uint64_t parked;
+    uint64_t by_events;
+    uint64_t by_timeout;
+
+    void complete(Waiter &waiter);
+    void release(Waiter &waiter);
+
+    PullPointWaiters(const PullPointWaiters &);
+    PullPointWaiters &operator=(const PullPointWaiters &);
+};
+
+
+
+
+
+#endif // PULLPOINT_WAITERS_H
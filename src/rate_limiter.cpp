@@ -0,0 +1,221 @@
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "rate_limiter.h"
+#include "access_policy.h"
+#include "smacros.h"
+
+
+
+
+
+static const char *class_names[] = { "all", "PTZ", "expensive" };
+
+
+
+// sorted by name (strcmp), the reads which are expensive to serve
+static const char *expensive_reads[] =
+{
+    "CreatePullPointSubscription",
+    "GetEventProperties",
+    "GetProfiles",
+    "GetServices",
+    "GetVideoEncoderConfigurationOptions",
+    "Subscribe"
+};
+
+
+
+static const char fault_body[] =
+    "<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n"
+    "<SOAP-ENV:Envelope xmlns:SOAP-ENV=\"http://www.w3.org/2003/05/soap-envelope\">"
+    "<SOAP-ENV:Body><SOAP-ENV:Fault>"
+    "<SOAP-ENV:Code><SOAP-ENV:Value>SOAP-ENV:Receiver</SOAP-ENV:Value></SOAP-ENV:Code>"
+    "<SOAP-ENV:Reason><SOAP-ENV:Text xml:lang=\"en\">Too many requests</SOAP-ENV:Text></SOAP-ENV:Reason>"
+    "</SOAP-ENV:Fault></SOAP-ENV:Body></SOAP-ENV:Envelope>\n";
+
+
+
+static int64_t now_ms(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return (int64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+
+
+static int compare_names(const void *key, const void *item)
+{
+    return strcmp((const char *)key, *(const char * const *)item);
+}
+
+
+
+RateLimiter::RateLimiter():
+    limited( false ),
+    evicted( 0 )
+{
+    memset(rates,    0, sizeof(rates));
+    memset(table,    0, sizeof(table));
+    memset(allowed,  0, sizeof(allowed));
+    memset(rejected, 0, sizeof(rejected));
+
+
+    char header[256];
+
+    snprintf(header, sizeof(header),
+             "HTTP/1.1 429 Too Many Requests\r\n"
+             "Content-Type: application/soap+xml; charset=utf-8\r\n"
+             "Content-Length: %u\r\n"
+             "Retry-After: 1\r\n"
+             "Connection: close\r\n\r\n", (unsigned)(sizeof(fault_body) - 1));
+
+    fault = std::string(header) + fault_body;
+}
+
+
+
+RateLimiter::Class RateLimiter::get_class(const char *operation)
+{
+    switch( get_access_class(operation) )
+    {
+        case ACCESS_ACTUATE:
+            return PTZ;
+
+        case ACCESS_READ_SYSTEM_SENSITIVE:
+        case ACCESS_READ_SYSTEM_SECRET:
+        case ACCESS_WRITE_SYSTEM:
+        case ACCESS_UNRECOVERABLE:
+            return EXPENSIVE;
+
+        default:
+            break;
+    }
+
+
+    const char *name = strchr(operation, ':');
+    name = name ? name + 1 : operation;
+
+    if( bsearch(name, expensive_reads, COUNT_ELEMENTS(expensive_reads), sizeof(expensive_reads[0]), compare_names) )
+        return EXPENSIVE;
+
+    return READ;
+}
+
+
+
+bool RateLimiter::allow(uint32_t ip, Class rate_class)
+{
+    const Rate &rate = rates[rate_class];
+
+    if( !rate.rate )
+        return true;
+
+
+    int64_t now     = now_ms();
+    Entry  &entry   = get_entry(ip, now);
+    Bucket &bucket  = entry.buckets[rate_class];
+    uint64_t tokens = bucket.tokens + (uint64_t)(now - bucket.time) * rate.rate; // ms * 1/s = 1/SCALE
+
+    bucket.tokens = (tokens < (uint64_t)rate.burst * SCALE) ? (uint32_t)tokens : rate.burst * SCALE;
+    bucket.time   = now;
+
+    if( bucket.tokens < SCALE )
+    {
+        rejected[rate_class]++;
+        return false;
+    }
+
+
+    bucket.tokens -= SCALE;
+    allowed[rate_class]++;
+
+    return true;
+}
+
+
+
+RateLimiter::Entry &RateLimiter::get_entry(uint32_t ip, int64_t now)
+{
+    Entry *set    = &table[((ip * 0x9E3779B1u) >> 16) % SETS * WAYS];
+    Entry *oldest = set;
+
+    for( size_t i = 0; i < WAYS; ++i )
+    {
+        if( set[i].used && (set[i].ip == ip) )
+        {
+            set[i].seen = now;
+            return set[i];
+        }
+
+        if( !set[i].used || (oldest->used && (set[i].seen < oldest->seen)) )
+            oldest = &set[i];
+    }
+
+
+    if( oldest->used )
+        evicted++;
+
+    oldest->ip   = ip;
+    oldest->used = true;
+    oldest->seen = now;
+
+    // a new client starts with the full buckets
+    for( size_t i = 0; i < CLASSES; ++i )
+    {
+        oldest->buckets[i].tokens = rates[i].burst * SCALE;
+        oldest->buckets[i].time   = now;
+    }
+
+    return *oldest;
+}
+
+
+
+bool RateLimiter::set_rate(Class rate_class, const char *new_val)
+{
+    char         *end;
+    unsigned long rate  = strtoul(new_val ? new_val : "", &end, 10);
+    unsigned long burst = 2 * rate;
+
+    if( (end != new_val) && (*end == ':') )
+        burst = strtoul(end + 1, &end, 10);
+
+    if( !new_val || (end == new_val) || *end || !rate || (rate > 10000) || (burst < 1) || (burst > 10000) )
+    {
+        str_err = std::string("rate of ") + class_names[rate_class] + " is bad, format: RATE[:BURST], 1-10000";
+        return false;
+    }
+
+
+    rates[rate_class].rate  = rate;
+    rates[rate_class].burst = burst;
+    limited = true;
+
+    return true;
+}
+
+
+
+void RateLimiter::dump_stats(FILE *fp) const
+{
+    size_t clients = 0;
+
+    for( size_t i = 0; i < COUNT_ELEMENTS(table); ++i )
+        clients += table[i].used;
+
+
+    fprintf(fp, "Rate limit: clients %zu  evicted %llu", clients, (unsigned long long)evicted);
+
+    for( size_t i = 0; i < CLASSES; ++i )
+    {
+        fprintf(fp, "  %s %llu/%llu", class_names[i],
+                (unsigned long long)allowed[i],
+                (unsigned long long)rejected[i]);
+    }
+
+    fprintf(fp, " (allowed/rejected)\n");
+}
@@ -0,0 +1,115 @@
+#ifndef RATE_LIMITER_H
+#define RATE_LIMITER_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string>
+
+
+
+
+
+/*
+ * Limit of the requests per client IP (token buckets).
+ *
+ * A client has a bucket for all its requests (READ) and the buckets of the
+ * classes: PTZ control and expensive operations (GetProfiles, the changes,
+ * snapshots), so a VMS which polls GetProfiles too often does not take the
+ * PTZ of the others and is not limited in its GetStatus. The bucket READ is
+ * charged by admit() as soon as the request comes (before its header is
+ * parsed and the digest is checked), the bucket of the class by allow() when
+ * the request element is known. A class without the rate is not limited.
+ *
+ * The clients are kept in a fixed table: SETS sets of WAYS entries, the IP
+ * selects the set, a new client takes the least recently seen entry of its
+ * set. A scan of many IPs only evicts the entries of the idle clients (an
+ * evicted client starts with the full buckets), the memory does not grow.
+ * The table is used by the main loop only, there are no locks.
+ *
+ * The limited requests get the HTTP response with the SOAP fault which is
+ * serialized once (get_fault()), the connection is closed. A request over
+ * the limit of admit() is not read at all, over the limit of its class only
+ * its HTTP header and the request element are read.
+ */
+class RateLimiter
+{
+public:
+    RateLimiter();
+
+    static const size_t SETS = 128;
+    static const size_t WAYS = 8;
+
+    enum Class
+    {
+        READ,
+        PTZ,
+        EXPENSIVE,
+        CLASSES
+    };
+
+    bool enabled(void) const { return limited; }
+
+    // class of the operation (the name of the request element)
+    static Class get_class(const char *operation);
+
+    // takes a token of the client for any request, false if the client is over the limit
+    bool admit(uint32_t ip) { return allow(ip, READ); }
+
+    // takes a token of the client for the class, false if the client is over
+    // the limit; READ (the cheap reads) has no own bucket, see admit()
+    bool allow(uint32_t ip, Class rate_class);
+
+    // HTTP response to the limited requests
+    const std::string &get_fault(void) const { return fault; }
+
+    void dump_stats(FILE *fp) const;
+
+    //methods for parsing opt from cmd, RATE[:BURST] requests per sec
+    bool set_rate(Class rate_class, const char *new_val);
+
+    std::string get_str_err() const { return str_err; }
+    const char *get_cstr_err() const { return str_err.c_str(); }
+
+private:
+    static const uint32_t SCALE = 1000; // tokens are kept in 1/SCALE
+
+    struct Rate
+    {
+        uint32_t rate;   // tokens per sec
+        uint32_t burst;  // tokens
+    };
+
+    struct Bucket
+    {
+        uint32_t tokens; // 1/SCALE
+        int64_t  time;   // ms, of the last refill
+    };
+
+    struct Entry
+    {
+        uint32_t ip;
+        bool     used;
+        int64_t  seen;   // ms, for the eviction
+        Bucket   buckets[CLASSES];
+    };
+
+    Rate        rates[CLASSES];
+    bool        limited;
+    Entry       table[SETS * WAYS];
+    std::string fault;
+
+    uint64_t allowed[CLASSES];
+    uint64_t rejected[CLASSES];
+    uint64_t evicted;
+
+    std::string str_err;
+
+    Entry &get_entry(uint32_t ip, int64_t now);
+};
+
+
+
+
+
+#endif // RATE_LIMITER_H
@@ -0,0 +1,403 @@
+#include <fcntl.h>
+#include <setjmp.h>
+#include <signal.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "shm_frame_source.h"
+#include "smacros.h"
+
+
+
+
+
+static inline uint32_t load_acquire(const uint32_t *ptr)
+{
+    return __atomic_load_n(ptr, __ATOMIC_ACQUIRE);
+}
+
+
+
+static inline size_t get_slot_stride(uint32_t slot_size)
+{
+    return (sizeof(ShmFrameSlot) + slot_size + 63) & ~(size_t)63;
+}
+
+
+
+// SIGBUS of a read from the mapping of a truncated object jumps back to the guard of the thread
+static thread_local sigjmp_buf *bus_guard = NULL;
+
+
+
+static void on_sigbus(int sig, siginfo_t *info, void *context)
+{
+    UNUSED(info);
+    UNUSED(context);
+
+    if( bus_guard )
+        siglongjmp(*bus_guard, 1);
+
+
+    // not a read of the shm: default action
+    signal(sig, SIG_DFL);
+    raise(sig);
+}
+
+
+
+static void install_sigbus_handler(void)
+{
+    static std::once_flag once;
+
+    std::call_once(once, []()
+    {
+        struct sigaction sa;
+        memset(&sa, 0, sizeof(sa));
+        sa.sa_sigaction = on_sigbus;
+        sa.sa_flags     = SA_SIGINFO;
+        sigemptyset(&sa.sa_mask);
+        sigaction(SIGBUS, &sa, NULL);
+    });
+}
+
+
+
+enum ReadResult
+{
+    READ_OK,
+    READ_NO_FRAME, // the encoder has not written a frame yet
+    READ_MISS,     // the slot was changed under us
+    READ_BAD_HEADER,
+    READ_FAULT     // SIGBUS, the object was truncated
+};
+
+
+
+static bool is_header_valid(const uint8_t *base, size_t size)
+{
+    const ShmFrameHeader *hdr = (const ShmFrameHeader *)base;
+
+    return (hdr->magic == SHM_FRAME_MAGIC) && (hdr->version == SHM_FRAME_VERSION) && hdr->slot_count &&
+           (sizeof(ShmFrameHeader) + hdr->slot_count * get_slot_stride(hdr->slot_size) <= size);
+}
+
+
+
+static ReadResult read_latest(const ShmMapping &map, ShmFrame &frame)
+{
+    const ShmFrameHeader *hdr = (const ShmFrameHeader *)map.ptr;
+
+    if( !is_header_valid(map.ptr, map.size) )
+        return READ_BAD_HEADER; // the encoder was restarted and did not finish init yet
+
+
+    const size_t stride = get_slot_stride(hdr->slot_size);
+
+    // the writer can be in the middle of the update, few attempts are enough
+    for(int attempt = 0; attempt < 4; ++attempt)
+    {
+        uint32_t idx = load_acquire(&hdr->latest);
+        if( idx >= hdr->slot_count )
+            return READ_MISS;
+
+
+        const ShmFrameSlot *slot = (const ShmFrameSlot *)(map.ptr + sizeof(ShmFrameHeader) + idx * stride);
+
+        uint32_t seq = load_acquire(&slot->seq);
+        if( !seq )
+            return READ_NO_FRAME;
+
+        if( seq & 1 )
+            continue;
+
+
+        frame.slot         = slot;
+        frame.seq          = seq;
+        frame.data         = (const uint8_t *)(slot + 1);
+        frame.size         = *(volatile const uint32_t *)&slot->size;
+        frame.timestamp_us = *(volatile const uint64_t *)&slot->timestamp_us;
+
+
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+
+        if( load_acquire(&slot->seq) != seq )
+            continue;
+
+        return (frame.size && (frame.size <= hdr->slot_size)) ? READ_OK : READ_MISS;
+    }
+
+
+    return READ_MISS;
+}
+
+
+
+static ReadResult guarded_read_latest(const ShmMapping &map, ShmFrame &frame)
+{
+    sigjmp_buf jmp;
+
+    if( sigsetjmp(jmp, 1) )
+    {
+        bus_guard = NULL;
+        return READ_FAULT;
+    }
+
+
+    bus_guard = &jmp;
+    ReadResult res = read_latest(map, frame);
+    bus_guard = NULL;
+
+    return res;
+}
+
+
+
+static time_t get_monotonic_sec(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return ts.tv_sec;
+}
+
+
+
+ShmMapping::~ShmMapping()
+{
+    munmap(ptr, size);
+}
+
+
+
+bool ShmFrameSource::set_name(const char *new_val)
+{
+    if( !new_val || (new_val[0] != '/') || !new_val[1] )
+    {
+        str_err = "shm name must be like /name";
+        return false;
+    }
+
+
+    name = new_val;
+    return true;
+}
+
+
+
+ShmMappingPtr ShmFrameSource::revalidate()
+{
+    std::lock_guard<std::mutex> lock(map_mtx);
+
+    checked_at.store(get_monotonic_sec());
+    install_sigbus_handler();
+
+
+    ShmMappingPtr cur = std::atomic_load(&map);
+
+    int fd = shm_open(name.c_str(), O_RDONLY, 0);
+    if( fd < 0 )
+    {
+        str_err = "can't open shm: " + name; // the encoder is stopped, the old mapping is stale
+        std::atomic_store(&map, ShmMappingPtr());
+        return ShmMappingPtr();
+    }
+
+
+    struct stat st;
+    if( (fstat(fd, &st) != 0) || ((size_t)st.st_size < sizeof(ShmFrameHeader)) )
+    {
+        ::close(fd);
+        str_err = "shm is too small: " + name; // encoder did not finish init yet
+        std::atomic_store(&map, ShmMappingPtr());
+        return ShmMappingPtr();
+    }
+
+
+    if( cur && (cur->ino == st.st_ino) && (cur->size == (size_t)st.st_size) )
+    {
+        ::close(fd);
+
+        ShmFrame   frame;
+        ReadResult res = guarded_read_latest(*cur, frame);
+
+        if( (res != READ_FAULT) && (res != READ_BAD_HEADER) )
+            return cur; // the same object, the miss was a race with the writer
+    }
+
+
+    void *ptr = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    ::close(fd);
+
+    if( ptr == MAP_FAILED )
+    {
+        str_err = "can't map shm: " + name;
+        std::atomic_store(&map, ShmMappingPtr());
+        return ShmMappingPtr();
+    }
+
+
+    ShmMappingPtr next = std::make_shared<ShmMapping>((uint8_t *)ptr, st.st_size, st.st_ino);
+
+    ShmFrame   frame;
+    ReadResult res = guarded_read_latest(*next, frame);
+
+    if( (res == READ_FAULT) || (res == READ_BAD_HEADER) )
+    {
+        str_err = "shm has bad header: " + name;
+        std::atomic_store(&map, ShmMappingPtr());
+        return ShmMappingPtr();
+    }
+
+
+    mappings++;
+
+    // the old mapping is unmapped when the frames being sent from it are released
+    std::atomic_store(&map, next);
+    return next;
+}
+
+
+
+bool ShmFrameSource::get_latest(ShmFrame &frame)
+{
+    ShmMappingPtr cur = std::atomic_load(&map);
+
+    if( !cur || (get_monotonic_sec() - checked_at.load() >= REVALIDATE_SEC) )
+        cur = revalidate();
+
+
+    ReadResult res = cur ? guarded_read_latest(*cur, frame) : READ_MISS;
+
+    if( cur && (res != READ_OK) && (res != READ_NO_FRAME) )
+    {
+        // the encoder may be restarted: check the object and try once more
+        cur = revalidate();
+        res = cur ? guarded_read_latest(*cur, frame) : READ_MISS;
+    }
+
+
+    if( res != READ_OK )
+    {
+        DEBUG_MSG("Snapshot shm: %s\n", cur ? "no frame" : str_err.c_str());
+        return false;
+    }
+
+
+    frame.map = cur;
+    return true;
+}
+
+
+
+bool ShmFrameSource::is_valid(const ShmFrame &frame)
+{
+    sigjmp_buf jmp;
+
+    if( sigsetjmp(jmp, 1) )
+    {
+        bus_guard = NULL;
+        return false; // truncated while the frame was sent
+    }
+
+
+    bus_guard = &jmp;
+
+    __atomic_thread_fence(__ATOMIC_ACQUIRE);
+    bool valid = load_acquire(&frame.slot->seq) == frame.seq;
+
+    bus_guard = NULL;
+
+    return valid;
+}
+
+
+
+// ------------------------------- RawFrameSource -------------------------------
+
+
+
+bool RawFrameSource::set_spec(const char *spec, int frame_width, int frame_height)
+{
+    std::string str(spec ? spec : "");
+    size_t      colon = str.find(':');
+
+
+    std::string fmt = str.substr(0, colon);
+
+    if( fmt == "nv12" )
+        format = YUV_NV12;
+    else if( fmt == "i420" )
+        format = YUV_I420;
+    else
+    {
+        str_err = "raw frame must be like nv12:/path or i420:/path";
+        return false;
+    }
+
+
+    if( (colon == std::string::npos) || (colon + 1 >= str.size()) )
+    {
+        str_err = "path of raw frame is empty";
+        return false;
+    }
+
+
+    if( (frame_width < 16) || (frame_height < 16) || (frame_width & 1) || (frame_height & 1) )
+    {
+        str_err = "size of raw frame must be even and >= 16";
+        return false;
+    }
+
+
+    path   = str.substr(colon + 1);
+    width  = frame_width;
+    height = frame_height;
+
+    return true;
+}
+
+
+
+bool RawFrameSource::make_jpeg(int dst_w, int dst_h, const JpegEncoder &encoder, std::string &out) const
+{
+    size_t frame_size = (size_t)width * height * 3 / 2;
+
+
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if( fd < 0 )
+    {
+        DEBUG_MSG("Snapshot raw: can't open %s\n", path.c_str());
+        return false;
+    }
+
+
+    struct stat st;
+    if( (fstat(fd, &st) != 0) || ((size_t)st.st_size < frame_size) )
+    {
+        ::close(fd);
+        DEBUG_MSG("Snapshot raw: %s is smaller than the frame\n", path.c_str());
+        return false;
+    }
+
+
+    void *ptr = mmap(NULL, frame_size, PROT_READ, MAP_SHARED, fd, 0);
+    ::close(fd);
+
+    if( ptr == MAP_FAILED )
+        return false;
+
+
+    YuvImage img;
+    yuv_scale((const uint8_t *)ptr, format, width, height, img, dst_w, dst_h);
+
+    munmap(ptr, frame_size);
+
+
+    encoder.encode(img, out);
+
+    return true;
+}
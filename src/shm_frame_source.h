@@ -0,0 +1,179 @@
+#ifndef SHM_FRAME_SOURCE_H
+#define SHM_FRAME_SOURCE_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/types.h>
+#include <string>
+#include <mutex>
+#include <memory>
+#include <atomic>
+
+#include "yuv_scale.h"
+#include "jpeg_encoder.h"
+
+
+
+
+
+/*
+ * Layout of the POSIX shared memory object (shm_open) written by the encoder.
+ * All fields are in host byte order, the object is:
+ *
+ *   ShmFrameHeader
+ *   slot_count * (ShmFrameSlot + slot_size bytes of JPEG), stride is 64-aligned
+ *
+ * Writer (encoder), for each new frame:
+ *   1. take slot (latest + 1) % slot_count
+ *   2. seq++ (odd - slot is being written), release
+ *   3. write data, size, timestamp
+ *   4. seq++ (even - slot is complete), release
+ *   5. latest = index of the slot, release
+ *
+ * Readers never block the writer: they check seq before and after they use
+ * the data and drop the frame if it was changed.
+ *
+ * The encoder can be restarted: it creates the object again (other inode) or
+ * truncates and resizes it. The reader checks inode, size and magic of the
+ * object after a miss and once per REVALIDATE_SEC and maps it again when they
+ * were changed. Reads from the mapping of a truncated object (SIGBUS) are
+ * taken as a miss.
+ */
+#define SHM_FRAME_MAGIC    0x5346564Fu  // "OVFS"
+#define SHM_FRAME_VERSION  1
+
+
+
+struct ShmFrameHeader
+{
+    uint32_t magic;
+    uint32_t version;
+    uint32_t slot_count;
+    uint32_t slot_size;   // max size of JPEG in the slot
+    uint32_t latest;      // index of the last complete slot
+    uint32_t reserved[11];
+};
+
+
+
+struct ShmFrameSlot
+{
+    uint32_t seq;          // odd while the writer updates the slot
+    uint32_t size;         // size of JPEG
+    uint64_t timestamp_us; // CLOCK_MONOTONIC of the frame
+    uint8_t  reserved[48];
+    // followed by slot_size bytes of data
+};
+
+
+
+// Mapping of the shm object, unmapped when the last frame from it is released
+struct ShmMapping
+{
+    ShmMapping(uint8_t *ptr, size_t size, ino_t ino) : ptr(ptr), size(size), ino(ino) {}
+    ~ShmMapping();
+
+    uint8_t *ptr;
+    size_t   size;
+    ino_t    ino;
+};
+
+typedef std::shared_ptr<const ShmMapping> ShmMappingPtr;
+
+
+
+// Frame in the mapping, valid while the writer does not reuse the slot
+struct ShmFrame
+{
+    const uint8_t *data;
+    uint32_t       size;
+    uint64_t       timestamp_us;
+
+    const ShmFrameSlot *slot;
+    uint32_t            seq;
+
+    ShmMappingPtr map; // keeps data mapped after a remap
+};
+
+
+
+class ShmFrameSource
+{
+public:
+    ShmFrameSource() : checked_at(0), mappings(0) {}
+
+    static const time_t REVALIDATE_SEC = 1;
+
+    bool set_name(const char *new_val);
+    const std::string &get_name(void) const { return name; }
+
+    // get the latest complete frame (maps the shm on first use)
+    bool get_latest(ShmFrame &frame);
+
+    // check that the frame was not overwritten since get_latest
+    static bool is_valid(const ShmFrame &frame);
+
+    // number of mappings after the first one (restarts of the encoder)
+    uint64_t get_remaps(void) const { uint64_t n = mappings.load(); return n ? n - 1 : 0; }
+
+    std::string get_str_err() const { return str_err; }
+    const char *get_cstr_err() const { return str_err.c_str(); }
+
+private:
+    std::string name;
+
+    std::mutex            map_mtx;    // only for (re)mapping
+    ShmMappingPtr         map;        // std::atomic_load/store, NULL - not mapped
+    std::atomic<time_t>   checked_at; // CLOCK_MONOTONIC of the last revalidation
+    std::atomic<uint64_t> mappings;
+
+    std::string str_err;
+
+    // check the object and map it again if it was changed, returns the current mapping
+    ShmMappingPtr revalidate(void);
+
+    ShmFrameSource(const ShmFrameSource &);
+    ShmFrameSource &operator=(const ShmFrameSource &);
+};
+
+
+
+
+
+/*
+ * Raw frame (NV12 or I420 without padding) of the encoder in a file,
+ * usually in /dev/shm. The frame is mapped for each request, scaled and
+ * encoded to JPEG. There is no sync with the writer: a frame updated while
+ * it is scaled gives only a visual artifact in the thumbnail.
+ */
+class RawFrameSource
+{
+public:
+    RawFrameSource() : format(YUV_NV12), width(0), height(0) {}
+
+    // spec: nv12:/path or i420:/path, size of the frame is the size of the profile
+    bool set_spec(const char *spec, int frame_width, int frame_height);
+
+    int get_width(void) const { return width; }
+    int get_height(void) const { return height; }
+
+    // scale the frame to dst_w x dst_h and append JPEG to out
+    bool make_jpeg(int dst_w, int dst_h, const JpegEncoder &encoder, std::string &out) const;
+
+    std::string get_str_err() const { return str_err; }
+    const char *get_cstr_err() const { return str_err.c_str(); }
+
+private:
+    YuvFormat   format;
+    std::string path;
+    int         width;
+    int         height;
+
+    std::string str_err;
+};
+
+
+
+
+
+#endif // SHM_FRAME_SOURCE_H
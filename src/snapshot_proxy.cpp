@@ -0,0 +1,636 @@
+#include <time.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <sstream>
+
+#include <curl/curl.h>
+
+#include "snapshot_proxy.h"
+#include "smacros.h"
+
+
+
+
+
+static uint64_t monotonic_ms(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return (uint64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+
+
+// Send all iovecs, MSG_NOSIGNAL: client can close the socket at any time
+static bool send_iov(int fd, struct iovec *iov, int iovcnt)
+{
+    while( iovcnt > 0 )
+    {
+        struct msghdr msg;
+        memset(&msg, 0, sizeof(msg));
+        msg.msg_iov    = iov;
+        msg.msg_iovlen = iovcnt;
+
+        ssize_t n = sendmsg(fd, &msg, MSG_NOSIGNAL);
+
+        if( n < 0 )
+        {
+            if( errno == EINTR )
+                continue;
+
+            return false;
+        }
+
+
+        while( (iovcnt > 0) && ((size_t)n >= iov->iov_len) )
+        {
+            n -= iov->iov_len;
+            ++iov;
+            --iovcnt;
+        }
+
+        if( iovcnt > 0 )
+        {
+            iov->iov_base = (char *)iov->iov_base + n;
+            iov->iov_len -= n;
+        }
+    }
+
+
+    return true;
+}
+
+
+
+static const char *status_str(int code)
+{
+    switch( code )
+    {
+        case 200: return "200 OK";
+        case 404: return "404 Not Found";
+        case 429: return "429 Too Many Requests";
+        case 502: return "502 Bad Gateway";
+        case 503: return "503 Service Unavailable";
+        default:  return "500 Internal Server Error";
+    }
+}
+
+
+
+void SnapshotProxy::send_error(int fd, int code)
+{
+    char header[128];
+
+    int len = snprintf(header, sizeof(header),
+                       "HTTP/1.1 %s\r\n"
+                       "Content-Length: 0\r\n"
+                       "Connection: close\r\n\r\n", status_str(code));
+
+    struct iovec iov;
+    iov.iov_base = header;
+    iov.iov_len  = len;
+
+    send_iov(fd, &iov, 1);
+    close(fd);
+}
+
+
+
+void SnapshotProxy::start()
+{
+    if( !enable || started )
+        return;
+
+
+    queue.resize(QUEUE_SIZE);
+    started = true;
+
+    for(unsigned int i = 0; i < workers; ++i)
+        std::thread(&SnapshotProxy::worker, this).detach();
+}
+
+
+
+void SnapshotProxy::enqueue(int fd, const std::string &profile, const char *upstream_url,
+                            int width, int height)
+{
+    requests++;
+
+    {
+        std::lock_guard<std::mutex> lock(queue_mtx);
+
+        if( started && (queue_len < QUEUE_SIZE) && (strlen(upstream_url) < URI_TEMPLATE_MAX_LEN) )
+        {
+            Job &job = queue[(queue_head + queue_len) % QUEUE_SIZE];
+
+            job.fd      = fd;
+            job.profile = profile;
+            strcpy(job.url, upstream_url);
+            job.width   = width;
+            job.height  = height;
+
+            queue_len++;
+            queue_cond.notify_one();
+            return;
+        }
+    }
+
+
+    rejected++;
+    send_error(fd, 503);
+}
+
+
+
+void SnapshotProxy::worker()
+{
+    // one curl handle per worker, connection to the encoder is reused
+    CURL *curl = curl_easy_init();
+
+    Job job;
+
+    while( true )
+    {
+        {
+            std::unique_lock<std::mutex> lock(queue_mtx);
+
+            while( !queue_len )
+                queue_cond.wait(lock);
+
+            Job &front = queue[queue_head];
+
+            job.fd = front.fd;
+            job.profile.swap(front.profile);
+            memcpy(job.url, front.url, sizeof(job.url));
+            job.width  = front.width;
+            job.height = front.height;
+
+            queue_head = (queue_head + 1) % QUEUE_SIZE;
+            queue_len--;
+        }
+
+
+        process(curl, job);
+    }
+}
+
+
+
+bool SnapshotProxy::add_shm_source(const std::string &profile, const std::string &shm_name)
+{
+    if( started )
+    {
+        str_err = "snapshot proxy is already started";
+        return false;
+    }
+
+
+    std::shared_ptr<ShmFrameSource> src = std::make_shared<ShmFrameSource>();
+
+    if( !src->set_name(shm_name.c_str()) )
+    {
+        str_err = src->get_str_err();
+        return false;
+    }
+
+
+    shm_sources[profile] = src;
+    return true;
+}
+
+
+
+bool SnapshotProxy::add_raw_source(const std::string &profile, const std::string &spec,
+                                   int width, int height)
+{
+    if( started )
+    {
+        str_err = "snapshot proxy is already started";
+        return false;
+    }
+
+
+    std::shared_ptr<RawFrameSource> src = std::make_shared<RawFrameSource>();
+
+    if( !src->set_spec(spec.c_str(), width, height) )
+    {
+        str_err = src->get_str_err();
+        return false;
+    }
+
+
+    raw_sources[profile] = src;
+    return true;
+}
+
+
+
+void SnapshotProxy::process(void *curl, Job &job)
+{
+    struct timeval tv;
+    tv.tv_sec  = 3;
+    tv.tv_usec = 0;
+    setsockopt(job.fd, SOL_SOCKET, SO_SNDTIMEO, &tv, sizeof(tv));
+
+
+    auto shm = shm_sources.find(job.profile);
+    auto raw = raw_sources.find(job.profile);
+
+    bool thumbnail = (raw != raw_sources.end()) && (job.width || job.height || !job.url[0]);
+
+    if( !thumbnail && (shm != shm_sources.end()) && process_shm(*shm->second, job.fd) )
+        return;
+
+
+    Image image;
+
+    if( thumbnail )
+    {
+        image = get_thumbnail(*raw->second, job);
+    }
+    else if( job.url[0] )
+    {
+        const char *url = job.url;
+
+        image = get_cached(job.profile, [this, curl, url](std::string &data)
+        {
+            return fetch(curl, url, data);
+        });
+    }
+    else
+    {
+        send_error(job.fd, 503); // shm has no frame and there is no snapurl
+        return;
+    }
+
+    if( !image )
+    {
+        send_error(job.fd, thumbnail ? 503 : 502); // the raw frame is local, it is not ready yet
+        return;
+    }
+
+
+    char header[192];
+
+    int len = snprintf(header, sizeof(header),
+                       "HTTP/1.1 200 OK\r\n"
+                       "Content-Type: image/jpeg\r\n"
+                       "Content-Length: %zu\r\n"
+                       "Cache-Control: no-cache\r\n"
+                       "Connection: close\r\n\r\n", image->size());
+
+    struct iovec iov[2];
+    iov[0].iov_base = header;
+    iov[0].iov_len  = len;
+    iov[1].iov_base = (void *)image->data(); // shared with the cache, not copied
+    iov[1].iov_len  = image->size();
+
+    send_iov(job.fd, iov, 2);
+    close(job.fd);
+}
+
+
+
+// Send the latest frame straight from the shm mapping of the encoder
+bool SnapshotProxy::process_shm(ShmFrameSource &shm, int fd)
+{
+    ShmFrame frame;
+
+    if( !shm.get_latest(frame) )
+        return false;
+
+
+    char header[192];
+
+    int len = snprintf(header, sizeof(header),
+                       "HTTP/1.1 200 OK\r\n"
+                       "Content-Type: image/jpeg\r\n"
+                       "Content-Length: %u\r\n"
+                       "Cache-Control: no-cache\r\n"
+                       "Connection: close\r\n\r\n", frame.size);
+
+    struct iovec iov[2];
+    iov[0].iov_base = header;
+    iov[0].iov_len  = len;
+    iov[1].iov_base = (void *)frame.data;
+    iov[1].iov_len  = frame.size;
+
+    send_iov(fd, iov, 2);
+
+
+    if( !ShmFrameSource::is_valid(frame) )
+    {
+        // the writer reused the slot while we sent it, the client got a broken
+        // image: reset the connection, so it is not taken as a good one
+        shm_torn++;
+
+        struct linger lg;
+        lg.l_onoff  = 1;
+        lg.l_linger = 0;
+        setsockopt(fd, SOL_SOCKET, SO_LINGER, &lg, sizeof(lg));
+    }
+    else
+    {
+        shm_frames++;
+    }
+
+
+    close(fd);
+    return true;
+}
+
+
+
+std::shared_ptr<SnapshotProxy::CacheEntry> SnapshotProxy::get_entry(const std::string &key)
+{
+    std::lock_guard<std::mutex> lock(cache_mtx);
+
+
+    // thumbnail sizes come from clients, do not let the cache grow without limit
+    if( (cache.size() >= MAX_CACHE_ENTRIES) && (cache.find(key) == cache.end()) )
+    {
+        for(auto it = cache.begin(); it != cache.end(); )
+        {
+            if( it->second.unique() ) // nobody uses it now
+                it = cache.erase(it);
+            else
+                ++it;
+        }
+    }
+
+
+    std::shared_ptr<CacheEntry> &entry = cache[key];
+
+    if( !entry )
+        entry = std::make_shared<CacheEntry>();
+
+    return entry;
+}
+
+
+
+// Image from the cache or from produce(), concurrent calls for the key wait for one produce()
+SnapshotProxy::Image SnapshotProxy::get_cached(const std::string &key,
+                                               const std::function<bool(std::string &)> &produce)
+{
+    std::shared_ptr<CacheEntry> entry = get_entry(key);
+
+    std::unique_lock<std::mutex> lock(entry->mtx);
+
+
+    if( entry->image && (monotonic_ms() - entry->fetched_at < ttl) )
+    {
+        hits++;
+        return entry->image;
+    }
+
+
+    if( entry->fetching )
+    {
+        // somebody fetches this image right now, wait for his result
+        coalesced++;
+
+        uint64_t gen = entry->gen;
+
+        while( entry->gen == gen )
+            entry->cond.wait(lock);
+
+        return entry->last_ok ? entry->image : Image();
+    }
+
+
+    entry->fetching = true;
+    lock.unlock();
+
+
+    std::string *data = new std::string;
+    bool ok = produce(*data);
+
+    fetches++;
+
+
+    lock.lock();
+
+    entry->fetching = false;
+    entry->gen++;
+    entry->last_ok = ok;
+
+    if( ok )
+    {
+        entry->image.reset(data);
+        entry->fetched_at = monotonic_ms();
+    }
+    else
+    {
+        delete data;
+        fetch_errors++;
+    }
+
+    entry->cond.notify_all();
+
+
+    return ok ? entry->image : Image();
+}
+
+
+
+SnapshotProxy::Image SnapshotProxy::get_thumbnail(const RawFrameSource &raw, const Job &job)
+{
+    int src_w = raw.get_width();
+    int src_h = raw.get_height();
+    int w     = job.width;
+    int h     = job.height;
+
+    // the source is not configured yet (the sizes are divisors and bounds below)
+    if( (src_w <= 0) || (src_h <= 0) )
+        return Image();
+
+
+    // keep aspect ratio if only one side is set, full size if none
+    if( !w && !h )
+    {
+        w = src_w;
+        h = src_h;
+    }
+    else if( !w )
+    {
+        w = (int)((int64_t)h * src_w / src_h);
+    }
+    else if( !h )
+    {
+        h = (int)((int64_t)w * src_h / src_w);
+    }
+
+    w = (w < 16) ? 16 : (w > src_w) ? src_w : w;
+    h = (h < 16) ? 16 : (h > src_h) ? src_h : h;
+    w &= ~1;
+    h &= ~1;
+
+
+    char key[64];
+    snprintf(key, sizeof(key), "@%dx%d", w, h);
+
+
+    return get_cached(job.profile + key, [this, &raw, w, h](std::string &data)
+    {
+        thumbnails++;
+        return raw.make_jpeg(w, h, encoder, data);
+    });
+}
+
+
+
+static size_t append_data(void *ptr, size_t size, size_t nmemb, void *userdata)
+{
+    ((std::string *)userdata)->append((const char *)ptr, size * nmemb);
+
+    return size * nmemb;
+}
+
+
+
+bool SnapshotProxy::fetch(void *handle, const char *url, std::string &data) const
+{
+    CURL *curl = (CURL *)handle;
+
+    if( !curl )
+        return false;
+
+
+    curl_easy_reset(curl);
+    curl_easy_setopt(curl, CURLOPT_URL, url);
+    curl_easy_setopt(curl, CURLOPT_NOPROGRESS, 1L);
+    curl_easy_setopt(curl, CURLOPT_NOSIGNAL, 1L);
+    curl_easy_setopt(curl, CURLOPT_FOLLOWLOCATION, 1L);
+    curl_easy_setopt(curl, CURLOPT_MAXREDIRS, 5L);
+    curl_easy_setopt(curl, CURLOPT_TCP_KEEPALIVE, 1L);
+    curl_easy_setopt(curl, CURLOPT_CONNECTTIMEOUT_MS, (long)timeout);
+    curl_easy_setopt(curl, CURLOPT_TIMEOUT_MS, (long)timeout);
+    curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION, append_data);
+    curl_easy_setopt(curl, CURLOPT_WRITEDATA, &data);
+
+
+    if( curl_easy_perform(curl) != CURLE_OK )
+    {
+        DEBUG_MSG("Snapshot proxy: can't fetch %s\n", url);
+        return false;
+    }
+
+
+    long http_code = 0;
+    curl_easy_getinfo(curl, CURLINFO_RESPONSE_CODE, &http_code);
+
+    return (http_code < 400) && !data.empty();
+}
+
+
+
+void SnapshotProxy::dump_stats(FILE *fp) const
+{
+    uint64_t shm_remaps = 0;
+
+    for( auto it = shm_sources.cbegin(); it != shm_sources.cend(); ++it )
+        shm_remaps += it->second->get_remaps();
+
+
+    fprintf(fp, "Snapshot proxy: requests %llu  hits %llu  coalesced %llu  fetches %llu  "
+                "fetch errors %llu  rejected %llu  shm frames %llu  shm torn %llu  "
+                "shm remaps %llu  thumbnails %llu (%s)\n",
+            (unsigned long long)requests.load(),
+            (unsigned long long)hits.load(),
+            (unsigned long long)coalesced.load(),
+            (unsigned long long)fetches.load(),
+            (unsigned long long)fetch_errors.load(),
+            (unsigned long long)rejected.load(),
+            (unsigned long long)shm_frames.load(),
+            (unsigned long long)shm_torn.load(),
+            (unsigned long long)shm_remaps,
+            (unsigned long long)thumbnails.load(),
+            yuv_scale_kernel_name());
+}
+
+
+
+bool SnapshotProxy::set_uint_value(const char *new_val, unsigned int min, unsigned int max,
+                                   unsigned int &value, const char *name)
+{
+    std::istringstream ss(new_val ? new_val : "");
+    long tmp_val = -1;
+    ss >> tmp_val;
+
+
+    if( ss.fail() || (tmp_val < (long)min) || (tmp_val > (long)max) )
+    {
+        std::ostringstream os;
+        os << name << " is bad, correct range: " << min << "-" << max;
+        str_err = os.str();
+        return false;
+    }
+
+
+    value = (unsigned int)tmp_val;
+    return true;
+}
+
+
+
+bool SnapshotProxy::set_ttl(const char *new_val)
+{
+    return set_uint_value(new_val, 0, 60000, ttl, "ttl");
+}
+
+
+
+bool SnapshotProxy::set_workers(const char *new_val)
+{
+    return set_uint_value(new_val, 1, 64, workers, "workers");
+}
+
+
+
+bool SnapshotProxy::set_timeout(const char *new_val)
+{
+    return set_uint_value(new_val, 10, 60000, timeout, "timeout");
+}
+
+
+
+bool SnapshotProxy::set_quality(const char *new_val)
+{
+    if( !set_uint_value(new_val, 1, 100, quality, "quality") )
+        return false;
+
+    encoder.set_quality(quality);
+    return true;
+}
+
+
+
+void SnapshotProxy::clear()
+{
+    enable  = false;
+    ttl     = 1000;
+    workers = 2;
+    timeout = 3000;
+    quality = 75;
+
+    encoder.set_quality(quality);
+
+    queue_head = 0;
+    queue_len  = 0;
+
+    requests     = 0;
+    hits         = 0;
+    coalesced    = 0;
+    fetches      = 0;
+    fetch_errors = 0;
+    rejected     = 0;
+    shm_frames   = 0;
+    shm_torn     = 0;
+    thumbnails   = 0;
+}
@@ -0,0 +1,153 @@
+#ifndef SNAPSHOT_PROXY_H
+#define SNAPSHOT_PROXY_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include <string>
+#include <vector>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <thread>
+#include <functional>
+
+#include "uri_template.h"
+#include "shm_frame_source.h"
+
+
+
+
+
+/*
+ * HTTP GET /snapshot/<profile> served by the daemon itself.
+ *
+ * The main loop accepts the request and hands the client socket to the pool
+ * of workers. Concurrent requests for the same profile are coalesced into one
+ * upstream fetch (single-flight), the JPEG is cached for ttl ms and sent from
+ * the cache buffer with one sendmsg() (header + body, no copy of the image).
+ *
+ * Profiles with a shm source (see ShmFrameSource) are served from the mapping
+ * of the encoder directly, the cache is not used for them. If the shm has no
+ * frame, the proxy falls back to the snapurl (if set).
+ *
+ * Profiles with a raw source (see RawFrameSource) can give thumbnails:
+ * /snapshot/<profile>?width=320&height=180, the frame is scaled and encoded
+ * in the daemon, the result is cached per size like upstream snapshots.
+ */
+class SnapshotProxy
+{
+public:
+    SnapshotProxy() : started(false) { clear(); }
+
+    bool enable;
+
+    // start the workers (after daemonize), they live until the process exits
+    void start(void);
+
+    // take ownership of the client socket, upstream_url is the rendered snapurl (can be empty),
+    // width/height - requested size of thumbnail (0 - not set)
+    void enqueue(int fd, const std::string &profile, const char *upstream_url, int width, int height);
+
+    // sources of the profile, must be added before start()
+    bool add_shm_source(const std::string &profile, const std::string &shm_name);
+    bool add_raw_source(const std::string &profile, const std::string &spec, int width, int height);
+
+    // send short HTTP error response and close the socket
+    static void send_error(int fd, int code);
+
+    void dump_stats(FILE *fp) const;
+
+    //methods for parsing opt from cmd
+    bool set_ttl(const char *new_val);
+    bool set_workers(const char *new_val);
+    bool set_timeout(const char *new_val);
+    bool set_quality(const char *new_val);
+
+    std::string get_str_err() const { return str_err; }
+    const char *get_cstr_err() const { return str_err.c_str(); }
+
+    void clear(void);
+
+private:
+    typedef std::shared_ptr<const std::string> Image;
+
+    struct Job
+    {
+        int         fd;
+        std::string profile;
+        char        url[URI_TEMPLATE_MAX_LEN];
+        int         width;
+        int         height;
+    };
+
+    struct CacheEntry
+    {
+        CacheEntry() : fetching(false), gen(0), last_ok(false), fetched_at(0) {}
+
+        std::mutex              mtx;
+        std::condition_variable cond;
+        bool                    fetching;
+        uint64_t                gen;        // incremented after each fetch
+        bool                    last_ok;
+        Image                   image;
+        uint64_t                fetched_at; // ms
+    };
+
+    unsigned int ttl;     // ms
+    unsigned int workers;
+    unsigned int timeout; // ms
+    unsigned int quality;
+
+    JpegEncoder encoder;
+
+    // queue of accepted clients (bounded ring)
+    static const size_t QUEUE_SIZE = 64;
+
+    std::mutex              queue_mtx;
+    std::condition_variable queue_cond;
+    std::vector<Job>        queue;
+    size_t                  queue_head;
+    size_t                  queue_len;
+    bool                    started;
+
+    static const size_t MAX_CACHE_ENTRIES = 256;
+
+    std::mutex                                         cache_mtx;
+    std::map<std::string, std::shared_ptr<CacheEntry>> cache;
+
+    // not changed after start(), read without lock
+    std::map<std::string, std::shared_ptr<ShmFrameSource>> shm_sources;
+    std::map<std::string, std::shared_ptr<RawFrameSource>> raw_sources;
+
+    // stats
+    std::atomic<uint64_t> requests;
+    std::atomic<uint64_t> hits;
+    std::atomic<uint64_t> coalesced;
+    std::atomic<uint64_t> fetches;
+    std::atomic<uint64_t> fetch_errors;
+    std::atomic<uint64_t> rejected;
+    std::atomic<uint64_t> shm_frames;
+    std::atomic<uint64_t> shm_torn;
+    std::atomic<uint64_t> thumbnails;
+
+    std::string str_err;
+
+    void worker(void);
+    void process(void *curl, Job &job);
+    bool process_shm(ShmFrameSource &shm, int fd);
+    Image get_cached(const std::string &key, const std::function<bool(std::string &)> &produce);
+    Image get_thumbnail(const RawFrameSource &raw, const Job &job);
+    std::shared_ptr<CacheEntry> get_entry(const std::string &key);
+    bool fetch(void *curl, const char *url, std::string &data) const;
+
+    bool set_uint_value(const char *new_val, unsigned int min, unsigned int max,
+                        unsigned int &value, const char *name);
+};
+
+
+
+
+
+#endif // SNAPSHOT_PROXY_H
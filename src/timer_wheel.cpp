@@ -0,0 +1,211 @@
+#include "timer_wheel.h"
+
+
+
+
+
+static const unsigned SLOT_MASK = TimerWheel::SLOTS - 1;
+static const int64_t  MAX_DELTA = ((int64_t)1 << (TimerWheel::SLOT_BITS * TimerWheel::LEVELS)) - 1;
+
+
+
+TimerWheel::TimerWheel(int64_t start_tick):
+    free_list( NO_TIMER   ),
+    now      ( start_tick ),
+    count    ( 0 )
+{
+    for( size_t i = 0; i < LEVELS * SLOTS; ++i )
+        heads[i] = NO_TIMER;
+}
+
+
+
+TimerWheel::TimerId TimerWheel::insert(int64_t tick, void *data)
+{
+    TimerId id = free_list;
+
+    if( id != NO_TIMER )
+    {
+        free_list = timers[id].next;
+    }
+    else
+    {
+        id = timers.size();
+        timers.push_back(Timer());
+    }
+
+
+    // the slot of now is processed already
+    timers[id].tick = (tick > now) ? tick : now + 1;
+    timers[id].data = data;
+
+    place(id);
+    count++;
+
+    return id;
+}
+
+
+
+void TimerWheel::cancel(TimerId id)
+{
+    if( (id >= timers.size()) || (timers[id].slot == NO_TIMER) )
+        return;
+
+
+    unlink(id);
+
+    timers[id].next = free_list;
+    free_list = id;
+    count--;
+}
+
+
+
+void TimerWheel::advance(int64_t tick, std::vector<void *> &expired)
+{
+    while( now < tick )
+    {
+        if( !count )
+        {
+            now = tick; // nothing to do on the way
+            break;
+        }
+
+
+        now++;
+
+        unsigned index = now & SLOT_MASK;
+
+        // the slots of higher levels which start at now go down
+        for( unsigned level = 1; !index && (level < LEVELS); ++level )
+        {
+            index = (now >> (SLOT_BITS * level)) & SLOT_MASK;
+            cascade(level, index);
+        }
+
+
+        TimerId id;
+
+        while( (id = heads[now & SLOT_MASK]) != NO_TIMER )
+        {
+            expired.push_back(timers[id].data);
+            cancel(id);
+        }
+    }
+}
+
+
+
+int64_t TimerWheel::get_next(int64_t max_ticks) const
+{
+    if( !count )
+        return max_ticks;
+
+
+    int64_t next = max_ticks;
+
+    for( int64_t t = now + 1; (t <= now + SLOTS) && (t - now < next); ++t )
+    {
+        if( heads[t & SLOT_MASK] != NO_TIMER )
+        {
+            next = t - now;
+            break;
+        }
+    }
+
+
+    // the slots of a level are cascaded in turn, each SLOTS^level ticks
+    for( unsigned level = 1; level < LEVELS; ++level )
+    {
+        unsigned shift = SLOT_BITS * level;
+        int64_t  t     = ((now >> shift) + 1) << shift;
+
+        for( unsigned i = 0; (i < SLOTS) && (t - now < next); ++i, t += (int64_t)1 << shift )
+        {
+            if( heads[level * SLOTS + ((t >> shift) & SLOT_MASK)] != NO_TIMER )
+            {
+                next = t - now;
+                break;
+            }
+        }
+    }
+
+    return next;
+}
+
+
+
+void TimerWheel::place(TimerId id)
+{
+    int64_t delta = timers[id].tick - now;
+
+    if( delta <= 0 )
+    {
+        // cascaded timer of now, its slot is processed after the cascade
+        link(id, now & SLOT_MASK);
+        return;
+    }
+
+    if( delta > MAX_DELTA )
+        delta = MAX_DELTA; // it is placed again on the cascade
+
+
+    int64_t  tick  = now + delta;
+    unsigned level = 0;
+
+    while( (level < LEVELS - 1) && (delta >> (SLOT_BITS * (level + 1))) )
+        level++;
+
+    link(id, level * SLOTS + ((tick >> (SLOT_BITS * level)) & SLOT_MASK));
+}
+
+
+
+void TimerWheel::link(TimerId id, uint32_t slot)
+{
+    Timer &timer = timers[id];
+
+    timer.slot = slot;
+    timer.prev = NO_TIMER;
+    timer.next = heads[slot];
+
+    if( timer.next != NO_TIMER )
+        timers[timer.next].prev = id;
+
+    heads[slot] = id;
+}
+
+
+
+void TimerWheel::unlink(TimerId id)
+{
+    Timer &timer = timers[id];
+
+    if( timer.prev != NO_TIMER )
+        timers[timer.prev].next = timer.next;
+    else
+        heads[timer.slot] = timer.next;
+
+    if( timer.next != NO_TIMER )
+        timers[timer.next].prev = timer.prev;
+
+    timer.slot = NO_TIMER;
+}
+
+
+
+void TimerWheel::cascade(unsigned level, unsigned index)
+{
+    TimerId id = heads[level * SLOTS + index];
+
+    heads[level * SLOTS + index] = NO_TIMER;
+
+    while( id != NO_TIMER )
+    {
+        TimerId next = timers[id].next;
+
+        place(id);
+        id = next;
+    }
+}
@@ -0,0 +1,76 @@
+#ifndef TIMER_WHEEL_H
+#define TIMER_WHEEL_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <vector>
+
+
+
+
+
+/*
+ * Hierarchical timer wheel: LEVELS wheels of SLOTS slots, a slot of level n
+ * holds the timers of SLOTS^n ticks. insert() and cancel() are O(1), the
+ * timers of a slot of a higher level are moved down (cascaded) when the wheel
+ * reaches the slot, so a timer is moved at most LEVELS - 1 times. A timer
+ * beyond the range of the wheel (SLOTS^LEVELS ticks) waits in the last slot
+ * and is placed again on each cascade.
+ *
+ * The timers are kept in a pool and are named by their index, so the owners
+ * of the timers can be moved (they keep the index only). The wheel is not
+ * thread safe, the owner serializes the calls.
+ */
+class TimerWheel
+{
+public:
+    typedef uint32_t TimerId;
+
+    static const TimerId  NO_TIMER  = 0xFFFFFFFF;
+    static const unsigned SLOT_BITS = 6;
+    static const unsigned SLOTS     = 1 << SLOT_BITS;
+    static const unsigned LEVELS    = 4;
+
+    explicit TimerWheel(int64_t start_tick = 0);
+
+    // timer which expires at tick (not before the next tick), data is returned by advance()
+    TimerId insert(int64_t tick, void *data);
+    void cancel(TimerId id);
+
+    // move the wheel to tick, data of the expired timers is appended to expired
+    void advance(int64_t tick, std::vector<void *> &expired);
+
+    // ticks until the wheel has work (a timer expires or a slot is cascaded),
+    // not more than max_ticks
+    int64_t get_next(int64_t max_ticks) const;
+
+    int64_t get_tick(void) const { return now; }
+    size_t  get_count(void) const { return count; }
+
+private:
+    struct Timer
+    {
+        int64_t  tick;
+        void    *data;
+        TimerId  prev;  // in the slot (NO_TIMER - head), next free in the pool
+        TimerId  next;
+        uint32_t slot;  // index in heads, NO_TIMER - free
+    };
+
+    std::vector<Timer> timers; // pool
+    TimerId            free_list;
+    TimerId            heads[LEVELS * SLOTS];
+    int64_t            now;    // last processed tick
+    size_t             count;
+
+    void place(TimerId id);
+    void link(TimerId id, uint32_t slot);
+    void unlink(TimerId id);
+    void cascade(unsigned level, unsigned index);
+};
+
+
+
+
+
+#endif // TIMER_WHEEL_H
@@ -0,0 +1,218 @@
+#include <errno.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <openssl/ssl.h>
+
+#include <sstream>
+
+#include "tls_listener.h"
+
+
+
+
+
+static const char session_id_context[] = "onvif_srvd";
+
+
+
+static uint64_t now_us(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return (uint64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+
+
+TlsListener::TlsListener():
+    port      ( 0 ),
+    fd        ( -1 ),
+    ktls      ( false ),
+    full      ( 0 ),
+    resumed   ( 0 ),
+    failed    ( 0 ),
+    ktls_send ( 0 ),
+    full_us   ( 0 ),
+    resumed_us( 0 )
+{
+}
+
+
+
+bool TlsListener::set_port(const char *new_val)
+{
+    std::istringstream ss(new_val ? new_val : "");
+    long tmp_val = -1;
+    ss >> tmp_val;
+
+    if( ss.fail() || (tmp_val < 1) || (tmp_val > 65535) )
+    {
+        str_err = "port is bad, correct range: 1-65535";
+        return false;
+    }
+
+
+    port = (int)tmp_val;
+    return true;
+}
+
+
+
+bool TlsListener::set_cert(const char *new_val)
+{
+    if( !new_val || !new_val[0] )
+    {
+        str_err = "file name is empty";
+        return false;
+    }
+
+
+    cert = new_val;
+    return true;
+}
+
+
+
+bool TlsListener::open(struct soap *soap)
+{
+    if( cert.empty() )
+    {
+        str_err = "certificate is not set (see opt tls_cert)";
+        return false;
+    }
+
+
+    soap_ssl_init();
+
+    if( soap_ssl_server_context(soap, SOAP_SSL_DEFAULT, cert.c_str(), NULL, NULL, NULL, NULL, NULL,
+                                session_id_context) )
+    {
+        str_err = "can't load the key and the certificate: " + cert;
+        return false;
+    }
+
+
+    SSL_CTX *ctx = soap->ctx;
+
+    SSL_CTX_set_min_proto_version(ctx, TLS1_2_VERSION);
+
+    // a reconnecting client resumes its session by the id (cache) or by the ticket
+    SSL_CTX_set_session_cache_mode(ctx, SSL_SESS_CACHE_SERVER);
+    SSL_CTX_sess_set_cache_size(ctx, SESSIONS);
+    SSL_CTX_set_timeout(ctx, SESSION_TIMEOUT);
+    SSL_CTX_clear_options(ctx, SSL_OP_NO_TICKET);
+
+#ifdef SSL_OP_ENABLE_KTLS
+    if( ktls )
+        SSL_CTX_set_options(ctx, SSL_OP_ENABLE_KTLS); // OpenSSL falls back if the kernel can't do it
+#endif
+
+
+    fd = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if( fd < 0 )
+    {
+        str_err = "can't create socket";
+        return false;
+    }
+
+    int on = 1;
+    setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+
+
+    struct sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family      = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_ANY);
+    addr.sin_port        = htons(port);
+
+    if( (bind(fd, (struct sockaddr *)&addr, sizeof(addr)) != 0) || (listen(fd, 10) != 0) )
+    {
+        str_err = std::string("can't listen on the port: ") + strerror(errno);
+        close();
+        return false;
+    }
+
+
+    return true;
+}
+
+
+
+void TlsListener::close()
+{
+    if( fd >= 0 )
+    {
+        ::close(fd);
+        fd = -1;
+    }
+}
+
+
+
+bool TlsListener::accept(struct soap *soap)
+{
+    // gSOAP accepts on its master socket, it is the socket of HTTPS for a moment
+    SOAP_SOCKET master = soap->master;
+
+    soap->master = fd;
+    SOAP_SOCKET sock = soap_accept(soap);
+    soap->master = master;
+
+    return soap_valid_socket(sock);
+}
+
+
+
+bool TlsListener::handshake(struct soap *soap)
+{
+    uint64_t start = now_us();
+
+    if( soap_ssl_accept(soap) )
+    {
+        failed++;
+        return false;
+    }
+
+
+    uint64_t time_us = now_us() - start;
+
+    if( SSL_session_reused(soap->ssl) )
+    {
+        resumed++;
+        resumed_us += time_us;
+    }
+    else
+    {
+        full++;
+        full_us += time_us;
+    }
+
+#ifdef BIO_get_ktls_send
+    if( BIO_get_ktls_send(SSL_get_wbio(soap->ssl)) )
+        ktls_send++;
+#endif
+
+
+    return true;
+}
+
+
+
+void TlsListener::dump_stats(FILE *fp) const
+{
+    uint64_t handshakes = full + resumed;
+
+    fprintf(fp, "TLS: handshakes %llu  full %llu (%llu us)  resumed %llu (%llu us, %llu%%)  failed %llu  kTLS %llu\n",
+            (unsigned long long)handshakes,
+            (unsigned long long)full,
+            (unsigned long long)(full ? full_us / full : 0),
+            (unsigned long long)resumed,
+            (unsigned long long)(resumed ? resumed_us / resumed : 0),
+            (unsigned long long)(handshakes ? resumed * 100 / handshakes : 0),
+            (unsigned long long)failed,
+            (unsigned long long)ktls_send);
+}
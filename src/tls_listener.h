@@ -0,0 +1,85 @@
+#ifndef TLS_LISTENER_H
+#define TLS_LISTENER_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include <string>
+
+#include "soapH.h"
+
+
+
+
+
+/*
+ * HTTPS listener of the services, next to the HTTP one (WITH_OPENSSL only).
+ *
+ * The main loop polls the socket of the listener and accepts the clients on
+ * the same gSOAP context as the HTTP clients, the TLS handshake is done by
+ * soap_ssl_accept() with the SSL_CTX of the context (TLS 1.2 or newer).
+ *
+ * A full handshake costs much more than a request, so the sessions can be
+ * resumed: the server session cache (SESSIONS for SESSION_TIMEOUT) and the
+ * session tickets let a VMS which reconnects skip the key exchange. With
+ * ktls the records are encrypted by the kernel (if the kernel and OpenSSL
+ * support it, else OpenSSL does it), SSL_write() passes the serialized
+ * response to the socket without the user space encryption buffer.
+ */
+class TlsListener
+{
+public:
+    TlsListener();
+    ~TlsListener() { close(); }
+
+    static const long   SESSIONS        = 1024;
+    static const long   SESSION_TIMEOUT = 3600; // sec
+
+    bool enabled(void) const { return port != 0; }
+
+    int  get_port(void) const { return port; }
+    int  get_fd(void)   const { return fd; }
+
+    // binds the socket and creates the SSL_CTX of soap (the context of the services)
+    bool open(struct soap *soap);
+    void close(void);
+
+    // accept the client, soap must have no connection (closed or parked)
+    bool accept(struct soap *soap);
+
+    // TLS handshake of the accepted client (the main loop checks the rate limit before it)
+    bool handshake(struct soap *soap);
+
+    void dump_stats(FILE *fp) const;
+
+    //methods for parsing opt from cmd
+    bool set_port(const char *new_val);
+    bool set_cert(const char *new_val);
+    void set_ktls(bool new_val) { ktls = new_val; }
+
+    std::string get_str_err() const { return str_err; }
+    const char *get_cstr_err() const { return str_err.c_str(); }
+
+private:
+    int         port;
+    int         fd;
+    std::string cert;  // PEM: the key and the certificate chain
+    bool        ktls;
+
+    uint64_t full;
+    uint64_t resumed;
+    uint64_t failed;
+    uint64_t ktls_send;   // connections with kTLS TX
+    uint64_t full_us;     // time of the handshakes
+    uint64_t resumed_us;
+
+    std::string str_err;
+
+    TlsListener(const TlsListener &);
+    TlsListener &operator=(const TlsListener &);
+};
+
+
+
+
+
+#endif // TLS_LISTENER_H
@@ -0,0 +1,259 @@
+#include <ctype.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "uri_template.h"
+
+
+
+
+
+UriTemplateArgs::UriTemplateArgs() :
+    server_ip    ( NULL  ),
+    client_ip    ( NULL  ),
+    profile      ( NULL  ),
+    preset       ( NULL  ),
+    port         ( 0     ),
+    x            ( 0     ),
+    y            ( 0     ),
+    z            ( 0     ),
+    speed        ( 0     ),
+    only_pan_tilt( false ),
+    only_zoom    ( false )
+{
+}
+
+
+
+void UriTemplate::add_segment(Field field, size_t offset, size_t len)
+{
+    if( (field == LITERAL) && !len )
+        return;
+
+
+    // merge neighboring literals (%% gives a literal of one char)
+    if( (field == LITERAL) && !segments.empty() && (segments.back().field == LITERAL) &&
+        (segments.back().offset + segments.back().len == offset) )
+    {
+        segments.back().len += len;
+        return;
+    }
+
+
+    Segment seg;
+    seg.field  = field;
+    seg.offset = offset;
+    seg.len    = len;
+
+    segments.push_back(seg);
+    fields_mask |= (1u << field);
+}
+
+
+
+bool UriTemplate::compile(const char *new_src)
+{
+    clear();
+
+    if( !new_src )
+        return false;
+
+
+    src = new_src;
+
+
+    size_t lit_start = 0;
+    size_t i         = 0;
+
+    while( i < src.size() )
+    {
+        if( (src[i] != '%') || (i + 1 >= src.size()) )
+        {
+            ++i;
+            continue;
+        }
+
+
+        Field field;
+
+        switch( src[i + 1] )
+        {
+            case 's': field = SERVER_IP;     break;
+            case 'i': field = CLIENT_IP;     break;
+            case 'p': field = PORT;          break;
+            case 'n': field = PROFILE;       break;
+            case 't': field = PRESET;        break;
+            case 'x': field = X;             break;
+            case 'y': field = Y;             break;
+            case 'z': field = Z;             break;
+            case 'v': field = SPEED;         break;
+            case 'P': field = ONLY_PAN_TILT; break;
+            case 'Z': field = ONLY_ZOOM;     break;
+
+            case '%':
+                add_segment(LITERAL, lit_start, i + 1 - lit_start); // keep one '%'
+                i        += 2;
+                lit_start = i;
+                continue;
+
+            default:
+                ++i; // not a placeholder (URL-encoded char), keep as is
+                continue;
+        }
+
+
+        add_segment(LITERAL, lit_start, i - lit_start);
+        add_segment(field, 0, 0);
+
+        i        += 2;
+        lit_start = i;
+    }
+
+
+    add_segment(LITERAL, lit_start, src.size() - lit_start);
+
+    return true;
+}
+
+
+
+void UriTemplate::clear()
+{
+    src.clear();
+    segments.clear();
+    fields_mask = 0;
+}
+
+
+
+static inline int put_str(char *buf, size_t size, size_t pos, const char *str, size_t len)
+{
+    if( pos + len >= size )
+        return -1;
+
+    memcpy(buf + pos, str, len);
+    return (int)len;
+}
+
+
+
+static inline int put_fmt(char *buf, size_t size, size_t pos, const char *fmt, double val)
+{
+    int len = snprintf(buf + pos, size - pos, fmt, val);
+
+    if( (len < 0) || (pos + len >= size) )
+        return -1;
+
+    return len;
+}
+
+
+
+static inline int put_cstr(char *buf, size_t size, size_t pos, const char *str)
+{
+    if( !str )
+        return 0;
+
+    return put_str(buf, size, pos, str, strlen(str));
+}
+
+
+
+// percent-encoding of all chars except unreserved ones (RFC 3986), the tokens
+// are set by clients and can contain '/', '?', '&', ' ' ...
+static inline int put_enc(char *buf, size_t size, size_t pos, const char *str)
+{
+    static const char hex[] = "0123456789ABCDEF";
+
+    if( !str )
+        return 0;
+
+
+    size_t start = pos;
+
+    for(; *str; ++str)
+    {
+        unsigned char c = *str;
+
+        if( isalnum(c) || (c == '-') || (c == '.') || (c == '_') || (c == '~') )
+        {
+            if( pos + 1 >= size )
+                return -1;
+
+            buf[pos++] = c;
+        }
+        else
+        {
+            if( pos + 3 >= size )
+                return -1;
+
+            buf[pos++] = '%';
+            buf[pos++] = hex[c >> 4];
+            buf[pos++] = hex[c & 0x0F];
+        }
+    }
+
+
+    return (int)(pos - start);
+}
+
+
+
+static inline const char *bool_str(bool val)
+{
+    return val ? "true" : "false";
+}
+
+
+
+int UriTemplate::render(char *buf, size_t size, const UriTemplateArgs &args) const
+{
+    if( !buf || !size )
+        return -1;
+
+
+    size_t pos = 0;
+
+    for(size_t i = 0; i < segments.size(); ++i)
+    {
+        const Segment &seg = segments[i];
+        int            len = 0;
+
+        switch( seg.field )
+        {
+            case LITERAL:
+                len = put_str(buf, size, pos, src.data() + seg.offset, seg.len);
+                break;
+
+            case SERVER_IP:     len = put_cstr(buf, size, pos, args.server_ip);               break;
+            case CLIENT_IP:     len = put_cstr(buf, size, pos, args.client_ip);               break;
+            case PROFILE:       len = put_enc (buf, size, pos, args.profile);                 break;
+            case PRESET:        len = put_enc (buf, size, pos, args.preset);                  break;
+            case ONLY_PAN_TILT: len = put_cstr(buf, size, pos, bool_str(args.only_pan_tilt)); break;
+            case ONLY_ZOOM:     len = put_cstr(buf, size, pos, bool_str(args.only_zoom));     break;
+
+            case PORT:  len = put_fmt(buf, size, pos, "%.0f", args.port);  break;
+            case X:     len = put_fmt(buf, size, pos, "%f",   args.x);     break;
+            case Y:     len = put_fmt(buf, size, pos, "%f",   args.y);     break;
+            case Z:     len = put_fmt(buf, size, pos, "%f",   args.z);     break;
+            case SPEED: len = put_fmt(buf, size, pos, "%f",   args.speed); break;
+
+            default:
+                break;
+        }
+
+
+        if( len < 0 )
+        {
+            buf[0] = '\0';
+            return -1;
+        }
+
+        pos += len;
+    }
+
+
+    buf[pos] = '\0';
+
+    return (int)pos;
+}
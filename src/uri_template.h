@@ -0,0 +1,109 @@
+#ifndef URI_TEMPLATE_H
+#define URI_TEMPLATE_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+
+
+
+
+// Max length of rendered URI (with '\0'), for buffers on the stack
+#define URI_TEMPLATE_MAX_LEN  1024
+
+
+
+/*
+ * Values for the placeholders of the URI template.
+ * Strings that are NULL are rendered as empty.
+ */
+struct UriTemplateArgs
+{
+    UriTemplateArgs();
+
+    const char *server_ip;
+    const char *client_ip;
+    const char *profile;
+    const char *preset;
+    int         port;
+    float       x;
+    float       y;
+    float       z;
+    float       speed;
+    bool        only_pan_tilt;
+    bool        only_zoom;
+};
+
+
+
+/*
+ * URI template compiled once (at startup) into literal and placeholder
+ * segments. Rendering writes into a caller buffer and does not allocate.
+ *
+ * Placeholders:
+ *   %s - IP of the server interface (for the client)
+ *   %i - IP of the client
+ *   %p - port of the ONVIF services
+ *   %n - profile token (percent-encoded)
+ *   %t - preset token  (percent-encoded)
+ *   %x %y %z - PTZ vector
+ *   %v - PTZ speed
+ *   %P - onlySendPanTilt (true|false)
+ *   %Z - onlySendZoom    (true|false)
+ *   %% - '%'
+ *
+ * Any other '%' sequence (for example URL-encoded %2F) is kept as is.
+ */
+class UriTemplate
+{
+public:
+    UriTemplate() : fields_mask(0) {}
+
+    enum Field
+    {
+        LITERAL,
+        SERVER_IP,
+        CLIENT_IP,
+        PORT,
+        PROFILE,
+        PRESET,
+        X,
+        Y,
+        Z,
+        SPEED,
+        ONLY_PAN_TILT,
+        ONLY_ZOOM
+    };
+
+    bool compile(const char *new_src);
+    void clear(void);
+
+    bool empty(void) const { return src.empty(); }
+    bool has_field(Field field) const { return fields_mask & (1u << field); }
+    const std::string &get_src(void) const { return src; }
+
+    // returns length of URI (without '\0') or -1 if the buffer is too small
+    int render(char *buf, size_t size, const UriTemplateArgs &args) const;
+
+private:
+    struct Segment
+    {
+        uint32_t field;
+        uint32_t offset; // for LITERAL, offset in src
+        uint32_t len;
+    };
+
+    std::string          src;
+    std::vector<Segment> segments;
+    uint32_t             fields_mask;
+
+    void add_segment(Field field, size_t offset, size_t len);
+};
+
+
+
+
+
+#endif // URI_TEMPLATE_H
@@ -0,0 +1,442 @@
+#include <ctype.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <openssl/crypto.h>
+#include <openssl/evp.h>
+#include <openssl/rand.h>
+
+#include <fstream>
+
+#include "user_store.h"
+#include "http_digest.h"
+#include "wsse_auth.h"
+#include "smacros.h"
+
+
+
+
+
+static const size_t IV_LEN  = 12;
+static const size_t TAG_LEN = 16;
+
+static const char *level_names[] = { "Administrator", "Operator", "User" };
+
+
+
+bool UserStore::set_file(const char *new_val)
+{
+    if( !new_val || !new_val[0] )
+    {
+        str_err = "file name is empty";
+        return false;
+    }
+
+
+    file = new_val;
+    return true;
+}
+
+
+
+void UserStore::set_password(User &user, const std::string &password)
+{
+    user.password   = password;
+    user.ha1_md5    = HttpDigest::get_ha1(HttpDigest::MD5,    user.name, password);
+    user.ha1_sha256 = HttpDigest::get_ha1(HttpDigest::SHA256, user.name, password);
+}
+
+
+
+// the name is written as is but '%' and the control chars (%XX), a name with
+// '\n' would break the record
+static std::string escape_name(const std::string &name)
+{
+    static const char hex[] = "0123456789ABCDEF";
+
+    std::string out;
+
+    for( size_t i = 0; i < name.size(); ++i )
+    {
+        unsigned char c = name[i];
+
+        if( (c < 0x20) || (c == 0x7F) || (c == '%') )
+        {
+            out += '%';
+            out += hex[c >> 4];
+            out += hex[c & 0x0F];
+        }
+        else
+        {
+            out += c;
+        }
+    }
+
+    return out;
+}
+
+
+
+static std::string unescape_name(const std::string &str)
+{
+    std::string out;
+
+    for( size_t i = 0; i < str.size(); ++i )
+    {
+        if( (str[i] == '%') && (i + 2 < str.size()) && isxdigit((unsigned char)str[i + 1]) &&
+            isxdigit((unsigned char)str[i + 2]) )
+        {
+            out += (char)strtol(str.substr(i + 1, 2).c_str(), NULL, 16);
+            i   += 2;
+        }
+        else
+        {
+            out += str[i];
+        }
+    }
+
+    return out;
+}
+
+
+
+bool UserStore::load()
+{
+    if( file.empty() )
+        return true;
+
+    if( !load_key() )
+        return false;
+
+
+    std::ifstream in(file.c_str());
+    if( !in.is_open() )
+    {
+        if( errno == ENOENT )
+            return true; // nothing was created yet
+
+        str_err = "can't open users file: " + file;
+        return false;
+    }
+
+
+    std::shared_ptr<UserMap> map = std::make_shared<UserMap>();
+    User       *user = NULL;
+    bool        skip = false; // lines of the bad record up to the next one
+    size_t      records = 0;
+    std::string line;
+    int         line_num = 0;
+
+    // a bad record is skipped (the others are loaded), the daemon must start
+    auto skip_record = [&](const char *reason)
+    {
+        DEBUG_MSG("%s:%d: %s, the user is skipped\n", file.c_str(), line_num, reason);
+        UNUSED(reason);
+
+        if( user )
+            map->erase(user->name);
+
+        user = NULL;
+        skip = true;
+    };
+
+    while( std::getline(in, line) )
+    {
+        line_num++;
+
+        if( line.empty() || (line[0] == '#') )
+            continue;
+
+
+        size_t      eq    = line.find('=');
+        std::string key   = line.substr(0, eq);
+        std::string value = (eq != std::string::npos) ? line.substr(eq + 1) : std::string();
+
+        if( (eq != std::string::npos) && (key == "user") )
+        {
+            records++;
+            skip = false;
+            user = NULL;
+
+            std::string name = unescape_name(value);
+
+            if( name.empty() || (name.size() > MAX_NAME_LEN) || map->count(name) )
+            {
+                skip_record("wrong name");
+                continue;
+            }
+
+            user = &(*map)[name];
+            user->name = name;
+            continue;
+        }
+
+
+        if( skip )
+            continue;
+
+        if( eq == std::string::npos )
+        {
+            skip_record("wrong line");
+            continue;
+        }
+
+        if( !user )
+        {
+            skip_record("parameter out of user");
+            continue;
+        }
+
+
+        if( key == "level" )
+        {
+            size_t i = 0;
+            while( (i < COUNT_ELEMENTS(level_names)) && (value != level_names[i]) )
+                i++;
+
+            if( i == COUNT_ELEMENTS(level_names) )
+            {
+                skip_record("unknown level");
+                continue;
+            }
+
+            user->level = (UserLevel)i;
+        }
+        else if( key == "password" )
+        {
+            std::string password;
+
+            if( !decrypt(user->name, value, password) )
+            {
+                skip_record("can't decrypt password");
+                continue;
+            }
+
+            set_password(*user, password);
+        }
+        else
+        {
+            skip_record("unknown parameter");
+        }
+    }
+
+
+    // no user at all is the wrong key, not bad records: the file is not overwritten
+    if( records && map->empty() )
+    {
+        str_err = "can't load any user of " + file + " (wrong key?)";
+        return false;
+    }
+
+
+    std::atomic_store(&users, UserMapPtr(map));
+    return true;
+}
+
+
+
+bool UserStore::update(const std::function<bool(UserMap &)> &fn)
+{
+    std::lock_guard<std::mutex> lock(mtx);
+
+    std::shared_ptr<UserMap> next = std::make_shared<UserMap>(*get_users());
+
+    if( !fn(*next) )
+        return false;
+
+    if( !file.empty() && !write(*next) )
+    {
+        str_err = "can't write users file: " + file;
+        return false;
+    }
+
+
+    // readers keep the old set while they hold it, the new one is published at once
+    std::atomic_store(&users, UserMapPtr(next));
+    return true;
+}
+
+
+
+bool UserStore::load_key()
+{
+    std::string key_file = file + ".key";
+
+    int fd = open(key_file.c_str(), O_RDONLY | O_CLOEXEC);
+    if( fd >= 0 )
+    {
+        ssize_t len = read(fd, key, sizeof(key));
+        close(fd);
+
+        if( len != (ssize_t)sizeof(key) )
+        {
+            str_err = "wrong key file: " + key_file;
+            return false;
+        }
+
+        return true;
+    }
+
+
+    if( errno != ENOENT )
+    {
+        str_err = "can't open key file: " + key_file;
+        return false;
+    }
+
+
+    // the first start, only the daemon can read the key
+    if( RAND_bytes(key, sizeof(key)) != 1 )
+    {
+        str_err = "can't make key";
+        return false;
+    }
+
+    fd = open(key_file.c_str(), O_WRONLY | O_CREAT | O_EXCL | O_CLOEXEC, 0600);
+    if( fd < 0 )
+    {
+        str_err = "can't create key file: " + key_file;
+        return false;
+    }
+
+    bool ok = (::write(fd, key, sizeof(key)) == (ssize_t)sizeof(key)) && (fsync(fd) == 0);
+    ok = (close(fd) == 0) && ok;
+
+    if( !ok )
+    {
+        unlink(key_file.c_str());
+        str_err = "can't write key file: " + key_file;
+        return false;
+    }
+
+
+    return true;
+}
+
+
+
+bool UserStore::write(const UserMap &map)
+{
+    std::string tmp_file = file + ".tmp";
+
+    int fd = open(tmp_file.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0600);
+    if( fd < 0 )
+        return false;
+
+    FILE *fp = fdopen(fd, "w");
+    if( !fp )
+    {
+        close(fd);
+        unlink(tmp_file.c_str());
+        return false;
+    }
+
+
+    bool ok = true;
+
+    fprintf(fp, "# users of the services, written by onvif_srvd (passwords are encrypted with the key of %s.key)\n",
+            file.c_str());
+
+    for( auto it = map.cbegin(); ok && (it != map.cend()); ++it )
+    {
+        const User &user = it->second;
+        std::string password;
+
+        ok = encrypt(user, password);
+
+        fprintf(fp, "\nuser=%s\n", escape_name(user.name).c_str());
+        fprintf(fp, "level=%s\n", level_names[user.level]);
+        fprintf(fp, "password=%s\n", password.c_str());
+    }
+
+
+    ok = ok && (fflush(fp) == 0) && (fsync(fileno(fp)) == 0);
+    ok = (fclose(fp) == 0) && ok;
+
+    if( !ok || (rename(tmp_file.c_str(), file.c_str()) != 0) )
+    {
+        unlink(tmp_file.c_str());
+        return false;
+    }
+
+
+    return true;
+}
+
+
+
+// Base64( IV | ciphertext | tag )
+bool UserStore::encrypt(const User &user, std::string &out) const
+{
+    unsigned char buf[IV_LEN + MAX_PASSWORD_LEN + TAG_LEN];
+    unsigned char b64[2 * sizeof(buf)];
+    int           len, final_len;
+
+    if( (user.password.size() > MAX_PASSWORD_LEN) || (RAND_bytes(buf, IV_LEN) != 1) )
+        return false;
+
+
+    EVP_CIPHER_CTX *ctx = EVP_CIPHER_CTX_new();
+    if( !ctx )
+        return false;
+
+    bool ok = EVP_EncryptInit_ex(ctx, EVP_aes_256_gcm(), NULL, NULL, NULL) &&
+              EVP_CIPHER_CTX_ctrl(ctx, EVP_CTRL_GCM_SET_IVLEN, IV_LEN, NULL) &&
+              EVP_EncryptInit_ex(ctx, NULL, NULL, key, buf) &&
+              EVP_EncryptUpdate(ctx, NULL, &len, (const unsigned char *)user.name.data(), user.name.size()) &&
+              EVP_EncryptUpdate(ctx, buf + IV_LEN, &len, (const unsigned char *)user.password.data(),
+                                user.password.size()) &&
+              EVP_EncryptFinal_ex(ctx, buf + IV_LEN + len, &final_len) &&
+              EVP_CIPHER_CTX_ctrl(ctx, EVP_CTRL_GCM_GET_TAG, TAG_LEN, buf + IV_LEN + len + final_len);
+
+    EVP_CIPHER_CTX_free(ctx);
+
+    if( !ok )
+        return false;
+
+
+    EVP_EncodeBlock(b64, buf, IV_LEN + len + final_len + TAG_LEN);
+    out = (const char *)b64;
+
+    return true;
+}
+
+
+
+bool UserStore::decrypt(const std::string &name, const std::string &in, std::string &password) const
+{
+    uint8_t       buf[IV_LEN + MAX_PASSWORD_LEN + TAG_LEN];
+    unsigned char plain[MAX_PASSWORD_LEN + 1];
+    int           buf_len = decode_base64(in.c_str(), buf, sizeof(buf));
+    int           len, final_len;
+
+    if( buf_len < (int)(IV_LEN + TAG_LEN) )
+        return false;
+
+
+    EVP_CIPHER_CTX *ctx = EVP_CIPHER_CTX_new();
+    if( !ctx )
+        return false;
+
+    bool ok = EVP_DecryptInit_ex(ctx, EVP_aes_256_gcm(), NULL, NULL, NULL) &&
+              EVP_CIPHER_CTX_ctrl(ctx, EVP_CTRL_GCM_SET_IVLEN, IV_LEN, NULL) &&
+              EVP_DecryptInit_ex(ctx, NULL, NULL, key, buf) &&
+              EVP_DecryptUpdate(ctx, NULL, &len, (const unsigned char *)name.data(), name.size()) &&
+              EVP_DecryptUpdate(ctx, plain, &len, buf + IV_LEN, buf_len - IV_LEN - TAG_LEN) &&
+              EVP_CIPHER_CTX_ctrl(ctx, EVP_CTRL_GCM_SET_TAG, TAG_LEN, buf + buf_len - TAG_LEN) &&
+              (EVP_DecryptFinal_ex(ctx, plain + len, &final_len) > 0);  // checks the tag
+
+    EVP_CIPHER_CTX_free(ctx);
+
+    if( !ok )
+        return false;
+
+
+    password.assign((const char *)plain, len + final_len);
+    OPENSSL_cleanse(plain, sizeof(plain));
+
+    return true;
+}
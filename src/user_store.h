@@ -0,0 +1,97 @@
+#ifndef USER_STORE_H
+#define USER_STORE_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <functional>
+
+#include "access_policy.h"
+
+
+
+
+
+// user of the services, the keys of HTTP Digest are derived once (on change)
+struct User
+{
+    User() : level(USER_LEVEL_USER) {}
+
+    std::string name;
+    UserLevel   level;
+    std::string password;      // UsernameToken needs it as is
+    std::string ha1_md5;       // HTTP Digest H(name:realm:password), hex
+    std::string ha1_sha256;
+};
+
+typedef std::map<std::string, User> UserMap;
+typedef std::shared_ptr<const UserMap> UserMapPtr;
+
+
+
+/*
+ * Users of the services (GetUsers, CreateUsers, ...).
+ *
+ * The set of users is never changed: a change builds new set and publishes it
+ * at once, the readers keep the old set while they hold it (like profiles).
+ *
+ * The users are kept in a file (if it is set), the passwords are encrypted
+ * there (AES-256-GCM, the name is the associated data) with the key of the
+ * file <file>.key (32 random bytes, it is created on the first start). Digest
+ * authentication needs the passwords (or H(A1)) and the hashes would be
+ * equivalent of the passwords, so they are encrypted, not hashed. The file is
+ * written (tmp file + rename) before a change is published, a change which
+ * can't be saved is not made. The names are written with '%' and the control
+ * chars escaped (%XX); a bad record is skipped by load(), it fails only if no
+ * record can be read (wrong key).
+ */
+class UserStore
+{
+public:
+    UserStore() : users(std::make_shared<UserMap>()) {}
+
+    static const size_t MAX_USERS        = 32;
+    static const size_t MAX_NAME_LEN     = 32;
+    static const size_t MAX_PASSWORD_LEN = 64;
+
+    bool enabled(void) const { return !file.empty(); }
+
+    // read the key and the file, missing file is not an error
+    bool load(void);
+
+    UserMapPtr get_users(void) const { return std::atomic_load(&users); }
+
+    // fn changes the copy of the set (it returns false to cancel)
+    bool update(const std::function<bool(UserMap &)> &fn);
+
+    // set password and the derived keys
+    static void set_password(User &user, const std::string &password);
+
+    //methods for parsing opt from cmd
+    bool set_file(const char *new_val);
+
+    std::string get_str_err() const { return str_err; }
+    const char *get_cstr_err() const { return str_err.c_str(); }
+
+private:
+    std::string   file;
+    unsigned char key[32];
+    UserMapPtr    users;
+    std::mutex    mtx;   // writers only
+
+    std::string str_err;
+
+    bool load_key(void);
+    bool write(const UserMap &map);
+    bool encrypt(const User &user, std::string &out) const;
+    bool decrypt(const std::string &name, const std::string &in, std::string &password) const;
+};
+
+
+
+
+
+#endif // USER_STORE_H
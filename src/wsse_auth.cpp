@@ -0,0 +1,288 @@
+#include <ctype.h>
+#include <string.h>
+#include <openssl/crypto.h>
+#include <openssl/sha.h>
+
+#include "wsse_auth.h"
+
+
+
+
+
+static const size_t MAX_NONCE    = 64;   // bytes of the decoded nonce
+static const size_t MAX_CREATED  = 64;
+static const size_t MAX_PASSWORD = 256;
+
+
+
+static uint64_t fnv1a(uint64_t hash, const void *data, size_t len)
+{
+    const uint8_t *p = (const uint8_t *)data;
+
+    for( size_t i = 0; i < len; ++i )
+    {
+        hash ^= p[i];
+        hash *= 0x100000001B3ULL;
+    }
+
+    return hash;
+}
+
+
+
+static bool ends_with(const char *str, const char *suffix)
+{
+    size_t len        = strlen(str);
+    size_t suffix_len = strlen(suffix);
+
+    return (len >= suffix_len) && !strcmp(str + len - suffix_len, suffix);
+}
+
+
+
+WsseAuth::Result WsseAuth::verify(const char *username, const char *password_type, const char *digest,
+                                  const char *nonce, const char *created,
+                                  const UserMap &users, const User *session, const User *&user)
+{
+    if( !username || !digest || !nonce || !created )
+    {
+        failed++;
+        return NO_TOKEN;
+    }
+
+
+    // Type is optional, the default is PasswordText
+    if( !password_type || !ends_with(password_type, "#PasswordDigest") )
+    {
+        failed++;
+        return UNSUPPORTED;
+    }
+
+
+    time_t created_time = parse_xsd_datetime(created);
+    time_t now          = time(NULL);
+
+    if( (created_time == -1) || (created_time < now - nonces.get_window()) ||
+        (created_time > now + nonces.get_window()) )
+    {
+        stale++;
+        return STALE;
+    }
+
+
+    const User *found = (session && (session->name == username)) ? session : NULL;
+
+    if( !found )
+    {
+        UserMap::const_iterator it = users.find(username);
+        if( it == users.end() )
+        {
+            failed++;
+            return NOT_AUTHORIZED;
+        }
+
+        found = &it->second;
+    }
+
+
+    const std::string &password = found->password;
+
+    uint8_t buf[MAX_NONCE + MAX_CREATED + MAX_PASSWORD];
+    uint8_t expected[SHA_DIGEST_LENGTH];
+    uint8_t received[SHA_DIGEST_LENGTH + 3]; // Base64 is decoded by 3 bytes
+    size_t  created_len = strlen(created);
+    int     nonce_len   = decode_base64(nonce, buf, MAX_NONCE);
+
+    if( (nonce_len <= 0) || (created_len > MAX_CREATED) || (password.size() > MAX_PASSWORD) ||
+        (decode_base64(digest, received, sizeof(received)) != SHA_DIGEST_LENGTH) )
+    {
+        failed++;
+        return NOT_AUTHORIZED;
+    }
+
+
+    size_t len = nonce_len;
+
+    memcpy(buf + len, created, created_len);
+    len += created_len;
+    memcpy(buf + len, password.data(), password.size());
+    len += password.size();
+
+    // the digest is checked always (the password is at the end, so there is no
+    // state of SHA-1 to keep), the session only saves the lookup of the user
+    SHA1(buf, len, expected);
+
+    if( CRYPTO_memcmp(expected, received, SHA_DIGEST_LENGTH) )
+    {
+        failed++;
+        return NOT_AUTHORIZED;
+    }
+
+
+    uint64_t hash = fnv1a(0xCBF29CE484222325ULL, buf, nonce_len + created_len);
+    hash = fnv1a(hash, username, strlen(username));
+
+    switch( nonces.insert(hash, created_time, now) )
+    {
+        case NonceCache::FRESH:
+            user = found;
+            verified++;
+            return OK;
+
+        case NonceCache::REPLAYED:
+            replayed++;
+            return REPLAYED;
+
+        case NonceCache::STALE:
+            stale++;
+            return STALE;
+
+        default:
+            failed++;
+            return BUSY;
+    }
+}
+
+
+
+const char *WsseAuth::get_result_str(Result result)
+{
+    switch( result )
+    {
+        case OK:             return "OK";
+        case NO_TOKEN:       return "no UsernameToken";
+        case UNSUPPORTED:    return "only PasswordDigest is supported";
+        case NOT_AUTHORIZED: return "wrong user or password";
+        case STALE:          return "Created is out of the time window";
+        case REPLAYED:       return "Nonce was used already";
+        case BUSY:           return "too many requests";
+    }
+
+    return "";
+}
+
+
+
+void WsseAuth::dump_stats(FILE *fp) const
+{
+    fprintf(fp, "WS-Security: verified %llu  failed %llu  replayed %llu  stale %llu  nonces %zu\n",
+            (unsigned long long)verified,
+            (unsigned long long)failed,
+            (unsigned long long)replayed,
+            (unsigned long long)stale,
+            nonces.get_count());
+}
+
+
+
+static bool get_number(const char *&str, int digits, int &val)
+{
+    val = 0;
+
+    for( int i = 0; i < digits; ++i, ++str )
+    {
+        if( !isdigit((unsigned char)*str) )
+            return false;
+
+        val = val * 10 + (*str - '0');
+    }
+
+    return true;
+}
+
+
+
+time_t parse_xsd_datetime(const char *str)
+{
+    struct tm tm;
+    int       offset = 0; // sec
+    int       year, mon;
+
+    memset(&tm, 0, sizeof(tm));
+
+    if( !get_number(str, 4, year)       || (*str++ != '-') ||
+        !get_number(str, 2, mon)        || (*str++ != '-') ||
+        !get_number(str, 2, tm.tm_mday) || (*str++ != 'T') ||
+        !get_number(str, 2, tm.tm_hour) || (*str++ != ':') ||
+        !get_number(str, 2, tm.tm_min)  || (*str++ != ':') ||
+        !get_number(str, 2, tm.tm_sec) )
+        return -1;
+
+
+    if( *str == '.' )
+    {
+        for( ++str; isdigit((unsigned char)*str); ++str )
+            ;
+    }
+
+
+    if( (*str == '+') || (*str == '-') )
+    {
+        int sign = (*str++ == '-') ? -1 : 1;
+        int hour, min;
+
+        if( !get_number(str, 2, hour) || (*str++ != ':') || !get_number(str, 2, min) )
+            return -1;
+
+        offset = sign * (hour * 3600 + min * 60);
+    }
+    else if( *str == 'Z' )
+    {
+        str++;
+    }
+
+    if( *str || (mon < 1) || (mon > 12) || (tm.tm_mday < 1) || (tm.tm_mday > 31) ||
+        (tm.tm_hour > 23) || (tm.tm_min > 59) || (tm.tm_sec > 60) )
+        return -1;
+
+
+    tm.tm_year = year - 1900;
+    tm.tm_mon  = mon - 1;
+
+    return timegm(&tm) - offset;
+}
+
+
+
+int decode_base64(const char *str, uint8_t *buf, size_t size)
+{
+    uint32_t bits  = 0;
+    int      nbits = 0;
+    size_t   len   = 0;
+
+    for( ; *str && (*str != '='); ++str )
+    {
+        int val;
+        char c = *str;
+
+        if( (c >= 'A') && (c <= 'Z') )
+            val = c - 'A';
+        else if( (c >= 'a') && (c <= 'z') )
+            val = c - 'a' + 26;
+        else if( (c >= '0') && (c <= '9') )
+            val = c - '0' + 52;
+        else if( c == '+' )
+            val = 62;
+        else if( c == '/' )
+            val = 63;
+        else if( isspace((unsigned char)c) )
+            continue;
+        else
+            return -1;
+
+
+        bits   = (bits << 6) | val;
+        nbits += 6;
+
+        if( nbits >= 8 )
+        {
+            if( len == size )
+                return -1;
+
+            nbits -= 8;
+            buf[len++] = (uint8_t)(bits >> nbits);
+        }
+    }
+
+    return len;
+}
@@ -0,0 +1,77 @@
+#ifndef WSSE_AUTH_H
+#define WSSE_AUTH_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <time.h>
+#include <string>
+
+#include "nonce_cache.h"
+#include "user_store.h"
+
+
+
+
+
+/*
+ * Verification of WS-Security UsernameToken with PasswordDigest:
+ *
+ *   Password = Base64( SHA-1( Nonce + Created + password ) )
+ *
+ * Created must be in the window of the clock of the device (the client gets
+ * it by GetSystemDateAndTime, which is PRE_AUTH) and the nonce must not be
+ * seen before: the nonces of the verified tokens are kept in NonceCache,
+ * so a captured request can't be replayed. The digest is checked before the
+ * nonce is remembered, wrong credentials don't fill the cache.
+ *
+ * PasswordText is not accepted (the password would go in plain text).
+ */
+class WsseAuth
+{
+public:
+    WsseAuth() : verified(0), failed(0), replayed(0), stale(0) {}
+
+    enum Result
+    {
+        OK,
+        NO_TOKEN,       // no UsernameToken or it is not complete
+        UNSUPPORTED,    // not PasswordDigest
+        NOT_AUTHORIZED, // unknown user or wrong digest
+        STALE,          // Created is out of the window or wrong
+        REPLAYED,       // the nonce was used already
+        BUSY            // too many nonces in the window
+    };
+
+    // fields of UsernameToken (NULL if there is no field), user is set if it is OK;
+    // the user of session (AuthSessions, can be NULL) is not looked up
+    Result verify(const char *username, const char *password_type, const char *digest,
+                  const char *nonce, const char *created,
+                  const UserMap &users, const User *session, const User *&user);
+
+    static const char *get_result_str(Result result);
+
+    void dump_stats(FILE *fp) const;
+
+private:
+    NonceCache nonces;
+
+    uint64_t verified;
+    uint64_t failed;
+    uint64_t replayed;
+    uint64_t stale;
+};
+
+
+
+// xsd:dateTime (2020-01-01T00:00:00.000Z) to UTC time, -1 if it is wrong
+time_t parse_xsd_datetime(const char *str);
+
+// decode Base64 into buf, returns length or -1 if it is wrong or does not fit
+int decode_base64(const char *str, uint8_t *buf, size_t size);
+
+
+
+
+
+#endif // WSSE_AUTH_H
@@ -0,0 +1,465 @@
+#include <string.h>
+
+#include "yuv_scale.h"
+
+
+#if defined(__x86_64__) || defined(__i386__)
+    #include <immintrin.h>
+    #define YUV_SCALE_X86
+#endif
+
+#if defined(__ARM_NEON) || defined(__ARM_NEON__)
+    #include <arm_neon.h>
+    #define YUV_SCALE_NEON
+#endif
+
+
+
+
+
+// All kernels give the same (bit exact) result:
+// out = avg(avg(r0[2i], r1[2i]), avg(r0[2i+1], r1[2i+1])), avg(a, b) = (a + b + 1) >> 1
+struct YuvKernels
+{
+    const char *name;
+
+    // one output row of the 2x2 halving, r0 and r1 are two input rows
+    void (*halve_row)(const uint8_t *r0, const uint8_t *r1, uint8_t *dst, int n);
+
+    // NV12 UV row into U and V rows
+    void (*deinterleave)(const uint8_t *uv, uint8_t *u, uint8_t *v, int n);
+};
+
+
+
+static inline uint8_t avg_u8(unsigned int a, unsigned int b)
+{
+    return (a + b + 1) >> 1;
+}
+
+
+
+static void halve_row_tail(const uint8_t *r0, const uint8_t *r1, uint8_t *dst, int i, int n)
+{
+    for(; i < n; ++i)
+        dst[i] = avg_u8(avg_u8(r0[2*i], r1[2*i]), avg_u8(r0[2*i+1], r1[2*i+1]));
+}
+
+
+
+static void deinterleave_tail(const uint8_t *uv, uint8_t *u, uint8_t *v, int i, int n)
+{
+    for(; i < n; ++i)
+    {
+        u[i] = uv[2*i];
+        v[i] = uv[2*i+1];
+    }
+}
+
+
+
+// ------------------------------- scalar -------------------------------
+
+
+
+static void halve_row_scalar(const uint8_t *r0, const uint8_t *r1, uint8_t *dst, int n)
+{
+    halve_row_tail(r0, r1, dst, 0, n);
+}
+
+
+
+static void deinterleave_scalar(const uint8_t *uv, uint8_t *u, uint8_t *v, int n)
+{
+    deinterleave_tail(uv, u, v, 0, n);
+}
+
+
+
+// ------------------------------- SSE2 / AVX2 -------------------------------
+
+
+
+#ifdef YUV_SCALE_X86
+
+__attribute__((target("sse2")))
+static void halve_row_sse2(const uint8_t *r0, const uint8_t *r1, uint8_t *dst, int n)
+{
+    const __m128i mask = _mm_set1_epi16(0x00FF);
+
+    int i = 0;
+
+    for(; i + 16 <= n; i += 16)
+    {
+        __m128i a0 = _mm_loadu_si128((const __m128i *)(r0 + 2*i));
+        __m128i a1 = _mm_loadu_si128((const __m128i *)(r0 + 2*i + 16));
+        __m128i b0 = _mm_loadu_si128((const __m128i *)(r1 + 2*i));
+        __m128i b1 = _mm_loadu_si128((const __m128i *)(r1 + 2*i + 16));
+
+        // vertical, then even/odd bytes as 16-bit lanes
+        __m128i v0 = _mm_avg_epu8(a0, b0);
+        __m128i v1 = _mm_avg_epu8(a1, b1);
+
+        __m128i s0 = _mm_avg_epu16(_mm_and_si128(v0, mask), _mm_srli_epi16(v0, 8));
+        __m128i s1 = _mm_avg_epu16(_mm_and_si128(v1, mask), _mm_srli_epi16(v1, 8));
+
+        _mm_storeu_si128((__m128i *)(dst + i), _mm_packus_epi16(s0, s1));
+    }
+
+    halve_row_tail(r0, r1, dst, i, n);
+}
+
+
+
+__attribute__((target("sse2")))
+static void deinterleave_sse2(const uint8_t *uv, uint8_t *u, uint8_t *v, int n)
+{
+    const __m128i mask = _mm_set1_epi16(0x00FF);
+
+    int i = 0;
+
+    for(; i + 16 <= n; i += 16)
+    {
+        __m128i a = _mm_loadu_si128((const __m128i *)(uv + 2*i));
+        __m128i b = _mm_loadu_si128((const __m128i *)(uv + 2*i + 16));
+
+        _mm_storeu_si128((__m128i *)(u + i), _mm_packus_epi16(_mm_and_si128(a, mask), _mm_and_si128(b, mask)));
+        _mm_storeu_si128((__m128i *)(v + i), _mm_packus_epi16(_mm_srli_epi16(a, 8), _mm_srli_epi16(b, 8)));
+    }
+
+    deinterleave_tail(uv, u, v, i, n);
+}
+
+
+
+__attribute__((target("avx2")))
+static void halve_row_avx2(const uint8_t *r0, const uint8_t *r1, uint8_t *dst, int n)
+{
+    const __m256i mask = _mm256_set1_epi16(0x00FF);
+
+    int i = 0;
+
+    for(; i + 32 <= n; i += 32)
+    {
+        __m256i a0 = _mm256_loadu_si256((const __m256i *)(r0 + 2*i));
+        __m256i a1 = _mm256_loadu_si256((const __m256i *)(r0 + 2*i + 32));
+        __m256i b0 = _mm256_loadu_si256((const __m256i *)(r1 + 2*i));
+        __m256i b1 = _mm256_loadu_si256((const __m256i *)(r1 + 2*i + 32));
+
+        __m256i v0 = _mm256_avg_epu8(a0, b0);
+        __m256i v1 = _mm256_avg_epu8(a1, b1);
+
+        __m256i s0 = _mm256_avg_epu16(_mm256_and_si256(v0, mask), _mm256_srli_epi16(v0, 8));
+        __m256i s1 = _mm256_avg_epu16(_mm256_and_si256(v1, mask), _mm256_srli_epi16(v1, 8));
+
+        // packus works in 128-bit lanes, restore the order of the quarters
+        __m256i r = _mm256_permute4x64_epi64(_mm256_packus_epi16(s0, s1), 0xD8);
+
+        _mm256_storeu_si256((__m256i *)(dst + i), r);
+    }
+
+    halve_row_tail(r0, r1, dst, i, n);
+}
+
+
+
+__attribute__((target("avx2")))
+static void deinterleave_avx2(const uint8_t *uv, uint8_t *u, uint8_t *v, int n)
+{
+    const __m256i mask = _mm256_set1_epi16(0x00FF);
+
+    int i = 0;
+
+    for(; i + 32 <= n; i += 32)
+    {
+        __m256i a = _mm256_loadu_si256((const __m256i *)(uv + 2*i));
+        __m256i b = _mm256_loadu_si256((const __m256i *)(uv + 2*i + 32));
+
+        __m256i ru = _mm256_packus_epi16(_mm256_and_si256(a, mask), _mm256_and_si256(b, mask));
+        __m256i rv = _mm256_packus_epi16(_mm256_srli_epi16(a, 8), _mm256_srli_epi16(b, 8));
+
+        _mm256_storeu_si256((__m256i *)(u + i), _mm256_permute4x64_epi64(ru, 0xD8));
+        _mm256_storeu_si256((__m256i *)(v + i), _mm256_permute4x64_epi64(rv, 0xD8));
+    }
+
+    deinterleave_tail(uv, u, v, i, n);
+}
+
+#endif // YUV_SCALE_X86
+
+
+
+// ------------------------------- NEON -------------------------------
+
+
+
+#ifdef YUV_SCALE_NEON
+
+static void halve_row_neon(const uint8_t *r0, const uint8_t *r1, uint8_t *dst, int n)
+{
+    int i = 0;
+
+    for(; i + 16 <= n; i += 16)
+    {
+        uint8x16x2_t a = vld2q_u8(r0 + 2*i); // val[0] - even, val[1] - odd bytes
+        uint8x16x2_t b = vld2q_u8(r1 + 2*i);
+
+        uint8x16_t even = vrhaddq_u8(a.val[0], b.val[0]);
+        uint8x16_t odd  = vrhaddq_u8(a.val[1], b.val[1]);
+
+        vst1q_u8(dst + i, vrhaddq_u8(even, odd));
+    }
+
+    halve_row_tail(r0, r1, dst, i, n);
+}
+
+
+
+static void deinterleave_neon(const uint8_t *uv, uint8_t *u, uint8_t *v, int n)
+{
+    int i = 0;
+
+    for(; i + 16 <= n; i += 16)
+    {
+        uint8x16x2_t a = vld2q_u8(uv + 2*i);
+
+        vst1q_u8(u + i, a.val[0]);
+        vst1q_u8(v + i, a.val[1]);
+    }
+
+    deinterleave_tail(uv, u, v, i, n);
+}
+
+#endif // YUV_SCALE_NEON
+
+
+
+// ------------------------------- dispatch -------------------------------
+
+
+
+// kernels which this CPU can run, the best one is the last
+static std::vector<YuvKernels> get_available_kernels(void)
+{
+    std::vector<YuvKernels> list;
+
+    YuvKernels scalar = { "scalar", halve_row_scalar, deinterleave_scalar };
+    list.push_back(scalar);
+
+#ifdef YUV_SCALE_X86
+    __builtin_cpu_init();
+
+    if( __builtin_cpu_supports("sse2") )
+    {
+        YuvKernels sse2 = { "sse2", halve_row_sse2, deinterleave_sse2 };
+        list.push_back(sse2);
+    }
+
+    if( __builtin_cpu_supports("avx2") )
+    {
+        YuvKernels avx2 = { "avx2", halve_row_avx2, deinterleave_avx2 };
+        list.push_back(avx2);
+    }
+#endif
+
+#ifdef YUV_SCALE_NEON
+    YuvKernels neon = { "neon", halve_row_neon, deinterleave_neon };
+    list.push_back(neon);
+#endif
+
+    return list;
+}
+
+
+
+static YuvKernels selected_kernels = get_available_kernels().back();
+
+
+
+static const YuvKernels &get_kernels(void)
+{
+    return selected_kernels;
+}
+
+
+
+bool yuv_scale_set_kernel(const char *name)
+{
+    std::vector<YuvKernels> list = get_available_kernels();
+
+    for(size_t i = 0; i < list.size(); ++i)
+    {
+        if( !strcmp(list[i].name, name) )
+        {
+            selected_kernels = list[i];
+            return true;
+        }
+    }
+
+    return false;
+}
+
+
+
+const char *yuv_scale_kernel_name(void)
+{
+    return get_kernels().name;
+}
+
+
+
+// ------------------------------- planes -------------------------------
+
+
+
+void YuvImage::resize(int w, int h)
+{
+    width  = w;
+    height = h;
+    data.resize(w * h + 2 * get_uv_width() * get_uv_height());
+}
+
+
+
+static void halve_plane(const YuvKernels &k, const uint8_t *src, int sw, int sh, uint8_t *dst)
+{
+    int dw = sw / 2;
+    int dh = sh / 2;
+
+    for(int y = 0; y < dh; ++y)
+        k.halve_row(src + (2*y) * sw, src + (2*y + 1) * sw, dst + y * dw, dw);
+}
+
+
+
+static void bilinear_coords(int src_size, int dst_size, std::vector<int> &pos, std::vector<int> &frac)
+{
+    pos.resize(dst_size);
+    frac.resize(dst_size);
+
+    for(int i = 0; i < dst_size; ++i)
+    {
+        // center of the dst pixel in src, 8 bit fraction
+        int64_t p = ((int64_t)(2*i + 1) * src_size * 128) / dst_size - 128;
+
+        if( p < 0 )
+            p = 0;
+
+        int ip = (int)(p >> 8);
+        int fp = (int)(p & 255);
+
+        if( ip >= src_size - 1 )
+        {
+            ip = src_size - 1;
+            fp = 0;
+        }
+
+        pos[i]  = ip;
+        frac[i] = fp;
+    }
+}
+
+
+
+static void bilinear_plane(const uint8_t *src, int sw, int sh, uint8_t *dst, int dw, int dh)
+{
+    std::vector<int> xp, xf, yp, yf;
+
+    bilinear_coords(sw, dw, xp, xf);
+    bilinear_coords(sh, dh, yp, yf);
+
+
+    for(int y = 0; y < dh; ++y)
+    {
+        const uint8_t *r0 = src + yp[y] * sw;
+        const uint8_t *r1 = (yp[y] < sh - 1) ? r0 + sw : r0;
+        unsigned int   fy = yf[y];
+
+        for(int x = 0; x < dw; ++x)
+        {
+            int          x0 = xp[x];
+            int          x1 = (x0 < sw - 1) ? x0 + 1 : x0;
+            unsigned int fx = xf[x];
+
+            unsigned int top = r0[x0] * (256 - fx) + r0[x1] * fx;
+            unsigned int bot = r1[x0] * (256 - fx) + r1[x1] * fx;
+
+            dst[x] = (top * (256 - fy) + bot * fy + 32768) >> 16;
+        }
+
+        dst += dw;
+    }
+}
+
+
+
+static void scale_plane(const YuvKernels &k, const uint8_t *src, int sw, int sh,
+                        uint8_t *dst, int dw, int dh)
+{
+    std::vector<uint8_t> buf[2];
+    int cur = 0;
+
+
+    // halving is cheap and exact, bilinear only for the last step
+    while( (sw / 2 >= dw) && (sh / 2 >= dh) && (sw >= 2) && (sh >= 2) )
+    {
+        buf[cur].resize((sw / 2) * (sh / 2));
+        halve_plane(k, src, sw, sh, &buf[cur][0]);
+
+        src  = &buf[cur][0];
+        sw  /= 2;
+        sh  /= 2;
+        cur ^= 1;
+    }
+
+
+    if( (sw == dw) && (sh == dh) )
+        memcpy(dst, src, dw * dh);
+    else
+        bilinear_plane(src, sw, sh, dst, dw, dh);
+}
+
+
+
+void yuv_scale(const uint8_t *src, YuvFormat fmt, int src_w, int src_h,
+               YuvImage &dst, int dst_w, int dst_h)
+{
+    const YuvKernels &k = get_kernels();
+
+    if( dst_w > src_w )
+        dst_w = src_w;
+
+    if( dst_h > src_h )
+        dst_h = src_h;
+
+    dst.resize(dst_w, dst_h);
+
+
+    int src_uv_w = (src_w + 1) / 2;
+    int src_uv_h = (src_h + 1) / 2;
+
+    const uint8_t *src_y = src;
+    const uint8_t *src_u = src + src_w * src_h;
+    const uint8_t *src_v = src_u + src_uv_w * src_uv_h;
+
+    std::vector<uint8_t> uv_planes;
+
+    if( fmt == YUV_NV12 )
+    {
+        uv_planes.resize(2 * src_uv_w * src_uv_h);
+
+        uint8_t *u = &uv_planes[0];
+        uint8_t *v = u + src_uv_w * src_uv_h;
+
+        for(int y = 0; y < src_uv_h; ++y)
+            k.deinterleave(src_u + y * 2 * src_uv_w, u + y * src_uv_w, v + y * src_uv_w, src_uv_w);
+
+        src_u = u;
+        src_v = v;
+    }
+
+
+    scale_plane(k, src_y, src_w, src_h, dst.y(), dst.width, dst.height);
+    scale_plane(k, src_u, src_uv_w, src_uv_h, dst.u(), dst.get_uv_width(), dst.get_uv_height());
+    scale_plane(k, src_v, src_uv_w, src_uv_h, dst.v(), dst.get_uv_width(), dst.get_uv_height());
+}
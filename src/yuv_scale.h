@@ -0,0 +1,65 @@
+#ifndef YUV_SCALE_H
+#define YUV_SCALE_H
+
+#include <stdint.h>
+#include <vector>
+
+
+
+
+
+enum YuvFormat
+{
+    YUV_I420,  // Y plane, U plane, V plane
+    YUV_NV12   // Y plane, interleaved UV plane
+};
+
+
+
+// I420 image with own memory, strides are equal to the width of the planes
+struct YuvImage
+{
+    YuvImage() : width(0), height(0) {}
+
+    void resize(int w, int h);
+
+    uint8_t *y(void) { return &data[0]; }
+    uint8_t *u(void) { return &data[width * height]; }
+    uint8_t *v(void) { return &data[width * height + get_uv_width() * get_uv_height()]; }
+
+    const uint8_t *y(void) const { return &data[0]; }
+    const uint8_t *u(void) const { return &data[width * height]; }
+    const uint8_t *v(void) const { return &data[width * height + get_uv_width() * get_uv_height()]; }
+
+    int get_uv_width(void) const { return (width + 1) / 2; }
+    int get_uv_height(void) const { return (height + 1) / 2; }
+
+    int width;
+    int height;
+    std::vector<uint8_t> data;
+};
+
+
+
+/*
+ * Downscale the frame (src_w x src_h, I420 or NV12 without padding) into dst.
+ *
+ * The planes are halved (2x2 average) with the SIMD kernel while the result is
+ * not smaller than the target, then the final size is made by bilinear pass.
+ * Upscale is not supported, dst size is limited by the source size.
+ */
+void yuv_scale(const uint8_t *src, YuvFormat fmt, int src_w, int src_h,
+               YuvImage &dst, int dst_w, int dst_h);
+
+// name of the kernel selected for this CPU (scalar, sse2, avx2, neon)
+const char *yuv_scale_kernel_name(void);
+
+// select another kernel by name (for the benchmark), false if this CPU can't
+// run it; it is not thread safe, it must be called before yuv_scale() is used
+bool yuv_scale_set_kernel(const char *name);
+
+
+
+
+
+#endif // YUV_SCALE_H
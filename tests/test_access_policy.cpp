@@ -0,0 +1,110 @@
+/*
+ * Default access policy: the changes of the profiles, the media
+ * configurations and the presets (Media, Media2, PTZ) are ACTUATE, an
+ * Operator may do them, a User may not; the changes of the system stay
+ * WRITE_SYSTEM. The table of the operations must be sorted for the search.
+ */
+#include <stdio.h>
+
+#include "access_policy.h"
+#include "smacros.h"
+
+
+
+
+
+static int failed = 0;
+
+
+
+static void check(const char *operation, UserLevel level, bool allowed)
+{
+    AccessClass access = get_access_class(operation);
+
+    if( is_allowed(level, access) == allowed )
+        return;
+
+
+    printf("FAIL: %s (%s) must%s be allowed for level %d\n", operation, get_access_class_name(access),
+           allowed ? "" : " not", (int)level);
+    failed++;
+}
+
+
+
+int main(void)
+{
+    static const char *actuate[] =
+    {
+        "trt:CreateProfile",
+        "trt:DeleteProfile",
+        "trt:AddVideoEncoderConfiguration",
+        "trt:AddVideoSourceConfiguration",
+        "trt:AddPTZConfiguration",
+        "trt:RemoveVideoEncoderConfiguration",
+        "trt:RemoveVideoSourceConfiguration",
+        "trt:RemovePTZConfiguration",
+        "trt:SetVideoEncoderConfiguration",
+        "trt:SetVideoSourceConfiguration",
+        "tr2:CreateProfile",
+        "tr2:DeleteProfile",
+        "tr2:AddConfiguration",
+        "tr2:RemoveConfiguration",
+        "tr2:SetVideoEncoderConfiguration",
+        "tr2:SetVideoSourceConfiguration",
+        "tptz:SetPreset",
+        "tptz:RemovePreset",
+        "tptz:SetHomePosition",
+        "tptz:SetConfiguration",
+        "tptz:ContinuousMove",
+        "tptz:GotoPreset"
+    };
+
+    static const char *write_system[] =
+    {
+        "tds:CreateUsers",
+        "tds:DeleteUsers",
+        "tds:SetUser",
+        "tds:SetDiscoveryMode",
+        "tds:SetScopes",
+        "tds:SetNetworkInterfaces"
+    };
+
+
+    for( size_t i = 0; i < COUNT_ELEMENTS(actuate); ++i )
+    {
+        if( get_access_class(actuate[i]) != ACCESS_ACTUATE )
+        {
+            printf("FAIL: %s is %s, not ACTUATE\n", actuate[i], get_access_class_name(get_access_class(actuate[i])));
+            failed++;
+        }
+
+        check(actuate[i], USER_LEVEL_ADMINISTRATOR, true);
+        check(actuate[i], USER_LEVEL_OPERATOR,      true);
+        check(actuate[i], USER_LEVEL_USER,          false);
+        check(actuate[i], USER_LEVEL_ANONYMOUS,     false);
+    }
+
+
+    for( size_t i = 0; i < COUNT_ELEMENTS(write_system); ++i )
+    {
+        check(write_system[i], USER_LEVEL_ADMINISTRATOR, true);
+        check(write_system[i], USER_LEVEL_OPERATOR,      false);
+        check(write_system[i], USER_LEVEL_USER,          false);
+    }
+
+
+    // reading stays open for a User, PRE_AUTH for everyone
+    check("trt:GetProfiles",            USER_LEVEL_USER,      true);
+    check("tr2:GetStreamUri",           USER_LEVEL_USER,      true);
+    check("tds:GetDeviceInformation",   USER_LEVEL_USER,      true);
+    check("tds:GetSystemDateAndTime",   USER_LEVEL_ANONYMOUS, true);
+    check("tds:GetUsers",               USER_LEVEL_OPERATOR,  false);
+
+
+    if( failed )
+        return 1;
+
+    printf("OK\n");
+    return 0;
+}
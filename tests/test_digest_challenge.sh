@@ -0,0 +1,63 @@
+#! /bin/sh
+#
+# A SOAP request without credentials (the first request of a client of HTTP
+# Digest) gets 401 with the challenges of HTTP Digest, SHA-256 and MD5.
+# Needs the daemon built with WSSE_ON=1 and curl.
+#
+# usage: test_digest_challenge.sh [daemon] [port]
+
+DAEMON=${1:-./onvif_srvd_debug}
+PORT=${2:-18000}
+TMP_DIR=$(mktemp -d)
+
+
+
+fail()
+{
+    echo "FAIL: $1"
+    [ -f "$TMP_DIR/headers" ] && cat "$TMP_DIR/headers"
+    exit 1
+}
+
+
+
+cleanup()
+{
+    [ -n "$DAEMON_PID" ] && kill "$DAEMON_PID" 2>/dev/null && wait "$DAEMON_PID" 2>/dev/null
+    rm -rf "$TMP_DIR"
+}
+
+trap cleanup EXIT
+
+
+
+"$DAEMON" --no_fork --no_chdir --pid_file "$TMP_DIR/daemon.pid" --port "$PORT" \
+          --user admin --password admin --ifs lo --scope onvif://www.onvif.org/name/TestDev \
+          --name RTSP --width 800 --height 600 --url rtsp://%s:554/unicast --type JPEG &
+DAEMON_PID=$!
+
+
+
+REQUEST='<?xml version="1.0" encoding="UTF-8"?>
+<s:Envelope xmlns:s="http://www.w3.org/2003/05/soap-envelope" xmlns:tds="http://www.onvif.org/ver10/device/wsdl">
+<s:Body><tds:GetDeviceInformation/></s:Body>
+</s:Envelope>'
+
+for i in $(seq 50); do
+    CODE=$(curl -s -o /dev/null -D "$TMP_DIR/headers" -w '%{http_code}' \
+                -H 'Content-Type: application/soap+xml; charset=utf-8' \
+                --data-binary "$REQUEST" "http://127.0.0.1:$PORT/onvif/device_service")
+    [ "$CODE" != "000" ] && break
+    kill -0 "$DAEMON_PID" 2>/dev/null || fail "the daemon is not running"
+    sleep 0.1
+done
+
+
+
+[ "$CODE" = "401" ] || fail "expected 401, got $CODE"
+
+grep -qi '^WWW-Authenticate: Digest .*algorithm=SHA-256' "$TMP_DIR/headers" || fail "no SHA-256 challenge"
+grep -qi '^WWW-Authenticate: Digest .*algorithm=MD5'     "$TMP_DIR/headers" || fail "no MD5 challenge"
+grep -qi 'realm="onvif"'                                 "$TMP_DIR/headers" || fail "wrong realm"
+
+echo "OK"